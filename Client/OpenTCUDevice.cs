@@ -22,6 +22,10 @@ namespace ReadieFur.OpenTCU.Client
         static readonly Guid RebootGuid = new Guid("bfb5e32f-0000-1000-8000-00805f9b34fb");
         static readonly Guid ToggleRuntimeStatsGuid = new Guid("9ed8266d-0000-1000-8000-00805f9b34fb");
 
+        //Schema versions that this client was written against, newer devices append fields after these.
+        const byte RuntimeStatsVersion = 1;
+        const byte PersistentDataVersion = 1;
+
         public IDevice Device { get; private init; }
         private IReadOnlyDictionary<Guid, IService> _services { get; init; }
         private IReadOnlyDictionary<Guid, ICharacteristic> _characteristics { get; init; }
@@ -79,22 +83,32 @@ namespace ReadieFur.OpenTCU.Client
             var data = await _characteristics[PersistentDataGuid].ReadAsync();
             Debug.WriteLine($"Get persistent data ({data.data.Length}): {BitConverter.ToString(data.data)}");
 
+            if (data.data.Length < 11 || data.data[0] < PersistentDataVersion)
+                throw new InvalidDataException($"Unsupported persistent data ({data.data.Length} bytes).");
+
+            //The first byte is the schema version, fields added in later versions are appended after these.
             SPersistentData persistentData = new();
             //persistentData.DeviceName
             //persistentData.BikeSerialNumber
-            persistentData.BaseWheelCircumference = BitConverter.ToUInt16(data.data, 0);
-            persistentData.TargetWheelCircumference = BitConverter.ToUInt16(data.data, 2);
-            persistentData.Pin = BitConverter.ToUInt32(data.data, 4);
+            persistentData.BaseWheelCircumference = BitConverter.ToUInt16(data.data, 1);
+            persistentData.TargetWheelCircumference = BitConverter.ToUInt16(data.data, 3);
+            persistentData.Pin = BitConverter.ToUInt32(data.data, 5);
+            persistentData.SpeedLimit = BitConverter.ToUInt16(data.data, 9);
 
             return persistentData;
         }
 
         public async Task<bool> SetPersistentData(SPersistentData persistentData)
         {
-            byte[] data = new byte[8];
-            BitConverter.GetBytes(persistentData.BaseWheelCircumference).CopyTo(data, 0);
-            BitConverter.GetBytes(persistentData.TargetWheelCircumference).CopyTo(data, 2);
-            BitConverter.GetBytes(persistentData.Pin).CopyTo(data, 4);
+            //Every field of the version is required, so a speed limit that isn't being changed is read back first.
+            persistentData.SpeedLimit ??= (await GetPersistentData()).SpeedLimit;
+
+            byte[] data = new byte[11];
+            data[0] = PersistentDataVersion;
+            BitConverter.GetBytes(persistentData.BaseWheelCircumference).CopyTo(data, 1);
+            BitConverter.GetBytes(persistentData.TargetWheelCircumference).CopyTo(data, 3);
+            BitConverter.GetBytes(persistentData.Pin).CopyTo(data, 5);
+            BitConverter.GetBytes(persistentData.SpeedLimit!.Value).CopyTo(data, 9);
 
             int res = await _characteristics[PersistentDataGuid].WriteAsync(data);
             Debug.WriteLineIf(res != 0, $"Failed to write persistent data: {res}");
@@ -107,17 +121,21 @@ namespace ReadieFur.OpenTCU.Client
             var data = await _characteristics[RuntimeStatsGuid].ReadAsync();
             //Debug.WriteLine($"Get runtime stats ({data.data.Length}): {BitConverter.ToString(data.data)}");
 
+            if (data.data.Length < 20 || data.data[0] < RuntimeStatsVersion)
+                throw new InvalidDataException($"Unsupported runtime stats ({data.data.Length} bytes).");
+
+            //The first byte is the schema version, fields added in later versions are appended after these.
             SRuntimeStats runtimeStats = new();
-            runtimeStats.BikeSpeed = BitConverter.ToUInt16(data.data, 0);
-            runtimeStats.RealSpeed = BitConverter.ToUInt16(data.data, 2);
-            runtimeStats.Cadance = BitConverter.ToUInt16(data.data, 4);
-            runtimeStats.RiderPower = BitConverter.ToUInt16(data.data, 6);
-            runtimeStats.MotorPower = BitConverter.ToUInt16(data.data, 8);
-            runtimeStats.BatteryVoltage = BitConverter.ToUInt16(data.data, 10);
-            runtimeStats.BatteryCurrent = BitConverter.ToUInt32(data.data, 12);
-            runtimeStats.EaseSetting = data.data[16];
-            runtimeStats.PowerSetting = data.data[17];
-            runtimeStats.WalkMode = data.data[18] != 0;
+            runtimeStats.BikeSpeed = BitConverter.ToUInt16(data.data, 1);
+            runtimeStats.RealSpeed = BitConverter.ToUInt16(data.data, 3);
+            runtimeStats.Cadance = BitConverter.ToUInt16(data.data, 5);
+            runtimeStats.RiderPower = BitConverter.ToUInt16(data.data, 7);
+            runtimeStats.MotorPower = BitConverter.ToUInt16(data.data, 9);
+            runtimeStats.BatteryVoltage = BitConverter.ToUInt16(data.data, 11);
+            runtimeStats.BatteryCurrent = BitConverter.ToUInt32(data.data, 13);
+            runtimeStats.EaseSetting = data.data[17];
+            runtimeStats.PowerSetting = data.data[18];
+            runtimeStats.WalkMode = data.data[19] != 0;
 
             return runtimeStats;
         }
@@ -13,5 +13,6 @@ namespace ReadieFur.OpenTCU.Client
         public UInt16 BaseWheelCircumference;
         public UInt16 TargetWheelCircumference;
         public UInt32 Pin;
+        public UInt16? SpeedLimit; //km/h * 100, 0 for no limit. Left unchanged on the device when null.
     }
 }
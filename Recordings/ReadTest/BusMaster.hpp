@@ -6,8 +6,11 @@
 #include <vector>
 #include "Samples.hpp"
 #include "EStringType.h"
+#include "../../Software/src/CAN/Signals.h"
 #include <map>
 
+using namespace ReadieFur::OpenTCU::CAN;
+
 #pragma region Other data
 uint8_t _stringRequestType = 0;
 size_t _stringRequestBufferIndex = 0;
@@ -120,27 +123,21 @@ void InterceptMessage(SCanMessage* message)
     }
     case 0x201:
     {
-        //D1 and D2 combined contain the speed of the bike in km/h * 100 (little-endian).
-        //Example: EA, 01 -> 01EA -> 490 -> 4.9km/h.
-        //We won't work in decimals.
-        _bikeSpeedBuffer.AddSample(message->data[0] | message->data[1] << 8);
+        //Speed is in km/h * 100, we won't work in decimals.
+        _bikeSpeedBuffer.AddSample(SignalCodec<Signals::Speed>::Extract(message->data));
         break;
     }
     case 0x300:
     {
-        _walkMode = message->data[1] == 0xA5;
-        _easeSetting = message->data[4];
-        _powerSetting = message->data[6];
+        _walkMode = SignalCodec<Signals::WalkMode>::Extract(message->data) == 0xA5;
+        _easeSetting = SignalCodec<Signals::EaseSetting>::Extract(message->data);
+        _powerSetting = SignalCodec<Signals::PowerSetting>::Extract(message->data);
         break;
     }
     case 0x401:
     {
-        _batteryVoltage.AddSample(message->data[0] | message->data[1] << 8);
-
-        //D5, D6, D7 and D8 combined contain the battery current in mA (little-endian with two's complement).
-        //Example 1: 46, 00, 00, 00 -> 00 000046 -> 70mA.
-        //Example 2: 5B, F0, FF, FF -> FF FFF05B -> -4005mA.
-        _batteryCurrent.AddSample(message->data[4] | message->data[5] << 8 | message->data[6] << 16 | message->data[7] << 24);
+        _batteryVoltage.AddSample(SignalCodec<Signals::BatteryVoltage>::Extract(message->data));
+        _batteryCurrent.AddSample(SignalCodec<Signals::BatteryCurrent>::Extract(message->data));
         break;
     }
     default:
@@ -5,13 +5,20 @@
 #include <Network/Bluetooth/SGattServerProfile.h>
 #include <Network/Bluetooth/GattServerService.hpp>
 #include <esp_err.h>
-#include <vector>
+#include "Memory/StaticVector.hpp"
+#include "Memory/FixedString.hpp"
+#include "GattSchema.h"
 #include "CAN/BusMaster.hpp"
 #ifdef ENABLE_CAN_DUMP
 #include "CAN/Logger.hpp"
 #endif
+#ifdef DEBUG
+#include "CAN/TransmitScheduler.hpp"
+#endif
 #include "Data/PersistentData.hpp"
 #include "Data/RuntimeStats.hpp"
+#include "Metrics/Metrics.hpp"
+#include "Metrics/HttpExporter.hpp"
 #include <Network/WiFi.hpp>
 #include <string>
 #include <cstring>
@@ -31,7 +38,69 @@ namespace ReadieFur::OpenTCU::Bluetooth
             .gattServerCallback = [this](auto a, auto b, auto c){ ServerAppCallback(a, b, c); },
         };
 
-        std::vector<Network::Bluetooth::GattServerService*> _services;
+        static const size_t MAX_ATTRIBUTE_SIZE = 22; //A single packet at the default MTU.
+
+        typedef GattSchema<
+            GattField<&Data::RuntimeStats::BikeSpeed>,
+            GattField<&Data::RuntimeStats::RealSpeed>,
+            GattField<&Data::RuntimeStats::Cadence>,
+            GattField<&Data::RuntimeStats::RiderPower>,
+            GattField<&Data::RuntimeStats::MotorPower>,
+            GattField<&Data::RuntimeStats::BatteryVoltage>,
+            GattField<&Data::RuntimeStats::BatteryCurrent>,
+            GattField<&Data::RuntimeStats::EaseSetting>,
+            GattField<&Data::RuntimeStats::PowerSetting>,
+            GattField<&Data::RuntimeStats::WalkMode>
+        > RuntimeStatsSchema;
+        static_assert(RuntimeStatsSchema::MAX_SIZE <= MAX_ATTRIBUTE_SIZE, "The runtime stats don't fit in a single read.");
+
+        typedef GattSchema<
+            GattField<&Data::PersistentData::BaseWheelCircumference>,
+            GattField<&Data::PersistentData::TargetWheelCircumference>,
+            GattField<&Data::PersistentData::Pin>,
+            GattField<&Data::PersistentData::SpeedLimit>
+        > PersistentDataSchema;
+        static_assert(PersistentDataSchema::MAX_SIZE <= MAX_ATTRIBUTE_SIZE, "The persistent data doesn't fit in a single read.");
+
+        //The strings are kept apart from the rest of the persistent data as they fill a read by themselves.
+        typedef GattSchema<
+            GattField<&Data::PersistentData::BikeSerialNumber>
+        > PersistentStringsSchema;
+        static_assert(PersistentStringsSchema::MAX_SIZE <= MAX_ATTRIBUTE_SIZE, "The persistent strings don't fit in a single read.");
+
+        Memory::StaticVector<Network::Bluetooth::GattServerService*, 2> _services; //Main and debug.
+        size_t _metricsCursor = 0;
+        uint8_t _bikeInfoId = CAN::EStringType::MotorSerialNumber;
+        uint8_t _bikeInfoOffset = 0;
+        #ifdef ENABLE_CAN_DUMP
+        uint32_t _idTableCursor = 0;
+        #endif
+        #ifdef DEBUG
+        int8_t _lastScheduledSlot = -1;
+
+        //Size of a frame written to the inject and schedule attributes: { uint8 bus, uint32 id, uint8 length, uint8 data[8] }.
+        static const size_t INJECTED_FRAME_SIZE = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + (sizeof(uint8_t) * 8);
+
+        static bool ParseInjectedFrame(const uint8_t* inValue, bool* outBus, CAN::SCanMessage* outMessage)
+        {
+            *outBus = inValue[0];
+            *outMessage =
+            {
+                .id = (uint32_t)(inValue[1] | inValue[2] << 8 | inValue[3] << 16 | inValue[4] << 24),
+                .length = inValue[5],
+                .isExtended = false,
+                .isRemote = false
+            };
+            if (outMessage->length > 8)
+            {
+                LOGW(nameof(Bluetooth::API), "Invalid data length: %i", outMessage->length);
+                return false;
+            }
+            for (size_t i = 0; i < outMessage->length; i++)
+                outMessage->data[i] = inValue[6 + i];
+            return true;
+        }
+        #endif
 
         void ServerAppCallback(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t* param)
         {
@@ -65,9 +134,9 @@ namespace ReadieFur::OpenTCU::Bluetooth
             apConfig.ap.ssid_len = strlen(deviceNameCStr);
             std::strncpy(reinterpret_cast<char*>(apConfig.ap.ssid), deviceNameCStr, sizeof(apConfig.ap.ssid));
             
-            std::string password = "OpenTCU" + std::to_string(Data::PersistentData::Pin);
-            const char* passwordCStr = password.c_str();
-            std::strncpy(reinterpret_cast<char*>(apConfig.ap.password), passwordCStr, sizeof(apConfig.ap.password));
+            Memory::FixedString<sizeof(apConfig.ap.password) - 1> password = "OpenTCU";
+            password.append_format("%lu", (unsigned long)Data::PersistentData::Pin);
+            std::strncpy(reinterpret_cast<char*>(apConfig.ap.password), password.c_str(), sizeof(apConfig.ap.password));
 
             esp_err_t err = ReadieFur::Network::WiFi::ConfigureInterface(WIFI_IF_AP, apConfig);
             if (err != ESP_OK)
@@ -86,6 +155,15 @@ namespace ReadieFur::OpenTCU::Bluetooth
                 return ESP_GATT_INTERNAL_ERROR;
             }
 
+            //Metrics are served on the default port alongside the OTA server.
+            httpd_config_t metricsHttpdConfig = HTTPD_DEFAULT_CONFIG();
+            err = Metrics::HttpExporter::Init(&metricsHttpdConfig);
+            if (err != ESP_OK)
+            {
+                LOGE(nameof(Bluetooth::API), "Failed to start metrics server: %s", esp_err_to_name(err));
+                return ESP_GATT_INTERNAL_ERROR;
+            }
+
             LOGI(nameof(Bluetooth::API), "AP mode started.");
             return ESP_GATT_OK;
         }
@@ -107,115 +185,53 @@ namespace ReadieFur::OpenTCU::Bluetooth
             //Temporary solution to sending the data.
             Network::Bluetooth::GattServerService mainService(Network::Bluetooth::SUUID(0x29FCAA6CUL), 0);
 
-            //Runtime stats.
+            //Runtime stats, see RuntimeStatsSchema.
             mainService.AddAttribute(
                 Network::Bluetooth::SUUID(0xAD09C337UL),
                 ESP_GATT_PERM_READ,
-                [busMaster](uint8_t* outValue, uint16_t* outLength)
+                [](uint8_t* outValue, uint16_t* outLength)
                 {
-                    *outLength = 0;
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::BikeSpeed, sizeof(Data::RuntimeStats::BikeSpeed));
-                    *outLength += sizeof(Data::RuntimeStats::BikeSpeed);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::RealSpeed, sizeof(Data::RuntimeStats::RealSpeed));
-                    *outLength += sizeof(Data::RuntimeStats::RealSpeed);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::Cadence, sizeof(Data::RuntimeStats::Cadence));
-                    *outLength += sizeof(Data::RuntimeStats::Cadence);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::RiderPower, sizeof(Data::RuntimeStats::RiderPower));
-                    *outLength += sizeof(Data::RuntimeStats::RiderPower);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::MotorPower, sizeof(Data::RuntimeStats::MotorPower));
-                    *outLength += sizeof(Data::RuntimeStats::MotorPower);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::BatteryVoltage, sizeof(Data::RuntimeStats::BatteryVoltage));
-                    *outLength += sizeof(Data::RuntimeStats::BatteryVoltage);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::BatteryCurrent, sizeof(Data::RuntimeStats::BatteryCurrent));
-                    *outLength += sizeof(Data::RuntimeStats::BatteryCurrent);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::EaseSetting, sizeof(Data::RuntimeStats::EaseSetting));
-                    *outLength += sizeof(Data::RuntimeStats::EaseSetting);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::PowerSetting, sizeof(Data::RuntimeStats::PowerSetting));
-                    *outLength += sizeof(Data::RuntimeStats::PowerSetting);
-
-                    memcpy(outValue + *outLength, &Data::RuntimeStats::WalkMode, sizeof(Data::RuntimeStats::WalkMode));
-                    *outLength += sizeof(Data::RuntimeStats::WalkMode);
-
+                    RuntimeStatsSchema::Encode(outValue, outLength);
                     return ESP_GATT_OK;
                 });
 
-            //Persistent data.
+            //Persistent data, see PersistentDataSchema.
             mainService.AddAttribute(
                 Network::Bluetooth::SUUID(0x3A3D3A3DUL),
                 ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
                 [](uint8_t* outValue, uint16_t* outLength)
                 {
-                    *outLength = 0;
-
-                    //TODO: Fix string parsing.
-                    // std::string stdStr = Data::PersistentData::DeviceName.Get();
-                    // const char* cStr = stdStr.c_str();
-                    // size_t strLen = strlen(cStr);
-                    // std::strncpy(reinterpret_cast<char*>(outValue), cStr, strLen);
-                    // *outLength += strLen;
-                    // outValue[*outLength++] = '\0';
-
-                    // stdStr = Data::PersistentData::BikeSerialNumber;
-                    // cStr = stdStr.c_str();
-                    // strLen = strlen(cStr);
-                    // strncpy(reinterpret_cast<char*>(outValue + *outLength), cStr, strLen);
-                    // *outLength += strLen;
-                    // outValue[*outLength++] = '\0';
-
-                    memcpy(outValue + *outLength, &Data::PersistentData::BaseWheelCircumference, sizeof(Data::PersistentData::BaseWheelCircumference));
-                    *outLength += sizeof(Data::PersistentData::BaseWheelCircumference);
-
-                    memcpy(outValue + *outLength, &Data::PersistentData::TargetWheelCircumference, sizeof(Data::PersistentData::TargetWheelCircumference));
-                    *outLength += sizeof(Data::PersistentData::TargetWheelCircumference);
-
-                    memcpy(outValue + *outLength, &Data::PersistentData::Pin, sizeof(Data::PersistentData::Pin));
-                    *outLength += sizeof(Data::PersistentData::Pin);
-                    
+                    PersistentDataSchema::Encode(outValue, outLength);
                     return ESP_GATT_OK;
                 },
                 [this, busMaster](uint8_t* inValue, uint16_t inLength)
                 {
-                    size_t offset = 0;
-                    size_t size;
-
-                    // std::string deviceName(reinterpret_cast<char*>(inValue));
-                    // offset += deviceName.length();
-
-                    // Data::PersistentData::BikeSerialNumber = reinterpret_cast<char*>(inValue + offset);
-                    // offset += Data::PersistentData::BikeSerialNumber.length();
-
-                    size = sizeof(Data::PersistentData::BaseWheelCircumference);
-                    if (offset + size > inLength)
+                    PersistentDataSchema::TValues values = PersistentDataSchema::Get();
+                    if (!PersistentDataSchema::Decode(inValue, inLength, &values))
                         return ESP_GATT_ILLEGAL_PARAMETER;
-                    uint16_t baseWheelCircumference = *(uint16_t*)(inValue + offset);
-                    offset += size;
+
+                    uint16_t baseWheelCircumference = PersistentDataSchema::Get<&Data::PersistentData::BaseWheelCircumference>(values);
                     if (baseWheelCircumference > 2400 || baseWheelCircumference < 800)
                         return ESP_GATT_ILLEGAL_PARAMETER;
 
-                    size = sizeof(Data::PersistentData::TargetWheelCircumference);
-                    if (offset + size > inLength)
-                        return ESP_GATT_ILLEGAL_PARAMETER;
-                    uint16_t targetWheelCircumference = *(uint16_t*)(inValue + offset);
-                    offset += size;
+                    uint16_t targetWheelCircumference = PersistentDataSchema::Get<&Data::PersistentData::TargetWheelCircumference>(values);
                     if (targetWheelCircumference > 2400 || targetWheelCircumference < 800)
                         return ESP_GATT_ILLEGAL_PARAMETER;
 
-                    size = sizeof(Data::PersistentData::Pin);
-                    if (offset + size > inLength)
+                    uint32_t pin = PersistentDataSchema::Get<&Data::PersistentData::Pin>(values);
+
+                    uint16_t speedLimit = PersistentDataSchema::Get<&Data::PersistentData::SpeedLimit>(values);
+                    if (speedLimit != 0 && (speedLimit < CAN::AssistController::SPEED_LIMIT_TAPER_WIDTH || speedLimit > CAN::BusMaster::MAX_SPEED_LIMIT))
                         return ESP_GATT_ILLEGAL_PARAMETER;
-                    uint32_t pin = *(uint32_t*)(inValue + offset);
-                    offset += size;
 
-                    // Data::PersistentData::DeviceName.Set(deviceName);
+                    //First so that nothing is applied if the write can't be queued. It is saved separately once the bike accepts it.
+                    if (Data::PersistentData::TargetWheelCircumference != targetWheelCircumference)
+                    {
+                        LOGI(nameof(Bluetooth::API), "Setting target wheel circumference to %i", targetWheelCircumference);
+                        if (busMaster->SetTargetWheelCircumference(targetWheelCircumference) != ESP_OK)
+                            return ESP_GATT_INTERNAL_ERROR;
+                    }
+
                     bool hasChanges = false;
                     if (Data::PersistentData::BaseWheelCircumference != baseWheelCircumference)
                     {
@@ -223,12 +239,6 @@ namespace ReadieFur::OpenTCU::Bluetooth
                         Data::PersistentData::BaseWheelCircumference = baseWheelCircumference;
                         hasChanges = true;
                     }
-                    if (Data::PersistentData::TargetWheelCircumference != targetWheelCircumference)
-                    {
-                        LOGI(nameof(Bluetooth::API), "Setting target wheel circumference to %i", targetWheelCircumference);
-                        busMaster->SetTargetWheelCircumference(targetWheelCircumference); //The persistent data is updated via this call.
-                        hasChanges = true;
-                    }
                     if (Data::PersistentData::Pin != pin)
                     {
                         LOGI(nameof(Bluetooth::API), "Setting new pin.");
@@ -236,6 +246,12 @@ namespace ReadieFur::OpenTCU::Bluetooth
                         ReadieFur::Network::Bluetooth::BLE::SetPin(pin);
                         hasChanges = true;
                     }
+                    if (Data::PersistentData::SpeedLimit != speedLimit)
+                    {
+                        LOGI(nameof(Bluetooth::API), "Setting speed limit to %i", speedLimit);
+                        busMaster->SetSpeedLimit(speedLimit); //The persistent data is updated via this call.
+                        hasChanges = true;
+                    }
 
                     if (!hasChanges)
                         return ESP_GATT_OK;
@@ -248,6 +264,30 @@ namespace ReadieFur::OpenTCU::Bluetooth
                     return ESP_GATT_OK;
                 });
 
+            //Persistent strings, see PersistentStringsSchema. The device name is taken from the bike serial number on startup.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x51C8B0E2UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [](uint8_t* outValue, uint16_t* outLength)
+                {
+                    PersistentStringsSchema::Encode(outValue, outLength);
+                    return ESP_GATT_OK;
+                },
+                [](uint8_t* inValue, uint16_t inLength)
+                {
+                    PersistentStringsSchema::TValues values = PersistentStringsSchema::Get();
+                    if (!PersistentStringsSchema::Decode(inValue, inLength, &values))
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    if (Data::PersistentData::BikeSerialNumber == PersistentStringsSchema::Get<&Data::PersistentData::BikeSerialNumber>(values))
+                        return ESP_GATT_OK;
+
+                    PersistentStringsSchema::Apply(values);
+                    LOGI(nameof(Bluetooth::API), "Setting bike serial number to %s", Data::PersistentData::BikeSerialNumber.c_str());
+                    Data::PersistentData::Save();
+                    return ESP_GATT_OK;
+                });
+
             //AP toggle.
             mainService.AddAttribute(
                 Network::Bluetooth::SUUID(0xB45D9CEDUL),
@@ -284,73 +324,319 @@ namespace ReadieFur::OpenTCU::Bluetooth
                     }
                     else if (!enable && currentMode == WIFI_MODE_AP)
                     {
-                        ReadieFur::Network::OTA::API::Deinit();
-                        esp_err_t err = ReadieFur::Network::WiFi::ShutdownInterface(WIFI_IF_AP);
-                        if (err != ESP_OK)
-                        {
-                            LOGE(nameof(Bluetooth::API), "Failed to stop AP mode: %s", esp_err_to_name(err));
-                            return ESP_GATT_INTERNAL_ERROR;
-                        }
-
-                        LOGI(nameof(Bluetooth::API), "AP mode stopped.");
-                        return ESP_GATT_OK;
+                        return StopAP() == ESP_OK ? ESP_GATT_OK : ESP_GATT_INTERNAL_ERROR;
                     }
 
                     LOGE(nameof(Bluetooth::API), "Invalid AP mode state.");
                     return ESP_GATT_INTERNAL_ERROR; //We shouldn't reach here.
                 });
 
+            //CAN health, one attribute per bus so that each fits in a single packet at the default MTU.
+            //Counters are sent as their low 16 bits, take the difference between reads to get a rate.
+            auto readHealth = [busMaster](bool bus, uint8_t* outValue, uint16_t* outLength)
+            {
+                CAN::SCanHealth health = busMaster->GetHealth(bus);
+                CAN::SCanFaultStats faults = busMaster->GetFaultStats(bus);
+                uint16_t counters[] =
+                {
+                    (uint16_t)health.rxMissed,
+                    (uint16_t)health.rxOverrun,
+                    (uint16_t)health.txFailed,
+                    (uint16_t)health.arbLost,
+                    (uint16_t)health.busErrors,
+                    (uint16_t)faults.errorPassive,
+                    (uint16_t)faults.busOff,
+                };
+
+                *outLength = 0;
+                outValue[(*outLength)++] = health.state;
+                outValue[(*outLength)++] = health.txErrorCounter > UINT8_MAX ? UINT8_MAX : health.txErrorCounter;
+                outValue[(*outLength)++] = health.rxErrorCounter > UINT8_MAX ? UINT8_MAX : health.rxErrorCounter;
+                outValue[(*outLength)++] = health.txQueued > UINT8_MAX ? UINT8_MAX : health.txQueued;
+                outValue[(*outLength)++] = health.rxQueued > UINT8_MAX ? UINT8_MAX : health.rxQueued;
+                memcpy(outValue + *outLength, counters, sizeof(counters));
+                *outLength += sizeof(counters);
+                return ESP_GATT_OK;
+            };
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x5B8E21C4UL),
+                ESP_GATT_PERM_READ,
+                [readHealth](uint8_t* outValue, uint16_t* outLength) { return readHealth(false, outValue, outLength); });
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0xD07A6F93UL),
+                ESP_GATT_PERM_READ,
+                [readHealth](uint8_t* outValue, uint16_t* outLength) { return readHealth(true, outValue, outLength); });
+
+            //Metrics, read out a few series at a time so that each read fits in a single packet at the default MTU.
+            //Write a uint16 series index to start from (0 to read from the beginning), each read then returns the total number of series
+            //followed by up to METRICS_PER_READ records of { uint8 metric index, uint8 series index, uint32 value } and advances the index.
+            //Metric indices follow the order of the /metrics text export.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x2F4C96E1UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [this](uint8_t* outValue, uint16_t* outLength)
+                {
+                    const size_t METRICS_PER_READ = 3;
+
+                    uint16_t total = (uint16_t)Metrics::Registry::GetSeriesCount();
+                    *outLength = 0;
+                    memcpy(outValue + *outLength, &total, sizeof(total));
+                    *outLength += sizeof(total);
+
+                    for (size_t i = 0; i < METRICS_PER_READ && _metricsCursor < total; i++, _metricsCursor++)
+                    {
+                        uint32_t value;
+                        if (!Metrics::Registry::GetSeries(_metricsCursor, &outValue[*outLength], &outValue[*outLength + 1], &value))
+                            break;
+                        *outLength += 2;
+                        memcpy(outValue + *outLength, &value, sizeof(value));
+                        *outLength += sizeof(value);
+                    }
+                    if (_metricsCursor >= total)
+                        _metricsCursor = 0;
+
+                    return ESP_GATT_OK;
+                },
+                [this](uint8_t* inValue, uint16_t inLength)
+                {
+                    if (inLength != sizeof(uint16_t))
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    _metricsCursor = inValue[0] | inValue[1] << 8;
+                    return ESP_GATT_OK;
+                });
+
+            //Relay stalls, reads return the latest as { uint32 stall count, uint8 bus, uint8 reason, uint32 gap us, uint32 duration us (0 while ongoing), uint32 age ms }.
+            //Writing anything prints every retained snapshot, with the frames and task states leading up to it, to the console.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x6A13E0B7UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [busMaster](uint8_t* outValue, uint16_t* outLength)
+                {
+                    uint32_t count = busMaster->GetStallCount();
+                    CAN::RelayWatchdog::SStallSnapshot snapshot = {};
+                    uint32_t age = busMaster->GetStallSnapshot(0, &snapshot) ? (uint32_t)((esp_timer_get_time() - snapshot.detectedAt) / 1000) : 0;
+
+                    *outLength = 0;
+                    memcpy(outValue + *outLength, &count, sizeof(count));
+                    *outLength += sizeof(count);
+                    outValue[(*outLength)++] = snapshot.bus;
+                    outValue[(*outLength)++] = snapshot.reason;
+                    memcpy(outValue + *outLength, &snapshot.gapUs, sizeof(snapshot.gapUs));
+                    *outLength += sizeof(snapshot.gapUs);
+                    memcpy(outValue + *outLength, &snapshot.durationUs, sizeof(snapshot.durationUs));
+                    *outLength += sizeof(snapshot.durationUs);
+                    memcpy(outValue + *outLength, &age, sizeof(age));
+                    *outLength += sizeof(age);
+                    return ESP_GATT_OK;
+                },
+                [busMaster](uint8_t* inValue, uint16_t inLength)
+                {
+                    busMaster->DumpStallSnapshots();
+                    return ESP_GATT_OK;
+                });
+
+            //Configuration round trips between the display and the motor, the full histograms are in the metrics.
+            //Reads return the latest as { uint8 service, uint16 DID, uint32 answered, uint32 request relay us, uint32 device us, uint32 response relay us }.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0xE4A7395BUL),
+                ESP_GATT_PERM_READ,
+                [busMaster](uint8_t* outValue, uint16_t* outLength)
+                {
+                    CAN::RoundTripTracker::SRoundTrip roundTrip;
+                    uint32_t fields[4];
+                    fields[0] = busMaster->GetLastRoundTrip(&roundTrip);
+                    fields[1] = roundTrip.requestRelayUs;
+                    fields[2] = roundTrip.deviceUs;
+                    fields[3] = roundTrip.responseRelayUs;
+
+                    *outLength = 0;
+                    outValue[(*outLength)++] = roundTrip.service;
+                    memcpy(outValue + *outLength, &roundTrip.did, sizeof(roundTrip.did));
+                    *outLength += sizeof(roundTrip.did);
+                    memcpy(outValue + *outLength, fields, sizeof(fields));
+                    *outLength += sizeof(fields);
+                    return ESP_GATT_OK;
+                });
+
+            //Periodic ID health, { uint8 ID count, uint32 healthy, uint32 learned, uint32 overdue, uint32 drifting } with a bit per ID in the order of BusMaster::PERIODIC_IDS.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x93D1B2F5UL),
+                ESP_GATT_PERM_READ,
+                [busMaster](uint8_t* outValue, uint16_t* outLength)
+                {
+                    uint32_t bitmaps[4];
+                    bitmaps[0] = busMaster->GetPeriodHealth(&bitmaps[1], &bitmaps[2], &bitmaps[3]);
+
+                    *outLength = 0;
+                    outValue[(*outLength)++] = busMaster->GetPeriodicIdCount();
+                    memcpy(outValue + *outLength, bitmaps, sizeof(bitmaps));
+                    *outLength += sizeof(bitmaps);
+                    return ESP_GATT_OK;
+                });
+
+            //Bike information, answered from the values cached by BusMaster so that reads never wait on the bike.
+            //Write a uint8 ID to select it (an EStringType, or 0x06 for the wheel circumference), reads return { uint8 ID, uint8 state, uint8 value[] }.
+            //The state is 0 when the bike hasn't reported the value yet, 1 when it is stale and 2 when it is fresh, a missing or stale value is requested in the background.
+            //Values longer than a read (the motor serial number) are read in parts by writing { uint8 ID, uint8 offset }, a read with less than a full part of value is the last one.
+            mainService.AddAttribute(
+                Network::Bluetooth::SUUID(0x7C2D5E18UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [this, busMaster](uint8_t* outValue, uint16_t* outLength)
+                {
+                    static const size_t MAX_PART = MAX_ATTRIBUTE_SIZE - 2;
+                    uint8_t value[CAN::ConfigTransactions::MAX_DATA];
+                    uint8_t length;
+                    CAN::ConfigTransactions::ECacheState state = busMaster->GetConfig(CAN::ConfigTransactions::DID_BASE | _bikeInfoId, value, &length);
+                    size_t part = length > _bikeInfoOffset ? length - _bikeInfoOffset : 0;
+                    if (part > MAX_PART)
+                        part = MAX_PART;
+                    outValue[0] = _bikeInfoId;
+                    outValue[1] = state;
+                    memcpy(outValue + 2, value + _bikeInfoOffset, part);
+                    *outLength = 2 + part;
+                    return ESP_GATT_OK;
+                },
+                [this](uint8_t* inValue, uint16_t inLength)
+                {
+                    if (inLength != sizeof(uint8_t) && inLength != 2 * sizeof(uint8_t))
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+                    if (inLength == 2 * sizeof(uint8_t) && inValue[1] >= CAN::ConfigTransactions::MAX_DATA)
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    _bikeInfoId = inValue[0];
+                    _bikeInfoOffset = inLength == 2 * sizeof(uint8_t) ? inValue[1] : 0;
+                    return ESP_GATT_OK;
+                });
+
             _services.push_back(&mainService);
 
             #ifdef DEBUG
             Network::Bluetooth::GattServerService debugService(Network::Bluetooth::SUUID(0x877C911DUL), 1);
+            CAN::TransmitScheduler* scheduler = GetService<CAN::TransmitScheduler>();
 
-            //CAN bus inject message.
-            const size_t injectMessageDataSize =
-                sizeof(uint8_t) //bus
-                + sizeof(uint32_t) //id
-                + sizeof(uint8_t) //length
-                + (sizeof(uint8_t) * 8); //data
+            //CAN bus inject message, a single frame is sent straight away.
+            //Longer writes hold several frames back to back and are queued on the transmit scheduler as a batch (subject to its rate cap).
             debugService.AddAttribute(
                 Network::Bluetooth::SUUID(0x78FDC1CEUL),
                 ESP_GATT_PERM_WRITE,
                 nullptr,
-                [busMaster](uint8_t* inValue, uint16_t inLength)
+                [busMaster, scheduler](uint8_t* inValue, uint16_t inLength)
                 {
-                    if (inLength != injectMessageDataSize)
+                    if (inLength == 0 || inLength % INJECTED_FRAME_SIZE != 0 || inLength / INJECTED_FRAME_SIZE > CAN::TransmitSchedule::MAX_ONE_SHOTS)
                     {
                         LOGW(nameof(Bluetooth::API), "Invalid message length: %i", inLength);
                         return ESP_GATT_ILLEGAL_PARAMETER;
                     }
 
-                    bool bus = inValue[0];
-                    CAN::SCanMessage message =
+                    if (inLength == INJECTED_FRAME_SIZE)
                     {
-                        .id = (uint32_t)(inValue[1] | inValue[2] << 8 | inValue[3] << 16 | inValue[4] << 24),
-                        .length = inValue[5],
-                        .isExtended = false,
-                        .isRemote = false
-                    };
-                    if (message.length > 8)
+                        bool bus;
+                        CAN::SCanMessage message;
+                        if (!ParseInjectedFrame(inValue, &bus, &message))
+                            return ESP_GATT_ILLEGAL_PARAMETER;
+
+                        esp_err_t res = busMaster->InjectMessage(bus, message);
+                        if (res != ESP_OK)
+                        {
+                            LOGE(nameof(Bluetooth::API), "Failed to inject message: %i", res);
+                            return ESP_GATT_INTERNAL_ERROR;
+                        }
+                        return ESP_GATT_OK;
+                    }
+
+                    static CAN::TransmitScheduler::SInjectedFrame frames[CAN::TransmitSchedule::MAX_ONE_SHOTS]; //Off the stack, the callbacks run on a single task.
+                    size_t count = inLength / INJECTED_FRAME_SIZE;
+                    for (size_t i = 0; i < count; i++)
                     {
-                        LOGW(nameof(Bluetooth::API), "Invalid data length: %i", message.length);
-                        return ESP_GATT_ILLEGAL_PARAMETER;
+                        frames[i].delayUs = 0;
+                        if (!ParseInjectedFrame(inValue + i * INJECTED_FRAME_SIZE, &frames[i].bus, &frames[i].message))
+                            return ESP_GATT_ILLEGAL_PARAMETER;
                     }
-                    for (size_t i = 0; i < message.length; i++)
-                        message.data[i] = inValue[6 + i];
 
-                    esp_err_t res = busMaster->InjectMessage(bus, message);
-                    if (res != ESP_OK)
+                    if (!scheduler->QueueSequence(frames, count))
                     {
-                        LOGE(nameof(Bluetooth::API), "Failed to inject message: %i", res);
+                        LOGW(nameof(Bluetooth::API), "Transmit queue is full, dropped a batch of %u frames.", count);
                         return ESP_GATT_INTERNAL_ERROR;
                     }
+                    LOGD(nameof(Bluetooth::API), "Queued a batch of %u frames.", count);
+                    return ESP_GATT_OK;
+                });
+
+            //CAN bus transmit schedule, each write is a uint8 operation followed by its arguments:
+            //0 clear, 1 add periodic { frame, uint32 period us }, 2 remove periodic { uint8 slot }, 3 queue one-shot { frame, uint32 delay us after the previous one-shot }.
+            //Frames are laid out as for the inject attribute. Reads return
+            //{ uint8 periodic count, uint8 one-shots queued, int8 slot of the last periodic added (-1 if it failed), uint32 sent, uint32 throttled, uint32 max lateness us, uint32 mean lateness us }.
+            debugService.AddAttribute(
+                Network::Bluetooth::SUUID(0x3F5A2C71UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [this, scheduler](uint8_t* outValue, uint16_t* outLength)
+                {
+                    CAN::TransmitSchedule::STimingStats stats;
+                    size_t periodic, oneShots;
+                    scheduler->GetStats(&stats, &periodic, &oneShots);
 
+                    uint32_t fields[] =
+                    {
+                        stats.sent,
+                        stats.throttled,
+                        stats.maxLatenessUs,
+                        stats.sent > 0 ? (uint32_t)(stats.totalLatenessUs / stats.sent) : 0,
+                    };
+                    outValue[0] = periodic;
+                    outValue[1] = oneShots;
+                    outValue[2] = _lastScheduledSlot;
+                    memcpy(outValue + 3, fields, sizeof(fields));
+                    *outLength = 3 + sizeof(fields);
                     return ESP_GATT_OK;
+                },
+                [this, scheduler](uint8_t* inValue, uint16_t inLength)
+                {
+                    if (inLength == 0)
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    const size_t timedFrameSize = 1 + INJECTED_FRAME_SIZE + sizeof(uint32_t);
+                    CAN::TransmitScheduler::SInjectedFrame frame = {};
+                    uint32_t timeUs = 0;
+                    if (inValue[0] == 1 || inValue[0] == 3)
+                    {
+                        if (inLength != timedFrameSize || !ParseInjectedFrame(inValue + 1, &frame.bus, &frame.message))
+                            return ESP_GATT_ILLEGAL_PARAMETER;
+                        memcpy(&timeUs, inValue + 1 + INJECTED_FRAME_SIZE, sizeof(timeUs));
+                    }
+
+                    switch (inValue[0])
+                    {
+                    case 0:
+                        LOGD(nameof(Bluetooth::API), "Clearing the transmit schedule.");
+                        scheduler->Clear();
+                        return ESP_GATT_OK;
+                    case 1:
+                        _lastScheduledSlot = scheduler->AddPeriodic(frame.bus, frame.message, timeUs);
+                        if (_lastScheduledSlot < 0)
+                        {
+                            LOGW(nameof(Bluetooth::API), "Failed to schedule %x every %luus.", frame.message.id, timeUs);
+                            return ESP_GATT_ILLEGAL_PARAMETER;
+                        }
+                        LOGD(nameof(Bluetooth::API), "Scheduled %x every %luus in slot %i.", frame.message.id, timeUs, _lastScheduledSlot);
+                        return ESP_GATT_OK;
+                    case 2:
+                        if (inLength != 2 || !scheduler->RemovePeriodic(inValue[1]))
+                            return ESP_GATT_ILLEGAL_PARAMETER;
+                        return ESP_GATT_OK;
+                    case 3:
+                        frame.delayUs = timeUs;
+                        if (!scheduler->QueueSequence(&frame, 1))
+                            return ESP_GATT_INTERNAL_ERROR;
+                        return ESP_GATT_OK;
+                    default:
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+                    }
                 });
 
             #ifdef ENABLE_CAN_DUMP
-            //CAN bus logging whitelist.
+            //CAN bus logging whitelist, a list of uint32 IDs replacing the previous one (empty to log everything).
+            //Any number of standard IDs and up to CAN::IdTable::MAX_EXTENDED_IDS extended ones can be given.
             debugService.AddAttribute(
                 Network::Bluetooth::SUUID(0x1450D8E6UL),
                 ESP_GATT_PERM_WRITE,
@@ -364,18 +650,108 @@ namespace ReadieFur::OpenTCU::Bluetooth
                         return ESP_GATT_ILLEGAL_PARAMETER;
                     }
 
+                    size_t extended = 0;
+                    for (size_t i = 0; i < inLength; i += 4)
+                    {
+                        uint32_t id = inValue[i] | inValue[i + 1] << 8 | inValue[i + 2] << 16 | inValue[i + 3] << 24;
+                        if (id > CAN::IdTable::MAX_EXTENDED_ID)
+                        {
+                            LOGW(nameof(Bluetooth::API), "Invalid ID: %x", id);
+                            return ESP_GATT_ILLEGAL_PARAMETER;
+                        }
+                        if (id >= CAN::IdTable::ID_COUNT)
+                            extended++;
+                    }
+                    if (extended > CAN::IdTable::MAX_EXTENDED_IDS)
+                    {
+                        LOGW(nameof(Bluetooth::API), "Whitelist too long: %i extended IDs, at most %i are kept.", (int)extended, (int)CAN::IdTable::MAX_EXTENDED_IDS);
+                        return ESP_GATT_INVALID_ATTR_LEN;
+                    }
+
                     LOGD(nameof(Bluetooth::API), "Clearing log whitelist.");
-                    logger->Whitelist.clear();
+                    logger->ClearWhitelist();
 
                     for (size_t i = 0; i < inLength; i += 4)
                     {
                         uint32_t id = inValue[i] | inValue[i + 1] << 8 | inValue[i + 2] << 16 | inValue[i + 3] << 24;
                         LOGD(nameof(Bluetooth::API), "Adding ID to whitelist: %x", id);
-                        logger->Whitelist.push_back(id);
+                        logger->AddToWhitelist(id);
                     }
 
                     return ESP_GATT_OK;
                 });
+
+            //CAN bus ID table, read out one ID at a time so that each read fits in a single packet at the default MTU.
+            //Write a uint16 ID to start from (0 to read from the beginning), each read then returns the next seen ID as
+            //{ uint16 id (bit 15 set if whitelisted), uint16 count (low 16 bits), uint16 mean interval ms, uint16 jitter ms, uint16 max interval ms, uint8 length, uint8 data[8] }
+            //and advances past it, or nothing once every ID has been read (the next read starts from the beginning again).
+            //Only standard IDs are listed, extended IDs are logged as new when first seen but have no statistics.
+            debugService.AddAttribute(
+                Network::Bluetooth::SUUID(0x4C7E05A9UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [this, logger](uint8_t* outValue, uint16_t* outLength)
+                {
+                    *outLength = 0;
+
+                    uint32_t id;
+                    CAN::IdTable::SIdStats stats;
+                    bool whitelisted;
+                    if (!logger->GetNextIdStats(_idTableCursor, &id, &stats, &whitelisted))
+                    {
+                        _idTableCursor = 0;
+                        return ESP_GATT_OK;
+                    }
+                    _idTableCursor = id + 1;
+
+                    uint16_t fields[] =
+                    {
+                        (uint16_t)(id | (whitelisted ? 0x8000 : 0)),
+                        (uint16_t)stats.count,
+                        stats.intervalMean,
+                        stats.intervalJitter,
+                        stats.intervalMax,
+                    };
+                    memcpy(outValue + *outLength, fields, sizeof(fields));
+                    *outLength += sizeof(fields);
+                    outValue[(*outLength)++] = stats.length;
+                    memcpy(outValue + *outLength, stats.data, sizeof(stats.data));
+                    *outLength += sizeof(stats.data);
+                    return ESP_GATT_OK;
+                },
+                [this](uint8_t* inValue, uint16_t inLength)
+                {
+                    if (inLength != sizeof(uint16_t))
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    _idTableCursor = inValue[0] | inValue[1] << 8;
+                    return ESP_GATT_OK;
+                });
+
+            //CAN bus capture mode, write a uint8 with bit 0 set for change-only (delta) capture and bit 1 set for compressed capture.
+            //Reads return { uint8 mode, uint32 frames logged, uint32 frames suppressed as repeats, uint32 frames compressed, uint32 compressed bytes, uint32 encoding cycles per frame }.
+            debugService.AddAttribute(
+                Network::Bluetooth::SUUID(0x6B0E41D3UL),
+                ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                [logger](uint8_t* outValue, uint16_t* outLength)
+                {
+                    uint32_t counts[5];
+                    logger->GetCaptureCounts(&counts[0], &counts[1]);
+                    logger->GetCompressionStats(&counts[2], &counts[3], &counts[4]);
+                    outValue[0] = (logger->DeltaCapture ? 0x01 : 0) | (logger->CompressCapture ? 0x02 : 0);
+                    memcpy(outValue + 1, counts, sizeof(counts));
+                    *outLength = 1 + sizeof(counts);
+                    return ESP_GATT_OK;
+                },
+                [logger](uint8_t* inValue, uint16_t inLength)
+                {
+                    if (inLength != sizeof(uint8_t))
+                        return ESP_GATT_ILLEGAL_PARAMETER;
+
+                    LOGD(nameof(Bluetooth::API), "Setting capture mode: delta %s, compressed %s", inValue[0] & 0x01 ? "on" : "off", inValue[0] & 0x02 ? "on" : "off");
+                    logger->DeltaCapture = inValue[0] & 0x01;
+                    logger->CompressCapture = inValue[0] & 0x02;
+                    return ESP_GATT_OK;
+                });
             #endif
 
             //Reboot.
@@ -426,6 +802,22 @@ namespace ReadieFur::OpenTCU::Bluetooth
         }
 
     public:
+        //Stops the servers running on the AP and then the AP itself.
+        static esp_err_t StopAP()
+        {
+            ReadieFur::Network::OTA::API::Deinit();
+            Metrics::HttpExporter::Deinit();
+            esp_err_t err = ReadieFur::Network::WiFi::ShutdownInterface(WIFI_IF_AP);
+            if (err != ESP_OK)
+            {
+                LOGE(nameof(Bluetooth::API), "Failed to stop AP mode: %s", esp_err_to_name(err));
+                return err;
+            }
+
+            LOGI(nameof(Bluetooth::API), "AP mode stopped.");
+            return ESP_OK;
+        }
+
         API()
         {
             ServiceEntrypointStackDepth += 1024;
@@ -433,6 +825,9 @@ namespace ReadieFur::OpenTCU::Bluetooth
             #ifdef ENABLE_CAN_DUMP
             AddDependencyType<CAN::Logger>();
             #endif
+            #ifdef DEBUG
+            AddDependencyType<CAN::TransmitScheduler>();
+            #endif
         }
     };
 };
@@ -0,0 +1,258 @@
+#pragma once
+
+//Compile time layouts for the GATT characteristics that carry a set of values, so that the packing is declared once instead of written out with offsets in every read and write.
+//A schema is a list of fields, each one a pointer to the static variable that holds the value, and is sent as a version byte followed by the fields in order with no padding.
+//Scalars and arrays of scalars are copied as they are (little-endian), FixedStrings are sent as a length byte followed by the characters.
+//A field added later is appended with the schema version it was added in, the version increases with it and writes from older clients leave the newer fields unchanged.
+//Every size is known at compile time, so the encoder is the same run of fixed size copies that would be written by hand and MAX_SIZE can be checked against the attribute size.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "Memory/FixedString.hpp"
+
+namespace ReadieFur::OpenTCU::Bluetooth
+{
+    //How a value of type T is packed, specialised for each kind of field that a schema can hold.
+    template <typename T, typename = void>
+    struct GattFieldCodec;
+
+    template <typename T>
+    struct GattFieldCodec<T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>>
+    {
+        static constexpr size_t MAX_SIZE = sizeof(T);
+
+        static inline size_t Encode(const T& value, uint8_t* out)
+        {
+            memcpy(out, &value, sizeof(T));
+            return sizeof(T);
+        }
+
+        static inline bool Decode(const uint8_t* in, size_t length, size_t* offset, T* value)
+        {
+            if (length - *offset < sizeof(T))
+                return false;
+            memcpy(value, in + *offset, sizeof(T));
+            *offset += sizeof(T);
+            return true;
+        }
+    };
+
+    template <>
+    struct GattFieldCodec<bool>
+    {
+        static constexpr size_t MAX_SIZE = 1;
+
+        static inline size_t Encode(const bool& value, uint8_t* out)
+        {
+            *out = value ? 1 : 0;
+            return 1;
+        }
+
+        static inline bool Decode(const uint8_t* in, size_t length, size_t* offset, bool* value)
+        {
+            if (length - *offset < 1 || in[*offset] > 1)
+                return false;
+            *value = in[(*offset)++] != 0;
+            return true;
+        }
+    };
+
+    template <typename T, size_t N>
+    struct GattFieldCodec<T[N], std::enable_if_t<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>>
+    {
+        static constexpr size_t MAX_SIZE = sizeof(T) * N;
+
+        static inline size_t Encode(const T (&value)[N], uint8_t* out)
+        {
+            memcpy(out, value, sizeof(value));
+            return sizeof(value);
+        }
+
+        static inline bool Decode(const uint8_t* in, size_t length, size_t* offset, T (*value)[N])
+        {
+            if (length - *offset < sizeof(*value))
+                return false;
+            memcpy(value, in + *offset, sizeof(*value));
+            *offset += sizeof(*value);
+            return true;
+        }
+    };
+
+    template <size_t N>
+    struct GattFieldCodec<Memory::FixedString<N>>
+    {
+        static_assert(N <= UINT8_MAX, "The length is sent as a single byte.");
+        static constexpr size_t MAX_SIZE = 1 + N;
+
+        static inline size_t Encode(const Memory::FixedString<N>& value, uint8_t* out)
+        {
+            out[0] = value.length();
+            memcpy(out + 1, value.c_str(), value.length());
+            return 1 + value.length();
+        }
+
+        static inline bool Decode(const uint8_t* in, size_t length, size_t* offset, Memory::FixedString<N>* value)
+        {
+            if (length - *offset < 1)
+                return false;
+            size_t stringLength = in[*offset];
+            if (stringLength > N || length - *offset - 1 < stringLength || memchr(in + *offset + 1, '\0', stringLength) != nullptr)
+                return false;
+            char buffer[N + 1];
+            memcpy(buffer, in + *offset + 1, stringLength);
+            buffer[stringLength] = '\0';
+            value->assign(buffer);
+            *offset += 1 + stringLength;
+            return true;
+        }
+    };
+
+    //Holds a copy of a field's value, wrapped so that arrays can be copied like the other values.
+    template <typename T>
+    struct SGattValue
+    {
+        T value;
+
+        static inline void Copy(T* destination, const T& source)
+        {
+            *destination = source;
+        }
+    };
+
+    template <typename T, size_t N>
+    struct SGattValue<T[N]>
+    {
+        T value[N];
+
+        static inline void Copy(T (*destination)[N], const T (&source)[N])
+        {
+            memcpy(*destination, source, sizeof(source));
+        }
+    };
+
+    //A value in a schema, Since is the schema version that the field was added in.
+    template <auto* Pointer, uint8_t Since = 1>
+    struct GattField
+    {
+        static_assert(Since >= 1, "Version 0 is not used so that an empty write is never valid.");
+        typedef std::remove_pointer_t<decltype(Pointer)> TValue;
+        typedef GattFieldCodec<TValue> TCodec;
+        static constexpr auto* POINTER = Pointer;
+        static constexpr uint8_t SINCE = Since;
+    };
+
+    template <typename... Fields>
+    class GattSchema
+    {
+    private:
+        template <auto* Pointer>
+        struct STag {};
+
+        template <typename Field>
+        static inline void EncodeField(uint8_t* out, size_t* offset)
+        {
+            *offset += Field::TCodec::Encode(*Field::POINTER, out + *offset);
+        }
+
+        template <typename Field, typename TValue>
+        static inline bool DecodeField(uint8_t version, const uint8_t* in, size_t length, size_t* offset, TValue* value)
+        {
+            //Fields newer than the writer keep the value they were given.
+            return Field::SINCE > version || Field::TCodec::Decode(in, length, offset, value);
+        }
+
+        template <size_t... Indices>
+        static inline bool DecodeFields(std::index_sequence<Indices...>, uint8_t version, const uint8_t* in, size_t length, size_t* offset, std::tuple<SGattValue<typename Fields::TValue>...>* values)
+        {
+            return (DecodeField<Fields>(version, in, length, offset, &std::get<Indices>(*values).value) && ...);
+        }
+
+        template <size_t... Indices>
+        static inline void CopyFields(std::index_sequence<Indices...>, std::tuple<SGattValue<typename Fields::TValue>...>* values)
+        {
+            (SGattValue<typename Fields::TValue>::Copy(&std::get<Indices>(*values).value, *Fields::POINTER), ...);
+        }
+
+        template <size_t... Indices>
+        static inline void ApplyFields(std::index_sequence<Indices...>, const std::tuple<SGattValue<typename Fields::TValue>...>& values)
+        {
+            (SGattValue<typename Fields::TValue>::Copy(Fields::POINTER, std::get<Indices>(values).value), ...);
+        }
+
+        template <auto* Pointer>
+        static constexpr size_t IndexOf()
+        {
+            constexpr bool matches[] = { std::is_same<STag<Pointer>, STag<Fields::POINTER>>::value... };
+            for (size_t i = 0; i < sizeof...(Fields); i++)
+                if (matches[i])
+                    return i;
+            return sizeof...(Fields);
+        }
+
+        static constexpr uint8_t LatestVersion()
+        {
+            uint8_t version = 1;
+            for (uint8_t since : { Fields::SINCE... })
+                if (since > version)
+                    version = since;
+            return version;
+        }
+
+    public:
+        static_assert(sizeof...(Fields) > 0, "A schema needs at least one field.");
+
+        typedef std::tuple<SGattValue<typename Fields::TValue>...> TValues;
+
+        static constexpr uint8_t VERSION = LatestVersion();
+        static constexpr size_t MAX_SIZE = 1 + (Fields::TCodec::MAX_SIZE + ...);
+
+        //Writes the version and every field, out must have room for MAX_SIZE bytes.
+        static inline void Encode(uint8_t* out, uint16_t* outLength)
+        {
+            size_t offset = 0;
+            out[offset++] = VERSION;
+            (EncodeField<Fields>(out, &offset), ...);
+            *outLength = offset;
+        }
+
+        //A copy of the current values, decoded into and then checked before anything is applied.
+        static inline TValues Get()
+        {
+            TValues values;
+            CopyFields(std::index_sequence_for<Fields...>(), &values);
+            return values;
+        }
+
+        //The value of the field that points at Pointer.
+        template <auto* Pointer>
+        static inline auto& Get(TValues& values)
+        {
+            constexpr size_t index = IndexOf<Pointer>();
+            static_assert(index < sizeof...(Fields), "The schema has no field for this value.");
+            return std::get<index>(values).value;
+        }
+
+        /**
+         * Overwrites values with the fields in the input, the fields that the writer's version doesn't have are left as they were.
+         * Returns false, with values partly overwritten, if the version is unknown or the input is cut short or too long.
+         */
+        static inline bool Decode(const uint8_t* in, size_t length, TValues* values)
+        {
+            if (length < 1 || in[0] == 0 || in[0] > VERSION)
+                return false;
+            size_t offset = 1;
+            return DecodeFields(std::index_sequence_for<Fields...>(), in[0], in, length, &offset, values) && offset == length;
+        }
+
+        //Stores every value back into the variables the fields point at.
+        static inline void Apply(const TValues& values)
+        {
+            ApplyFields(std::index_sequence_for<Fields...>(), values);
+        }
+    };
+};
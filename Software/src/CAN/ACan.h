@@ -3,9 +3,13 @@
 //https://stackoverflow.com/questions/9756893/how-to-implement-interfaces-in-c
 
 #include <esp_err.h>
+#include <esp_timer.h>
 #include <freertos/portmacro.h>
 #include <freertos/semphr.h>
 #include "SCanMessage.h"
+#include "ECanBusState.h"
+#include "SCanFaultStats.h"
+#include "SCanHealth.h"
 
 #define USE_CAN_DRIVER_LOCK
 
@@ -17,10 +21,96 @@ namespace ReadieFur::OpenTCU::CAN
         #ifdef USE_CAN_DRIVER_LOCK
         volatile SemaphoreHandle_t _driverMutex = xSemaphoreCreateMutex();
         #endif
+        volatile ECanBusState _busState = ErrorActive;
+        SCanFaultStats _faultStats = {};
+        int64_t _busOffAt = 0;
+        volatile bool _sleeping = false;
+        volatile int64_t _wokenAt = 0;
+
+        //Records a state change reported by the controller, counting faults and timing how long the bus was down for.
+        void SetBusState(ECanBusState state)
+        {
+            if (state == _busState)
+                return;
+
+            switch (state)
+            {
+            case ErrorPassive:
+                _faultStats.errorPassive++;
+                break;
+            case BusOff:
+                //A recovery attempt that drops back to bus-off is part of the same outage.
+                if (_busState != Recovering)
+                {
+                    _faultStats.busOff++;
+                    _busOffAt = esp_timer_get_time();
+                }
+                break;
+            case ErrorActive:
+                if (_busState == BusOff || _busState == Recovering)
+                {
+                    uint32_t downtime = (uint32_t)(esp_timer_get_time() - _busOffAt);
+                    _faultStats.recoveries++;
+                    _faultStats.lastDowntimeUs = downtime;
+                    _faultStats.totalDowntimeUs += downtime;
+                    if (downtime > _faultStats.maxDowntimeUs)
+                        _faultStats.maxDowntimeUs = downtime;
+                }
+                break;
+            default:
+                break;
+            }
+
+            _busState = state;
+        }
+
     public:
         virtual ~ACan() = default;
         virtual esp_err_t Send(SCanMessage message, TickType_t timeout = 0) = 0;
         virtual esp_err_t Receive(SCanMessage* message, TickType_t timeout = 0) = 0;
-        virtual esp_err_t GetStatus(uint32_t* status, TickType_t timeout = 0) = 0;
+        //Samples the controller's error counters, loss counters and queue depths.
+        virtual esp_err_t GetHealth(SCanHealth* health, TickType_t timeout = 0) = 0;
+
+        //Brings a bus-off controller back onto the bus, returns ESP_ERR_TIMEOUT if it has not rejoined yet in which case this should be called again.
+        //Buses without a physical controller never go bus-off.
+        virtual esp_err_t Recover(TickType_t timeout = 0)
+        {
+            return ESP_OK;
+        }
+
+        //Stops the controller while the bike is off so that the chip can enter light sleep, activity on the bus wakes the chip and the next Receive (or Send) resumes the controller.
+        //The frame that wakes the bus is lost. Buses that can't wake the chip return ESP_ERR_NOT_SUPPORTED and keep running, light sleep must not be enabled for them.
+        //Called from the task that receives from the bus, between receives, so that the controller is never stopped under a blocked Receive.
+        virtual esp_err_t Sleep()
+        {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        bool IsSleeping()
+        {
+            return _sleeping;
+        }
+
+        //esp_timer_get_time() of the bus activity that last woke the bus from Sleep, 0 if it has never slept.
+        int64_t GetWokenAt()
+        {
+            return _wokenAt;
+        }
+
+        ECanBusState GetBusState()
+        {
+            return _busState;
+        }
+
+        //Whether the controller is off the bus, frames can not be sent or received until Recover succeeds.
+        bool IsBusOff()
+        {
+            return _busState == BusOff || _busState == Recovering;
+        }
+
+        SCanFaultStats GetFaultStats()
+        {
+            return _faultStats;
+        }
     };
 };
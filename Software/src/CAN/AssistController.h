@@ -0,0 +1,156 @@
+#pragma once
+
+//Shapes the assist requested in 0x300 from the latest speed sample, easing power off as a speed limit is approached instead of cutting it at the limit.
+//The speed (0x201) and assist (0x300) frames arrive on different buses, so the sample is written and read by different relay tasks.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools (see /Tools/AssistSim).
+
+#include <stdint.h>
+#include <atomic>
+#include "Signals.h"
+#include "RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class AssistController
+    {
+    public:
+        static const uint16_t FULL_SCALE = 256; //Assist scale is a Q8 fraction, 256 is the requested assist unchanged.
+        static const uint16_t WALK_SPEED_LIMIT = 650; //Real speed (km/h * 100) at which walk assist is fully off, the legacy cut-off point.
+        static const uint16_t WALK_TAPER_WIDTH = 150; //Walk assist starts easing off this far below the limit.
+        static const uint16_t SPEED_LIMIT_TAPER_WIDTH = 200;
+        static const uint8_t WALK_MODE_ON = 0xA5;
+        //Speed arrives every 100ms, if a sample is much older than that the speed is unknown and assist is withheld while a limit is active.
+        static const uint32_t MAX_SAMPLE_AGE_US = 300000;
+
+        struct SStats
+        {
+            uint32_t frames; //0x300 frames seen.
+            uint32_t shaped; //Frames where assist was reduced.
+            uint32_t stale; //Frames where the speed sample was too old to use.
+            uint64_t reactionSumUs; //Age of the speed sample each shaped decision was based on.
+            uint32_t reactionMaxUs;
+        };
+
+    private:
+        //The speed and when it was sampled are packed together so that a reader never sees the speed of one sample with the time of another, or half of a 64 bit time.
+        //{ uint16 speed, 1 bit set once a sample exists, 47 bit microseconds (4 years before the time wraps) }.
+        static const uint8_t SAMPLE_SPEED_SHIFT = 48;
+        static const uint64_t SAMPLE_VALID = 1ULL << 47;
+        static const uint64_t SAMPLE_TIME_MASK = SAMPLE_VALID - 1;
+
+        std::atomic<uint64_t> _sample = 0;
+        bool _walkLimitEnabled = false;
+        uint16_t _speedLimit = 0; //0 for no limit.
+        uint16_t _lastScale = FULL_SCALE;
+        SStats _stats = {};
+
+        //Linear taper from full assist at (limit - width) to none at the limit.
+        static uint16_t Taper(uint16_t speed, uint16_t limit, uint16_t width)
+        {
+            if (speed >= limit)
+                return 0;
+            uint32_t headroom = limit - speed;
+            if (headroom >= width)
+                return FULL_SCALE;
+            return (uint16_t)(headroom * FULL_SCALE / width);
+        }
+
+    public:
+        //Walk assist is only limited when the wheel size has been changed, as the motor already limits walk speed against the true wheel size.
+        void SetWalkLimitEnabled(bool enabled)
+        {
+            _walkLimitEnabled = enabled;
+        }
+
+        void SetSpeedLimit(uint16_t limit)
+        {
+            _speedLimit = limit;
+        }
+
+        uint16_t GetSpeedLimit() const
+        {
+            return _speedLimit;
+        }
+
+        //Called for every speed frame with the real (wheel corrected) speed in km/h * 100.
+        inline void RELAY_IRAM_ATTR UpdateSpeed(uint16_t realSpeed, uint64_t nowUs)
+        {
+            _sample.store((uint64_t)realSpeed << SAMPLE_SPEED_SHIFT | SAMPLE_VALID | (nowUs & SAMPLE_TIME_MASK), std::memory_order_relaxed);
+        }
+
+        //Called for every 0x300 frame, scales the ease and power settings in place and returns the scale that was applied.
+        inline uint16_t RELAY_IRAM_ATTR Shape(uint8_t* data, uint64_t nowUs)
+        {
+            _stats.frames++;
+
+            bool walkMode = SignalCodec<Signals::WalkMode>::Extract(data) == WALK_MODE_ON;
+            uint16_t limit = 0, width = 0;
+            if (walkMode && _walkLimitEnabled)
+            {
+                limit = WALK_SPEED_LIMIT;
+                width = WALK_TAPER_WIDTH;
+            }
+            if (_speedLimit != 0 && (limit == 0 || _speedLimit < limit))
+            {
+                limit = _speedLimit;
+                width = SPEED_LIMIT_TAPER_WIDTH;
+            }
+            if (limit == 0)
+                return _lastScale = FULL_SCALE;
+
+            uint64_t sample = _sample.load(std::memory_order_relaxed);
+            bool hasSpeed = sample & SAMPLE_VALID;
+            uint64_t age = (nowUs - sample) & SAMPLE_TIME_MASK;
+            uint16_t scale;
+            if (!hasSpeed || age > MAX_SAMPLE_AGE_US)
+            {
+                _stats.stale++;
+                scale = 0;
+            }
+            else
+            {
+                scale = Taper((uint16_t)(sample >> SAMPLE_SPEED_SHIFT), limit, width);
+            }
+
+            if (scale < FULL_SCALE)
+            {
+                _stats.shaped++;
+                if (hasSpeed)
+                {
+                    _stats.reactionSumUs += age;
+                    if (age > _stats.reactionMaxUs)
+                        _stats.reactionMaxUs = (uint32_t)age;
+                }
+
+                if (scale == 0)
+                {
+                    SignalCodec<Signals::MotorMode>::Insert(data, 0);
+                    SignalCodec<Signals::EaseSetting>::Insert(data, 0);
+                    SignalCodec<Signals::PowerSetting>::Insert(data, 0);
+                }
+                else
+                {
+                    SignalCodec<Signals::EaseSetting>::Insert(data, (uint8_t)(SignalCodec<Signals::EaseSetting>::Extract(data) * scale / FULL_SCALE));
+                    SignalCodec<Signals::PowerSetting>::Insert(data, (uint8_t)(SignalCodec<Signals::PowerSetting>::Extract(data) * scale / FULL_SCALE));
+                }
+            }
+
+            return _lastScale = scale;
+        }
+
+        uint16_t GetLastScale() const
+        {
+            return _lastScale;
+        }
+
+        SStats GetStats() const
+        {
+            return _stats;
+        }
+
+        void ResetStats()
+        {
+            _stats = {};
+        }
+    };
+};
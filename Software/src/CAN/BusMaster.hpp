@@ -5,25 +5,55 @@
 #include <freertos/FreeRTOSConfig.h>
 #include "Data/StaticConfig.h"
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include <Service/AService.hpp>
+#include <atomic>
+#include "ACan.h"
+
+//Buses that are not backed by the on-board controllers.
+#if defined(CAN_STRESS_TEST) || defined(CAN_LOOPBACK)
+#define CAN_VIRTUAL_BUSES
+#endif
+
+#if defined(CAN_STRESS_TEST)
+#include "MemoryCan.hpp"
+#elif defined(CAN_LOOPBACK)
+#include "LoopbackCan.hpp"
+#else
 #include <driver/gpio.h>
 #include <driver/spi_master.h>
 #include <driver/spi_common.h>
 #include <driver/twai.h>
-#include <Service/AService.hpp>
-#include "ACan.h"
 #if SOC_TWAI_CONTROLLER_NUM <= 1
 #include "McpCan.hpp"
 #endif
 #include "TwaiCan.hpp"
+#endif
 #include "Logging.hpp"
 #include <map>
 #include <vector>
 #include <queue>
 #include "EStringType.h"
+#include "ConfigTransactions.h"
+#include "RoundTripTracker.h"
 #include "Samples.hpp"
+#include "Signals.h"
+#include "FixedRatio.h"
+#include "AssistController.h"
+#include "RelayWatchdog.hpp"
+#include "PeriodMonitor.h"
+#include "RelayPlacement.h"
+#include <esp_timer.h>
 #include <string>
+#include "Time/Clock.hpp"
 #include "Data/PersistentData.hpp"
 #include "Data/RuntimeStats.hpp"
+#include "Metrics/Metrics.hpp"
+#include "Profiling/BootTimeline.hpp"
+#include "Memory/FixedString.hpp"
+#include "Memory/InplaceFunction.hpp"
+#include "Memory/HeapCounter.hpp"
 
 // #define CAN_DUMP_BEFORE_INTERCEPT
 #define CAN_DUMP_AFTER_INTERCEPT
@@ -34,14 +64,41 @@ namespace ReadieFur::OpenTCU::CAN
     {
     private:
         static const TickType_t CAN_TIMEOUT_TICKS = pdMS_TO_TICKS(100);
+        static const TickType_t IDLE_CAN_TIMEOUT_TICKS = pdMS_TO_TICKS(5000); //Also the longest a wake-up can wait if the bike comes back on within this long of going idle.
         static const uint RELAY_TASK_STACK_SIZE = CONFIG_FREERTOS_IDLE_TASK_STACKSIZE + 1024;
         static const uint RELAY_TASK_PRIORITY = configMAX_PRIORITIES * 0.6;
         static const uint SECONDARY_TASK_STACK_SIZE = CONFIG_FREERTOS_IDLE_TASK_STACKSIZE + 1024;
         static const uint SECONDARY_TASK_PRIORITY = configMAX_PRIORITIES * 0.3;
-        static const TickType_t SECONDARY_TASK_INTERVAL = pdMS_TO_TICKS(1000);
+        static const int64_t SECONDARY_TASK_INTERVAL_US = 1000000; //On Time::Clock so that live data is sampled at the same rate in simulations.
+        static const uint32_t LIVE_DATA_TIMEOUT_MS = 2000;
+        static const uint32_t IDLE_TIMEOUT_MS = 30000; //Without live data for this long the bike is considered off.
+        static const uint WATCHDOG_TASK_STACK_SIZE = CONFIG_FREERTOS_IDLE_TASK_STACKSIZE + 1024;
+        static const uint WATCHDOG_TASK_PRIORITY = RELAY_TASK_PRIORITY + 1; //Above the relay so that a busy relay can't hide its own stall.
+        static const TickType_t WATCHDOG_TASK_INTERVAL = pdMS_TO_TICKS(10);
+        static const TickType_t IDLE_WATCHDOG_TASK_INTERVAL = pdMS_TO_TICKS(1000); //Nothing is relayed while idle, this only keeps the chip from waking every tick.
+        static const uint TRANSACTION_TASK_STACK_SIZE = CONFIG_FREERTOS_IDLE_TASK_STACKSIZE + 1024;
+        static const uint TRANSACTION_TASK_PRIORITY = RELAY_TASK_PRIORITY - 1; //Below the relay, the motor is given ConfigTransactions::RESPONSE_TIMEOUT_MS to answer so a late tick costs nothing.
+        static const TickType_t TRANSACTION_TASK_INTERVAL = pdMS_TO_TICKS(10);
+        static const TickType_t IDLE_TRANSACTION_TASK_INTERVAL = pdMS_TO_TICKS(1000);
+        static const int64_t HEAP_SETTLE_TIME_US = 10000000; //After startup completes, for the services to finish their own setup before allocations are counted against the steady state.
         #ifdef ENABLE_CAN_DUMP
         static const uint CAN_DUMP_QUEUE_SIZE = 500;
         #endif
+        static const UBaseType_t CONFIG_FRAME_QUEUE_SIZE = 16; //A full length response is 3 frames, with room for the display's requests between transaction task ticks.
+        static const bool CONFIG_BUS = true; //The bus the configuration requests are sent on, the motor side.
+        static const uint32_t BIKE_INFO_REFRESH_INTERVAL_MS = 30000; //Only the missing and stale values are requested, this limits how often one the bike doesn't answer is asked for.
+        static const uint32_t BIKE_INFO_STARTUP_DELAY_MS = 5000; //The display reads its values within 1.5s of the live data starting in the captures, most of ours are cached from its responses by then.
+        //Configuration values kept cached for the API, refreshed in the background once they go stale.
+        static constexpr uint16_t BIKE_INFO_DIDS[] =
+        {
+            ConfigTransactions::DID_BASE | EStringType::MotorSerialNumber,
+            ConfigTransactions::DID_BASE | EStringType::MotorHardwareID,
+            ConfigTransactions::DID_BASE | EStringType::BikeSerialNumber,
+            ConfigTransactions::DID_WHEEL_CIRCUMFERENCE
+        };
+        //Runtime IDs that the bike sends at a fixed rate (see Documentation/Data.md), in the bit order of the period health bitmaps.
+        //0x404 and its answer 0x405 are left out, they come in bursts when the TCU changes a setting (gaps from 0 to 24s in the recordings).
+        static constexpr uint16_t PERIODIC_IDS[] = { 0x200, 0x201, 0x202, 0x203, 0x204, 0x205, 0x206, 0x300, 0x301, 0x400, 0x401, 0x402, 0x403, 0x665, 0x666 };
 
         struct SRelayTaskParameters
         {
@@ -50,7 +107,7 @@ namespace ReadieFur::OpenTCU::CAN
             ACan* can2;
         };
 
-        #if SOC_TWAI_CONTROLLER_NUM <= 1
+        #if SOC_TWAI_CONTROLLER_NUM <= 1 && !defined(CAN_VIRTUAL_BUSES)
         spi_device_handle_t _mcpDeviceHandle = nullptr; //TODO: Move this to the MCP2515 file.
         #endif
         ACan* _can1 = nullptr;
@@ -58,21 +115,78 @@ namespace ReadieFur::OpenTCU::CAN
         TaskHandle_t _can1TaskHandle = NULL;
         TaskHandle_t _can2TaskHandle = NULL;
         TaskHandle_t _secondaryTaskHandle = NULL;
+        TaskHandle_t _watchdogTaskHandle = NULL;
+        TaskHandle_t _transactionTaskHandle = NULL;
+        #ifdef CAN_LOOPBACK
+        LoopbackCan* _loopbackPeers[2] = { nullptr, nullptr };
+        #endif
 
         #pragma region Other data
         bool _savePersistentData = false;
+        bool _wheelCircumferenceConfirmed = false; //Set once the bike has reported the wheel circumference, the multipliers are only applied from then on.
+        bool _bootTimelineLogged = false;
+        uint32_t _lastSteadyStateAllocations = 0;
+
+        //Base / target wheel circumference, applied to the speed relayed to the display and inverted for the speed reported by the bike.
+        FixedRatio _wheelMultiplier;
+        FixedRatio _inverseWheelMultiplier;
+        AssistController _assistController;
+        #pragma endregion
+
+        #pragma region Idle
+        std::atomic<bool> _idle = false;
+        int64_t _idleSince = 0; //esp_timer_get_time()
+        //A bit per bus index, set by EnterIdle and cleared by the relay task that receives from the bus once it has put it to sleep between receives.
+        std::atomic<uint8_t> _sleepRequests = 0;
+        std::atomic<uint8_t> _sleepingBuses = 0; //The buses that went to sleep for the current request.
+        uint32_t _lastWake = 0; //Time::Clock milliseconds.
+        EventGroupHandle_t _idleEvents = xEventGroupCreate();
+        #pragma endregion
 
-        uint8_t _stringRequestType = 0;
-        size_t _stringRequestBufferIndex = 0;
-        char* _stringRequestBuffer = nullptr;
-        // std::map<uint8_t, std::string> _strings;
+        #pragma region Health
+        //Sampled by the secondary task so that readers never touch the controllers (the MCP2515 is behind SPI and shares the driver lock with the relay).
+        SCanHealth _health[2] = {};
+        SemaphoreHandle_t _healthMutex = xSemaphoreCreateMutex();
 
-        //TODO: Set an artificial speed limit with a lower wheel size and ease off the power as the limit is approached.
-        double _wheelMultiplier = 1.0;
+        RelayWatchdog _watchdog;
+        PeriodMonitor _periodMonitor = PeriodMonitor(PERIODIC_IDS, sizeof(PERIODIC_IDS) / sizeof(PERIODIC_IDS[0])); //Checked by the watchdog task.
+        SemaphoreHandle_t _watchdogMutex = xSemaphoreCreateMutex(); //Guards the snapshots, the relay side of the watchdog is lock-free.
+        #pragma endregion
+
+        #pragma region Configuration transactions
+        struct SConfigFrame
+        {
+            SCanMessage message;
+            uint32_t receivedAt; //Time::Clock milliseconds.
+        };
+
+        struct SRoundTripFrame
+        {
+            SCanMessage message;
+            int64_t receivedAt; //esp_timer microseconds.
+            int64_t relayedAt;
+        };
+
+        struct STransactionCallback
+        {
+            uint32_t handle;
+            Memory::InplaceFunction<void(const ConfigTransactions::SResult&)> callback;
+        };
+
+        ConfigTransactions _transactions;
+        STransactionCallback _transactionCallbacks[ConfigTransactions::MAX_QUEUED] = {};
+        SemaphoreHandle_t _transactionMutex = xSemaphoreCreateMutex(); //Guards the transactions and their callbacks, never taken by the relay.
+        QueueHandle_t _configFrames = xQueueCreate(CONFIG_FRAME_QUEUE_SIZE, sizeof(SConfigFrame)); //0x100 and 0x101 frames handed from the relay to ProcessTransactions.
+        uint32_t _nextBikeInfoRefresh = 0; //Time::Clock milliseconds.
+
+        RoundTripTracker _roundTrips;
+        RoundTripTracker::SRoundTrip _lastRoundTrip = {};
+        SemaphoreHandle_t _roundTripMutex = xSemaphoreCreateMutex(); //Guards the tracker between TrackRoundTrips and the API, never taken by the relay.
+        QueueHandle_t _roundTripFrames = xQueueCreate(CONFIG_FRAME_QUEUE_SIZE, sizeof(SRoundTripFrame)); //Relayed 0x100 and 0x101 frames handed from both relay tasks to TrackRoundTrips.
         #pragma endregion
 
         #pragma region Live data
-        TickType_t _lastLiveDataUpdate = 0;
+        uint32_t _lastLiveDataUpdate = 0; //Time::Clock milliseconds, 32 bit so that the relay task can update it with a single store.
 
         Samples<uint16_t, uint32_t> _speedBuffer = Samples<uint16_t, uint32_t>(10);
 
@@ -80,24 +194,85 @@ namespace ReadieFur::OpenTCU::CAN
         Samples<int32_t, int64_t> _batteryCurrent = Samples<int32_t, int64_t>(10);
         #pragma endregion
 
+        #pragma region Metrics
+        //Labelled by the bus the frames were received on.
+        static Metrics::Counter _framesRelayed[2];
+        static Metrics::Counter _receiveTimeouts[2];
+        static Metrics::Counter _relayFailures[2];
+        static Metrics::Histogram<8> _relayLatency[2];
+        static Metrics::Gauge _busStateGauge[2];
+        static Metrics::Gauge _txErrorCounterGauge[2];
+        static Metrics::Gauge _rxErrorCounterGauge[2];
+        static Metrics::Counter _relayStalls[2];
+        static Metrics::Counter _framesOverdue;
+        static Metrics::Counter _periodDrifts;
+        static Metrics::Gauge _periodHealth;
+        static Metrics::Gauge _idleGauge;
+        static Metrics::Counter _idleEntries;
+        static Metrics::Histogram<8> _wakeLatency;
+        static Metrics::Gauge _bootToFirstRelay;
+        static Metrics::Gauge _heapAllocationsAfterBoot;
+        static Metrics::Counter _configRequests;
+        static Metrics::Counter _configRetries;
+        static Metrics::Counter _configFailures;
+        static Metrics::Counter _configFramesDropped;
+        //Labelled by the leg of the round trip, see RoundTripTracker.
+        static Metrics::Histogram<8> _roundTripLatency[4];
+        static Metrics::Counter _roundTripFramesDropped;
         #ifdef DEBUG
-        size_t _sampleCount = 0;
+        uint32_t _lastFramesRelayed = 0;
         #endif
+        #pragma endregion
 
     protected:
         void SecondaryTask()
         {
+            bool live = false;
             while (!ServiceCancellationToken.IsCancellationRequested())
             {
-                if (_savePersistentData)
+                //Until the persisted settings have been loaded a save would overwrite them with the defaults, keep the request until then.
+                if (_savePersistentData && Data::PersistentData::IsLoaded())
                 {
                     Data::PersistentData::Save();
                     _savePersistentData = false;
                 }
 
-                if (xTaskGetTickCount() - _lastLiveDataUpdate < pdMS_TO_TICKS(2000))
+                SampleHealth();
+
+                if (!_bootTimelineLogged && Profiling::BootTimeline::HasRelayed())
                 {
-                    Data::RuntimeStats::BikeSpeed = (uint32_t)(Data::RuntimeStats::RealSpeed / _wheelMultiplier);
+                    _bootTimelineLogged = true;
+                    int64_t firstRelayed = Profiling::BootTimeline::GetTime("First frame relayed");
+                    _bootToFirstRelay.Set((int32_t)firstRelayed);
+                    LOGI(nameof(CAN::BusMaster), "First frame relayed %lluus after boot.", firstRelayed);
+                    #ifdef DEBUG
+                    Profiling::BootTimeline::Dump();
+                    #endif
+                }
+
+                SampleHeap();
+
+                uint32_t now = Time::Clock::NowMs();
+                if (!_idle.load(std::memory_order_relaxed) && now - _lastLiveDataUpdate >= IDLE_TIMEOUT_MS && now - _lastWake >= IDLE_TIMEOUT_MS)
+                    EnterIdle();
+
+                if (Time::Clock::NowMs() - _lastLiveDataUpdate < LIVE_DATA_TIMEOUT_MS)
+                {
+                    //Only while the bike is on, a request to a bike that is off would just time out.
+                    //The display reads its values when the bike is turned on, the first refresh waits until it has finished rather than queue behind its exchanges.
+                    if (!live)
+                    {
+                        live = true;
+                        _nextBikeInfoRefresh = now + BIKE_INFO_STARTUP_DELAY_MS;
+                    }
+                    if ((int32_t)(now - _nextBikeInfoRefresh) >= 0)
+                    {
+                        _nextBikeInfoRefresh = now + BIKE_INFO_REFRESH_INTERVAL_MS;
+                        for (uint16_t did : BIKE_INFO_DIDS)
+                            RefreshConfig(did);
+                    }
+
+                    Data::RuntimeStats::BikeSpeed = _inverseWheelMultiplier.Apply(Data::RuntimeStats::RealSpeed);
                     Data::RuntimeStats::RealSpeed = _speedBuffer.Average();
                     // Data::RuntimeStats::Cadence = 0; //TODO: Implement cadence.
                     // Data::RuntimeStats::RiderPower = 0; //TODO: Implement rider power.
@@ -107,6 +282,7 @@ namespace ReadieFur::OpenTCU::CAN
                 }
                 else
                 {
+                    live = false;
                     //If the last live data update was over 5 seconds ago, consider the data to be broken/the bike is off.
                     Data::RuntimeStats::BikeSpeed =
                         Data::RuntimeStats::RealSpeed =
@@ -121,10 +297,11 @@ namespace ReadieFur::OpenTCU::CAN
                 }
 
                 #ifdef DEBUG
-                if (EnableRuntimeStats && xTaskGetTickCount() - _lastLiveDataUpdate < pdMS_TO_TICKS(2000))
+                if (EnableRuntimeStats && Time::Clock::NowMs() - _lastLiveDataUpdate < LIVE_DATA_TIMEOUT_MS)
                 {
-                    printf("Sample count: %i\n", _sampleCount);
-                    _sampleCount = 0;
+                    uint32_t framesRelayed = _framesRelayed[0].Get() + _framesRelayed[1].Get();
+                    printf("Sample count: %lu\n", framesRelayed - _lastFramesRelayed);
+                    _lastFramesRelayed = framesRelayed;
 
                     printf("Average bike speed: %u\n", Data::RuntimeStats::BikeSpeed);
                     printf("Average real speed: %u\n", Data::RuntimeStats::RealSpeed);
@@ -136,42 +313,437 @@ namespace ReadieFur::OpenTCU::CAN
                     printf("Average battery voltage: %u\n", Data::RuntimeStats::BatteryVoltage);
                     printf("Average battery current: %li\n", Data::RuntimeStats::BatteryCurrent);
                 }
+                if (EnableRuntimeStats)
+                {
+                    for (int i = 0; i < 2; i++)
+                    {
+                        SCanHealth health = GetHealth(i);
+                        printf("CAN%i health: state %u, TEC %u, REC %u, rx missed %lu, rx overrun %lu, tx failed %lu, arb lost %lu, bus errors %lu, queued tx %u rx %u\n",
+                            i + 1,
+                            health.state,
+                            health.txErrorCounter,
+                            health.rxErrorCounter,
+                            health.rxMissed,
+                            health.rxOverrun,
+                            health.txFailed,
+                            health.arbLost,
+                            health.busErrors,
+                            health.txQueued,
+                            health.rxQueued
+                        );
+                    }
+                }
                 #endif
 
-                vTaskDelay(SECONDARY_TASK_INTERVAL);
+                Time::Clock::Delay(SECONDARY_TASK_INTERVAL_US);
+            }
+
+            vTaskDelete(NULL);
+        }
+
+        void WatchdogTask()
+        {
+            while (!ServiceCancellationToken.IsCancellationRequested())
+            {
+                vTaskDelay(_idle.load(std::memory_order_relaxed) ? IDLE_WATCHDOG_TASK_INTERVAL : WATCHDOG_TASK_INTERVAL);
+
+                TaskHandle_t tasks[2] = { _can1TaskHandle, _can2TaskHandle };
+                ACan* buses[2] = { _can1, _can2 };
+                xSemaphoreTake(_watchdogMutex, portMAX_DELAY);
+                uint8_t stalled = _watchdog.Check(esp_timer_get_time(), tasks, buses);
+                const RelayWatchdog::SStallSnapshot* snapshot = stalled != 0 ? _watchdog.GetSnapshot(0) : nullptr;
+                xSemaphoreGive(_watchdogMutex);
+
+                for (int i = 0; i < 2; i++)
+                {
+                    if (!(stalled & (1 << i)))
+                        continue;
+                    _relayStalls[i].Increment();
+                    //Only the latest snapshot is described here, the rest can be dumped with DumpStallSnapshots.
+                    if (snapshot != nullptr && snapshot->bus == i)
+                        LOGW(nameof(CAN::BusMaster), "CAN%i relay stalled: %s for %lums (expected period %luus).",
+                            i + 1,
+                            snapshot->reason == RelayWatchdog::ReceiveGap ? "no frame" : "frame not relayed",
+                            (unsigned long)(snapshot->gapUs / 1000),
+                            (unsigned long)snapshot->expectedPeriodUs
+                        );
+                    else
+                        LOGW(nameof(CAN::BusMaster), "CAN%i relay stalled.", i + 1);
+                }
+
+                if (!_idle.load(std::memory_order_relaxed))
+                    CheckPeriods();
+
+                TrackRoundTrips();
             }
 
             vTaskDelete(NULL);
         }
 
-        virtual void RelayTask(void* param)
+        void CheckPeriods()
+        {
+            PeriodMonitor::SChanges changes = _periodMonitor.Check((uint32_t)Time::Clock::Now());
+            _periodHealth.Set(_periodMonitor.GetHealthBitmap());
+            if ((changes.learned | changes.overdue | changes.resumed | changes.drifted | changes.recovered) == 0)
+                return;
+
+            //Every ID goes overdue when the bike is turned off, only report the ones missing while the rest of the bus is still running.
+            bool live = Time::Clock::NowMs() - _lastLiveDataUpdate < LIVE_DATA_TIMEOUT_MS;
+            for (size_t i = 0; i < _periodMonitor.GetCount(); i++)
+            {
+                uint32_t bit = 1UL << i;
+                PeriodMonitor::SPeriodStats stats;
+                _periodMonitor.GetStats(i, &stats);
+
+                if (changes.learned & bit)
+                    LOGD(nameof(CAN::BusMaster), "%x period learned: %luus.", stats.id, stats.nominalPeriodUs);
+                if (changes.overdue & bit)
+                {
+                    _framesOverdue.Increment();
+                    if (live)
+                        LOGW(nameof(CAN::BusMaster), "%x overdue, expected every %luus.", stats.id, stats.nominalPeriodUs);
+                }
+                if (changes.resumed & bit)
+                    LOGD(nameof(CAN::BusMaster), "%x resumed.", stats.id);
+                if (changes.drifted & bit)
+                {
+                    _periodDrifts.Increment();
+                    LOGW(nameof(CAN::BusMaster), "%x rate drifted: every %luus (jitter %luus), expected every %luus.", stats.id, stats.periodUs, stats.jitterUs, stats.nominalPeriodUs);
+                }
+                if (changes.recovered & bit)
+                    LOGI(nameof(CAN::BusMaster), "%x rate recovered: every %luus.", stats.id, stats.periodUs);
+            }
+        }
+
+        void TransactionTask()
+        {
+            bool persistentDataLoaded = false;
+            while (!ServiceCancellationToken.IsCancellationRequested())
+            {
+                vTaskDelay(_idle.load(std::memory_order_relaxed) ? IDLE_TRANSACTION_TASK_INTERVAL : TRANSACTION_TASK_INTERVAL);
+
+                //Until the persisted settings have been loaded the results would be overwritten by them, they wait in the engine until then.
+                //Any that didn't fit are still in its cache, so the bike info is applied from there first.
+                if (!persistentDataLoaded && Data::PersistentData::IsLoaded())
+                {
+                    persistentDataLoaded = true;
+                    ApplyCachedConfig();
+                }
+
+                ProcessTransactions(persistentDataLoaded);
+            }
+
+            vTaskDelete(NULL);
+        }
+
+        //Feeds the engine the configuration frames the relay has seen, sends the requests that are due and hands out the results, the callbacks run here on the transaction task.
+        void ProcessTransactions(bool takeResults)
+        {
+            SCanMessage frames[2]; //At most a flow control frame and the next request.
+            size_t frameCount = 0;
+
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            SConfigFrame received;
+            while (xQueueReceive(_configFrames, &received, 0) == pdTRUE)
+                _transactions.Receive(received.message, received.receivedAt);
+            uint32_t retries = _transactions.GetStats().retries;
+            uint32_t requests = _transactions.GetStats().requests;
+            uint32_t now = Time::Clock::NowMs();
+            while (frameCount < 2 && _transactions.Poll(now, &frames[frameCount]))
+                frameCount++;
+            _configRequests.Increment(_transactions.GetStats().requests - requests);
+            _configRetries.Increment(_transactions.GetStats().retries - retries);
+            xSemaphoreGive(_transactionMutex);
+
+            //A frame that can't be queued is sent again on the retry.
+            for (size_t i = 0; i < frameCount; i++)
+                TransmitMessage(CONFIG_BUS, frames[i]);
+
+            while (takeResults)
+            {
+                ConfigTransactions::SResult result;
+                Memory::InplaceFunction<void(const ConfigTransactions::SResult&)> callback;
+                xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+                bool taken = _transactions.TakeCompleted(&result);
+                if (taken && result.handle != 0)
+                {
+                    for (auto&& entry : _transactionCallbacks)
+                    {
+                        if (entry.handle != result.handle)
+                            continue;
+                        callback = entry.callback;
+                        entry = {};
+                        break;
+                    }
+                }
+                xSemaphoreGive(_transactionMutex);
+                if (!taken)
+                    break;
+
+                OnTransactionResult(result);
+                if (callback)
+                    callback(result);
+            }
+        }
+
+        //Applies the values the bike reported before the persisted settings were loaded.
+        void ApplyCachedConfig()
+        {
+            const uint16_t dids[] = { ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, ConfigTransactions::DID_BASE | EStringType::BikeSerialNumber };
+            for (uint16_t did : dids)
+            {
+                uint8_t data[ConfigTransactions::MAX_DATA];
+                uint8_t length;
+                xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+                ConfigTransactions::ECacheState state = _transactions.GetCached(did, Time::Clock::NowMs(), data, &length);
+                xSemaphoreGive(_transactionMutex);
+                if (state == ConfigTransactions::CacheFresh)
+                    ApplyConfig(did, data, length);
+            }
+        }
+
+        //Matches the configuration frames the relay tasks have handed over, in the order they were relayed.
+        void TrackRoundTrips()
+        {
+            SRoundTripFrame frame;
+            while (xQueueReceive(_roundTripFrames, &frame, 0) == pdTRUE)
+            {
+                RoundTripTracker::SRoundTrip roundTrip;
+                bool matched = false;
+                xSemaphoreTake(_roundTripMutex, portMAX_DELAY);
+                if (frame.message.id == RoundTripTracker::REQUEST_ID)
+                    _roundTrips.OnRequest(frame.message, frame.receivedAt, frame.relayedAt);
+                else
+                    matched = _roundTrips.OnResponse(frame.message, frame.receivedAt, frame.relayedAt, &roundTrip);
+                if (matched)
+                    _lastRoundTrip = roundTrip;
+                xSemaphoreGive(_roundTripMutex);
+
+                if (!matched)
+                    continue;
+                _roundTripLatency[0].Observe(roundTrip.requestRelayUs);
+                _roundTripLatency[1].Observe(roundTrip.deviceUs);
+                _roundTripLatency[2].Observe(roundTrip.responseRelayUs);
+                _roundTripLatency[3].Observe(roundTrip.totalUs);
+            }
+        }
+
+        //Applies the configuration that the bike reports, whether we or the display asked for it.
+        void OnTransactionResult(const ConfigTransactions::SResult& result)
+        {
+            if (result.result == ConfigTransactions::TimedOut || result.result == ConfigTransactions::Rejected)
+            {
+                _configFailures.Increment();
+                LOGW(nameof(CAN::BusMaster), "Configuration %s of %x %s.",
+                    result.service == ConfigTransactions::SERVICE_WRITE ? "write" : "read",
+                    result.did,
+                    result.result == ConfigTransactions::TimedOut ? "timed out" : "was rejected");
+                return;
+            }
+            if (result.service == ConfigTransactions::SERVICE_READ)
+                ApplyConfig(result.did, result.data, result.length);
+        }
+
+        void ApplyConfig(uint16_t did, const uint8_t* data, uint8_t length)
+        {
+            if (did == ConfigTransactions::DID_WHEEL_CIRCUMFERENCE && length >= 2)
+            {
+                uint16_t wheelCircumference = data[0] | data[1] << 8;
+                UpdateWheelMultiplier();
+                _wheelCircumferenceConfirmed = true;
+                _savePersistentData = true;
+                LOGD(nameof(CAN::BusMaster), "Received wheel circumference: %u", wheelCircumference);
+                LOGD(nameof(CAN::BusMaster), "Wheel multiplier set to: %lu/%lu", _wheelMultiplier.GetNumerator(), _wheelMultiplier.GetDenominator());
+            }
+            else if (did == (ConfigTransactions::DID_BASE | EStringType::BikeSerialNumber))
+            {
+                //The strings are null terminated unless they fill the response.
+                char serialNumber[ConfigTransactions::MAX_DATA + 1] = {};
+                memcpy(serialNumber, data, length);
+                LOGD(nameof(CAN::BusMaster), "Received bike serial number: %s", serialNumber);
+                if (strcmp(Data::PersistentData::BikeSerialNumber.c_str(), serialNumber) != 0)
+                {
+                    Data::PersistentData::BikeSerialNumber = serialNumber;
+                    _savePersistentData = true;
+                }
+            }
+        }
+
+        void UpdateWheelMultiplier()
+        {
+            _wheelMultiplier = FixedRatio(Data::PersistentData::BaseWheelCircumference, Data::PersistentData::TargetWheelCircumference, Multiply);
+            _inverseWheelMultiplier = FixedRatio(Data::PersistentData::BaseWheelCircumference, Data::PersistentData::TargetWheelCircumference, Divide);
+            _assistController.SetWalkLimitEnabled(!_wheelMultiplier.IsIdentity());
+        }
+
+        //Asks the relay tasks to stop the controllers that can wake the chip by themselves, the relay tasks back off to IDLE_CAN_TIMEOUT_TICKS.
+        //The controllers are stopped by the tasks that receive from them so that a driver is never stopped under a blocked Receive, the PowerManager is signalled once both have.
+        void EnterIdle()
+        {
+            _idleSince = esp_timer_get_time();
+            _idle.store(true, std::memory_order_relaxed);
+            //The periods are learned again once the bike is back, rather than every ID being overdue from the first check.
+            _periodMonitor.Reset();
+
+            _idleEntries.Increment();
+            _idleGauge.Set(1);
+            xEventGroupClearBits(_idleEvents, ACTIVE_EVENT_BIT | SLEEP_EVENT_BIT);
+            _sleepingBuses.store(0, std::memory_order_relaxed);
+            _sleepRequests.store(0b11, std::memory_order_release);
+            LOGI(nameof(CAN::BusMaster), "No live data for %lus, idle.", IDLE_TIMEOUT_MS / 1000);
+        }
+
+        //Called by the relay task between receives when EnterIdle has asked for its bus to sleep.
+        void SleepBus(char bus, int busIndex, ACan* can)
+        {
+            uint8_t bit = 1 << busIndex;
+            esp_err_t err = can->Sleep();
+            if (err == ESP_OK)
+                _sleepingBuses.fetch_or(bit, std::memory_order_relaxed);
+            else if (err != ESP_ERR_NOT_SUPPORTED)
+                LOGE(nameof(CAN::BusMaster), "Failed to put CAN%c to sleep: %s", bus, esp_err_to_name(err));
+
+            //The last bus to be handled signals the PowerManager, unless the bike came back in the meantime.
+            if (_sleepRequests.fetch_and(~bit, std::memory_order_acq_rel) != bit || !_idle.load(std::memory_order_relaxed))
+                return;
+            bool canSleep = _sleepingBuses.load(std::memory_order_relaxed) == 0b11;
+            xEventGroupSetBits(_idleEvents, IDLE_EVENT_BIT | (canSleep ? SLEEP_EVENT_BIT : 0));
+            if (!canSleep)
+                LOGI(nameof(CAN::BusMaster), "Controllers can't wake the chip, light sleep disabled.");
+        }
+
+        //Called by the relay task that receives the first frame after going idle.
+        void ExitIdle(ACan* can, int64_t receivedAt)
+        {
+            bool expected = true;
+            if (!_idle.compare_exchange_strong(expected, false))
+                return;
+
+            _lastWake = Time::Clock::NowMs();
+            //A bus that hasn't gone to sleep yet no longer needs to.
+            _sleepRequests.store(0, std::memory_order_relaxed);
+            xEventGroupClearBits(_idleEvents, IDLE_EVENT_BIT | SLEEP_EVENT_BIT);
+            xEventGroupSetBits(_idleEvents, ACTIVE_EVENT_BIT);
+            _idleGauge.Set(0);
+
+            //Only meaningful if the bus slept and was woken by this activity, a bus that can't sleep delivers the first frame directly.
+            int64_t wokenAt = can->GetWokenAt();
+            if (wokenAt >= _idleSince)
+            {
+                _wakeLatency.Observe((uint32_t)(receivedAt - wokenAt));
+                LOGI(nameof(CAN::BusMaster), "Bus activity, leaving idle (first frame %luus after the wake-up).", (uint32_t)(receivedAt - wokenAt));
+            }
+            else
+            {
+                LOGI(nameof(CAN::BusMaster), "Bus activity, leaving idle.");
+            }
+        }
+
+        void SampleHealth()
+        {
+            ACan* buses[2] = { _can1, _can2 };
+            for (int i = 0; i < 2; i++)
+            {
+                //Don't wait on the driver lock, a missed sample is better than delaying the relay.
+                SCanHealth health;
+                if (buses[i] == nullptr || buses[i]->GetHealth(&health, 0) != ESP_OK)
+                    continue;
+
+                xSemaphoreTake(_healthMutex, portMAX_DELAY);
+                _health[i] = health;
+                xSemaphoreGive(_healthMutex);
+
+                _busStateGauge[i].Set(health.state);
+                _txErrorCounterGauge[i].Set(health.txErrorCounter);
+                _rxErrorCounterGauge[i].Set(health.rxErrorCounter);
+            }
+        }
+
+        //Once startup has settled nothing should allocate, any allocation from then on is reported so that it can be tracked down.
+        void SampleHeap()
+        {
+            if (!Memory::HeapCounter::IsSupported())
+                return;
+
+            if (!Memory::HeapCounter::IsSteadyState())
+            {
+                int64_t startupComplete = Profiling::BootTimeline::GetTime("Startup complete");
+                if (startupComplete != 0 && esp_timer_get_time() - startupComplete >= HEAP_SETTLE_TIME_US)
+                    Memory::HeapCounter::MarkSteadyState();
+                return;
+            }
+
+            uint32_t allocations = Memory::HeapCounter::GetSteadyStateAllocations();
+            if (allocations != _lastSteadyStateAllocations)
+            {
+                LOGW(nameof(CAN::BusMaster), "%lu heap allocation(s) since startup settled.", allocations);
+                _lastSteadyStateAllocations = allocations;
+            }
+            _heapAllocationsAfterBoot.Set(allocations);
+        }
+
+        //Brings a bus back from bus-off on the task that receives from it, relaying resumes from the same loop once the controller has rejoined.
+        void RecoverBus(char bus, ACan* can)
+        {
+            LOGW(nameof(CAN::BusMaster), "CAN%c is bus-off, recovering.", bus);
+
+            esp_err_t res;
+            while ((res = can->Recover(CAN_TIMEOUT_TICKS)) != ESP_OK)
+            {
+                if (ServiceCancellationToken.IsCancellationRequested())
+                    return;
+                if (res != ESP_ERR_TIMEOUT)
+                {
+                    LOGE(nameof(CAN::BusMaster), "CAN%c failed to recover: %s", bus, esp_err_to_name(res));
+                    vTaskDelay(CAN_TIMEOUT_TICKS);
+                }
+            }
+
+            SCanFaultStats stats = can->GetFaultStats();
+            LOGI(nameof(CAN::BusMaster), "CAN%c recovered after %lums (bus-off %lu times, %llums total).",
+                bus,
+                stats.lastDowntimeUs / 1000,
+                stats.busOff,
+                stats.totalDowntimeUs / 1000
+            );
+        }
+
+        virtual void RELAY_IRAM_ATTR RelayTask(void* param)
         {
             SRelayTaskParameters* params = static_cast<SRelayTaskParameters*>(param);
 
             char bus = pcTaskGetName(xTaskGetHandle(pcTaskGetName(NULL)))[3]; //Only really used for logging & debugging.
             char otherBus = bus == '1' ? '2' : '1';
+            int busIndex = bus == '1' ? 0 : 1;
 
             //Check if the task has been signalled for deletion.
             while (!ServiceCancellationToken.IsCancellationRequested())
             {
+                if (_sleepRequests.load(std::memory_order_acquire) & (1 << busIndex))
+                    SleepBus(bus, busIndex, params->can1);
+
                 //Attempt to read a message from the bus.
                 SCanMessage message;
                 esp_err_t res;
-                if ((res = params->can1->Receive(&message, CAN_TIMEOUT_TICKS)) != ESP_OK)
+                if ((res = params->can1->Receive(&message, _idle.load(std::memory_order_relaxed) ? IDLE_CAN_TIMEOUT_TICKS : CAN_TIMEOUT_TICKS)) != ESP_OK)
                 {
                     switch (res)
                     {
                     case ESP_ERR_TIMEOUT:
+                        _receiveTimeouts[busIndex].Increment();
                         #if defined(DEBUG) && true
                         //While debugging I have the board externally powered so the bike can be off and this error is to be expected.
                         #else
-                        //Messages should never time out as they are sent extremely frequently.
-                        LOGW(nameof(CAN::BusMaster), "CAN%c timed out while waiting for message.", bus);
+                        //Messages should never time out as they are sent extremely frequently, unless the bike is off.
+                        if (!_idle.load(std::memory_order_relaxed))
+                            LOGW(nameof(CAN::BusMaster), "CAN%c timed out while waiting for message.", bus);
                         #endif
                         break;
                     case ESP_ERR_INVALID_STATE:
-                        //TODO: Trigger a reset of the CAN controller.
-                        LOGE(nameof(CAN::BusMaster), "CAN%c bus failure: %s", bus);
+                        if (params->can1->IsBusOff())
+                            RecoverBus(bus, params->can1);
+                        else
+                            LOGE(nameof(CAN::BusMaster), "CAN%c bus failure: %s", bus, esp_err_to_name(res));
                         break;
                     default:
                         LOGE(nameof(CAN::BusMaster), "CAN%c failed to receive message: %i", bus, res);
@@ -181,6 +753,14 @@ namespace ReadieFur::OpenTCU::CAN
                     continue;
                 }
 
+                int64_t receivedAt = esp_timer_get_time();
+                _watchdog.OnReceived(busIndex, message, receivedAt);
+                if (!message.isExtended)
+                    _periodMonitor.OnFrame(message.id, (uint32_t)Time::Clock::Now());
+                Profiling::BootTimeline::MarkFrameReceived();
+                if (_idle.load(std::memory_order_relaxed))
+                    ExitIdle(params->can1, receivedAt);
+
                 #if defined(ENABLE_CAN_DUMP) && defined(CAN_DUMP_BEFORE_INTERCEPT)
                 LogMessage(bus, message);
                 #endif
@@ -193,8 +773,11 @@ namespace ReadieFur::OpenTCU::CAN
                 #endif
 
                 //Relay the message to the other CAN bus.
-                if ((res = params->can2->Send(message, CAN_TIMEOUT_TICKS)) != ESP_OK)
+                res = params->can2->Send(message, CAN_TIMEOUT_TICKS);
+                _watchdog.OnRelayed(busIndex);
+                if (res != ESP_OK)
                 {
+                    _relayFailures[busIndex].Increment();
                     switch (res)
                     {
                     case ESP_ERR_TIMEOUT:
@@ -202,7 +785,9 @@ namespace ReadieFur::OpenTCU::CAN
                         LOGE(nameof(CAN::BusMaster), "CAN%c timed out while waiting to relay message.", otherBus);
                         break;
                     case ESP_ERR_INVALID_STATE:
-                        LOGE(nameof(CAN::BusMaster), "CAN%c bus failure: %s", otherBus);
+                        //Frames for a bus that is off are dropped, the task that receives from that bus is recovering it.
+                        if (!params->can2->IsBusOff())
+                            LOGE(nameof(CAN::BusMaster), "CAN%c bus failure: %s", otherBus, esp_err_to_name(res));
                         break;
                     default:
                         LOGE(nameof(CAN::BusMaster), "CAN%c failed to relay message: %i", otherBus, res);
@@ -212,6 +797,19 @@ namespace ReadieFur::OpenTCU::CAN
                     continue;
                 }
 
+                int64_t relayedAt = esp_timer_get_time();
+                _framesRelayed[busIndex].Increment();
+                Profiling::BootTimeline::MarkFrameRelayed();
+                _relayLatency[busIndex].Observe((uint32_t)(relayedAt - receivedAt));
+
+                if (message.id == RoundTripTracker::REQUEST_ID || message.id == RoundTripTracker::RESPONSE_ID)
+                {
+                    //Matched on the watchdog task, the relay never waits on the API reading the round trips.
+                    SRoundTripFrame frame = { message, receivedAt, relayedAt };
+                    if (xQueueSend(_roundTripFrames, &frame, 0) != pdTRUE)
+                        _roundTripFramesDropped.Increment();
+                }
+
                 //Yield to allow other higher priority tasks to run, but use this method over vTaskDelay(0) keep delay time to a minimal as this is a very high priority task.
                 //We do not set a delay here as the delay is acted upon while waiting for CAN bus operations.
                 taskYIELD();
@@ -222,12 +820,12 @@ namespace ReadieFur::OpenTCU::CAN
         }
 
         #ifdef ENABLE_CAN_DUMP
-        inline virtual void LogMessage(char bus, SCanMessage& message)
+        inline virtual void RELAY_IRAM_ATTR LogMessage(char bus, SCanMessage& message)
         {
             //Copy the original message for logging.
             SCanDump dump =
             {
-                .timestamp = esp_log_timestamp(),
+                .timestamp = Time::Clock::NowMs(),
                 .bus = bus,
                 .message = message //Creates a copy of the struct.
             };
@@ -249,148 +847,47 @@ namespace ReadieFur::OpenTCU::CAN
         #endif
 
         //Force inline for minor performance improvements, ideal in this program as it will be called extremely frequently and is used for real-time data analysis.
-        inline virtual void InterceptMessage(SCanMessage* message)
+        inline virtual void RELAY_IRAM_ATTR InterceptMessage(SCanMessage* message)
         {
             switch (message->id)
             {
-            case 0x100:
-            {
-                if (message->data[0] == 0x05
-                    && message->data[1] == 0x2E
-                    && message->data[2] == 0x02
-                    && message->data[3] == 0x06
-                    && message->data[6] == 0x00
-                    && message->data[7] == 0x00)
-                {
-                    LOGD(nameof(CAN::BusMaster), "Received request to set wheel circumference to: %u", message->data[4] | message->data[5] << 8);
-                }
-                break;
-            }
-            case 0x101:
+            case ConfigTransactions::REQUEST_ID:
+            case ConfigTransactions::RESPONSE_ID:
             {
-                if (message->data[0] == 0x10
-                    && message->data[2] == 0x62
-                    && message->data[3] == 0x02)
-                {
-                    LOGD(nameof(CAN::BusMaster), "Received string response for %x.", message->data[4]);
-                    if (_stringRequestBuffer != nullptr)
-                    {
-                        LOGW(nameof(CAN::BusMaster), "New string request before previous request was completed, discarding previous request.");
-                        delete[] _stringRequestBuffer;
-                    }
-                    _stringRequestType = message->data[4];
-                    _stringRequestBuffer = new char[21]; //All string requests seem to be sent in a buffer of 20 bytes.
-                    _stringRequestBufferIndex = 0;
-
-                    //String response.
-                    if (_stringRequestBuffer == nullptr)
-                    {
-                        LOGW(nameof(CAN::BusMaster), "String response received before a request was sent.");
-                        break;
-                    }
-
-                    for (size_t i = 5; i < 8; i++)
-                        _stringRequestBuffer[_stringRequestBufferIndex++] = (char)message->data[i];
-                }
-                else if (message->data[0] == 0x21 || message->data[0] == 0x22)
-                {
-                    //String response continued.
-                    // LOGD(nameof(CAN::BusMaster), "Continued response for %x.", _stringRequestType);
-                    if (_stringRequestBuffer == nullptr)
-                    {
-                        LOGW(nameof(CAN::BusMaster), "String response continued before a request was sent.");
-                        break;
-                    }
-
-                    for (size_t i = 1; i < 8; i++)
-                        _stringRequestBuffer[_stringRequestBufferIndex++] = (char)message->data[i];
-                }
-                else if (message->data[0] == 0x23)
-                {
-                    //String response end.
-                    // LOGD(nameof(CAN::BusMaster), "String response end for %x.", _stringRequestType);
-                    if (_stringRequestBuffer == nullptr)
-                    {
-                        LOGW(nameof(CAN::BusMaster), "String response end before a request was sent.");
-                        break;
-                    }
-
-                    for (size_t i = 1; i < 4; i++)
-                        _stringRequestBuffer[_stringRequestBufferIndex++] = (char)message->data[i];
-                    _stringRequestBuffer[_stringRequestBufferIndex] = '\0';
-
-                    LOGD(nameof(CAN::BusMaster), "String response for %x: %s", _stringRequestType, _stringRequestBuffer);
-
-
-                    switch (_stringRequestType)
-                    {
-                    case EStringType::BikeSerialNumber:
-                        Data::PersistentData::BikeSerialNumber = std::string(_stringRequestBuffer);
-                        _savePersistentData = true;
-                        break;
-                    default:
-                        break;
-                    }
-                    // _strings[_stringRequestType] = std::string(_stringRequestBuffer);
-                    delete[] _stringRequestBuffer;
-                    _stringRequestBuffer = nullptr;
-                }
-                else if (message->data[0] == 0x05
-                    && message->data[1] == 0x62
-                    && message->data[2] == 0x02
-                    && message->data[3] == 0x06
-                    && message->data[6] == 0xE0
-                    && message->data[7] == 0xAA)
-                {
-                    uint16_t wheelCircumference = message->data[4] | message->data[5] << 8;
-                    _wheelMultiplier = (double)Data::PersistentData::BaseWheelCircumference / Data::PersistentData::TargetWheelCircumference;
-                    _savePersistentData = true;
-                    LOGD(nameof(CAN::BusMaster), "Received wheel circumference: %u", wheelCircumference);
-                    LOGD(nameof(CAN::BusMaster), "Wheel multiplier set to: %f", _wheelMultiplier);
-                }
+                //Configuration traffic, matched against our own requests and cached by ProcessTransactions.
+                //Handed over without waiting so that the relay never blocks on the API reading the transactions.
+                SConfigFrame frame = { *message, Time::Clock::NowMs() };
+                if (xQueueSend(_configFrames, &frame, 0) != pdTRUE)
+                    _configFramesDropped.Increment();
                 break;
             }
             case 0x201:
             {
-                //D1 and D2 combined contain the speed of the bike in km/h * 100 (little-endian).
-                //Example: EA, 01 -> 01EA -> 490 -> 4.9km/h.
-                //We won't work in decimals.
-                uint16_t bikeSpeed = message->data[0] | message->data[1] << 8;
-                uint16_t realSpeed = (uint16_t)(bikeSpeed * _wheelMultiplier);
+                //Speed is in km/h * 100, we won't work in decimals.
+                uint16_t bikeSpeed = SignalCodec<Signals::Speed>::Extract(message->data);
+                uint16_t realSpeed = (uint16_t)_wheelMultiplier.Apply(bikeSpeed);
                 _speedBuffer.AddSample(realSpeed);
-                message->data[0] = realSpeed & 0xFF;
-                message->data[1] = realSpeed >> 8;
-                _lastLiveDataUpdate = xTaskGetTickCount();
+                _assistController.UpdateSpeed(realSpeed, Time::Clock::Now());
+                SignalCodec<Signals::Speed>::Insert(message->data, realSpeed);
+                _lastLiveDataUpdate = Time::Clock::NowMs();
                 break;
             }
             case 0x300:
             {
                 //Assist settings.
-                Data::RuntimeStats::WalkMode = message->data[1] == 0xA5;
-                Data::RuntimeStats::EaseSetting = message->data[4];
-                Data::RuntimeStats::PowerSetting = message->data[6];
+                Data::RuntimeStats::WalkMode = SignalCodec<Signals::WalkMode>::Extract(message->data) == 0xA5;
+                Data::RuntimeStats::EaseSetting = SignalCodec<Signals::EaseSetting>::Extract(message->data);
+                Data::RuntimeStats::PowerSetting = SignalCodec<Signals::PowerSetting>::Extract(message->data);
 
-                //If we are in walk mode and a speed multiplier exists, attempt to keep the walk speed at the original 5kph by setting the motor power to 0 when over a real speed of 5kph.
-                if (Data::RuntimeStats::WalkMode && _wheelMultiplier != 1.0)
-                {
-                    uint16_t realSpeed = _speedBuffer.Latest();
-                    if (realSpeed > 650) //Set to 650 to allow for some margin.
-                    {
-                        message->data[0] = 0; //Motor mode?
-                        /*_easeSetting = */message->data[4] = 0;
-                        /*_powerSetting = */message->data[6] = 0;
-                    }
-                }
+                //If we are in walk mode and a speed multiplier exists, attempt to keep the walk speed at the original 5kph, and keep to the speed limit if one is set.
+                //Power is eased off as the limit is approached rather than cut at it, using the speed frame received just before this one.
+                _assistController.Shape(message->data, Time::Clock::Now());
                 break;
             }
             case 0x401:
             {
-                _batteryVoltage.AddSample(message->data[0] | message->data[1] << 8);
-
-                //D5, D6, D7 and D8 combined contain the battery current in mA (little-endian with two's complement).
-                //Example 1: 46, 00, 00, 00 -> 00 000046 -> 70mA.
-                //Example 2: 5B, F0, FF, FF -> FF FFF05B -> -4005mA.
-                _batteryCurrent.AddSample(message->data[4] | message->data[5] << 8 | message->data[6] << 16 | message->data[7] << 24);
+                _batteryVoltage.AddSample(SignalCodec<Signals::BatteryVoltage>::Extract(message->data));
+                _batteryCurrent.AddSample(SignalCodec<Signals::BatteryCurrent>::Extract(message->data));
                 break;
             }
             default:
@@ -401,7 +898,33 @@ namespace ReadieFur::OpenTCU::CAN
         void RunServiceImpl() override
         {
             esp_err_t err;
+            xEventGroupSetBits(_idleEvents, ACTIVE_EVENT_BIT);
 
+            #ifdef CAN_STRESS_TEST
+            //Run the relay between two in-memory segments, traffic is supplied by the StressTest service.
+            MemoryCan* memoryCan1 = MemoryCan::Initialize();
+            MemoryCan* memoryCan2 = MemoryCan::Initialize();
+            if (memoryCan1 == nullptr || memoryCan2 == nullptr)
+            {
+                LOGE(nameof(CAN::BusMaster), "Failed to initialize in-memory CAN buses.");
+                return;
+            }
+            memoryCan1->SetUpstream(memoryCan2);
+            memoryCan2->SetUpstream(memoryCan1);
+            _can1 = memoryCan1;
+            _can2 = memoryCan2;
+            #elif defined(CAN_LOOPBACK)
+            //Run the relay in-process, the far end of each bus is driven through GetLoopbackPeer.
+            LoopbackCan* loopbackCan1;
+            LoopbackCan* loopbackCan2;
+            if (!LoopbackCan::CreatePair(&loopbackCan1, &_loopbackPeers[0]) || !LoopbackCan::CreatePair(&loopbackCan2, &_loopbackPeers[1]))
+            {
+                LOGE(nameof(CAN::BusMaster), "Failed to initialize loopback CAN buses.");
+                return;
+            }
+            _can1 = loopbackCan1;
+            _can2 = loopbackCan2;
+            #else
             #pragma region CAN1
             gpio_config_t hostTxPinConfig1 = {
                 .pin_bit_mask = 1ULL << TWAI1_RX_PIN, //Have the GPIO config inverted, e.g. the RX of the CAN controller is the TX of the host.
@@ -548,6 +1071,9 @@ namespace ReadieFur::OpenTCU::CAN
                 return;
             }
             #pragma endregion
+            #endif
+
+            Profiling::BootTimeline::Mark("CAN controllers started");
 
             #ifdef ENABLE_CAN_DUMP
             CanDumpQueue = xQueueCreate(CAN_DUMP_QUEUE_SIZE, sizeof(BusMaster::SCanDump));
@@ -594,6 +1120,7 @@ namespace ReadieFur::OpenTCU::CAN
             }
             #endif
             #pragma endregion
+            Profiling::BootTimeline::Mark("Relay tasks started");
 
             if (xTaskCreate([](void* param) { static_cast<BusMaster*>(param)->SecondaryTask(); }, "ConfigTask", SECONDARY_TASK_STACK_SIZE, this, SECONDARY_TASK_PRIORITY, &_secondaryTaskHandle) != pdPASS)
             {
@@ -601,6 +1128,18 @@ namespace ReadieFur::OpenTCU::CAN
                 return;
             }
 
+            if (xTaskCreate([](void* param) { static_cast<BusMaster*>(param)->WatchdogTask(); }, "RelayWatchdog", WATCHDOG_TASK_STACK_SIZE, this, WATCHDOG_TASK_PRIORITY, &_watchdogTaskHandle) != pdPASS)
+            {
+                LOGE(nameof(CAN::BusMaster), "Failed to create watchdog task.");
+                return;
+            }
+
+            if (xTaskCreate([](void* param) { static_cast<BusMaster*>(param)->TransactionTask(); }, "Transactions", TRANSACTION_TASK_STACK_SIZE, this, TRANSACTION_TASK_PRIORITY, &_transactionTaskHandle) != pdPASS)
+            {
+                LOGE(nameof(CAN::BusMaster), "Failed to create transaction task.");
+                return;
+            }
+
             ServiceCancellationToken.WaitForCancellation();
 
             #pragma region Cleanup
@@ -613,11 +1152,19 @@ namespace ReadieFur::OpenTCU::CAN
             _can1TaskHandle = nullptr;
             _can2TaskHandle = nullptr;
             _secondaryTaskHandle = nullptr;
+            _watchdogTaskHandle = nullptr;
+            _transactionTaskHandle = nullptr;
 
-            #if SOC_TWAI_CONTROLLER_NUM <= 1
+            #if SOC_TWAI_CONTROLLER_NUM <= 1 && !defined(CAN_VIRTUAL_BUSES)
             spi_bus_remove_device(_mcpDeviceHandle);
             spi_bus_free(SPI2_HOST);
             #endif
+
+            #ifdef CAN_LOOPBACK
+            delete _loopbackPeers[0];
+            delete _loopbackPeers[1];
+            _loopbackPeers[0] = _loopbackPeers[1] = nullptr;
+            #endif
             #pragma endregion
 
             #ifdef ENABLE_CAN_DUMP
@@ -642,12 +1189,30 @@ namespace ReadieFur::OpenTCU::CAN
         bool EnableRuntimeStats = true;
         #endif
 
+        static const uint16_t MAX_SPEED_LIMIT = 6000; //km/h * 100.
+
         BusMaster()
         {
             ServiceEntrypointStackDepth += 1024;
             ServiceEntrypointPriority = RELAY_TASK_PRIORITY;
+            _assistController.SetSpeedLimit(Data::PersistentData::SpeedLimit);
         }
 
+        #ifdef CAN_STRESS_TEST
+        MemoryCan* GetMemoryBus(bool bus)
+        {
+            return static_cast<MemoryCan*>(bus ? _can2 : _can1);
+        }
+        #endif
+
+        #ifdef CAN_LOOPBACK
+        //The far end of a bus, frames sent here are received by the relay and frames relayed onto the bus are received here.
+        LoopbackCan* GetLoopbackPeer(bool bus)
+        {
+            return _loopbackPeers[bus];
+        }
+        #endif
+
         esp_err_t InjectMessage(bool bus, SCanMessage message)
         {
             LOGI(nameof(CAN::BusMaster), "Injecting message into CAN%c, ID: %x, Length: %i, Data: %02X %02X %02X %02X %02X %02X %02X %02X",
@@ -664,21 +1229,211 @@ namespace ReadieFur::OpenTCU::CAN
                 message.data[7]
             );
 
+            return TransmitMessage(bus, message, CAN_TIMEOUT_TICKS);
+        }
+
+        //As InjectMessage without the log line, for injected traffic that is sent too often to log (see TransmitScheduler).
+        esp_err_t TransmitMessage(bool bus, const SCanMessage& message, TickType_t timeout = 0)
+        {
             if (bus)
-                return _can2->Send(message, CAN_TIMEOUT_TICKS);
+                return _can2->Send(message, timeout);
             else
-                return _can1->Send(message, CAN_TIMEOUT_TICKS);
+                return _can1->Send(message, timeout);
+        }
+
+        typedef Memory::InplaceFunction<void(const ConfigTransactions::SResult&)> TTransactionCallback;
+
+        /**
+         * Queues a read or write of a configuration value on the motor, the request is retried and the callback gets the response, or the failure.
+         * Returns the handle that the result carries, or 0 if too many transactions are waiting.
+         * The callback runs on the transaction task, below the relay and only once the persisted settings have been loaded.
+         */
+        uint32_t BeginTransaction(uint8_t service, uint16_t did, const uint8_t* payload, size_t length, TTransactionCallback callback = nullptr)
+        {
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            uint32_t handle = _transactions.Queue(service, did, payload, length);
+            if (handle != 0 && callback)
+            {
+                //There is a callback slot per queue slot so one is always free.
+                for (auto&& entry : _transactionCallbacks)
+                {
+                    if (entry.handle != 0)
+                        continue;
+                    entry = { handle, callback };
+                    break;
+                }
+            }
+            xSemaphoreGive(_transactionMutex);
+            return handle;
+        }
+
+        //Drops a queued transaction, its callback won't be called.
+        bool CancelTransaction(uint32_t handle)
+        {
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            bool cancelled = _transactions.Cancel(handle);
+            for (auto&& entry : _transactionCallbacks)
+                if (entry.handle == handle)
+                    entry = {};
+            xSemaphoreGive(_transactionMutex);
+            return cancelled;
+        }
+
+        //Queues a read of the value unless it is fresh in the cache or already being read.
+        void RefreshConfig(uint16_t did)
+        {
+            uint8_t data[ConfigTransactions::MAX_DATA];
+            uint8_t length;
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            if (_transactions.GetCached(did, Time::Clock::NowMs(), data, &length) != ConfigTransactions::CacheFresh
+                && !_transactions.IsQueued(ConfigTransactions::SERVICE_READ, did))
+                _transactions.Queue(ConfigTransactions::SERVICE_READ, did, nullptr, 0);
+            xSemaphoreGive(_transactionMutex);
+        }
+
+        /**
+         * Copies the last value the bike reported for the DID (up to ConfigTransactions::MAX_DATA bytes) without going to the bus.
+         * A missing or stale value is refreshed in the background, read again once it has arrived.
+         */
+        ConfigTransactions::ECacheState GetConfig(uint16_t did, uint8_t* outData, uint8_t* outLength)
+        {
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            ConfigTransactions::ECacheState state = _transactions.GetCached(did, Time::Clock::NowMs(), outData, outLength);
+            if (state != ConfigTransactions::CacheFresh && !_transactions.IsQueued(ConfigTransactions::SERVICE_READ, did))
+                _transactions.Queue(ConfigTransactions::SERVICE_READ, did, nullptr, 0);
+            xSemaphoreGive(_transactionMutex);
+            return state;
+        }
+
+        //The latest request from the display that the motor answered, returns the number answered so far.
+        uint32_t GetLastRoundTrip(RoundTripTracker::SRoundTrip* outRoundTrip, RoundTripTracker::SStats* outStats = nullptr)
+        {
+            xSemaphoreTake(_roundTripMutex, portMAX_DELAY);
+            *outRoundTrip = _lastRoundTrip;
+            RoundTripTracker::SStats stats = _roundTrips.GetStats();
+            xSemaphoreGive(_roundTripMutex);
+            if (outStats != nullptr)
+                *outStats = stats;
+            return stats.matched;
+        }
 
+        ConfigTransactions::SStats GetTransactionStats()
+        {
+            xSemaphoreTake(_transactionMutex, portMAX_DELAY);
+            ConfigTransactions::SStats stats = _transactions.GetStats();
+            xSemaphoreGive(_transactionMutex);
+            return stats;
+        }
+
+        //Speed in km/h * 100 that assist is eased off towards, 0 to disable.
+        esp_err_t SetSpeedLimit(uint16_t limit)
+        {
+            if (limit != 0 && (limit < AssistController::SPEED_LIMIT_TAPER_WIDTH || limit > MAX_SPEED_LIMIT))
+            {
+                LOGW(nameof(CAN::BusMaster), "Invalid speed limit: %u", limit);
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            _assistController.SetSpeedLimit(limit);
+            Data::PersistentData::SpeedLimit = limit;
             return ESP_OK;
         }
 
-        // std::string GetString(EStringType type)
-        // {
-        //     if (_strings.find(type) == _strings.end())
-        //         return "";
-        //     return _strings[type];
-        // }
+        //Latest health snapshot of a bus, sampled every SECONDARY_TASK_INTERVAL_US.
+        SCanHealth GetHealth(bool bus)
+        {
+            xSemaphoreTake(_healthMutex, portMAX_DELAY);
+            SCanHealth health = _health[bus];
+            xSemaphoreGive(_healthMutex);
+            return health;
+        }
+
+        static const EventBits_t IDLE_EVENT_BIT = 1 << 0;
+        static const EventBits_t ACTIVE_EVENT_BIT = 1 << 1;
+        static const EventBits_t SLEEP_EVENT_BIT = 1 << 2; //Set with IDLE_EVENT_BIT when both controllers can wake the chip from light sleep.
+
+        //BusMaster is started before the persisted settings are loaded so that the bike is bridged as early as possible, it runs on the defaults until this is called.
+        void ApplyPersistentData()
+        {
+            _assistController.SetSpeedLimit(Data::PersistentData::SpeedLimit);
+            if (_wheelCircumferenceConfirmed)
+                UpdateWheelMultiplier();
+        }
+
+        bool IsIdle()
+        {
+            return _idle.load(std::memory_order_relaxed);
+        }
+
+        //Waits for the relay to be idle (or active), returns the event bits so that SLEEP_EVENT_BIT can be checked, 0 on timeout.
+        EventBits_t WaitForIdle(bool idle, TickType_t timeout)
+        {
+            EventBits_t wanted = idle ? IDLE_EVENT_BIT : ACTIVE_EVENT_BIT;
+            EventBits_t bits = xEventGroupWaitBits(_idleEvents, wanted, pdFALSE, pdFALSE, timeout);
+            return (bits & wanted) ? bits : 0;
+        }
+
+        //A bit per ID of PERIODIC_IDS that has learned its period and is neither overdue nor drifting.
+        uint32_t GetPeriodHealth(uint32_t* outLearned = nullptr, uint32_t* outOverdue = nullptr, uint32_t* outDrifting = nullptr)
+        {
+            if (outLearned != nullptr)
+                *outLearned = _periodMonitor.GetLearnedBitmap();
+            if (outOverdue != nullptr)
+                *outOverdue = _periodMonitor.GetOverdueBitmap();
+            if (outDrifting != nullptr)
+                *outDrifting = _periodMonitor.GetDriftingBitmap();
+            return _periodMonitor.GetHealthBitmap();
+        }
+
+        bool GetPeriodStats(size_t index, PeriodMonitor::SPeriodStats* outStats)
+        {
+            return _periodMonitor.GetStats(index, outStats);
+        }
+
+        size_t GetPeriodicIdCount()
+        {
+            return _periodMonitor.GetCount();
+        }
+
+        uint32_t GetStallCount()
+        {
+            xSemaphoreTake(_watchdogMutex, portMAX_DELAY);
+            uint32_t count = _watchdog.GetStallCount();
+            xSemaphoreGive(_watchdogMutex);
+            return count;
+        }
+
+        //Most recent first, returns false once index passes the retained snapshots.
+        bool GetStallSnapshot(size_t index, RelayWatchdog::SStallSnapshot* snapshot)
+        {
+            xSemaphoreTake(_watchdogMutex, portMAX_DELAY);
+            const RelayWatchdog::SStallSnapshot* stored = _watchdog.GetSnapshot(index);
+            if (stored != nullptr)
+                *snapshot = *stored;
+            xSemaphoreGive(_watchdogMutex);
+            return stored != nullptr;
+        }
+
+        //Prints every retained stall snapshot, including the frames leading up to it, to the console.
+        void DumpStallSnapshots()
+        {
+            xSemaphoreTake(_watchdogMutex, portMAX_DELAY);
+            _watchdog.Dump(esp_timer_get_time());
+            xSemaphoreGive(_watchdogMutex);
+        }
+
+        SCanFaultStats GetFaultStats(bool bus)
+        {
+            ACan* can = bus ? _can2 : _can1;
+            return can != nullptr ? can->GetFaultStats() : SCanFaultStats {};
+        }
+
+        AssistController::SStats GetAssistStats()
+        {
+            return _assistController.GetStats();
+        }
 
+        //Queues the write to the bike, TargetWheelCircumference is updated and saved when the bike accepts it and left unchanged if it doesn't.
         esp_err_t SetTargetWheelCircumference(uint16_t circumference)
         {
             if (circumference > 2400 || circumference < 800)
@@ -687,24 +1442,89 @@ namespace ReadieFur::OpenTCU::CAN
                 return ESP_ERR_INVALID_ARG;
             }
 
-            SCanMessage message =
-            {
-                .id = 0x100,
-                .data = { 0x05, 0x2E, 0x02, 0x06, (uint8_t)(circumference & 0xFF), (uint8_t)(circumference >> 8), 0x00, 0x00 },
-                .length = 8,
-                .isExtended = false,
-                .isRemote = false
-            };
-            esp_err_t err = InjectMessage(true, message);
+            //The bike only applies it after a restart, the persistent data is only updated once the bike has accepted the write.
+            uint8_t payload[2] = { (uint8_t)(circumference & 0xFF), (uint8_t)(circumference >> 8) };
+            uint32_t handle = BeginTransaction(ConfigTransactions::SERVICE_WRITE, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, payload, sizeof(payload),
+                [this, circumference](const ConfigTransactions::SResult& result)
+                {
+                    if (result.result != ConfigTransactions::Completed)
+                    {
+                        LOGE(nameof(CAN::BusMaster), "Failed to set wheel circumference to %u: the bike %s.", circumference, result.result == ConfigTransactions::TimedOut ? "did not answer" : "rejected it");
+                        return;
+                    }
 
-            if (err != ESP_OK)
+                    LOGI(nameof(CAN::BusMaster), "Wheel circumference set to %u.", circumference);
+                    Data::PersistentData::TargetWheelCircumference = circumference;
+                    _savePersistentData = true;
+                });
+
+            if (handle == 0)
             {
-                LOGE(nameof(CAN::BusMaster), "Failed to set wheel circumference: %i", err);
-                return err;
+                LOGE(nameof(CAN::BusMaster), "Failed to set wheel circumference: too many configuration requests waiting.");
+                return ESP_ERR_NO_MEM;
             }
-
-            Data::PersistentData::TargetWheelCircumference = circumference;
             return ESP_OK;
         }
     };
 };
+
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_framesRelayed[2] =
+{
+    { "can_frames_relayed_total", "Frames received on the bus and relayed to the other bus.", "bus=\"1\"" },
+    { "can_frames_relayed_total", "Frames received on the bus and relayed to the other bus.", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_receiveTimeouts[2] =
+{
+    { "can_receive_timeouts_total", "Receive waits that timed out without a frame.", "bus=\"1\"" },
+    { "can_receive_timeouts_total", "Receive waits that timed out without a frame.", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_relayFailures[2] =
+{
+    { "can_relay_failures_total", "Frames received on the bus that could not be sent to the other bus.", "bus=\"1\"" },
+    { "can_relay_failures_total", "Frames received on the bus that could not be sent to the other bus.", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Histogram<8> ReadieFur::OpenTCU::CAN::BusMaster::_relayLatency[2] =
+{
+    { "can_relay_latency_us", "Time from a frame being received to it being queued on the other bus.", { 25, 50, 100, 200, 500, 1000, 5000, 20000 }, "bus=\"1\"" },
+    { "can_relay_latency_us", "Time from a frame being received to it being queued on the other bus.", { 25, 50, 100, 200, 500, 1000, 5000, 20000 }, "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_busStateGauge[2] =
+{
+    { "can_bus_state", "0 error active, 1 error passive, 2 bus-off, 3 recovering.", "bus=\"1\"" },
+    { "can_bus_state", "0 error active, 1 error passive, 2 bus-off, 3 recovering.", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_txErrorCounterGauge[2] =
+{
+    { "can_tx_error_counter", "Controller transmit error counter (TEC).", "bus=\"1\"" },
+    { "can_tx_error_counter", "Controller transmit error counter (TEC).", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_rxErrorCounterGauge[2] =
+{
+    { "can_rx_error_counter", "Controller receive error counter (REC).", "bus=\"1\"" },
+    { "can_rx_error_counter", "Controller receive error counter (REC).", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_relayStalls[2] =
+{
+    { "can_relay_stalls_total", "Gaps in relay progress caught by the relay watchdog.", "bus=\"1\"" },
+    { "can_relay_stalls_total", "Gaps in relay progress caught by the relay watchdog.", "bus=\"2\"" }
+};
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_framesOverdue = { "can_frames_overdue_total", "Periodic IDs that went missing for several of their learned periods." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_periodDrifts = { "can_period_drifts_total", "Periodic IDs whose average period drifted from the learned one." };
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_periodHealth = { "can_period_health", "Bitmap of the periodic IDs that are arriving at their learned rate." };
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_idleGauge = { "can_idle", "1 while the bike is off and the relay is idle." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_idleEntries = { "can_idle_entries_total", "Times the relay went idle after losing live data." };
+ReadieFur::OpenTCU::Metrics::Histogram<8> ReadieFur::OpenTCU::CAN::BusMaster::_wakeLatency = { "can_wake_latency_us", "Time from the bus activity that woke a sleeping controller to the first frame received.", { 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 } };
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_bootToFirstRelay = { "boot_first_relayed_us", "Time from boot to the first relayed frame, 0 until a frame has been relayed." };
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::BusMaster::_heapAllocationsAfterBoot = { "heap_allocations_after_boot", "Heap allocations since startup settled, should stay at 0." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_configRequests = { "can_config_requests_total", "Configuration reads and writes sent to the motor, not counting retries." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_configRetries = { "can_config_retries_total", "Configuration requests sent again after going unanswered." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_configFailures = { "can_config_failures_total", "Configuration requests that timed out or were rejected." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_configFramesDropped = { "can_config_frames_dropped_total", "Configuration frames relayed but not seen by the transaction engine because its queue was full." };
+ReadieFur::OpenTCU::Metrics::Histogram<8> ReadieFur::OpenTCU::CAN::BusMaster::_roundTripLatency[4] =
+{
+    { "can_config_round_trip_us", "Configuration requests from the display to the motor's response, split by leg.", { 50, 100, 250, 1000, 5000, 20000, 100000, 500000 }, "leg=\"request_relay\"" },
+    { "can_config_round_trip_us", "Configuration requests from the display to the motor's response, split by leg.", { 50, 100, 250, 1000, 5000, 20000, 100000, 500000 }, "leg=\"device\"" },
+    { "can_config_round_trip_us", "Configuration requests from the display to the motor's response, split by leg.", { 50, 100, 250, 1000, 5000, 20000, 100000, 500000 }, "leg=\"response_relay\"" },
+    { "can_config_round_trip_us", "Configuration requests from the display to the motor's response, split by leg.", { 50, 100, 250, 1000, 5000, 20000, 100000, 500000 }, "leg=\"total\"" }
+};
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::BusMaster::_roundTripFramesDropped = { "can_round_trip_frames_dropped_total", "Configuration frames relayed but not matched into round trips because their queue was full." };
@@ -0,0 +1,402 @@
+#pragma once
+
+//Streaming compression of the CAN capture, written in blocks of at most BLOCK_SIZE bytes with a fixed amount of state on either side.
+//Each ID gets a one byte token the first time it is seen, after which a frame is its token, the time since the previous frame and only the payload bytes that changed since the last frame with that ID.
+//The ID dictionary carries over between blocks and is reset every RESET_BLOCKS blocks, a decoder that misses a block skips ahead to the next reset.
+//Block: { uint16 sequence, uint8 flags, uint32 timestamp of the first frame } followed by the frames:
+//- uint8 token: bits 0-5 dictionary slot (NEW_SLOT for an ID that isn't in the dictionary), bit 6 bus, bit 7 the length or remote flag changed.
+//- varint zigzag time since the previous frame in ms.
+//- New ID: varint (id << 1 | extended), uint8 (length | remote << 4), data[length].
+//- Known ID with the same length: uint8 mask of the bytes that changed, followed by those bytes.
+//- Known ID with a different length: uint8 (length | remote << 4), data[length].
+//Blocks are written to the text transports as base64.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class CaptureCodec
+    {
+    public:
+        static const size_t BLOCK_SIZE = 256;
+        static const size_t HEADER_SIZE = 7;
+        static const size_t MAX_FRAME_SIZE = 20; //Token, 5 byte time, 5 byte ID, layout and 8 data bytes.
+        static const size_t RESET_BLOCKS = 8;
+        static const size_t MAX_SLOTS = 63;
+        static const uint8_t NEW_SLOT = 63;
+        static const size_t ID_COUNT = 2048;
+        static const uint8_t FLAG_RESET = 0x01;
+        static const size_t BASE64_BLOCK_SIZE = (BLOCK_SIZE + 2) / 3 * 4;
+
+    protected:
+        struct SEntry
+        {
+            uint32_t id;
+            uint8_t layout; //length | remote << 4
+            uint8_t data[8];
+        };
+
+        SEntry _entries[MAX_SLOTS];
+        size_t _count = 0;
+
+        static inline uint8_t Layout(const SCanMessage& message)
+        {
+            return (message.length > 8 ? 8 : message.length) | (message.isRemote ? 0x10 : 0);
+        }
+
+        static inline uint32_t ZigZag(int32_t value)
+        {
+            return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        }
+
+        static inline int32_t UnZigZag(uint32_t value)
+        {
+            return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+
+        static inline bool IsDictionaryId(const SCanMessage& message)
+        {
+            return !message.isExtended && message.id < ID_COUNT;
+        }
+
+    public:
+        static size_t Base64Encode(const uint8_t* data, size_t length, char* outText)
+        {
+            static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            size_t written = 0;
+            for (size_t i = 0; i < length; i += 3)
+            {
+                uint32_t triple = data[i] << 16 | (i + 1 < length ? data[i + 1] << 8 : 0) | (i + 2 < length ? data[i + 2] : 0);
+                outText[written++] = ALPHABET[(triple >> 18) & 0x3F];
+                outText[written++] = ALPHABET[(triple >> 12) & 0x3F];
+                outText[written++] = i + 1 < length ? ALPHABET[(triple >> 6) & 0x3F] : '=';
+                outText[written++] = i + 2 < length ? ALPHABET[triple & 0x3F] : '=';
+            }
+            return written;
+        }
+
+        //Returns the decoded length, or 0 if the text isn't valid base64 or doesn't fit.
+        static size_t Base64Decode(const char* text, size_t length, uint8_t* outData, size_t maxLength)
+        {
+            size_t written = 0;
+            uint32_t bits = 0;
+            int count = 0;
+            for (size_t i = 0; i < length && text[i] != '='; i++)
+            {
+                char c = text[i];
+                uint32_t value;
+                if (c >= 'A' && c <= 'Z') value = c - 'A';
+                else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') value = c - '0' + 52;
+                else if (c == '+') value = 62;
+                else if (c == '/') value = 63;
+                else return 0;
+
+                bits = bits << 6 | value;
+                if (++count == 4)
+                {
+                    if (written + 3 > maxLength)
+                        return 0;
+                    outData[written++] = bits >> 16;
+                    outData[written++] = bits >> 8;
+                    outData[written++] = bits;
+                    bits = 0;
+                    count = 0;
+                }
+            }
+            if (count == 1 || (count > 1 && written + count - 1 > maxLength))
+                return 0;
+            if (count >= 2)
+                outData[written++] = bits >> (count == 2 ? 4 : 10);
+            if (count == 3)
+                outData[written++] = bits >> 2;
+            return written;
+        }
+    };
+
+    class CaptureEncoder : public CaptureCodec
+    {
+    private:
+        static const uint8_t NO_SLOT = 0xFF;
+
+        uint8_t _slots[ID_COUNT];
+        uint8_t _block[BLOCK_SIZE];
+        size_t _length = 0;
+        uint16_t _sequence = 0;
+        size_t _blocksSinceReset = 0;
+        uint32_t _lastTimestamp = 0;
+
+        inline void PutVarint(uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                _block[_length++] = (uint8_t)(value | 0x80);
+                value >>= 7;
+            }
+            _block[_length++] = (uint8_t)value;
+        }
+
+        inline void PutPayload(const SCanMessage& message, uint8_t layout)
+        {
+            _block[_length++] = layout;
+            memcpy(_block + _length, message.data, layout & 0x0F);
+            _length += layout & 0x0F;
+        }
+
+        void ClearDictionary()
+        {
+            for (size_t i = 0; i < _count; i++)
+                _slots[_entries[i].id] = NO_SLOT;
+            _count = 0;
+        }
+
+        void BeginBlock(uint32_t timestamp)
+        {
+            bool reset = _blocksSinceReset == 0;
+            if (reset)
+                ClearDictionary();
+            _blocksSinceReset = (_blocksSinceReset + 1) % RESET_BLOCKS;
+
+            _block[0] = _sequence;
+            _block[1] = _sequence >> 8;
+            _block[2] = reset ? FLAG_RESET : 0;
+            memcpy(_block + 3, &timestamp, sizeof(timestamp)); //Little endian on both the target and the host.
+            _length = HEADER_SIZE;
+            _sequence++;
+            _lastTimestamp = timestamp;
+        }
+
+    public:
+        CaptureEncoder()
+        {
+            memset(_slots, NO_SLOT, sizeof(_slots));
+        }
+
+        //Starts the next block with an empty dictionary, e.g. after the output was interrupted. Drops the open block.
+        void Reset()
+        {
+            _length = 0;
+            _blocksSinceReset = 0;
+        }
+
+        //Returns false if the block is full, Seal it and append the frame again.
+        bool Append(uint8_t bus, const SCanMessage& message, uint32_t timestamp)
+        {
+            if (_length == 0)
+                BeginBlock(timestamp);
+            else if (_length + MAX_FRAME_SIZE > BLOCK_SIZE)
+                return false;
+
+            size_t tokenAt = _length++;
+            uint8_t token = bus ? 0x40 : 0;
+            PutVarint(ZigZag((int32_t)(timestamp - _lastTimestamp)));
+            _lastTimestamp = timestamp;
+
+            uint8_t layout = Layout(message);
+            uint8_t slot = IsDictionaryId(message) ? _slots[message.id] : NO_SLOT;
+            if (slot == NO_SLOT)
+            {
+                token |= NEW_SLOT;
+                PutVarint(message.id << 1 | message.isExtended);
+                PutPayload(message, layout);
+                if (IsDictionaryId(message) && _count < MAX_SLOTS)
+                {
+                    SEntry& entry = _entries[_count];
+                    entry.id = message.id;
+                    entry.layout = layout;
+                    memcpy(entry.data, message.data, layout & 0x0F);
+                    _slots[message.id] = _count++;
+                }
+            }
+            else
+            {
+                token |= slot;
+                SEntry& entry = _entries[slot];
+                if (entry.layout != layout)
+                {
+                    token |= 0x80;
+                    PutPayload(message, layout);
+                    entry.layout = layout;
+                }
+                else
+                {
+                    size_t maskAt = _length++;
+                    uint8_t mask = 0;
+                    for (size_t i = 0; i < (layout & 0x0F); i++)
+                    {
+                        if (message.data[i] == entry.data[i])
+                            continue;
+                        mask |= 1 << i;
+                        _block[_length++] = message.data[i];
+                    }
+                    _block[maskAt] = mask;
+                }
+                memcpy(entry.data, message.data, layout & 0x0F);
+            }
+
+            _block[tokenAt] = token;
+            return true;
+        }
+
+        bool IsEmpty() const
+        {
+            return _length == 0;
+        }
+
+        //Closes the open block and returns its length (0 if no frames were appended), the block stays readable from GetBlock until the next Append.
+        size_t Seal()
+        {
+            size_t length = _length;
+            _length = 0;
+            return length;
+        }
+
+        const uint8_t* GetBlock() const
+        {
+            return _block;
+        }
+    };
+
+    enum ECaptureBlockResult : uint8_t
+    {
+        BlockDecoded = 0,
+        BlockSkipped = 1, //A previous block was lost, waiting for the next reset.
+        BlockCorrupt = 2,
+    };
+
+    class CaptureDecoder : public CaptureCodec
+    {
+    private:
+        uint16_t _nextSequence = 0;
+        bool _synchronised = false;
+
+        //Bounds checked cursor over a block.
+        struct SReader
+        {
+            const uint8_t* data;
+            size_t length;
+            size_t position;
+            bool failed;
+
+            uint8_t Byte()
+            {
+                if (position >= length)
+                {
+                    failed = true;
+                    return 0;
+                }
+                return data[position++];
+            }
+
+            uint32_t Varint()
+            {
+                uint32_t value = 0;
+                for (int shift = 0; shift < 35; shift += 7)
+                {
+                    uint8_t byte = Byte();
+                    value |= (uint32_t)(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                        return value;
+                }
+                failed = true;
+                return 0;
+            }
+
+            void Payload(SCanMessage& message, uint8_t layout)
+            {
+                message.length = layout & 0x0F;
+                message.isRemote = layout & 0x10;
+                if (message.length > 8)
+                    failed = true;
+                for (size_t i = 0; i < message.length && !failed; i++)
+                    message.data[i] = Byte();
+            }
+        };
+
+    public:
+        //Calls onFrame(uint8_t bus, const SCanMessage& message, uint32_t timestamp) for every frame in the block, in the order they were appended.
+        template <typename F>
+        ECaptureBlockResult Decode(const uint8_t* block, size_t length, F&& onFrame)
+        {
+            if (length < HEADER_SIZE || length > BLOCK_SIZE)
+                return BlockCorrupt;
+
+            uint16_t sequence = block[0] | block[1] << 8;
+            bool reset = block[2] & FLAG_RESET;
+            if (reset)
+            {
+                _count = 0;
+                _synchronised = true;
+            }
+            else if (!_synchronised || sequence != _nextSequence)
+            {
+                _synchronised = false;
+                return BlockSkipped;
+            }
+            _nextSequence = sequence + 1;
+
+            uint32_t timestamp;
+            memcpy(&timestamp, block + 3, sizeof(timestamp));
+            SReader in = { block, length, HEADER_SIZE, false };
+            while (in.position < length)
+            {
+                uint8_t token = in.Byte();
+                timestamp += UnZigZag(in.Varint());
+
+                SCanMessage message = {};
+                uint8_t slot = token & 0x3F;
+                if (slot == NEW_SLOT)
+                {
+                    uint32_t id = in.Varint();
+                    message.id = id >> 1;
+                    message.isExtended = id & 1;
+                    in.Payload(message, in.Byte());
+                    if (!in.failed && IsDictionaryId(message) && _count < MAX_SLOTS)
+                    {
+                        SEntry& entry = _entries[_count++];
+                        entry.id = message.id;
+                        entry.layout = Layout(message);
+                        memcpy(entry.data, message.data, sizeof(entry.data));
+                    }
+                }
+                else
+                {
+                    if (slot >= _count)
+                    {
+                        _synchronised = false;
+                        return BlockCorrupt;
+                    }
+
+                    SEntry& entry = _entries[slot];
+                    message.id = entry.id;
+                    if (token & 0x80)
+                    {
+                        in.Payload(message, in.Byte());
+                        entry.layout = Layout(message);
+                    }
+                    else
+                    {
+                        message.length = entry.layout & 0x0F;
+                        message.isRemote = entry.layout & 0x10;
+                        uint8_t mask = in.Byte();
+                        for (size_t i = 0; i < message.length; i++)
+                            message.data[i] = mask & (1 << i) ? in.Byte() : entry.data[i];
+                    }
+                    memcpy(entry.data, message.data, sizeof(entry.data));
+                }
+
+                if (in.failed)
+                {
+                    _synchronised = false;
+                    return BlockCorrupt;
+                }
+                onFrame((uint8_t)((token >> 6) & 1), message, timestamp);
+            }
+            return BlockDecoded;
+        }
+    };
+};
@@ -0,0 +1,488 @@
+#pragma once
+
+//Request/response transactions for the configuration data on 0x100 (requests) and 0x101 (responses), see Documentation/Data.md.
+//The frames are ISO-TP framed UDS: a read (0x22) or write (0x2E) of a data identifier (DID, 0x02xx) answered with the service + 0x40, or 0x7F if it was refused.
+//Only one request is on the bus at a time as the consecutive frames of a long response don't carry the DID, the rest wait in order behind it.
+//That includes the display's: ours are held while one of its requests is waiting for an answer, or until DISPLAY_TIMEOUT_MS after the last frame it sent.
+//A request that isn't answered within RESPONSE_TIMEOUT_MS is sent again, up to MAX_ATTEMPTS times before it fails.
+//Every response is cached, including the ones to requests made by the display, so that the values can be read from RAM instead of asking the bike again.
+//Times are in milliseconds on whatever clock the caller uses, the caller sends whatever Poll returns and takes the results with TakeCompleted.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class ConfigTransactions
+    {
+    public:
+        static const uint32_t REQUEST_ID = 0x100;
+        static const uint32_t RESPONSE_ID = 0x101;
+        static const uint8_t SERVICE_READ = 0x22;
+        static const uint8_t SERVICE_WRITE = 0x2E;
+        static const uint16_t DID_BASE = 0x0200; //Combined with an EStringType for the strings.
+        static const uint16_t DID_WHEEL_CIRCUMFERENCE = 0x0206;
+
+        static const size_t MAX_QUEUED = 8;
+        static const size_t MAX_PAYLOAD = 4; //Requests are single frames, 7 bytes less the service and DID.
+        static const size_t MAX_DATA = 24; //The longest response seen, the motor serial number (23 characters and a null).
+        static const size_t MAX_CACHED = 16; //The display reads 10 values when it starts.
+        static const size_t MAX_COMPLETED = 8;
+        static const uint32_t RESPONSE_TIMEOUT_MS = 250;
+        static const uint32_t DISPLAY_TIMEOUT_MS = RESPONSE_TIMEOUT_MS; //A request from the display that goes unanswered holds ours for this long.
+        static const uint32_t MAX_ATTEMPTS = 3;
+        static const uint32_t CACHE_TTL_MS = 600000; //The values only change when they are written, which invalidates them.
+
+        enum EResult
+        {
+            Completed,
+            Rejected, //Negative response, data[0] is the reason code.
+            TimedOut,
+            Observed //A response to a request that wasn't ours (handle 0).
+        };
+
+        enum ECacheState
+        {
+            CacheMissing,
+            CacheStale,
+            CacheFresh
+        };
+
+        struct SResult
+        {
+            uint32_t handle;
+            EResult result;
+            uint8_t service; //Of the request.
+            uint16_t did;
+            uint8_t length;
+            uint8_t data[MAX_DATA];
+        };
+
+        struct SStats
+        {
+            uint32_t requests;
+            uint32_t retries;
+            uint32_t timeouts;
+            uint32_t rejected;
+            uint32_t observed;
+            uint32_t dropped; //Results discarded because nobody took them in time.
+        };
+
+    private:
+        static const uint8_t NEGATIVE_RESPONSE = 0x7F;
+        static const uint8_t RESPONSE_PENDING = 0x78; //Negative response reason code meaning the answer is coming later.
+        static const uint8_t POSITIVE_RESPONSE_OFFSET = 0x40;
+
+        struct SRequest
+        {
+            uint32_t handle;
+            uint8_t service;
+            uint16_t did;
+            uint8_t length;
+            uint8_t payload[MAX_PAYLOAD];
+        };
+
+        struct SCacheEntry
+        {
+            bool valid;
+            uint16_t did;
+            uint8_t length;
+            uint8_t data[MAX_DATA];
+            uint32_t updatedAt;
+        };
+
+        SRequest _queue[MAX_QUEUED]; //Ring buffer, the head is the request on the bus while _inFlight is set.
+        size_t _queueHead = 0;
+        size_t _queueCount = 0;
+        uint32_t _nextHandle = 1;
+        bool _inFlight = false;
+        uint32_t _attempts = 0;
+        uint32_t _sentAt = 0;
+
+        //Reassembly of a multi-frame response.
+        bool _receiving = false;
+        uint8_t _rxService = 0;
+        uint16_t _rxDid = 0;
+        uint8_t _rxData[MAX_DATA];
+        size_t _rxLength = 0;
+        size_t _rxExpected = 0;
+        uint8_t _rxSequence = 0;
+        bool _flowControlPending = false;
+
+        //A request from the display that hasn't been answered yet.
+        bool _displayPending = false;
+        uint32_t _displayActiveAt = 0;
+
+        SCacheEntry _cache[MAX_CACHED] = {};
+        SResult _completed[MAX_COMPLETED]; //Ring buffer.
+        size_t _completedHead = 0;
+        size_t _completedCount = 0;
+        SStats _stats = {};
+
+        inline SRequest& Head()
+        {
+            return _queue[_queueHead];
+        }
+
+        void PopHead()
+        {
+            _queueHead = (_queueHead + 1) % MAX_QUEUED;
+            _queueCount--;
+            _inFlight = false;
+            _receiving = false;
+            _flowControlPending = false;
+        }
+
+        void PushResult(uint32_t handle, EResult result, uint8_t service, uint16_t did, const uint8_t* data, size_t length)
+        {
+            if (_completedCount >= MAX_COMPLETED)
+            {
+                _stats.dropped++;
+                return;
+            }
+            SResult& entry = _completed[(_completedHead + _completedCount++) % MAX_COMPLETED];
+            entry.handle = handle;
+            entry.result = result;
+            entry.service = service;
+            entry.did = did;
+            entry.length = length > MAX_DATA ? MAX_DATA : length;
+            memcpy(entry.data, data, entry.length);
+        }
+
+        SCacheEntry* FindCache(uint16_t did)
+        {
+            for (auto&& entry : _cache)
+                if (entry.valid && entry.did == did)
+                    return &entry;
+            return nullptr;
+        }
+
+        void Store(uint16_t did, const uint8_t* data, size_t length, uint32_t now)
+        {
+            SCacheEntry* entry = FindCache(did);
+            if (entry == nullptr)
+            {
+                //Replace the oldest entry once full, there are fewer DIDs in use than entries so this shouldn't happen.
+                entry = &_cache[0];
+                for (auto&& candidate : _cache)
+                {
+                    if (!candidate.valid)
+                    {
+                        entry = &candidate;
+                        break;
+                    }
+                    if ((int32_t)(candidate.updatedAt - entry->updatedAt) < 0)
+                        entry = &candidate;
+                }
+            }
+            entry->valid = true;
+            entry->did = did;
+            entry->length = length > MAX_DATA ? MAX_DATA : length;
+            memcpy(entry->data, data, entry->length);
+            entry->updatedAt = now;
+        }
+
+        void Invalidate(uint16_t did)
+        {
+            SCacheEntry* entry = FindCache(did);
+            if (entry != nullptr)
+                entry->valid = false;
+        }
+
+        inline bool IsOurs(uint8_t service, uint16_t did)
+        {
+            return _inFlight && Head().service == service && Head().did == did;
+        }
+
+        //A whole positive response has arrived.
+        void Complete(uint8_t responseService, uint16_t did, const uint8_t* data, size_t length, uint32_t now)
+        {
+            uint8_t service = responseService - POSITIVE_RESPONSE_OFFSET;
+            bool ours = IsOurs(service, did);
+
+            if (service == SERVICE_READ)
+                Store(did, data, length, now);
+            else if (service == SERVICE_WRITE && ours)
+                Store(did, Head().payload, Head().length, now);
+            else if (service == SERVICE_WRITE)
+                Invalidate(did); //Written by the display, the value isn't in the response.
+
+            if (ours)
+            {
+                PushResult(Head().handle, Completed, service, did, data, length);
+                PopHead();
+            }
+            else
+            {
+                _displayPending = false;
+                _stats.observed++;
+                PushResult(0, Observed, service, did, data, length);
+            }
+        }
+
+        void ReceiveResponse(const SCanMessage& message, uint32_t now)
+        {
+            if (message.length < 2)
+                return;
+
+            switch (message.data[0] >> 4)
+            {
+            case 0x0:
+            {
+                //Single frame.
+                size_t length = message.data[0] & 0x0F;
+                if (length > (size_t)message.length - 1)
+                    length = message.length - 1;
+
+                if (message.data[1] == NEGATIVE_RESPONSE && length >= 3)
+                {
+                    //The DID isn't repeated, so match on the service alone.
+                    if (!_inFlight || Head().service != message.data[2])
+                    {
+                        //The display's request was refused, or is answered later.
+                        if (message.data[3] == RESPONSE_PENDING)
+                            _displayActiveAt = now;
+                        else
+                            _displayPending = false;
+                        break;
+                    }
+                    if (message.data[3] == RESPONSE_PENDING)
+                    {
+                        _sentAt = now;
+                        break;
+                    }
+                    _stats.rejected++;
+                    PushResult(Head().handle, Rejected, Head().service, Head().did, &message.data[3], 1);
+                    PopHead();
+                }
+                else if (length >= 3 && message.data[1] >= POSITIVE_RESPONSE_OFFSET)
+                {
+                    Complete(message.data[1], message.data[2] << 8 | message.data[3], &message.data[4], length - 3, now);
+                }
+                break;
+            }
+            case 0x1:
+            {
+                //First frame of a longer response, the length counts the service and DID.
+                if (message.length < 8)
+                    break;
+                size_t length = (message.data[0] & 0x0F) << 8 | message.data[1];
+                if (length < 3)
+                    break;
+                _receiving = true;
+                _rxService = message.data[2];
+                _rxDid = message.data[3] << 8 | message.data[4];
+                _rxExpected = length - 3;
+                _rxLength = 0;
+                _rxSequence = 1;
+                for (size_t i = 5; i < 8 && _rxLength < _rxExpected; i++)
+                    if (_rxLength < MAX_DATA)
+                        _rxData[_rxLength++] = message.data[i];
+                    else
+                        _rxExpected--; //Longer than anything seen so far, keep what fits.
+                //The display asks for the rest of its own responses, only ours need a flow control frame.
+                _flowControlPending = IsOurs(_rxService - POSITIVE_RESPONSE_OFFSET, _rxDid);
+                if (_rxLength >= _rxExpected)
+                {
+                    _receiving = false;
+                    Complete(_rxService, _rxDid, _rxData, _rxLength, now);
+                }
+                break;
+            }
+            case 0x2:
+            {
+                //Consecutive frame, the sequence number wraps at 16.
+                if (!_receiving || (message.data[0] & 0x0F) != (_rxSequence & 0x0F))
+                {
+                    _receiving = false;
+                    break;
+                }
+                _rxSequence++;
+                for (size_t i = 1; i < message.length && i < 8 && _rxLength < _rxExpected; i++)
+                    if (_rxLength < MAX_DATA)
+                        _rxData[_rxLength++] = message.data[i];
+                    else
+                        _rxExpected--;
+                if (_rxLength >= _rxExpected)
+                {
+                    _receiving = false;
+                    Complete(_rxService, _rxDid, _rxData, _rxLength, now);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        //Single frame padded to 8 bytes, the way the display sends them.
+        static void BuildRequest(const SRequest& request, SCanMessage* outFrame)
+        {
+            *outFrame = { REQUEST_ID, {}, 8, false, false };
+            outFrame->data[0] = 3 + request.length;
+            outFrame->data[1] = request.service;
+            outFrame->data[2] = request.did >> 8;
+            outFrame->data[3] = request.did & 0xFF;
+            memcpy(&outFrame->data[4], request.payload, request.length);
+        }
+
+        void ReceiveRequest(const SCanMessage& message, uint32_t now)
+        {
+            //A request, or flow control for the rest of a response, the display's exchange is open until the response is complete.
+            _displayPending = true;
+            _displayActiveAt = now;
+
+            //Only writes from the display change the cache, the cached value is dropped until it has been read back.
+            if (message.length >= 4
+                && (message.data[0] >> 4) == 0x0
+                && message.data[1] == SERVICE_WRITE)
+                Invalidate(message.data[2] << 8 | message.data[3]);
+        }
+
+    public:
+        //Returns the handle that the result will carry, or 0 if the queue is full or the payload is too long.
+        uint32_t Queue(uint8_t service, uint16_t did, const uint8_t* payload, size_t length)
+        {
+            if (_queueCount >= MAX_QUEUED || length > MAX_PAYLOAD)
+                return 0;
+
+            SRequest& request = _queue[(_queueHead + _queueCount++) % MAX_QUEUED];
+            request.handle = _nextHandle++;
+            if (_nextHandle == 0)
+                _nextHandle = 1;
+            request.service = service;
+            request.did = did;
+            request.length = length;
+            if (length > 0)
+                memcpy(request.payload, payload, length);
+            return request.handle;
+        }
+
+        //True if a request for the service and DID is waiting or on the bus.
+        bool IsQueued(uint8_t service, uint16_t did) const
+        {
+            for (size_t i = 0; i < _queueCount; i++)
+            {
+                const SRequest& request = _queue[(_queueHead + i) % MAX_QUEUED];
+                if (request.service == service && request.did == did)
+                    return true;
+            }
+            return false;
+        }
+
+        //Drops the request without a result, a response that still arrives is treated as observed.
+        bool Cancel(uint32_t handle)
+        {
+            for (size_t i = 0; i < _queueCount; i++)
+            {
+                if (_queue[(_queueHead + i) % MAX_QUEUED].handle != handle)
+                    continue;
+                if (i == 0)
+                {
+                    PopHead();
+                    return true;
+                }
+                for (size_t j = i; j + 1 < _queueCount; j++)
+                    _queue[(_queueHead + j) % MAX_QUEUED] = _queue[(_queueHead + j + 1) % MAX_QUEUED];
+                _queueCount--;
+                return true;
+            }
+            return false;
+        }
+
+        //Feeds a frame seen on REQUEST_ID or RESPONSE_ID, anything else is ignored.
+        void Receive(const SCanMessage& message, uint32_t now)
+        {
+            if (message.isExtended || message.isRemote)
+                return;
+            if (message.id == RESPONSE_ID)
+                ReceiveResponse(message, now);
+            else if (message.id == REQUEST_ID)
+                ReceiveRequest(message, now);
+        }
+
+        //Returns true with a frame that has to be sent on REQUEST_ID now, call again until it returns false.
+        bool Poll(uint32_t now, SCanMessage* outFrame)
+        {
+            if (_flowControlPending)
+            {
+                _flowControlPending = false;
+                *outFrame = { REQUEST_ID, { 0x30, 0x00, 0x00 }, 3, false, false };
+                return true;
+            }
+
+            bool displayPending = IsDisplayPending(now);
+            if (_inFlight && now - _sentAt >= RESPONSE_TIMEOUT_MS)
+            {
+                if (_attempts < MAX_ATTEMPTS)
+                {
+                    if (displayPending)
+                        return false;
+                    _stats.retries++;
+                    _attempts++;
+                    _receiving = false;
+                    _sentAt = now;
+                    BuildRequest(Head(), outFrame);
+                    return true;
+                }
+                _stats.timeouts++;
+                PushResult(Head().handle, TimedOut, Head().service, Head().did, Head().payload, 0);
+                PopHead();
+            }
+
+            if (_inFlight || _queueCount == 0 || displayPending)
+                return false;
+
+            _stats.requests++;
+            _inFlight = true;
+            _attempts = 1;
+            _sentAt = now;
+            BuildRequest(Head(), outFrame);
+            return true;
+        }
+
+        //True while a request from the display is waiting for its answer, Poll holds ours until then.
+        bool IsDisplayPending(uint32_t now) const
+        {
+            return _displayPending && now - _displayActiveAt < DISPLAY_TIMEOUT_MS;
+        }
+
+        //Takes the oldest result, false once there are none.
+        bool TakeCompleted(SResult* outResult)
+        {
+            if (_completedCount == 0)
+                return false;
+            *outResult = _completed[_completedHead];
+            _completedHead = (_completedHead + 1) % MAX_COMPLETED;
+            _completedCount--;
+            return true;
+        }
+
+        //Copies the last value seen for the DID, a stale value is still copied so that it can be shown while it is refreshed.
+        ECacheState GetCached(uint16_t did, uint32_t now, uint8_t* outData, uint8_t* outLength)
+        {
+            SCacheEntry* entry = FindCache(did);
+            if (entry == nullptr)
+            {
+                *outLength = 0;
+                return CacheMissing;
+            }
+            memcpy(outData, entry->data, entry->length);
+            *outLength = entry->length;
+            return now - entry->updatedAt < CACHE_TTL_MS ? CacheFresh : CacheStale;
+        }
+
+        size_t GetQueuedCount() const
+        {
+            return _queueCount;
+        }
+
+        const SStats& GetStats() const
+        {
+            return _stats;
+        }
+    };
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+//Change-only capture: a frame is only logged when its payload differs from the last one logged for its ID.
+//Identical frames are counted instead and reported as a single repeat (count and time span) when the ID changes, on the next keyframe or once the ID goes quiet.
+//Every ID is logged in full at least once per KEYFRAME_INTERVAL so that a capture joined part way through, or with lost lines, resynchronises.
+//The host expands the repeats back into frames (see Tools/Common/Recording.hpp), payloads and counts are exact, the timestamps of the repeated frames are spread evenly over their span.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class DeltaFilter
+    {
+    public:
+        static const size_t ID_COUNT = 2048;
+        static const size_t MAX_TRACKED_IDS = 128; //IDs past this, and extended IDs, are always logged.
+        static const uint32_t KEYFRAME_INTERVAL = 1000; //ms
+
+        //The previously logged frame for the ID was seen count more times between firstTimestamp and lastTimestamp.
+        struct SRepeat
+        {
+            uint32_t id;
+            uint8_t bus;
+            uint32_t count;
+            uint32_t firstTimestamp;
+            uint32_t lastTimestamp;
+        };
+
+    private:
+        static const uint8_t NO_SLOT = 0xFF;
+        static_assert(MAX_TRACKED_IDS < NO_SLOT, "Slots are indexed by a single byte.");
+
+        struct SEntry
+        {
+            uint32_t id;
+            uint8_t bus;
+            uint8_t length;
+            bool isRemote;
+            uint8_t data[8];
+            uint32_t loggedAt;
+            uint32_t count; //Suppressed since the last logged frame.
+            uint32_t firstTimestamp;
+            uint32_t lastTimestamp;
+        };
+
+        uint8_t _slots[ID_COUNT];
+        SEntry _entries[MAX_TRACKED_IDS];
+        size_t _tracked = 0;
+
+        static inline bool IsSame(const SEntry& entry, uint8_t bus, const SCanMessage& message)
+        {
+            return entry.bus == bus
+                && entry.length == message.length
+                && entry.isRemote == message.isRemote
+                && memcmp(entry.data, message.data, message.length > 8 ? 8 : message.length) == 0;
+        }
+
+        static inline void TakeRepeat(SEntry& entry, SRepeat* outRepeat)
+        {
+            outRepeat->id = entry.id;
+            outRepeat->bus = entry.bus;
+            outRepeat->count = entry.count;
+            outRepeat->firstTimestamp = entry.firstTimestamp;
+            outRepeat->lastTimestamp = entry.lastTimestamp;
+            entry.count = 0;
+        }
+
+    public:
+        DeltaFilter()
+        {
+            Clear();
+        }
+
+        //Forgets every ID, any pending repeats are dropped so Flush first to keep them.
+        void Clear()
+        {
+            memset(_slots, NO_SLOT, sizeof(_slots));
+            _tracked = 0;
+        }
+
+        /**
+         * Returns true if the frame should be logged, false if it was counted as a repeat of the last logged one.
+         * When the frame is logged after identical ones were suppressed, outRepeat is filled in and outHasRepeat is set, the repeat must be logged before the frame.
+         */
+        bool Filter(uint8_t bus, const SCanMessage& message, uint32_t timestamp, SRepeat* outRepeat, bool* outHasRepeat)
+        {
+            *outHasRepeat = false;
+            if (message.isExtended || message.id >= ID_COUNT)
+                return true;
+
+            uint8_t slot = _slots[message.id];
+            if (slot == NO_SLOT)
+            {
+                if (_tracked >= MAX_TRACKED_IDS)
+                    return true;
+                slot = _slots[message.id] = _tracked++;
+                _entries[slot].id = message.id;
+                _entries[slot].count = 0;
+            }
+            else
+            {
+                SEntry& entry = _entries[slot];
+                if (IsSame(entry, bus, message) && timestamp - entry.loggedAt < KEYFRAME_INTERVAL)
+                {
+                    if (entry.count++ == 0)
+                        entry.firstTimestamp = timestamp;
+                    entry.lastTimestamp = timestamp;
+                    return false;
+                }
+
+                if (entry.count > 0)
+                {
+                    TakeRepeat(entry, outRepeat);
+                    *outHasRepeat = true;
+                }
+            }
+
+            SEntry& entry = _entries[slot];
+            entry.bus = bus;
+            entry.length = message.length > 8 ? 8 : message.length;
+            entry.isRemote = message.isRemote;
+            memcpy(entry.data, message.data, entry.length);
+            entry.loggedAt = timestamp;
+            return true;
+        }
+
+        /**
+         * Takes up to maxRepeats of the pending repeats of the IDs that haven't been seen for KEYFRAME_INTERVAL, or every pending repeat if all is set.
+         * Returns the number taken, call again while it equals maxRepeats.
+         */
+        size_t Flush(uint32_t now, SRepeat* outRepeats, size_t maxRepeats, bool all = false)
+        {
+            size_t taken = 0;
+            for (size_t i = 0; i < _tracked && taken < maxRepeats; i++)
+            {
+                SEntry& entry = _entries[i];
+                if (entry.count > 0 && (all || now - entry.lastTimestamp >= KEYFRAME_INTERVAL))
+                    TakeRepeat(entry, &outRepeats[taken++]);
+            }
+            return taken;
+        }
+    };
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Fault confinement state of a controller as defined by the CAN specification.
+    enum ECanBusState : uint8_t
+    {
+        ErrorActive = 0, //Normal operation.
+        ErrorPassive = 1, //TEC or REC has reached 128, the controller still takes part on the bus but can no longer flag errors actively.
+        BusOff = 2, //TEC has passed 255, the controller has disconnected itself from the bus.
+        Recovering = 3, //Bus-off recovery is in progress.
+    };
+};
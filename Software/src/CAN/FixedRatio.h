@@ -0,0 +1,110 @@
+#pragma once
+
+//Fixed-point scaling of 16 bit bus values by a rational factor (e.g. the wheel circumference ratio).
+//Results are identical to the double precision expressions the relay previously used, (uint32_t)(value * ((double)numerator / denominator))
+//and (uint32_t)(value / ((double)numerator / denominator)), but only integer operations are used per value.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <math.h>
+#include "RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    enum EScaleOperation : uint8_t
+    {
+        Multiply = 0, //value * (numerator / denominator)
+        Divide = 1, //value / (numerator / denominator)
+    };
+
+    class FixedRatio
+    {
+    public:
+        static const uint32_t MAX_TERM = 4095; //Keeps every intermediate within 64 bits.
+
+    private:
+        uint32_t _numerator = 1;
+        uint32_t _denominator = 1;
+        //ceil(2^32 * p / q) where p / q is the exact effective ratio, so the integer part of value * _factor / 2^32 is exactly floor(value * p / q).
+        uint64_t _factor = 1ULL << 32;
+        //The double expression rounds the ratio to 53 bits, which can leave a result that should be a whole number just below it (and so truncated one lower).
+        //That relative error is _error / (_errorBase * 2^_errorShift), _error is zero if the rounded ratio never undershoots.
+        uint64_t _error = 0;
+        uint64_t _errorBase = 0;
+        int _errorShift = 0;
+
+        //Whether the double expression produced a value just below the whole number k, i.e. k * (1 - error) rounds below k.
+        bool RELAY_IRAM_ATTR Undershoots(uint32_t k) const
+        {
+            //Half the spacing of doubles just below k is 2^(e - 53), or 2^(e - 54) when k is a power of two.
+            int e = 31 - __builtin_clz(k);
+            int ulpShift = (k & (k - 1)) == 0 ? 54 - e : 53 - e;
+
+            //Compare k * _error * 2^ulpShift against _errorBase * 2^_errorShift with the common power of two removed.
+            uint64_t lhs = (uint64_t)k * _error;
+            uint64_t rhs = _errorBase;
+            if (ulpShift > _errorShift)
+                lhs <<= ulpShift - _errorShift;
+            else
+                rhs <<= _errorShift - ulpShift;
+            return lhs > rhs;
+        }
+
+    public:
+        FixedRatio() {}
+
+        FixedRatio(uint32_t numerator, uint32_t denominator, EScaleOperation operation = Multiply)
+        {
+            if (numerator == 0 || denominator == 0 || numerator > MAX_TERM || denominator > MAX_TERM)
+                return;
+
+            _numerator = numerator;
+            _denominator = denominator;
+            uint32_t p = operation == Multiply ? numerator : denominator;
+            uint32_t q = operation == Multiply ? denominator : numerator;
+            _factor = (((uint64_t)p << 32) + q - 1) / q;
+
+            //Decompose the double ratio into Md * 2^-s with a 53 bit Md, done once here so that the per value path is integer only.
+            int exponent;
+            double mantissa = frexp((double)numerator / denominator, &exponent);
+            uint64_t md = (uint64_t)ldexp(mantissa, 53);
+            int s = 53 - exponent;
+            //The difference is small even though both terms overflow, so wrapping arithmetic gives the exact result.
+            int64_t difference = (int64_t)((s < 64 ? (uint64_t)numerator << s : 0) - md * denominator);
+
+            if (operation == Multiply && difference > 0)
+            {
+                //value * m_d = k * (1 - difference / (numerator * 2^s)).
+                _error = (uint64_t)difference;
+                _errorBase = numerator;
+                _errorShift = s;
+            }
+            else if (operation == Divide && difference < 0)
+            {
+                //value / m_d = k * (1 - R / (Md * denominator)) where Md * denominator = numerator * 2^s + R.
+                //As R < 2^s the + R only matters for exact equality, which a strict comparison against numerator * 2^s already excludes.
+                _error = (uint64_t)-difference;
+                _errorBase = numerator;
+                _errorShift = s;
+            }
+        }
+
+        inline uint32_t RELAY_IRAM_ATTR Apply(uint16_t value) const
+        {
+            uint64_t product = (uint64_t)value * _factor;
+            uint32_t result = (uint32_t)(product >> 32);
+            //The fraction bits are below value only for whole number results, inexact results are at least 2^32 / MAX_TERM (> 0xFFFF) away from a whole number.
+            if ((uint32_t)product < value && _error != 0 && result != 0 && Undershoots(result))
+                result--;
+            return result;
+        }
+
+        inline bool IsIdentity() const
+        {
+            return _numerator == _denominator;
+        }
+
+        uint32_t GetNumerator() const { return _numerator; }
+        uint32_t GetDenominator() const { return _denominator; }
+    };
+};
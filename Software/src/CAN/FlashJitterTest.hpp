@@ -0,0 +1,196 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
+#include <esp_app_format.h>
+#include <Service/AService.hpp>
+#include <string.h>
+#include "BusMaster.hpp"
+#include "Data/PersistentData.hpp"
+#include "Metrics/Metrics.hpp"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Measures relay latency and stalls while the flash is busy, comparing an idle baseline with back to back PersistentData saves and an OTA sized write.
+    //Needs live traffic, either on the bike or from CAN_STRESS_TEST, run it with and without CAN_RELAY_IN_IRAM to compare.
+    //The OTA phase writes to (and leaves invalid) the partition that the next OTA would be written to, the running firmware is not touched.
+    class FlashJitterTest : public Service::AService
+    {
+    private:
+        static const TickType_t PHASE_DURATION = pdMS_TO_TICKS(10000);
+        static const size_t OTA_IMAGE_SIZE = 512 * 1024;
+        static const size_t OTA_CHUNK_SIZE = 4096;
+        static const size_t LATENCY_SERIES = 10; //The 8 bounds of can_relay_latency_us, +Inf and the sum.
+        static const uint32_t LATENCY_LIMIT_US = 1000; //Must be one of the histogram bounds.
+
+        enum EPhase
+        {
+            Baseline,
+            Save,
+            Ota,
+        };
+
+        struct SPhaseSample
+        {
+            uint32_t latency[2][LATENCY_SERIES]; //Histogram series of can_relay_latency_us for each bus.
+            uint32_t stalls;
+        };
+
+        BusMaster* _busMaster = nullptr;
+        Metrics::AMetric* _latency[2] = { nullptr, nullptr };
+
+        static Metrics::AMetric* FindMetric(const char* name, const char* labels)
+        {
+            for (Metrics::AMetric* metric = Metrics::Registry::First(); metric != nullptr; metric = Metrics::Registry::Next(metric))
+                if (strcmp(metric->Name, name) == 0 && strcmp(metric->Labels, labels) == 0)
+                    return metric;
+            return nullptr;
+        }
+
+        void Sample(SPhaseSample* sample)
+        {
+            for (size_t bus = 0; bus < 2; bus++)
+                for (size_t i = 0; i < _latency[bus]->GetSeriesCount() && i < LATENCY_SERIES; i++)
+                    sample->latency[bus][i] = _latency[bus]->GetSeries(i);
+            sample->stalls = _busMaster->GetStallCount();
+        }
+
+        //Loads the flash in the given way for PHASE_DURATION.
+        void Load(EPhase phase)
+        {
+            TickType_t start = xTaskGetTickCount();
+            switch (phase)
+            {
+            case Save:
+                while (xTaskGetTickCount() - start < PHASE_DURATION && !ServiceCancellationToken.IsCancellationRequested())
+                {
+                    Data::PersistentData::Save();
+                    vTaskDelay(1);
+                }
+                break;
+            case Ota:
+            {
+                const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+                if (partition == NULL)
+                {
+                    LOGW(nameof(CAN::FlashJitterTest), "No OTA partition to write to, skipping the OTA phase.");
+                    break;
+                }
+
+                uint8_t* chunk = new uint8_t[OTA_CHUNK_SIZE];
+                memset(chunk, 0xFF, OTA_CHUNK_SIZE);
+                chunk[0] = ESP_IMAGE_HEADER_MAGIC; //esp_ota_write rejects data that doesn't start like an image.
+
+                //Beginning with a known size erases that much up front, as the OTA server does.
+                esp_ota_handle_t handle;
+                esp_err_t err = esp_ota_begin(partition, OTA_IMAGE_SIZE, &handle);
+                bool begun = err == ESP_OK;
+                for (size_t written = 0; err == ESP_OK && written < OTA_IMAGE_SIZE && xTaskGetTickCount() - start < PHASE_DURATION; written += OTA_CHUNK_SIZE)
+                {
+                    err = esp_ota_write(handle, chunk, OTA_CHUNK_SIZE);
+                    vTaskDelay(1);
+                }
+                if (err != ESP_OK)
+                    LOGW(nameof(CAN::FlashJitterTest), "OTA write failed: %s", esp_err_to_name(err));
+                if (begun)
+                    esp_ota_abort(handle);
+                delete[] chunk;
+                break;
+            }
+            default:
+                break;
+            }
+
+            while (xTaskGetTickCount() - start < PHASE_DURATION && !ServiceCancellationToken.IsCancellationRequested())
+                vTaskDelay(pdMS_TO_TICKS(100));
+        }
+
+        void Report(EPhase phase, const SPhaseSample& before, const SPhaseSample& after, int64_t phaseStart)
+        {
+            const char* name = phase == Baseline ? "baseline" : phase == Save ? "save" : "OTA";
+            size_t buckets = _latency[0]->GetBucketCount();
+
+            for (int bus = 0; bus < 2; bus++)
+            {
+                uint32_t count = after.latency[bus][buckets] - before.latency[bus][buckets];
+                uint32_t sum = after.latency[bus][buckets + 1] - before.latency[bus][buckets + 1];
+
+                //Upper bound of the bucket that the 50th and 99th percentile fall in, 0 when beyond the last bound.
+                uint32_t p50 = 0, p99 = 0, overLimit = count;
+                for (size_t i = buckets; i-- > 0 && count > 0;)
+                {
+                    uint32_t below = after.latency[bus][i] - before.latency[bus][i];
+                    if ((uint64_t)below * 100 >= (uint64_t)count * 50)
+                        p50 = _latency[bus]->GetBound(i);
+                    if ((uint64_t)below * 100 >= (uint64_t)count * 99)
+                        p99 = _latency[bus]->GetBound(i);
+                    if (_latency[bus]->GetBound(i) == LATENCY_LIMIT_US)
+                        overLimit = count - below;
+                }
+
+                LOGI(nameof(CAN::FlashJitterTest), "%-8s CAN%i: relayed %lu, latency avg %luus p50 <=%luus p99 <=%luus, over %luus %lu",
+                    name, bus + 1, count, count > 0 ? sum / count : 0, p50, p99, LATENCY_LIMIT_US, overLimit);
+            }
+
+            //Stalls are gaps of at least 50ms in relay progress, report the longest from this phase.
+            uint32_t longest = 0;
+            RelayWatchdog::SStallSnapshot snapshot;
+            for (size_t i = 0; _busMaster->GetStallSnapshot(i, &snapshot) && snapshot.detectedAt >= phaseStart; i++)
+            {
+                uint32_t gap = snapshot.durationUs != 0 ? snapshot.durationUs : snapshot.gapUs;
+                if (gap > longest)
+                    longest = gap;
+            }
+            LOGI(nameof(CAN::FlashJitterTest), "%-8s stalls %lu, longest %luus", name, after.stalls - before.stalls, longest);
+        }
+
+    protected:
+        void RunServiceImpl() override
+        {
+            _busMaster = GetService<BusMaster>();
+            _latency[0] = FindMetric("can_relay_latency_us", "bus=\"1\"");
+            _latency[1] = FindMetric("can_relay_latency_us", "bus=\"2\"");
+            if (_latency[0] == nullptr || _latency[1] == nullptr)
+            {
+                LOGE(nameof(CAN::FlashJitterTest), "Relay latency metrics not found.");
+                return;
+            }
+
+            //Wait for the relay tasks to come up and traffic to settle.
+            vTaskDelay(pdMS_TO_TICKS(2000));
+
+            #ifdef CAN_RELAY_IN_IRAM
+            LOGI(nameof(CAN::FlashJitterTest), "Relay path in IRAM.");
+            #else
+            LOGI(nameof(CAN::FlashJitterTest), "Relay path in flash.");
+            #endif
+
+            for (EPhase phase : { Baseline, Save, Ota })
+            {
+                if (ServiceCancellationToken.IsCancellationRequested())
+                    break;
+
+                SPhaseSample before, after;
+                int64_t phaseStart = esp_timer_get_time();
+                Sample(&before);
+                Load(phase);
+                //Let a stall that ended the phase be closed by the watchdog before sampling.
+                vTaskDelay(pdMS_TO_TICKS(100));
+                Sample(&after);
+                Report(phase, before, after, phaseStart);
+            }
+
+            ServiceCancellationToken.WaitForCancellation();
+        }
+
+    public:
+        FlashJitterTest()
+        {
+            ServiceEntrypointStackDepth += 2048; //Saving builds a JSON document on this stack.
+            AddDependencyType<BusMaster>();
+        }
+    };
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+//Traffic seen on each of the 2048 standard IDs, with constant time lookups by ID.
+//The dense part is a one byte slot index and a whitelist/seen bit per ID, the statistics live in a pool sized for the IDs a bike actually uses.
+//Extended IDs have no statistics, a short list of them is kept so that they can still be whitelisted and reported when first seen.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    enum EIdRecordResult : uint8_t
+    {
+        Recorded = 0,
+        FirstSeen = 1, //The first frame with this ID.
+        Untracked = 2, //Every slot is in use, or an extended ID that was already seen (which has no statistics).
+    };
+
+    class IdTable
+    {
+    public:
+        static const size_t ID_COUNT = 2048;
+        static const size_t MAX_TRACKED_IDS = 128; //The bike uses a few dozen IDs.
+        static const size_t MAX_EXTENDED_IDS = 16; //Per list, the bike doesn't use extended IDs.
+        static const uint32_t MAX_EXTENDED_ID = 0x1FFFFFFF;
+        static const uint8_t INTERVAL_SMOOTHING_SHIFT = 3; //Moving averages move by 1/8 of each difference.
+
+        //Times are in the milliseconds of the frame timestamps, intervals saturate at UINT16_MAX.
+        struct SIdStats
+        {
+            uint32_t firstSeen;
+            uint32_t lastSeen;
+            uint32_t count;
+            uint16_t intervalMean; //Moving average of the time between frames.
+            uint16_t intervalJitter; //Moving average of the absolute difference from intervalMean.
+            uint16_t intervalMin;
+            uint16_t intervalMax;
+            uint8_t length;
+            uint8_t data[8];
+        };
+
+    private:
+        static const uint8_t NO_SLOT = 0xFF;
+        static const size_t BITMAP_WORDS = ID_COUNT / 32;
+        static_assert(MAX_TRACKED_IDS < NO_SLOT, "Slots are indexed by a single byte.");
+
+        uint8_t _slots[ID_COUNT];
+        uint32_t _seen[BITMAP_WORDS] = {};
+        uint32_t _whitelist[BITMAP_WORDS] = {};
+        size_t _whitelistCount = 0;
+        SIdStats _stats[MAX_TRACKED_IDS];
+        size_t _tracked = 0;
+        uint32_t _extendedSeen[MAX_EXTENDED_IDS];
+        size_t _extendedSeenCount = 0;
+        uint32_t _extendedWhitelist[MAX_EXTENDED_IDS];
+        size_t _extendedWhitelistCount = 0;
+
+        static inline bool IsStandard(uint32_t id)
+        {
+            return id < ID_COUNT;
+        }
+
+        static inline bool GetBit(const uint32_t* bitmap, uint32_t id)
+        {
+            return (bitmap[id >> 5] >> (id & 31)) & 1;
+        }
+
+        static inline void SetBit(uint32_t* bitmap, uint32_t id)
+        {
+            bitmap[id >> 5] |= 1UL << (id & 31);
+        }
+
+        static inline uint16_t Saturate(uint32_t value)
+        {
+            return value > UINT16_MAX ? UINT16_MAX : value;
+        }
+
+        static bool Contains(const uint32_t* list, size_t count, uint32_t id)
+        {
+            for (size_t i = 0; i < count; i++)
+                if (list[i] == id)
+                    return true;
+            return false;
+        }
+
+    public:
+        IdTable()
+        {
+            Clear();
+        }
+
+        //Forgets every ID, the whitelist is kept.
+        void Clear()
+        {
+            memset(_slots, NO_SLOT, sizeof(_slots));
+            memset(_seen, 0, sizeof(_seen));
+            _tracked = 0;
+            _extendedSeenCount = 0;
+        }
+
+        EIdRecordResult Record(const SCanMessage& message, uint32_t timestamp)
+        {
+            if (message.isExtended || !IsStandard(message.id))
+            {
+                if (Contains(_extendedSeen, _extendedSeenCount, message.id) || _extendedSeenCount >= MAX_EXTENDED_IDS)
+                    return Untracked;
+                _extendedSeen[_extendedSeenCount++] = message.id;
+                return FirstSeen;
+            }
+
+            uint8_t slot = _slots[message.id];
+            if (slot == NO_SLOT)
+            {
+                if (_tracked >= MAX_TRACKED_IDS)
+                    return Untracked;
+
+                slot = _slots[message.id] = _tracked++;
+                SetBit(_seen, message.id);
+                SIdStats& stats = _stats[slot];
+                stats = {};
+                stats.firstSeen = stats.lastSeen = timestamp;
+                stats.count = 1;
+                stats.intervalMin = UINT16_MAX;
+                stats.length = message.length > 8 ? 8 : message.length;
+                memcpy(stats.data, message.data, stats.length);
+                return FirstSeen;
+            }
+
+            SIdStats& stats = _stats[slot];
+            uint16_t interval = Saturate(timestamp - stats.lastSeen);
+            if (stats.count == 1)
+            {
+                stats.intervalMean = interval;
+            }
+            else
+            {
+                int32_t difference = (int32_t)interval - stats.intervalMean;
+                stats.intervalMean += difference / (1 << INTERVAL_SMOOTHING_SHIFT);
+                int32_t deviation = difference < 0 ? -difference : difference;
+                stats.intervalJitter += (deviation - (int32_t)stats.intervalJitter) / (1 << INTERVAL_SMOOTHING_SHIFT);
+            }
+            if (interval < stats.intervalMin)
+                stats.intervalMin = interval;
+            if (interval > stats.intervalMax)
+                stats.intervalMax = interval;
+
+            stats.lastSeen = timestamp;
+            stats.count++;
+            stats.length = message.length > 8 ? 8 : message.length;
+            memcpy(stats.data, message.data, stats.length);
+            return Recorded;
+        }
+
+        bool IsSeen(uint32_t id) const
+        {
+            return IsStandard(id) && GetBit(_seen, id);
+        }
+
+        bool GetStats(uint32_t id, SIdStats* outStats) const
+        {
+            if (!IsSeen(id))
+                return false;
+            *outStats = _stats[_slots[id]];
+            return true;
+        }
+
+        //The lowest seen ID at or above fromId, for walking the table without visiting every ID. Returns false past the last one.
+        bool NextSeen(uint32_t fromId, uint32_t* outId) const
+        {
+            for (uint32_t word = fromId >> 5; word < BITMAP_WORDS; word++)
+            {
+                uint32_t bits = _seen[word];
+                if (word == fromId >> 5)
+                    bits &= ~0UL << (fromId & 31);
+                if (bits != 0)
+                {
+                    *outId = (word << 5) | __builtin_ctz(bits);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        size_t GetTrackedCount() const
+        {
+            return _tracked;
+        }
+
+        //Frames are matched on the ID alone, as with the standard/extended flag of a frame.
+        bool InWhitelist(uint32_t id) const
+        {
+            return IsStandard(id) ? GetBit(_whitelist, id) : Contains(_extendedWhitelist, _extendedWhitelistCount, id);
+        }
+
+        //An empty whitelist lets every ID through.
+        bool IsWhitelisted(const SCanMessage& message) const
+        {
+            if (_whitelistCount == 0 && _extendedWhitelistCount == 0)
+                return true;
+            return InWhitelist(message.id);
+        }
+
+        //Returns false for IDs past 29 bits, or once MAX_EXTENDED_IDS IDs above the standard range have been added.
+        bool AddToWhitelist(uint32_t id)
+        {
+            if (!IsStandard(id))
+            {
+                if (id > MAX_EXTENDED_ID || (!Contains(_extendedWhitelist, _extendedWhitelistCount, id) && _extendedWhitelistCount >= MAX_EXTENDED_IDS))
+                    return false;
+                if (!Contains(_extendedWhitelist, _extendedWhitelistCount, id))
+                    _extendedWhitelist[_extendedWhitelistCount++] = id;
+                return true;
+            }
+            if (!GetBit(_whitelist, id))
+            {
+                SetBit(_whitelist, id);
+                _whitelistCount++;
+            }
+            return true;
+        }
+
+        void ClearWhitelist()
+        {
+            memset(_whitelist, 0, sizeof(_whitelist));
+            _whitelistCount = 0;
+            _extendedWhitelistCount = 0;
+        }
+    };
+};
@@ -2,23 +2,40 @@
 
 #include <Service/AService.hpp>
 #include "BusMaster.hpp"
+#include "Signals.h"
+#include "IdTable.h"
+#include "DeltaFilter.h"
+#include "CaptureCodec.h"
 #include <Helpers.h>
 #include <Logging.hpp>
-#include <string>
-#include <functional>
-#include <vector>
+#include "Memory/InplaceFunction.hpp"
+#include <esp_cpu.h>
 
 namespace ReadieFur::OpenTCU::CAN
 {
     class Logger : public Service::AService
     {
     public:
-        std::vector<uint32_t> Whitelist;
+        bool DecodeSignals = false; //Additionally log the physical values of the known signals (see Signals.h).
+        bool DeltaCapture = false; //Only log frames whose payload changed, identical ones are logged as repeats (see DeltaFilter.h).
+        bool CompressCapture = false; //Log frames as compressed blocks (see CaptureCodec.h), takes precedence over DeltaCapture.
 
     private:
         static const TickType_t LOG_INTERVAL = pdMS_TO_TICKS(500);
         BusMaster* _busMaster = nullptr;
-        std::vector<uint32_t> _recognisedIds;
+        IdTable _idTable; //Also holds the whitelist.
+        SemaphoreHandle_t _idTableMutex = xSemaphoreCreateMutex(); //Updated by the logger task, read over BLE.
+        #ifdef ENABLE_CAN_DUMP
+        DeltaFilter _deltaFilter; //Only used by the logger task.
+        bool _deltaCaptureActive = false;
+        std::atomic<uint32_t> _framesLogged = 0;
+        std::atomic<uint32_t> _framesSuppressed = 0;
+        CaptureEncoder _encoder; //Only used by the logger task.
+        bool _compressCaptureActive = false;
+        std::atomic<uint32_t> _compressedBytes = 0;
+        std::atomic<uint32_t> _compressedFrames = 0;
+        std::atomic<uint32_t> _compressCycles = 0; //Moving average per frame, moves by 1/8 of each difference.
+        #endif
 
         inline void SendLog(const char* format, ...)
         {
@@ -27,7 +44,11 @@ namespace ReadieFur::OpenTCU::CAN
             char buffer[256];
             vsnprintf(buffer, sizeof(buffer), format, args);
             va_end(args);
+            SendLine(buffer);
+        }
 
+        inline void SendLine(const char* buffer)
+        {
             #ifdef ENABLE_CAN_DUMP_SERIAL
             // LOGI(nameof(CAN::Logger), "%s", buffer);
             puts(buffer); //Adds a newline (desired).
@@ -42,21 +63,43 @@ namespace ReadieFur::OpenTCU::CAN
         #ifdef ENABLE_CAN_DUMP
         inline void Log(BusMaster::SCanDump& dump)
         {
-            if (std::find(_recognisedIds.begin(), _recognisedIds.end(), dump.message.id) == _recognisedIds.end())
-            {
-                LOGI(nameof(CAN::Logger), "New ID detected: %x", dump.message.id);
-                _recognisedIds.push_back(dump.message.id);
+            xSemaphoreTake(_idTableMutex, portMAX_DELAY);
+            EIdRecordResult result = _idTable.Record(dump.message, dump.timestamp);
+            bool whitelisted = _idTable.IsWhitelisted(dump.message);
+            // //Add new IDs to the whitelist so they aren't missed.
+            // if (result == FirstSeen && !whitelisted)
+            //     whitelisted = _idTable.AddToWhitelist(dump.message.id);
+            xSemaphoreGive(_idTableMutex);
 
-                // //Add new IDs to the whitelist so they aren't missed.
-                // if (Whitelist.size() > 0)
-                //     Whitelist.push_back(dump.message.id);
-            }
+            if (result == FirstSeen)
+                LOGI(nameof(CAN::Logger), "New ID detected: %x", dump.message.id);
 
-            if (Whitelist.size() > 0 && std::find(Whitelist.begin(), Whitelist.end(), dump.message.id) == Whitelist.end())
+            if (!whitelisted)
                 return;
 
             int bus = (char)dump.bus == '1' ? 0 : 1;
 
+            if (_compressCaptureActive)
+            {
+                Compress(bus, dump);
+                LogSignals(bus, dump);
+                return;
+            }
+
+            if (_deltaCaptureActive)
+            {
+                DeltaFilter::SRepeat repeat;
+                bool hasRepeat;
+                if (!_deltaFilter.Filter(bus, dump.message, dump.timestamp, &repeat, &hasRepeat))
+                {
+                    _framesSuppressed.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                if (hasRepeat)
+                    LogRepeat(repeat);
+            }
+            _framesLogged.fetch_add(1, std::memory_order_relaxed);
+
             //Doing this the long way because previous dynamic methods were causing issues.
             switch (dump.message.length)
             {
@@ -170,6 +213,103 @@ namespace ReadieFur::OpenTCU::CAN
                         dump.message.data[7]);
                     break;
             }
+
+            LogSignals(bus, dump);
+        }
+
+        inline void LogSignals(int bus, BusMaster::SCanDump& dump)
+        {
+            if (!DecodeSignals)
+                return;
+
+            for (const SSignal* signal : Signals::ALL)
+            {
+                if (signal->id != dump.message.id)
+                    continue;
+                char value[SignalDecoder::MAX_FORMATTED];
+                SignalDecoder::Format(*signal, dump.message.data, value, sizeof(value));
+                SendLog(nameof(CAN::Signals)":%lu,%u,%x,%s,%s%s",
+                    dump.timestamp,
+                    bus,
+                    dump.message.id,
+                    signal->name,
+                    value,
+                    signal->unit);
+            }
+        }
+
+        inline void Compress(int bus, BusMaster::SCanDump& dump)
+        {
+            uint32_t start = esp_cpu_get_cycle_count();
+            bool appended = _encoder.Append(bus, dump.message, dump.timestamp);
+            uint32_t cycles = esp_cpu_get_cycle_count() - start;
+            if (!appended)
+            {
+                SendBlock();
+                start = esp_cpu_get_cycle_count();
+                _encoder.Append(bus, dump.message, dump.timestamp);
+                cycles += esp_cpu_get_cycle_count() - start;
+            }
+            uint32_t average = _compressCycles.load(std::memory_order_relaxed);
+            _compressCycles.store(average + ((int32_t)cycles - (int32_t)average) / 8, std::memory_order_relaxed);
+            _compressedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void SendBlock()
+        {
+            size_t length = _encoder.Seal();
+            if (length == 0)
+                return;
+
+            static const char PREFIX[] = nameof(CAN::Block)":";
+            char line[sizeof(PREFIX) + CaptureCodec::BASE64_BLOCK_SIZE];
+            memcpy(line, PREFIX, sizeof(PREFIX) - 1);
+            size_t written = sizeof(PREFIX) - 1 + CaptureCodec::Base64Encode(_encoder.GetBlock(), length, line + sizeof(PREFIX) - 1);
+            line[written] = '\0';
+            SendLine(line);
+            _compressedBytes.fetch_add(length, std::memory_order_relaxed);
+        }
+
+        //Sends the open block so that the capture lags by at most LOG_INTERVAL, and picks up changes to CompressCapture.
+        void FlushBlock()
+        {
+            if (_compressCaptureActive)
+                SendBlock();
+            if (_compressCaptureActive && !CompressCapture)
+                _encoder.Reset();
+            _compressCaptureActive = CompressCapture;
+        }
+
+        inline void LogRepeat(const DeltaFilter::SRepeat& repeat)
+        {
+            SendLog(nameof(CAN::Repeat)":%u,%x,%lu,%lu,%lu",
+                repeat.bus,
+                repeat.id,
+                repeat.count,
+                repeat.firstTimestamp,
+                repeat.lastTimestamp);
+        }
+
+        //Logs the repeats of the IDs that have gone quiet, or all of them and resets the filter when delta capture is turned off.
+        void FlushRepeats()
+        {
+            if (!_deltaCaptureActive && !DeltaCapture)
+                return;
+
+            bool all = !DeltaCapture;
+            DeltaFilter::SRepeat repeats[16];
+            size_t count;
+            do
+            {
+                count = _deltaFilter.Flush(Time::Clock::NowMs(), repeats, 16, all);
+                for (size_t i = 0; i < count; i++)
+                    LogRepeat(repeats[i]);
+            }
+            while (count == 16);
+
+            if (all)
+                _deltaFilter.Clear();
+            _deltaCaptureActive = DeltaCapture;
         }
         #endif
 
@@ -188,6 +328,8 @@ namespace ReadieFur::OpenTCU::CAN
                     Log(dump);
                 #else
                 //Process messages in batches.
+                FlushBlock();
+                FlushRepeats();
                 UBaseType_t capturedQueueLength = uxQueueMessagesWaiting(_busMaster->CanDumpQueue);
                 while (capturedQueueLength > 0 && uxQueueMessagesWaiting(_busMaster->CanDumpQueue) > 0)
                 {
@@ -207,11 +349,55 @@ namespace ReadieFur::OpenTCU::CAN
         }
 
     public:
-        std::function<int(const char*, size_t)> UdpLogger = nullptr;
+        Memory::InplaceFunction<int(const char*, size_t)> UdpLogger = nullptr;
+
+        #ifdef ENABLE_CAN_DUMP
+        //Frames written to the capture and, with DeltaCapture, frames folded into repeats instead.
+        void GetCaptureCounts(uint32_t* outLogged, uint32_t* outSuppressed) const
+        {
+            *outLogged = _framesLogged.load(std::memory_order_relaxed);
+            *outSuppressed = _framesSuppressed.load(std::memory_order_relaxed);
+        }
+
+        //Frames written as compressed blocks, the size of those blocks before base64 and the recent average of the CPU cycles spent encoding a frame.
+        void GetCompressionStats(uint32_t* outFrames, uint32_t* outBytes, uint32_t* outCyclesPerFrame) const
+        {
+            *outFrames = _compressedFrames.load(std::memory_order_relaxed);
+            *outBytes = _compressedBytes.load(std::memory_order_relaxed);
+            *outCyclesPerFrame = _compressCycles.load(std::memory_order_relaxed);
+        }
+        #endif
+
+        //Returns false for IDs past 29 bits, or once IdTable::MAX_EXTENDED_IDS extended IDs have been added.
+        bool AddToWhitelist(uint32_t id)
+        {
+            xSemaphoreTake(_idTableMutex, portMAX_DELAY);
+            bool added = _idTable.AddToWhitelist(id);
+            xSemaphoreGive(_idTableMutex);
+            return added;
+        }
+
+        void ClearWhitelist()
+        {
+            xSemaphoreTake(_idTableMutex, portMAX_DELAY);
+            _idTable.ClearWhitelist();
+            xSemaphoreGive(_idTableMutex);
+        }
+
+        //Copies the stats of the lowest seen ID at or above fromId, returns false past the last one.
+        bool GetNextIdStats(uint32_t fromId, uint32_t* outId, IdTable::SIdStats* outStats, bool* outWhitelisted)
+        {
+            xSemaphoreTake(_idTableMutex, portMAX_DELAY);
+            bool found = _idTable.NextSeen(fromId, outId) && _idTable.GetStats(*outId, outStats);
+            if (found)
+                *outWhitelisted = _idTable.InWhitelist(*outId);
+            xSemaphoreGive(_idTableMutex);
+            return found;
+        }
 
         Logger()
         {
-            ServiceEntrypointStackDepth += 1024;
+            ServiceEntrypointStackDepth += 1536; //Compressed blocks are base64 encoded on the stack.
             AddDependencyType<BusMaster>();
         }
     };
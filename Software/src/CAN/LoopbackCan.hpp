@@ -0,0 +1,131 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "SCanMessage.h"
+#include "ACan.h"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //One end of an in-process point to point bus, whatever is sent on one end is received on the other.
+    //Frames are written straight into the peer's ring buffer and read straight out of it, with no driver or queue copies in between.
+    //Any number of tasks may send (serialized by the driver lock) but only one task may receive on each end, which matches how BusMaster uses its buses.
+    class LoopbackCan : public ACan
+    {
+    public:
+        static const size_t DEFAULT_QUEUE_LENGTH = 32; //Must be a power of two.
+
+    private:
+        static const TickType_t POLL_INTERVAL = 1;
+
+        SCanMessage* _ring;
+        size_t _mask;
+        std::atomic<size_t> _head = 0; //Written by the sender on the peer.
+        std::atomic<size_t> _tail = 0; //Written by the receiver on this end.
+        SemaphoreHandle_t _available = xSemaphoreCreateBinary();
+        LoopbackCan* _peer = nullptr;
+        uint32_t _sendTimeouts = 0;
+
+        LoopbackCan(size_t queueLength) : ACan(), _ring(new SCanMessage[queueLength]), _mask(queueLength - 1) {}
+
+    public:
+        //Creates both ends of a bus, returns false if either end could not be created.
+        static bool CreatePair(LoopbackCan** outA, LoopbackCan** outB, size_t queueLength = DEFAULT_QUEUE_LENGTH)
+        {
+            if (queueLength == 0 || (queueLength & (queueLength - 1)) != 0)
+            {
+                LOGE(nameof(CAN::LoopbackCan), "Queue length must be a power of two: %u", (unsigned)queueLength);
+                return false;
+            }
+
+            LoopbackCan* a = new LoopbackCan(queueLength);
+            LoopbackCan* b = new LoopbackCan(queueLength);
+            if (a == nullptr || b == nullptr || a->_ring == nullptr || b->_ring == nullptr || a->_available == NULL || b->_available == NULL)
+            {
+                delete a;
+                delete b;
+                return false;
+            }
+
+            a->_peer = b;
+            b->_peer = a;
+            *outA = a;
+            *outB = b;
+            return true;
+        }
+
+        ~LoopbackCan()
+        {
+            if (_peer != nullptr)
+                _peer->_peer = nullptr;
+            if (_available != NULL)
+                vSemaphoreDelete(_available);
+            delete[] _ring;
+        }
+
+        esp_err_t Send(SCanMessage message, TickType_t timeout)
+        {
+            LoopbackCan* peer = _peer;
+            if (peer == nullptr)
+                return ESP_ERR_INVALID_STATE;
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+            #endif
+
+            //Block like a full TX queue would until the receiver catches up.
+            TickType_t start = xTaskGetTickCount();
+            size_t head = peer->_head.load(std::memory_order_relaxed);
+            while (head - peer->_tail.load(std::memory_order_acquire) > peer->_mask)
+            {
+                if (xTaskGetTickCount() - start >= timeout)
+                {
+                    _sendTimeouts++;
+                    #ifdef USE_CAN_DRIVER_LOCK
+                    xSemaphoreGive(_driverMutex);
+                    #endif
+                    return ESP_ERR_TIMEOUT;
+                }
+                vTaskDelay(POLL_INTERVAL);
+            }
+
+            peer->_ring[head & peer->_mask] = message;
+            peer->_head.store(head + 1, std::memory_order_release);
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+
+            xSemaphoreGive(peer->_available);
+            return ESP_OK;
+        }
+
+        esp_err_t Receive(SCanMessage* message, TickType_t timeout)
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            while (_head.load(std::memory_order_acquire) == tail)
+                if (xSemaphoreTake(_available, timeout) != pdTRUE)
+                    return ESP_ERR_TIMEOUT;
+
+            *message = _ring[tail & _mask];
+            _tail.store(tail + 1, std::memory_order_release);
+            return ESP_OK;
+        }
+
+        //Sends that timed out because the peer was not receiving are reported as TX failures.
+        esp_err_t GetHealth(SCanHealth* health, TickType_t timeout)
+        {
+            *health = {};
+            health->sampledAt = esp_timer_get_time();
+            health->state = _busState;
+            health->txFailed = _sendTimeouts;
+            health->rxQueued = (uint16_t)(_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed));
+            return ESP_OK;
+        }
+    };
+};
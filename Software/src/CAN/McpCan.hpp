@@ -15,6 +15,7 @@
 #include <driver/gpio.h>
 #include "ACan.h"
 #include "SCanMessage.h"
+#include "RelayPlacement.h"
 #include <Logging.hpp>
 
 namespace ReadieFur::OpenTCU::CAN
@@ -22,9 +23,18 @@ namespace ReadieFur::OpenTCU::CAN
     class McpCan : public ACan
     {
     private:
+        //The MCP2515 rejoins the bus by itself after monitoring 128 occurrences of 11 recessive bits (~5.6ms at 250kbit/s), it is only reset if that has not happened by then.
+        static const TickType_t AUTO_RECOVERY_TICKS = pdMS_TO_TICKS(10);
+
         spi_device_handle_t _device;
         MCP2515* _mcp2515;
         gpio_num_t _interruptPin;
+        CAN_SPEED _speed;
+        CAN_CLOCK _clock;
+        //The MCP2515 has no counters of its own beyond TEC/REC, these are counted from the flags seen while servicing it.
+        uint32_t _rxOverruns = 0;
+        uint32_t _txFailed = 0;
+        uint32_t _busErrors = 0;
         volatile SemaphoreHandle_t _interruptSemaphore = xSemaphoreCreateCounting(2, 0); //2 because the MCP2515 has two buffers (RX0 and RX1).
 
         static esp_err_t MCPErrorToESPError(MCP2515::ERROR error)
@@ -45,6 +55,23 @@ namespace ReadieFur::OpenTCU::CAN
             }
         }
 
+        void UpdateBusState(uint8_t errorFlags)
+        {
+            if (errorFlags & MCP2515::EFLG_TXBO)
+            {
+                if (_busState != Recovering)
+                    SetBusState(BusOff);
+            }
+            else if (errorFlags & (MCP2515::EFLG_TXEP | MCP2515::EFLG_RXEP))
+            {
+                SetBusState(ErrorPassive);
+            }
+            else if (_busState == ErrorPassive)
+            {
+                SetBusState(ErrorActive);
+            }
+        }
+
         static void IRAM_ATTR OnInterrupt(void* arg)
         {
             BaseType_t higherPriorityTaskWoken = pdFALSE;
@@ -65,6 +92,8 @@ namespace ReadieFur::OpenTCU::CAN
             //We are passing an instance here so that the instance does not need to be stored outside of this class.
             this->_device = device;
             this->_interruptPin = interruptPin;
+            this->_speed = speed;
+            this->_clock = clock;
 
             _mcp2515 = new MCP2515(&this->_device);
 
@@ -77,7 +106,12 @@ namespace ReadieFur::OpenTCU::CAN
         {
             //It seems like this method returns an error all of the time, however it is safe to call again. If something truly bad happens we will likely throw in the next stage.
             //https://esp32.com/viewtopic.php?t=13167
+            #ifdef CAN_RELAY_IN_IRAM
+            //OnInterrupt is already in IRAM, this keeps it serviced while the flash cache is disabled.
+            gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+            #else
             gpio_install_isr_service(0);
+            #endif
             if (gpio_isr_handler_add(_interruptPin, OnInterrupt, this) != ESP_OK)
             {
                 LOGE(nameof(CAN::McpCan), "Failed to setup interrupt: %i", 1);
@@ -113,7 +147,7 @@ namespace ReadieFur::OpenTCU::CAN
             xSemaphoreGive(_interruptSemaphore);
         }
 
-        esp_err_t Send(SCanMessage message, TickType_t timeout = 0)
+        esp_err_t RELAY_IRAM_ATTR Send(SCanMessage message, TickType_t timeout = 0)
         {
             can_frame frame = {
                 .can_id = message.id | (message.isExtended ? CAN_EFF_FLAG : 0) | (message.isRemote ? CAN_RTR_FLAG : 0),
@@ -131,6 +165,8 @@ namespace ReadieFur::OpenTCU::CAN
             #endif
 
             MCP2515::ERROR res = _mcp2515->sendMessage(&frame);
+            if (res != MCP2515::ERROR_OK)
+                _txFailed++;
 
             #ifdef USE_CAN_DRIVER_LOCK
             xSemaphoreGive(_driverMutex);
@@ -142,8 +178,11 @@ namespace ReadieFur::OpenTCU::CAN
             return retVal;
         }
 
-        esp_err_t Receive(SCanMessage* message, TickType_t timeout = 0)
+        esp_err_t RELAY_IRAM_ATTR Receive(SCanMessage* message, TickType_t timeout = 0)
         {
+            if (IsBusOff())
+                return ESP_ERR_INVALID_STATE;
+
             //Check if we need to wait for a message to be received.
             if (gpio_get_level(_interruptPin) == 1)
             {
@@ -176,7 +215,16 @@ namespace ReadieFur::OpenTCU::CAN
             uint8_t interruptFlags = _mcp2515->getInterrupts();
 
             if (interruptFlags & MCP2515::CANINTF_ERRIF) //Error Interrupt Flag bit is set.
+            {
+                //The error interrupt is raised whenever the error flags change, which includes the error passive and bus-off transitions.
+                uint8_t errorFlags = _mcp2515->getErrorFlags();
+                UpdateBusState(errorFlags);
+                if (errorFlags & MCP2515::EFLG_RX0OVR)
+                    _rxOverruns++;
+                if (errorFlags & MCP2515::EFLG_RX1OVR)
+                    _rxOverruns++;
                 _mcp2515->clearRXnOVR();
+            }
 
             can_frame frame;
             MCP2515::ERROR readResult;
@@ -192,12 +240,18 @@ namespace ReadieFur::OpenTCU::CAN
             if (interruptFlags & MCP2515::CANINTF_ERRIF)
                 _mcp2515->clearMERR();
             if (interruptFlags & MCP2515::CANINTF_MERRF) //Message Error Interrupt Flag bit is set.
+            {
+                _busErrors++;
                 _mcp2515->clearInterrupts();
+            }
 
             #ifdef USE_CAN_DRIVER_LOCK
             xSemaphoreGive(_driverMutex);
             #endif
 
+            if (IsBusOff())
+                return ESP_ERR_INVALID_STATE;
+
             //At some point in this development I broke the interrupt and it seems it never fires now.
             //As a result of I am using gpio_get_level. However an issue has occurred where I can reach this point and read empty messages (error code 5).
             //I would like to fix this as we are wasting CPU cycles with this bug.
@@ -217,7 +271,48 @@ namespace ReadieFur::OpenTCU::CAN
             return ESP_OK;
         }
 
-        esp_err_t GetStatus(uint32_t* status, TickType_t timeout = 0)
+        esp_err_t Recover(TickType_t timeout = 0)
+        {
+            if (!IsBusOff())
+                return ESP_OK;
+
+            if (_busState == BusOff)
+            {
+                SetBusState(Recovering);
+                vTaskDelay(AUTO_RECOVERY_TICKS < timeout ? AUTO_RECOVERY_TICKS : timeout);
+            }
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+            #endif
+
+            MCP2515::ERROR res = MCP2515::ERROR_OK;
+            if (_mcp2515->getErrorFlags() & MCP2515::EFLG_TXBO)
+            {
+                //Still off the bus, reinitialize the controller which also clears its error counters.
+                _mcp2515->reset();
+                _mcp2515->setBitrate(_speed, _clock);
+                res = _mcp2515->setNormalMode();
+            }
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+
+            if (res != MCP2515::ERROR_OK)
+                return MCPErrorToESPError(res);
+
+            SetBusState(ErrorActive);
+
+            //Frames that arrived while the controller was off the bus will not raise a new falling edge.
+            if (gpio_get_level(_interruptPin) == 0)
+                xSemaphoreGive(_interruptSemaphore);
+
+            return ESP_OK;
+        }
+
+        esp_err_t GetHealth(SCanHealth* health, TickType_t timeout = 0)
         {
             #ifdef USE_CAN_DRIVER_LOCK
             if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
@@ -226,7 +321,19 @@ namespace ReadieFur::OpenTCU::CAN
                 return ESP_ERR_TIMEOUT;
             }
             #endif
-            *status = _mcp2515->getInterrupts();
+
+            *health = {};
+            health->sampledAt = esp_timer_get_time();
+            health->state = _busState;
+            health->txErrorCounter = _mcp2515->errorCountTX();
+            health->rxErrorCounter = _mcp2515->errorCountRX();
+            health->rxOverrun = _rxOverruns;
+            health->txFailed = _txFailed;
+            health->busErrors = _busErrors;
+            //There is no driver queue, frames waiting are those sat in the two RX buffers.
+            uint8_t interruptFlags = _mcp2515->getInterrupts();
+            health->rxQueued = ((interruptFlags & MCP2515::CANINTF_RX0IF) ? 1 : 0) + ((interruptFlags & MCP2515::CANINTF_RX1IF) ? 1 : 0);
+
             #ifdef USE_CAN_DRIVER_LOCK
             xSemaphoreGive(_driverMutex);
             #endif
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include "SCanMessage.h"
+#include "ACan.h"
+#include "TrafficModel.h"
+#include "Time/Clock.hpp"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //In-memory bus segment used in place of a real controller to stress the relay with synthetic traffic.
+    //Inject() models a frame arriving from the bike on this segment, Send() models the relay transmitting onto this segment.
+    //Wire time is accounted for at 250kbit/s so that both the injected traffic and the relayed traffic share the segment like they would on the real bus.
+    //The wire is modelled on Time::Clock, under a VirtualClock frames only finish arriving as the simulation advances it.
+    class MemoryCan : public ACan
+    {
+    public:
+        static const size_t DEFAULT_RX_QUEUE_LENGTH = 5; //Matches the TWAI driver default rx_queue_len.
+        static const size_t DEFAULT_TX_QUEUE_LENGTH = 5; //Matches the TWAI driver default tx_queue_len.
+
+        struct SStats
+        {
+            uint32_t injected;
+            uint32_t dropped; //Frames that arrived while the RX queue was full, i.e. what the controller would report as rx_missed.
+            uint32_t received;
+            uint32_t sent;
+            uint32_t sendTimeouts;
+            uint64_t latencySumUs; //Time from injection on the upstream segment to the end of transmission on this segment.
+            uint32_t latencyMaxUs;
+        };
+
+    private:
+        struct SQueuedFrame
+        {
+            SCanMessage message;
+            int64_t injectedAt;
+        };
+
+        size_t _txQueueLength;
+        QueueHandle_t _rxQueue = NULL;
+        MemoryCan* _upstream = nullptr;
+        int64_t _lastReceivedAt = 0;
+        int64_t _busFreeAt = 0;
+        SStats _stats = {};
+
+        MemoryCan(size_t txQueueLength) : ACan(), _txQueueLength(txQueueLength) {}
+
+        int Install(size_t rxQueueLength)
+        {
+            if ((_rxQueue = xQueueCreate(rxQueueLength, sizeof(SQueuedFrame))) == NULL)
+            {
+                LOGE(nameof(CAN::MemoryCan), "Failed to create RX queue.");
+                return ESP_ERR_NO_MEM;
+            }
+            return 0;
+        }
+
+        static int64_t WireTimeUs(const SCanMessage& message)
+        {
+            return (int64_t)TrafficSynthesizer::FrameBits(message.length) * 1000000 / TrafficSynthesizer::BUS_BITRATE;
+        }
+
+        //Reserves the wire for a frame and returns when its transmission will end.
+        int64_t Occupy(const SCanMessage& message, int64_t now)
+        {
+            int64_t start = _busFreeAt > now ? _busFreeAt : now;
+            _busFreeAt = start + WireTimeUs(message);
+            return _busFreeAt;
+        }
+
+    public:
+        static MemoryCan* Initialize(size_t rxQueueLength = DEFAULT_RX_QUEUE_LENGTH, size_t txQueueLength = DEFAULT_TX_QUEUE_LENGTH)
+        {
+            MemoryCan* instance = new MemoryCan(txQueueLength);
+            if (instance == nullptr || instance->Install(rxQueueLength) == 0)
+                return instance;
+
+            delete instance;
+            return nullptr;
+        }
+
+        ~MemoryCan()
+        {
+            if (_rxQueue != NULL)
+                vQueueDelete(_rxQueue);
+        }
+
+        //The segment that frames sent on this one were received from, used to measure the relay latency.
+        //Only valid while a single task receives on the upstream segment and sends on this one, which is how BusMaster uses its buses.
+        void SetUpstream(MemoryCan* upstream)
+        {
+            _upstream = upstream;
+        }
+
+        //Returns false if the frame was dropped because the RX queue was full.
+        bool Inject(const SCanMessage& message)
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, portMAX_DELAY) != pdTRUE)
+                return false;
+            #endif
+
+            int64_t now = Time::Clock::Now();
+            //The frame is only complete (and therefore visible to the controller) once it has been fully transmitted by the other node.
+            SQueuedFrame frame = { message, Occupy(message, now) };
+            _stats.injected++;
+            bool accepted = xQueueSend(_rxQueue, &frame, 0) == pdTRUE;
+            if (!accepted)
+                _stats.dropped++;
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+            return accepted;
+        }
+
+        esp_err_t Send(SCanMessage message, TickType_t timeout)
+        {
+            TickType_t start = xTaskGetTickCount();
+            while (true)
+            {
+                #ifdef USE_CAN_DRIVER_LOCK
+                if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
+                    return ESP_ERR_TIMEOUT;
+                #endif
+
+                int64_t now = Time::Clock::Now();
+                //Block like twai_transmit does when the TX queue is full.
+                if (_busFreeAt - now <= (int64_t)_txQueueLength * WireTimeUs(message))
+                {
+                    int64_t transmittedAt = Occupy(message, now);
+                    _stats.sent++;
+                    if (_upstream != nullptr)
+                    {
+                        uint32_t latency = (uint32_t)(transmittedAt - _upstream->_lastReceivedAt);
+                        _stats.latencySumUs += latency;
+                        if (latency > _stats.latencyMaxUs)
+                            _stats.latencyMaxUs = latency;
+                    }
+                    #ifdef USE_CAN_DRIVER_LOCK
+                    xSemaphoreGive(_driverMutex);
+                    #endif
+                    return ESP_OK;
+                }
+
+                #ifdef USE_CAN_DRIVER_LOCK
+                xSemaphoreGive(_driverMutex);
+                #endif
+
+                if (xTaskGetTickCount() - start >= timeout)
+                {
+                    _stats.sendTimeouts++;
+                    return ESP_ERR_TIMEOUT;
+                }
+                vTaskDelay(1);
+            }
+        }
+
+        esp_err_t Receive(SCanMessage* message, TickType_t timeout)
+        {
+            SQueuedFrame frame;
+            if (xQueueReceive(_rxQueue, &frame, timeout) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+
+            //Don't hand the frame over before it has finished arriving, the wire time of a frame is well below a tick.
+            Time::Clock::SpinUntil(frame.injectedAt);
+
+            *message = frame.message;
+            _lastReceivedAt = frame.injectedAt;
+            _stats.received++;
+            return ESP_OK;
+        }
+
+        esp_err_t GetHealth(SCanHealth* health, TickType_t timeout)
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+            #endif
+
+            int64_t now = Time::Clock::Now();
+            *health = {};
+            health->sampledAt = esp_timer_get_time();
+            health->state = _busState;
+            health->rxMissed = _stats.dropped;
+            health->txFailed = _stats.sendTimeouts;
+            //The TX backlog is only modelled as wire time, report it in full length frames.
+            int64_t frameTime = (int64_t)TrafficSynthesizer::FrameBits(8) * 1000000 / TrafficSynthesizer::BUS_BITRATE;
+            if (_busFreeAt > now)
+                health->txQueued = (uint16_t)((_busFreeAt - now + frameTime - 1) / frameTime);
+            health->rxQueued = (uint16_t)uxQueueMessagesWaiting(_rxQueue);
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+            return ESP_OK;
+        }
+
+        SStats GetStats()
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreTake(_driverMutex, portMAX_DELAY);
+            #endif
+            SStats stats = _stats;
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+            return stats;
+        }
+
+        void ResetStats()
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreTake(_driverMutex, portMAX_DELAY);
+            #endif
+            _stats = {};
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+        }
+    };
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+//Checks that the IDs the bike sends at a fixed rate keep arriving at that rate.
+//Each ID learns its nominal period from its first LEARNING_FRAMES intervals, after which every frame updates a moving average of the period and of the jitter around the nominal one.
+//The relay tasks report frames with OnFrame (constant time, one writer per ID as every ID arrives on a single bus), Check is then called periodically to find the frames that are overdue.
+//State is kept as bitmaps with one bit per monitored ID, in the order the IDs were given.
+//Reset restarts learning, each ID starts over from its next frame.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class PeriodMonitor
+    {
+    public:
+        static const size_t MAX_IDS = 32; //One bit each in the bitmaps.
+        static const uint32_t LEARNING_FRAMES = 16;
+        static const uint32_t OVERDUE_PERIODS = 3; //A frame is overdue once this many nominal periods have passed without it.
+        static const uint32_t DRIFT_PERCENT = 20; //The average period has drifted once it is this far from the nominal one, and recovers at half of it.
+        static const uint8_t SMOOTHING_SHIFT = 3; //Moving averages move by 1/8 of each difference.
+
+        struct SPeriodStats
+        {
+            uint32_t id;
+            uint32_t nominalPeriodUs; //0 while learning.
+            uint32_t periodUs;
+            uint32_t jitterUs;
+            uint32_t frames;
+            uint32_t overdueCount;
+        };
+
+        //Bitmaps of the IDs that changed state since the previous Check.
+        struct SChanges
+        {
+            uint32_t learned;
+            uint32_t overdue;
+            uint32_t resumed;
+            uint32_t drifted;
+            uint32_t recovered;
+        };
+
+    private:
+        static const size_t ID_COUNT = 2048;
+        static const uint8_t NO_SLOT = 0xFF;
+
+        struct SEntry
+        {
+            uint32_t id;
+            //Written only by the relay task that receives the ID, times are truncated to 32 bits and only ever subtracted.
+            std::atomic<uint32_t> lastSeen = 0;
+            std::atomic<uint32_t> frames = 0;
+            std::atomic<uint32_t> nominalPeriodUs = 0;
+            std::atomic<uint32_t> periodUs = 0;
+            std::atomic<uint32_t> jitterUs = 0;
+            uint32_t learningSum = 0;
+            uint32_t generation = 0; //The _generation this entry learned in.
+            //Written only by Check.
+            uint32_t overdueCount = 0;
+        };
+
+        uint8_t _slots[ID_COUNT];
+        SEntry _entries[MAX_IDS];
+        size_t _count = 0;
+        std::atomic<uint32_t> _learned = 0;
+        std::atomic<uint32_t> _overdue = 0;
+        std::atomic<uint32_t> _drifting = 0;
+        std::atomic<uint32_t> _generation = 0; //Incremented by Reset.
+        //The state at the previous Check.
+        uint32_t _reportedLearned = 0;
+        uint32_t _reportedOverdue = 0;
+        uint32_t _reportedDrifting = 0;
+
+        static inline uint32_t Difference(uint32_t a, uint32_t b)
+        {
+            return a > b ? a - b : b - a;
+        }
+
+        static inline uint32_t Smooth(uint32_t average, uint32_t value)
+        {
+            return (uint32_t)((int64_t)average + ((int64_t)value - average) / (1 << SMOOTHING_SHIFT));
+        }
+
+    public:
+        //IDs past MAX_IDS, and extended IDs, are ignored.
+        PeriodMonitor(const uint16_t* ids, size_t count)
+        {
+            memset(_slots, NO_SLOT, sizeof(_slots));
+            for (size_t i = 0; i < count && _count < MAX_IDS; i++)
+            {
+                if (ids[i] >= ID_COUNT || _slots[ids[i]] != NO_SLOT)
+                    continue;
+                _slots[ids[i]] = _count;
+                _entries[_count].id = ids[i];
+                _count++;
+            }
+        }
+
+        inline void RELAY_IRAM_ATTR OnFrame(uint32_t id, uint32_t now)
+        {
+            if (id >= ID_COUNT || _slots[id] == NO_SLOT)
+                return;
+
+            uint8_t slot = _slots[id];
+            SEntry& entry = _entries[slot];
+            uint32_t bit = 1UL << slot;
+            uint32_t generation = _generation.load(std::memory_order_relaxed);
+            if (entry.generation != generation)
+            {
+                //The first frame since Reset, a bit set for the previous generation after Reset cleared the bitmaps is cleared here.
+                entry.generation = generation;
+                entry.learningSum = 0;
+                entry.nominalPeriodUs.store(0, std::memory_order_relaxed);
+                entry.periodUs.store(0, std::memory_order_relaxed);
+                entry.jitterUs.store(0, std::memory_order_relaxed);
+                entry.frames.store(0, std::memory_order_relaxed);
+                _learned.fetch_and(~bit, std::memory_order_relaxed);
+                _overdue.fetch_and(~bit, std::memory_order_relaxed);
+                _drifting.fetch_and(~bit, std::memory_order_relaxed);
+            }
+
+            uint32_t frames = entry.frames.load(std::memory_order_relaxed);
+            uint32_t interval = now - entry.lastSeen.load(std::memory_order_relaxed);
+            //Ordered against Check, which sets the overdue bit before reading lastSeen again: either this frame sees the bit and clears it or Check sees this time.
+            entry.lastSeen.store(now, std::memory_order_seq_cst);
+            entry.frames.store(frames + 1, std::memory_order_relaxed);
+            if (frames == 0)
+                return;
+
+            uint32_t nominal = entry.nominalPeriodUs.load(std::memory_order_relaxed);
+            if (nominal == 0)
+            {
+                entry.learningSum += interval;
+                if (frames < LEARNING_FRAMES)
+                    return;
+                nominal = entry.learningSum / LEARNING_FRAMES;
+                if (nominal == 0)
+                    nominal = 1;
+                entry.periodUs.store(nominal, std::memory_order_relaxed);
+                entry.nominalPeriodUs.store(nominal, std::memory_order_release);
+                _learned.fetch_or(bit, std::memory_order_relaxed);
+                return;
+            }
+
+            if (_overdue.load(std::memory_order_seq_cst) & bit)
+                _overdue.fetch_and(~bit, std::memory_order_relaxed);
+
+            //A gap this long has already been reported as overdue (or the bike was off), it says nothing about the rate.
+            if (interval > nominal * OVERDUE_PERIODS)
+                return;
+
+            uint32_t period = Smooth(entry.periodUs.load(std::memory_order_relaxed), interval);
+            entry.periodUs.store(period, std::memory_order_relaxed);
+            entry.jitterUs.store(Smooth(entry.jitterUs.load(std::memory_order_relaxed), Difference(interval, nominal)), std::memory_order_relaxed);
+
+            uint64_t drift = (uint64_t)Difference(period, nominal) * 100;
+            bool drifting = _drifting.load(std::memory_order_relaxed) & bit;
+            if (!drifting && drift > (uint64_t)nominal * DRIFT_PERCENT)
+                _drifting.fetch_or(bit, std::memory_order_relaxed);
+            else if (drifting && drift < (uint64_t)nominal * DRIFT_PERCENT / 2)
+                _drifting.fetch_and(~bit, std::memory_order_relaxed);
+        }
+
+        //Marks the learned IDs that haven't been seen for OVERDUE_PERIODS as overdue and returns what changed since the previous call.
+        //An overdue ID stays overdue (and is reported once) until its next frame, e.g. while the bike is off.
+        SChanges Check(uint32_t now)
+        {
+            uint32_t learned = _learned.load(std::memory_order_relaxed);
+            uint32_t overdue = _overdue.load(std::memory_order_relaxed);
+            SChanges changes = {};
+            changes.learned = learned & ~_reportedLearned;
+            changes.resumed = _reportedOverdue & ~overdue;
+
+            for (size_t i = 0; i < _count; i++)
+            {
+                uint32_t bit = 1UL << i;
+                if (!(learned & bit) || (overdue & bit))
+                    continue;
+
+                SEntry& entry = _entries[i];
+                uint32_t nominal = entry.nominalPeriodUs.load(std::memory_order_acquire);
+                uint32_t lastSeen = entry.lastSeen.load(std::memory_order_relaxed);
+                if (now - lastSeen <= nominal * OVERDUE_PERIODS)
+                    continue;
+
+                //A frame that arrived since lastSeen was read may have missed the bit, in which case it is taken back.
+                _overdue.fetch_or(bit, std::memory_order_seq_cst);
+                if (entry.lastSeen.load(std::memory_order_seq_cst) != lastSeen)
+                {
+                    _overdue.fetch_and(~bit, std::memory_order_relaxed);
+                    continue;
+                }
+
+                entry.overdueCount++;
+                changes.overdue |= bit;
+            }
+
+            uint32_t drifting = _drifting.load(std::memory_order_relaxed);
+            changes.drifted = drifting & ~_reportedDrifting;
+            changes.recovered = _reportedDrifting & ~drifting;
+
+            _reportedLearned = learned;
+            _reportedOverdue = overdue | changes.overdue;
+            _reportedDrifting = drifting;
+            return changes;
+        }
+
+        //Restarts learning for every ID and clears the bitmaps, without reporting it as changes.
+        //Called from the same task as Check, the relay tasks pick it up with their next frame.
+        void Reset()
+        {
+            _generation.fetch_add(1, std::memory_order_relaxed);
+            _learned.store(0, std::memory_order_relaxed);
+            _overdue.store(0, std::memory_order_relaxed);
+            _drifting.store(0, std::memory_order_relaxed);
+            _reportedLearned = 0;
+            _reportedOverdue = 0;
+            _reportedDrifting = 0;
+        }
+
+        //A bit per monitored ID that has learned its period and is neither overdue nor drifting.
+        uint32_t GetHealthBitmap() const
+        {
+            return _learned.load(std::memory_order_relaxed) & ~_overdue.load(std::memory_order_relaxed) & ~_drifting.load(std::memory_order_relaxed);
+        }
+
+        uint32_t GetLearnedBitmap() const { return _learned.load(std::memory_order_relaxed); }
+        uint32_t GetOverdueBitmap() const { return _overdue.load(std::memory_order_relaxed); }
+        uint32_t GetDriftingBitmap() const { return _drifting.load(std::memory_order_relaxed); }
+
+        size_t GetCount() const
+        {
+            return _count;
+        }
+
+        bool GetStats(size_t index, SPeriodStats* outStats) const
+        {
+            if (index >= _count)
+                return false;
+            const SEntry& entry = _entries[index];
+            outStats->id = entry.id;
+            outStats->nominalPeriodUs = entry.nominalPeriodUs.load(std::memory_order_acquire);
+            outStats->periodUs = entry.periodUs.load(std::memory_order_relaxed);
+            outStats->jitterUs = entry.jitterUs.load(std::memory_order_relaxed);
+            outStats->frames = entry.frames.load(std::memory_order_relaxed);
+            outStats->overdueCount = entry.overdueCount;
+            return true;
+        }
+    };
+};
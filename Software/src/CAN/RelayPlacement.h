@@ -0,0 +1,15 @@
+#pragma once
+
+//Placement of the relay path, with CAN_RELAY_IN_IRAM defined the functions that every relayed frame passes through are linked into IRAM.
+//Flash writes (PersistentData::Save, OTA) disable the cache and flush it, code in IRAM doesn't have to be fetched back from flash afterwards so the relay resumes without cache miss stalls.
+//The data the path touches (driver instances, queues, metrics) is already in internal RAM as it is either heap allocated or zero initialised.
+//The hardware side (TWAI ISR, MCP2515 GPIO ISR) is also made IRAM safe so that frames keep being queued while the cache is disabled.
+//Tools/IramCheck verifies the placement against the linker map.
+//This header has no platform dependencies so that it can be shared with the host tools, where it expands to nothing.
+
+#if defined(CAN_RELAY_IN_IRAM) && __has_include(<esp_attr.h>)
+#include <esp_attr.h>
+#define RELAY_IRAM_ATTR IRAM_ATTR
+#else
+#define RELAY_IRAM_ATTR
+#endif
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <stdio.h>
+#include "SCanMessage.h"
+#include "ACan.h"
+#include "RelayPlacement.h"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Watches both relay loops for gaps in progress and freezes a snapshot of what led up to each one.
+    //The relay tasks report each frame as it is received and relayed, Check is then called periodically from a task of higher priority than the relay.
+    class RelayWatchdog
+    {
+    public:
+        static const size_t RECENT_FRAMES = 16;
+        static const size_t MAX_SNAPSHOTS = 4;
+        static const uint32_t MIN_STALL_US = 50000; //Ignore gaps shorter than this regardless of the frame period.
+        static const uint32_t STALL_PERIOD_FACTOR = 10; //A gap of this many expected frame periods is a stall.
+        static const uint32_t IDLE_GAP_US = 1000000; //Longer than this without a frame and the bus is considered off rather than stalled.
+
+        enum EStallReason : uint8_t
+        {
+            ReceiveGap = 0, //No frame was received for much longer than the bus's frame period.
+            RelayBlocked = 1, //A received frame was not relayed in time, e.g. a Send waiting on a full TX queue.
+        };
+
+        struct SRecentFrame
+        {
+            int64_t receivedAt;
+            SCanMessage message;
+        };
+
+        struct STaskInfo
+        {
+            eTaskState state;
+            UBaseType_t priority;
+            uint32_t stackHighWaterMark;
+        };
+
+        struct SStallSnapshot
+        {
+            int64_t detectedAt;
+            uint8_t bus; //0 for CAN1->CAN2, 1 for CAN2->CAN1.
+            EStallReason reason;
+            uint32_t expectedPeriodUs;
+            uint32_t gapUs; //Gap when the stall was detected.
+            uint32_t durationUs; //Full length of the gap, set once the relay makes progress again (0 until then).
+            STaskInfo tasks[2];
+            uint16_t rxQueued[2];
+            uint8_t frameCount[2];
+            SRecentFrame frames[2][RECENT_FRAMES]; //Oldest first.
+        };
+
+    private:
+        struct SRelayState
+        {
+            //Written only by the relay task, read by Check.
+            SRecentFrame frames[RECENT_FRAMES];
+            std::atomic<uint32_t> frameIndex = 0;
+            std::atomic<int64_t> lastFrameAt = 0;
+            std::atomic<int64_t> inFlightSince = 0; //Receive time of the frame being relayed, 0 when none is.
+            std::atomic<uint32_t> periodUs = 0; //Moving average of the time between frames.
+            //Written only by Check.
+            int stallSnapshot = -1; //Index of the snapshot of the ongoing stall, -1 when there is none.
+            int64_t stallFrom = 0;
+        };
+
+        SRelayState _relays[2];
+        SStallSnapshot _snapshots[MAX_SNAPSHOTS] = {};
+        uint32_t _stallCount = 0;
+
+        void Capture(int bus, EStallReason reason, int64_t from, int64_t now, TaskHandle_t tasks[2], ACan* buses[2])
+        {
+            SRelayState& relay = _relays[bus];
+            relay.stallSnapshot = _stallCount % MAX_SNAPSHOTS;
+            relay.stallFrom = from;
+            _stallCount++;
+
+            SStallSnapshot& snapshot = _snapshots[relay.stallSnapshot];
+            snapshot.detectedAt = now;
+            snapshot.bus = bus;
+            snapshot.reason = reason;
+            snapshot.expectedPeriodUs = relay.periodUs.load(std::memory_order_relaxed);
+            snapshot.gapUs = (uint32_t)(now - from);
+            snapshot.durationUs = 0;
+
+            for (int i = 0; i < 2; i++)
+            {
+                snapshot.tasks[i] = {};
+                if (tasks[i] != NULL)
+                {
+                    snapshot.tasks[i].state = eTaskGetState(tasks[i]);
+                    snapshot.tasks[i].priority = uxTaskPriorityGet(tasks[i]);
+                    snapshot.tasks[i].stackHighWaterMark = uxTaskGetStackHighWaterMark(tasks[i]);
+                }
+
+                //Frames waiting in the controller tell a stalled relay apart from a quiet bus.
+                SCanHealth health = {};
+                if (buses[i] != nullptr)
+                    buses[i]->GetHealth(&health, 0);
+                snapshot.rxQueued[i] = health.rxQueued;
+
+                //The frames of a stalled relay are not changing, the other relay may overwrite one while it is copied which is acceptable for a diagnostic.
+                uint32_t end = _relays[i].frameIndex.load(std::memory_order_acquire);
+                uint32_t count = end < RECENT_FRAMES ? end : RECENT_FRAMES;
+                snapshot.frameCount[i] = count;
+                for (uint32_t j = 0; j < count; j++)
+                    snapshot.frames[i][j] = _relays[i].frames[(end - count + j) % RECENT_FRAMES];
+            }
+        }
+
+    public:
+        //Called by the relay task when a frame has been received.
+        inline void RELAY_IRAM_ATTR OnReceived(int bus, const SCanMessage& message, int64_t now)
+        {
+            SRelayState& relay = _relays[bus];
+            uint32_t index = relay.frameIndex.load(std::memory_order_relaxed);
+            relay.frames[index % RECENT_FRAMES] = { now, message };
+            relay.frameIndex.store(index + 1, std::memory_order_release);
+
+            int64_t last = relay.lastFrameAt.load(std::memory_order_relaxed);
+            if (last != 0 && now - last < IDLE_GAP_US)
+            {
+                //Average over ~16 frames, enough to smooth the bursts of the bike bus.
+                uint32_t period = relay.periodUs.load(std::memory_order_relaxed);
+                uint32_t interval = (uint32_t)(now - last);
+                relay.periodUs.store(period == 0 ? interval : period - period / 16 + interval / 16, std::memory_order_relaxed);
+            }
+            relay.lastFrameAt.store(now, std::memory_order_relaxed);
+            relay.inFlightSince.store(now, std::memory_order_release);
+        }
+
+        //Called by the relay task when the frame has been sent on (or has failed to be).
+        inline void RELAY_IRAM_ATTR OnRelayed(int bus)
+        {
+            _relays[bus].inFlightSince.store(0, std::memory_order_release);
+        }
+
+        //Returns a bit per bus (bit 0 for CAN1) that a new stall was detected on.
+        uint8_t Check(int64_t now, TaskHandle_t tasks[2], ACan* buses[2])
+        {
+            uint8_t detected = 0;
+            for (int bus = 0; bus < 2; bus++)
+            {
+                SRelayState& relay = _relays[bus];
+                int64_t inFlightSince = relay.inFlightSince.load(std::memory_order_acquire);
+                int64_t lastFrameAt = relay.lastFrameAt.load(std::memory_order_relaxed);
+                uint32_t period = relay.periodUs.load(std::memory_order_relaxed);
+                uint32_t threshold = period * STALL_PERIOD_FACTOR > MIN_STALL_US ? period * STALL_PERIOD_FACTOR : MIN_STALL_US;
+
+                //The stall is over once a newer frame has arrived and been relayed.
+                if (relay.stallSnapshot >= 0)
+                {
+                    if (lastFrameAt > relay.stallFrom && inFlightSince == 0)
+                    {
+                        SStallSnapshot& snapshot = _snapshots[relay.stallSnapshot];
+                        snapshot.durationUs = (uint32_t)(lastFrameAt - relay.stallFrom);
+                        LOGW(nameof(CAN::RelayWatchdog), "CAN%i relay resumed after %lums.", bus + 1, (unsigned long)(snapshot.durationUs / 1000));
+                        relay.stallSnapshot = -1;
+                    }
+                    else if (inFlightSince == 0 && now - lastFrameAt >= IDLE_GAP_US && _snapshots[relay.stallSnapshot].reason == ReceiveGap)
+                    {
+                        //The bus has gone quiet, the gap can't be told apart from the bike turning off so stop timing it.
+                        relay.stallSnapshot = -1;
+                    }
+                    continue;
+                }
+
+                if (inFlightSince != 0 && now - inFlightSince > threshold)
+                {
+                    Capture(bus, RelayBlocked, inFlightSince, now, tasks, buses);
+                    detected |= 1 << bus;
+                }
+                else if (inFlightSince == 0 && period != 0 && lastFrameAt != 0 && now - lastFrameAt > threshold && now - lastFrameAt < IDLE_GAP_US)
+                {
+                    Capture(bus, ReceiveGap, lastFrameAt, now, tasks, buses);
+                    detected |= 1 << bus;
+                }
+            }
+            return detected;
+        }
+
+        uint32_t GetStallCount() const
+        {
+            return _stallCount;
+        }
+
+        //Most recent first, index 0 to min(GetStallCount(), MAX_SNAPSHOTS) - 1.
+        const SStallSnapshot* GetSnapshot(size_t index) const
+        {
+            if (index >= _stallCount || index >= MAX_SNAPSHOTS)
+                return nullptr;
+            return &_snapshots[(_stallCount - 1 - index) % MAX_SNAPSHOTS];
+        }
+
+        void Dump(int64_t now) const
+        {
+            for (size_t i = 0; GetSnapshot(i) != nullptr; i++)
+            {
+                const SStallSnapshot* snapshot = GetSnapshot(i);
+                printf("Stall %lu: CAN%u %s, %lldms ago, gap %luus (%luus total), expected period %luus\n",
+                    (unsigned long)(_stallCount - i),
+                    snapshot->bus + 1,
+                    snapshot->reason == ReceiveGap ? "receive gap" : "relay blocked",
+                    (long long)((now - snapshot->detectedAt) / 1000),
+                    (unsigned long)snapshot->gapUs,
+                    (unsigned long)snapshot->durationUs,
+                    (unsigned long)snapshot->expectedPeriodUs);
+                for (int bus = 0; bus < 2; bus++)
+                {
+                    printf("  CAN%i task: state %i, priority %u, stack free %lu, rx queued %u\n",
+                        bus + 1,
+                        snapshot->tasks[bus].state,
+                        (unsigned)snapshot->tasks[bus].priority,
+                        (unsigned long)snapshot->tasks[bus].stackHighWaterMark,
+                        snapshot->rxQueued[bus]);
+                    for (size_t j = 0; j < snapshot->frameCount[bus]; j++)
+                    {
+                        const SRecentFrame& frame = snapshot->frames[bus][j];
+                        printf("    %+lldus %03lx [%u]", (long long)(frame.receivedAt - snapshot->detectedAt), (unsigned long)frame.message.id, frame.message.length);
+                        for (size_t k = 0; k < frame.message.length && k < 8; k++)
+                            printf(" %02X", frame.message.data[k]);
+                        printf("\n");
+                    }
+                }
+            }
+        }
+    };
+};
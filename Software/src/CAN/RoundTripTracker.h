@@ -0,0 +1,163 @@
+#pragma once
+
+//Pairs the configuration requests that the display sends on 0x100 with the motor's responses on 0x101 as they pass through the relay, by service and DID (see ConfigTransactions.h).
+//Each round trip is split into the time the request spent in our relay before reaching the motor's bus, the time the motor took to answer it,
+//and the time the response spent in our relay on the way back, so that a slow answer can be put down to the relay or to the motor.
+//Only the first frame of a response is timed, the rest of a long response is paced by the display's flow control.
+//Times are in microseconds on whatever clock the caller uses.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class RoundTripTracker
+    {
+    public:
+        static const uint32_t REQUEST_ID = 0x100;
+        static const uint32_t RESPONSE_ID = 0x101;
+        static const size_t MAX_PENDING = 4;
+        static const int64_t RESPONSE_TIMEOUT_US = 1000000; //Requests that haven't been answered by then are forgotten.
+
+        struct SRoundTrip
+        {
+            uint8_t service;
+            uint16_t did; //0 for a negative response, which doesn't repeat it.
+            uint32_t requestRelayUs; //Received from the display to queued on the motor's bus.
+            uint32_t deviceUs; //Queued on the motor's bus to the response being received.
+            uint32_t responseRelayUs; //Response received to queued on the display's bus.
+            uint32_t totalUs;
+        };
+
+        struct SStats
+        {
+            uint32_t matched;
+            uint32_t unmatched; //Responses to requests that weren't seen, such as our own.
+            uint32_t expired; //Requests that were never answered.
+        };
+
+    private:
+        static const uint8_t NEGATIVE_RESPONSE = 0x7F;
+        static const uint8_t POSITIVE_RESPONSE_OFFSET = 0x40;
+
+        struct SPending
+        {
+            bool active;
+            uint8_t service;
+            uint16_t did;
+            int64_t receivedAt;
+            int64_t relayedAt;
+        };
+
+        SPending _pending[MAX_PENDING] = {};
+        SStats _stats = {};
+
+        static inline uint32_t Elapsed(int64_t from, int64_t to)
+        {
+            return to > from ? (uint32_t)(to - from > UINT32_MAX ? UINT32_MAX : to - from) : 0;
+        }
+
+        void Expire(int64_t now)
+        {
+            for (auto&& pending : _pending)
+            {
+                if (pending.active && now - pending.relayedAt >= RESPONSE_TIMEOUT_US)
+                {
+                    pending.active = false;
+                    _stats.expired++;
+                }
+            }
+        }
+
+    public:
+        //A request relayed from the display, receivedAt is when it was read from the display's bus and relayedAt when it was queued on the motor's.
+        void OnRequest(const SCanMessage& message, int64_t receivedAt, int64_t relayedAt)
+        {
+            //Single frame reads and writes only, flow control frames (0x3_) are part of a response that is already being timed.
+            if (message.id != REQUEST_ID || message.length < 4 || (message.data[0] >> 4) != 0x0)
+                return;
+
+            Expire(relayedAt);
+
+            //A repeated request replaces the oldest entry when full, the older one has most likely been given up on.
+            SPending* slot = &_pending[0];
+            for (auto&& pending : _pending)
+            {
+                if (!pending.active)
+                {
+                    slot = &pending;
+                    break;
+                }
+                if (pending.relayedAt < slot->relayedAt)
+                    slot = &pending;
+            }
+            if (slot->active)
+                _stats.expired++;
+            *slot = { true, message.data[1], (uint16_t)(message.data[2] << 8 | message.data[3]), receivedAt, relayedAt };
+        }
+
+        //A response relayed from the motor, returns true with the round trip if it answers a request that was seen.
+        bool OnResponse(const SCanMessage& message, int64_t receivedAt, int64_t relayedAt, SRoundTrip* outRoundTrip)
+        {
+            if (message.id != RESPONSE_ID || message.length < 4)
+                return false;
+
+            uint8_t service;
+            uint16_t did = 0;
+            bool matchDid = true;
+            switch (message.data[0] >> 4)
+            {
+            case 0x0:
+                if (message.data[1] == NEGATIVE_RESPONSE)
+                {
+                    service = message.data[2];
+                    matchDid = false;
+                }
+                else
+                {
+                    service = message.data[1] - POSITIVE_RESPONSE_OFFSET;
+                    did = message.data[2] << 8 | message.data[3];
+                }
+                break;
+            case 0x1:
+                if (message.length < 5)
+                    return false;
+                service = message.data[2] - POSITIVE_RESPONSE_OFFSET;
+                did = message.data[3] << 8 | message.data[4];
+                break;
+            default:
+                return false;
+            }
+
+            Expire(receivedAt);
+
+            //The oldest matching request, the display waits for each answer so there should only ever be one.
+            SPending* match = nullptr;
+            for (auto&& pending : _pending)
+                if (pending.active && pending.service == service && (!matchDid || pending.did == did) && (match == nullptr || pending.relayedAt < match->relayedAt))
+                    match = &pending;
+            if (match == nullptr)
+            {
+                _stats.unmatched++;
+                return false;
+            }
+
+            match->active = false;
+            _stats.matched++;
+            outRoundTrip->service = service;
+            outRoundTrip->did = did;
+            outRoundTrip->requestRelayUs = Elapsed(match->receivedAt, match->relayedAt);
+            outRoundTrip->deviceUs = Elapsed(match->relayedAt, receivedAt);
+            outRoundTrip->responseRelayUs = Elapsed(receivedAt, relayedAt);
+            outRoundTrip->totalUs = Elapsed(match->receivedAt, relayedAt);
+            return true;
+        }
+
+        const SStats& GetStats() const
+        {
+            return _stats;
+        }
+    };
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    struct SCanFaultStats
+    {
+        uint32_t errorPassive; //Times the controller entered the error passive state.
+        uint32_t busOff; //Times the controller went bus-off.
+        uint32_t recoveries; //Times the controller rejoined the bus after going bus-off.
+        uint32_t lastDowntimeUs; //Time from going bus-off to rejoining the bus, for the most recent recovery.
+        uint32_t maxDowntimeUs;
+        uint64_t totalDowntimeUs;
+    };
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "ECanBusState.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Snapshot of a controller's error state and loss counters, counters are cumulative since the driver was installed.
+    //Fields a backend can not measure are left at 0.
+    struct SCanHealth
+    {
+        int64_t sampledAt; //esp_timer_get_time() when the snapshot was taken, 0 if the bus has never been sampled.
+        ECanBusState state;
+        uint16_t txErrorCounter; //TEC, 128 and above is error passive, above 255 is bus-off.
+        uint16_t rxErrorCounter; //REC.
+        uint32_t rxMissed; //Frames lost because the driver RX queue was full.
+        uint32_t rxOverrun; //Frames lost because the controller RX buffer overran before it was read.
+        uint32_t txFailed; //Frames that could not be transmitted.
+        uint32_t arbLost; //Arbitration lost while transmitting.
+        uint32_t busErrors; //Bit, stuff, form, CRC and ACK errors.
+        uint16_t txQueued; //Frames waiting to be transmitted.
+        uint16_t rxQueued; //Frames waiting to be received.
+    };
+};
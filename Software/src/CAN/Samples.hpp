@@ -1,5 +1,7 @@
 #pragma once
 
+#include "RelayPlacement.h"
+
 namespace ReadieFur::OpenTCU::CAN
 {
     template <typename T, typename TAverage = T>
@@ -18,7 +20,7 @@ namespace ReadieFur::OpenTCU::CAN
             delete[] _samples;
         }
 
-        inline void AddSample(T sample)
+        inline void RELAY_IRAM_ATTR AddSample(T sample)
         {
             //Add samples to the array, and remove the oldest sample if the array is full.
             if (_index >= _capacity)
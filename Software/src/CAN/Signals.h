@@ -0,0 +1,196 @@
+#pragma once
+
+//DBC-like description of the known bus signals (see /Documentation/Data.md).
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <type_traits>
+#include <utility>
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    enum EByteOrder : uint8_t
+    {
+        LittleEndian = 0, //Intel, the start bit is the least significant bit.
+        BigEndian = 1, //Motorola, only byte aligned signals are supported, the start bit is the first bit of the most significant byte.
+    };
+
+    struct SSignal
+    {
+        uint32_t id;
+        uint8_t startBit;
+        uint8_t length;
+        EByteOrder byteOrder;
+        bool isSigned;
+        //Physical value = raw * scaleNumerator / scaleDenominator. Kept rational so the firmware never needs floating point.
+        int32_t scaleNumerator;
+        int32_t scaleDenominator;
+        const char* name;
+        const char* unit;
+    };
+
+    namespace Signals
+    {
+        //D1 and D2, speed of the bike in km/h * 100. Example: EA, 01 -> 01EA -> 490 -> 4.9km/h.
+        inline constexpr SSignal Speed = { 0x201, 0, 16, LittleEndian, false, 1, 100, "Speed", "km/h" };
+
+        //D1, possibly the motor power mode. 00 off, 01 low, 02 medium, 03 high.
+        inline constexpr SSignal MotorMode = { 0x300, 0, 8, LittleEndian, false, 1, 1, "MotorMode", "" };
+        //D2, A5 enables walk mode and 5A disables it.
+        inline constexpr SSignal WalkMode = { 0x300, 8, 8, LittleEndian, false, 1, 1, "WalkMode", "" };
+        //D5, 00 to 64.
+        inline constexpr SSignal EaseSetting = { 0x300, 32, 8, LittleEndian, false, 1, 1, "EaseSetting", "%" };
+        //D7, 00 to 64.
+        inline constexpr SSignal PowerSetting = { 0x300, 48, 8, LittleEndian, false, 1, 1, "PowerSetting", "%" };
+
+        //D1 and D2, battery voltage. Example: 35, 9F -> 9F35 -> 40757mV.
+        inline constexpr SSignal BatteryVoltage = { 0x401, 0, 16, LittleEndian, false, 1, 1000, "BatteryVoltage", "V" };
+        //D5 to D8, battery current, positive when discharging. Example: 5B, F0, FF, FF -> FFFFF05B -> -4005mA.
+        inline constexpr SSignal BatteryCurrent = { 0x401, 32, 32, LittleEndian, true, 1, 1000, "BatteryCurrent", "A" };
+
+        inline constexpr const SSignal* ALL[] =
+        {
+            &Speed,
+            &MotorMode,
+            &WalkMode,
+            &EaseSetting,
+            &PowerSetting,
+            &BatteryVoltage,
+            &BatteryCurrent,
+        };
+    };
+
+    /**
+     * Compile time generated accessors for a signal.
+     * The byte range, shifts and masks are all constants so the calls reduce to the same straight-line loads, shifts and masks as hand-written code.
+     */
+    template <const SSignal& Signal>
+    class SignalCodec
+    {
+        static_assert(Signal.length > 0 && Signal.length <= 32, "Signals must be between 1 and 32 bits long.");
+        static_assert(Signal.byteOrder == LittleEndian || (Signal.startBit % 8 == 0 && Signal.length % 8 == 0), "Big endian signals must be byte aligned.");
+
+    private:
+        static constexpr size_t FIRST_BYTE = Signal.startBit / 8;
+        static constexpr size_t SHIFT = Signal.byteOrder == LittleEndian ? Signal.startBit % 8 : 0;
+        static constexpr size_t BYTE_COUNT = (SHIFT + Signal.length + 7) / 8;
+        static_assert(FIRST_BYTE + BYTE_COUNT <= 8, "Signal exceeds the frame payload.");
+
+        //Use the native register width when possible (the RISC-V cores are 32 bit).
+        using TWord = std::conditional_t<(BYTE_COUNT <= 4), uint32_t, uint64_t>;
+        static constexpr TWord MASK = Signal.length == 32 ? (TWord)0xFFFFFFFF : (((TWord)1 << Signal.length) - 1);
+
+        static constexpr size_t BytePosition(size_t i)
+        {
+            return Signal.byteOrder == LittleEndian ? i : BYTE_COUNT - 1 - i;
+        }
+
+        template <size_t... I>
+        static inline TWord Gather(const uint8_t* data, std::index_sequence<I...>)
+        {
+            return (((TWord)data[FIRST_BYTE + I] << (8 * BytePosition(I))) | ...);
+        }
+
+        template <size_t... I>
+        static inline void Scatter(uint8_t* data, TWord bits, std::index_sequence<I...>)
+        {
+            constexpr TWord KEEP = ~(MASK << SHIFT);
+            ((data[FIRST_BYTE + I] = (uint8_t)((data[FIRST_BYTE + I] & (uint8_t)(KEEP >> (8 * BytePosition(I)))) | (uint8_t)(bits >> (8 * BytePosition(I))))), ...);
+        }
+
+    public:
+        using TValue = std::conditional_t<Signal.isSigned, int32_t, uint32_t>;
+        static constexpr uint32_t ID = Signal.id;
+
+        static inline TValue Extract(const uint8_t* data)
+        {
+            TWord raw = (Gather(data, std::make_index_sequence<BYTE_COUNT>{}) >> SHIFT) & MASK;
+            if constexpr (Signal.isSigned && Signal.length < 32)
+            {
+                //Sign extend without branching.
+                constexpr TWord SIGN_BIT = (TWord)1 << (Signal.length - 1);
+                return (TValue)(int32_t)((raw ^ SIGN_BIT) - SIGN_BIT);
+            }
+            else
+            {
+                return (TValue)raw;
+            }
+        }
+
+        static inline void Insert(uint8_t* data, TValue value)
+        {
+            Scatter(data, ((TWord)(uint32_t)value & MASK) << SHIFT, std::make_index_sequence<BYTE_COUNT>{});
+        }
+    };
+
+    //Runtime (table driven) equivalents of SignalCodec for the logger and host analysis, these are not intended for the relay path.
+    class SignalDecoder
+    {
+    public:
+        static const size_t MAX_FORMATTED = 41; //Buffer size that fits any value Format can write, sign, 19 digits either side of the point and the null.
+
+        static int64_t Extract(const SSignal& signal, const uint8_t* data)
+        {
+            uint64_t raw = 0;
+            if (signal.byteOrder == LittleEndian)
+            {
+                for (size_t bit = 0; bit < signal.length; bit++)
+                {
+                    size_t position = signal.startBit + bit;
+                    raw |= (uint64_t)((data[position / 8] >> (position % 8)) & 1) << bit;
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < signal.length / 8u; i++)
+                    raw = raw << 8 | data[signal.startBit / 8 + i];
+            }
+
+            if (signal.isSigned && (raw >> (signal.length - 1)) & 1)
+                raw |= ~(uint64_t)0 << signal.length;
+            return (int64_t)raw;
+        }
+
+        //The physical value in units of 10^-decimals, with as many decimals as the denominator needs (2 for 1/100), so 490 km/h * 100 gives 490 with 2 decimals.
+        //Integer math only, rounded towards zero when the denominator isn't a power of 10.
+        static int64_t Physical(const SSignal& signal, int64_t raw, uint8_t* outDecimals)
+        {
+            int64_t precision = 1;
+            uint8_t decimals = 0;
+            while (precision < signal.scaleDenominator && decimals < 9)
+            {
+                precision *= 10;
+                decimals++;
+            }
+            *outDecimals = decimals;
+            return raw * signal.scaleNumerator * precision / signal.scaleDenominator;
+        }
+
+        //Writes the physical value of the signal in the frame, e.g. "4.90" for the Speed in EA 01, the unit is left to the caller.
+        static int Format(const SSignal& signal, const uint8_t* data, char* outBuffer, size_t size)
+        {
+            uint8_t decimals;
+            int64_t value = Physical(signal, Extract(signal, data), &decimals);
+            if (decimals == 0)
+                return snprintf(outBuffer, size, "%lld", (long long)value);
+
+            int64_t precision = 1;
+            for (uint8_t i = 0; i < decimals; i++)
+                precision *= 10;
+            uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+            return snprintf(outBuffer, size, "%s%llu.%0*llu", value < 0 ? "-" : "",
+                (unsigned long long)(magnitude / precision), (int)decimals, (unsigned long long)(magnitude % precision));
+        }
+
+        static const SSignal* Find(const char* name)
+        {
+            for (const SSignal* signal : Signals::ALL)
+                if (strcmp(signal->name, name) == 0)
+                    return signal;
+            return nullptr;
+        }
+    };
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <Service/AService.hpp>
+#include "BusMaster.hpp"
+#include "MemoryCan.hpp"
+#include "TrafficModel.h"
+#include "TrafficModelData.h"
+#include "Time/Clock.hpp"
+#include "Memory/HeapCounter.hpp"
+#include "Logging.hpp"
+
+#ifndef CAN_STRESS_TEST
+#error "The stress test requires BusMaster to be built with CAN_STRESS_TEST."
+#endif
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Feeds synthetic bike traffic (see TrafficModelData.h) into the in-memory buses at increasing rates and reports where the relay starts to fall behind.
+    //With VIRTUAL_TIME it instead replays VIRTUAL_RIDE_DURATION_US of traffic at the recorded rate on the virtual clock, as fast as the relay can process it.
+    class StressTest : public Service::AService
+    {
+    private:
+        static const TickType_t STEP_DURATION = pdMS_TO_TICKS(5000);
+        static const TickType_t SETTLE_DURATION = pdMS_TO_TICKS(500);
+        static const uint32_t LATENCY_THRESHOLD_US = 1000; //A relayed frame should never be held for longer than this.
+        #ifdef VIRTUAL_TIME
+        static const int64_t VIRTUAL_RIDE_DURATION_US = 60LL * 60 * 1000000;
+        #endif
+
+        BusMaster* _busMaster = nullptr;
+
+        struct SStepResult
+        {
+            uint32_t rateScale;
+            MemoryCan::SStats stats[2];
+        };
+
+        //Returns false if the relay could not keep up at the given rate.
+        bool RunStep(uint32_t rateScale, SStepResult* result)
+        {
+            MemoryCan* buses[2] = { _busMaster->GetMemoryBus(false), _busMaster->GetMemoryBus(true) };
+            TrafficSynthesizer synthesizer(TrafficModelData::STREAMS, TrafficModelData::STREAM_COUNT, rateScale);
+
+            for (auto&& bus : buses)
+                bus->ResetStats();
+
+            SCanMessage message;
+            uint8_t bus;
+            uint64_t due;
+            bool pending = synthesizer.Next(&message, &bus, &due);
+            int64_t start = esp_timer_get_time();
+            int64_t end = start + (int64_t)pdTICKS_TO_MS(STEP_DURATION) * 1000;
+            while (pending && !ServiceCancellationToken.IsCancellationRequested())
+            {
+                int64_t now = esp_timer_get_time();
+                if (now >= end)
+                    break;
+
+                //Inject everything that has become due since the last tick.
+                while (pending && start + (int64_t)due <= now)
+                {
+                    buses[bus & 1]->Inject(message);
+                    pending = synthesizer.Next(&message, &bus, &due);
+                }
+                vTaskDelay(1);
+            }
+
+            //Let the relay drain what is still queued before sampling the stats.
+            vTaskDelay(SETTLE_DURATION);
+
+            return Collect(rateScale, buses, result);
+        }
+
+        bool Collect(uint32_t rateScale, MemoryCan* buses[2], SStepResult* result)
+        {
+            result->rateScale = rateScale;
+            bool ok = true;
+            for (size_t i = 0; i < 2; i++)
+            {
+                result->stats[i] = buses[i]->GetStats();
+                ok &= result->stats[i].dropped == 0 && result->stats[i].sendTimeouts == 0 && result->stats[i].latencyMaxUs <= LATENCY_THRESHOLD_US;
+            }
+            return ok;
+        }
+
+        #ifdef VIRTUAL_TIME
+        //Returns false if the relay could not keep up with the recorded rate.
+        bool RunVirtualRide(SStepResult* result)
+        {
+            Time::VirtualClock* clock = static_cast<Time::VirtualClock*>(Time::Clock::Get()); //Installed by main.cpp when VIRTUAL_TIME is defined.
+            MemoryCan* buses[2] = { _busMaster->GetMemoryBus(false), _busMaster->GetMemoryBus(true) };
+            TrafficSynthesizer synthesizer(TrafficModelData::STREAMS, TrafficModelData::STREAM_COUNT, 100);
+
+            for (auto&& bus : buses)
+                bus->ResetStats();
+
+            SCanMessage message;
+            uint8_t bus;
+            uint64_t due;
+            bool pending = synthesizer.Next(&message, &bus, &due);
+            int64_t start = clock->Now();
+            int64_t realStart = esp_timer_get_time();
+            while (pending && (int64_t)due < VIRTUAL_RIDE_DURATION_US && !ServiceCancellationToken.IsCancellationRequested())
+            {
+                //The relay tasks run above this one, advancing the clock lets them finish with every frame that has arrived by now before the next is injected.
+                clock->AdvanceTo(start + (int64_t)due);
+                buses[bus & 1]->Inject(message);
+                pending = synthesizer.Next(&message, &bus, &due);
+            }
+
+            //Let the last frames finish arriving and be relayed before sampling the stats.
+            clock->Advance((int64_t)pdTICKS_TO_MS(SETTLE_DURATION) * 1000);
+            vTaskDelay(pdMS_TO_TICKS(100));
+
+            LOGI(nameof(CAN::StressTest), "Replayed %llds of traffic in %lldms.",
+                (long long)((clock->Now() - start) / 1000000), (long long)((esp_timer_get_time() - realStart) / 1000));
+            return Collect(100, buses, result);
+        }
+        #endif
+
+        void Report(const SStepResult& result, bool ok)
+        {
+            for (size_t i = 0; i < 2; i++)
+            {
+                //Stats for the relayed direction are recorded on the bus that was sent to.
+                const MemoryCan::SStats& upstream = result.stats[i];
+                const MemoryCan::SStats& downstream = result.stats[i ^ 1];
+                LOGI(nameof(CAN::StressTest), "%3lu.%02lux CAN%u->CAN%u: injected %lu, dropped %lu, relayed %lu, timeouts %lu, latency avg %lluus max %luus%s",
+                    result.rateScale / 100, result.rateScale % 100, i + 1, (i ^ 1) + 1,
+                    upstream.injected, upstream.dropped, downstream.sent, downstream.sendTimeouts,
+                    downstream.sent > 0 ? downstream.latencySumUs / downstream.sent : 0, downstream.latencyMaxUs,
+                    ok ? "" : " (FAIL)");
+            }
+        }
+
+    protected:
+        void RunServiceImpl() override
+        {
+            _busMaster = GetService<BusMaster>(); //Won't be null here, the service manager will ensure that all required services are started before this one.
+
+            //Wait for the relay tasks to come up.
+            vTaskDelay(pdMS_TO_TICKS(1000));
+
+            uint32_t load = TrafficSynthesizer::BusLoad(TrafficModelData::STREAMS, TrafficModelData::STREAM_COUNT);
+            uint32_t saturation = load > 0 ? 1000000 / load : 100;
+            LOGI(nameof(CAN::StressTest), "Bus load at 1x: %lu.%02lu%%, saturation at %lu%% of the recorded rate.", load / 100, load % 100, saturation);
+
+            //The relay should not touch the heap however much traffic it handles.
+            uint32_t allocationsBefore = Memory::HeapCounter::GetAllocations();
+
+            #ifdef VIRTUAL_TIME
+            SStepResult result;
+            bool ok = RunVirtualRide(&result);
+            Report(result, ok);
+            if (ok)
+                LOGI(nameof(CAN::StressTest), "The relay kept up with the recorded rate for the whole ride.");
+            else
+                LOGW(nameof(CAN::StressTest), "The relay fell behind at the recorded rate.");
+            #else
+            //Double the rate each step, finishing with a step at the theoretical saturation point.
+            uint32_t failedAt = 0;
+            for (uint32_t rateScale = 100; !ServiceCancellationToken.IsCancellationRequested(); rateScale *= 2)
+            {
+                if (rateScale > saturation)
+                    rateScale = saturation;
+
+                SStepResult result;
+                bool ok = RunStep(rateScale, &result);
+                Report(result, ok);
+                if (!ok && failedAt == 0)
+                    failedAt = rateScale;
+
+                if (rateScale == saturation)
+                    break;
+            }
+
+            if (failedAt == 0)
+                LOGI(nameof(CAN::StressTest), "The relay kept up at every rate up to bus saturation.");
+            else
+                LOGW(nameof(CAN::StressTest), "The relay first fell behind at %lu%% of the recorded rate.", failedAt);
+            #endif
+
+            uint32_t allocations = Memory::HeapCounter::GetAllocations() - allocationsBefore;
+            if (!Memory::HeapCounter::IsSupported())
+                LOGI(nameof(CAN::StressTest), "Heap allocations are not counted in this build (CONFIG_HEAP_USE_HOOKS).");
+            else if (allocations == 0)
+                LOGI(nameof(CAN::StressTest), "No heap allocations during the run.");
+            else
+                LOGW(nameof(CAN::StressTest), "%lu heap allocation(s) during the run.", allocations);
+
+            ServiceCancellationToken.WaitForCancellation();
+        }
+
+    public:
+        StressTest()
+        {
+            ServiceEntrypointStackDepth += 1024;
+            AddDependencyType<BusMaster>();
+        }
+    };
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+//Statistical model of the bike bus traffic (learned from the recordings by /Tools/TrafficGen) and a deterministic synthesizer for it.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    struct STrafficByteModel
+    {
+        uint8_t initial;
+        uint8_t minimum;
+        uint8_t maximum;
+        uint16_t changeProbability; //Out of 65535, the chance that the byte differs from the previous frame.
+        int8_t step; //Non-zero if the byte behaves like a counter (always changes by the same amount), zero for values drawn from [minimum, maximum].
+    };
+
+    struct STrafficStreamModel
+    {
+        uint32_t id;
+        uint8_t bus;
+        uint8_t length;
+        uint32_t periodUs; //Nominal interval between frames.
+        uint32_t jitterUs; //Frames are spread uniformly within +/- this of the nominal interval.
+        uint32_t phaseUs; //Offset of the first frame.
+        STrafficByteModel bytes[8];
+    };
+
+    class TrafficSynthesizer
+    {
+    public:
+        static const uint32_t BUS_BITRATE = 250000;
+        static const size_t MAX_STREAMS = 32;
+
+    private:
+        const STrafficStreamModel* _streams;
+        size_t _streamCount;
+        uint32_t _rateScale; //Percentage of the recorded rate, i.e. 100 is 1x.
+        uint32_t _random;
+        uint64_t _due[MAX_STREAMS];
+        uint8_t _payloads[MAX_STREAMS][8];
+
+        uint32_t NextRandom()
+        {
+            //xorshift32, deterministic for a given seed so runs can be reproduced.
+            _random ^= _random << 13;
+            _random ^= _random >> 17;
+            _random ^= _random << 5;
+            return _random;
+        }
+
+        uint64_t Interval(const STrafficStreamModel& stream)
+        {
+            uint64_t period = (uint64_t)stream.periodUs * 100 / _rateScale;
+            uint64_t jitter = (uint64_t)stream.jitterUs * 100 / _rateScale;
+            if (jitter == 0 || jitter >= period)
+                return period > 0 ? period : 1;
+            return period - jitter + NextRandom() % (2 * jitter + 1);
+        }
+
+    public:
+        TrafficSynthesizer(const STrafficStreamModel* streams, size_t streamCount, uint32_t rateScale = 100, uint32_t seed = 0x0DE7C0DE)
+            : _streams(streams), _streamCount(streamCount < MAX_STREAMS ? streamCount : MAX_STREAMS), _rateScale(rateScale > 0 ? rateScale : 1), _random(seed != 0 ? seed : 1)
+        {
+            for (size_t i = 0; i < _streamCount; i++)
+            {
+                _due[i] = (uint64_t)_streams[i].phaseUs * 100 / _rateScale;
+                for (size_t b = 0; b < 8; b++)
+                    _payloads[i][b] = _streams[i].bytes[b].initial;
+            }
+        }
+
+        //Produces the next frame in time order, returns false if there are no streams.
+        bool Next(SCanMessage* outMessage, uint8_t* outBus, uint64_t* outTimeUs)
+        {
+            if (_streamCount == 0)
+                return false;
+
+            size_t next = 0;
+            for (size_t i = 1; i < _streamCount; i++)
+                if (_due[i] < _due[next])
+                    next = i;
+
+            const STrafficStreamModel& stream = _streams[next];
+            for (size_t b = 0; b < stream.length; b++)
+            {
+                const STrafficByteModel& byte = stream.bytes[b];
+                if ((NextRandom() & 0xFFFF) >= byte.changeProbability)
+                    continue;
+                if (byte.step != 0)
+                    _payloads[next][b] += byte.step;
+                else
+                    _payloads[next][b] = byte.minimum + NextRandom() % ((uint32_t)byte.maximum - byte.minimum + 1);
+            }
+
+            outMessage->id = stream.id;
+            outMessage->length = stream.length;
+            outMessage->isExtended = false;
+            outMessage->isRemote = false;
+            for (size_t b = 0; b < 8; b++)
+                outMessage->data[b] = b < stream.length ? _payloads[next][b] : 0;
+            *outBus = stream.bus;
+            *outTimeUs = _due[next];
+
+            _due[next] += Interval(stream);
+            return true;
+        }
+
+        //Worst case length of a standard data frame on the wire, including bit stuffing and the inter-frame space.
+        static uint32_t FrameBits(uint8_t length)
+        {
+            uint32_t stuffable = 34 + 8 * length;
+            return stuffable + 13 + (stuffable - 1) / 4;
+        }
+
+        //Bus load in hundredths of a percent of the given streams at 1x.
+        //Every frame is relayed, so each bus segment carries the traffic of both sides.
+        static uint32_t BusLoad(const STrafficStreamModel* streams, size_t streamCount)
+        {
+            uint64_t bitsPerSecond = 0;
+            for (size_t i = 0; i < streamCount; i++)
+                if (streams[i].periodUs > 0)
+                    bitsPerSecond += (uint64_t)FrameBits(streams[i].length) * 1000000 / streams[i].periodUs;
+            return (uint32_t)(bitsPerSecond * 10000 / BUS_BITRATE);
+        }
+    };
+};
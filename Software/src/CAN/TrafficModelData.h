@@ -0,0 +1,38 @@
+#pragma once
+
+//Generated by Tools/TrafficGen from:
+//  Recordings/big_motor.txt
+//  Recordings/freewheel.txt
+//  Recordings/idle.txt
+//  Recordings/no_motor.txt
+//  Recordings/real_walk.txt
+//  Recordings/some_motor.txt
+//  Recordings/walk0kph.txt
+//  Recordings/walk5kph.txt
+//Do not edit by hand, regenerate with: trafficgen header <this file> <captures>...
+
+#include "TrafficModel.h"
+
+namespace ReadieFur::OpenTCU::CAN::TrafficModelData
+{
+    inline constexpr STrafficStreamModel STREAMS[] =
+    {
+        { 0x300, 0, 8, 50009, 106, 0, { { 0x03, 0x00, 0x03, 26, 0 }, { 0x5A, 0x5A, 0xA5, 78, 0 }, { 0x64, 0x64, 0x64, 0, 0 }, { 0x5A, 0x5A, 0x5A, 0, 0 }, { 0x32, 0x00, 0x64, 117, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x32, 0x00, 0x64, 117, 0 }, { 0x72, 0x03, 0xFF, 65535, 0 } } },
+        { 0x301, 0, 3, 50009, 122, 0, { { 0x6B, 0x03, 0xF5, 65521, 0 }, { 0x02, 0x00, 0x0F, 65521, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x404, 0, 2, 277960, 277959, 48160, { { 0x4A, 0x01, 0xB1, 65535, 0 }, { 0x00, 0x00, 0x30, 17800, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x200, 1, 8, 3001315, 2284, 0, { { 0x58, 0x57, 0x58, 1579, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x8C, 0x00, 0xFB, 58428, 0 }, { 0xA1, 0x9C, 0xAA, 9474, 0 }, { 0x08, 0x08, 0x08, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x01, 0x00, 0x02, 62376, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x201, 1, 5, 100043, 94, 30000, { { 0x00, 0x00, 0xFC, 5613, 0 }, { 0x00, 0x00, 0x0A, 966, 0 }, { 0x00, 0x00, 0xFE, 22793, 0 }, { 0x00, 0x00, 0x1B, 15456, 0 }, { 0x62, 0x02, 0x63, 208, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x202, 1, 8, 1000329, 636, 100000, { { 0xE2, 0xE2, 0xE2, 0, 0 }, { 0x13, 0x10, 0x15, 33816, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x42, 0x00, 0xFF, 36961, 0 }, { 0x7D, 0x7C, 0x7E, 1048, 0 }, { 0x05, 0x05, 0x05, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x203, 1, 8, 100043, 102, 0, { { 0x00, 0x00, 0xFF, 35009, 0 }, { 0x00, 0x00, 0x10, 2893, 0 }, { 0x00, 0x00, 0xFC, 21714, 0 }, { 0x00, 0x00, 0xFF, 22627, 0 }, { 0x00, 0x00, 0xCB, 22027, 0 }, { 0x00, 0x00, 0x01, 208, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x80, 78, -128 } } },
+        { 0x204, 1, 8, 1000411, 788, 90000, { { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x206, 1, 8, 100035, 70, 20000, { { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x400, 1, 8, 100231, 452, 0, { { 0x01, 0x01, 0x01, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x0C, 0x0C, 0x2C, 418, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x401, 1, 8, 100236, 468, 0, { { 0xDA, 0x00, 0xFF, 19840, 0 }, { 0x9E, 0x95, 0x9F, 4339, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x46, 0x00, 0xFF, 19135, 0 }, { 0x00, 0x00, 0x49, 8025, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x402, 1, 8, 1002345, 3590, 20000, { { 0x58, 0x57, 0x58, 524, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0xCC, 0x00, 0xFC, 18087, 0 }, { 0xA0, 0x9A, 0xAA, 4456, 0 }, { 0x08, 0x08, 0x08, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x403, 1, 8, 1002345, 3590, 150000, { { 0x64, 0x64, 0x64, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x40, 0x40, 0x40, 0, 0 }, { 0xE3, 0xE3, 0xE3, 0, 0 }, { 0x09, 0x09, 0x09, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x405, 1, 8, 277975, 277974, 48100, { { 0x4A, 0x01, 0xB1, 65535, 0 }, { 0x00, 0x00, 0x30, 17800, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x06, 0x00, 0x81, 49026, 0 }, { 0x00, 0x00, 0x4C, 36104, 0 }, { 0x00, 0x00, 0x80, 45012, 0 }, { 0x00, 0x00, 0x54, 37537, 0 } } },
+        { 0x665, 1, 8, 3001200, 2112, 10000, { { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x53, 0x53, 0x53, 0, 0 }, { 0x4C, 0x4C, 0x4C, 0, 0 }, { 0x18, 0x18, 0x18, 0, 0 }, { 0x53, 0x53, 0x53, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 } } },
+        { 0x666, 1, 8, 3001066, 1905, 330000, { { 0x52, 0x52, 0x52, 0, 0 }, { 0x08, 0x08, 0x08, 0, 0 }, { 0x05, 0x05, 0x05, 0, 0 }, { 0x00, 0x00, 0x00, 0, 0 }, { 0x52, 0x52, 0x52, 0, 0 }, { 0x95, 0x95, 0x95, 0, 0 }, { 0x36, 0x36, 0x36, 0, 0 }, { 0x02, 0x02, 0x02, 0, 0 } } },
+    };
+    inline constexpr size_t STREAM_COUNT = sizeof(STREAMS) / sizeof(STREAMS[0]);
+};
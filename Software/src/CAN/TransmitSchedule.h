@@ -0,0 +1,213 @@
+#pragma once
+
+//Deadlines for injected frames: periodic frames that repeat at a fixed interval and one-shot sequences where each frame is sent a given delay after the previous one.
+//Times are in microseconds on whatever clock the caller uses, the caller waits until GetNextWake and then takes every frame that is due with PopDue.
+//Injected traffic is rate capped per bus (MAX_FRAMES_PER_SECOND with a burst of BURST_FRAMES), frames over the cap wait for their turn instead of crowding out the relayed traffic.
+//Periodic deadlines advance by exactly one period from the previous deadline so that lateness never accumulates, a frame that falls a whole period behind skips the deadlines it missed.
+//This header has no platform dependencies so that it can be shared by the firmware and the host tools.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SCanMessage.h"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    class TransmitSchedule
+    {
+    public:
+        static const size_t MAX_PERIODIC = 16;
+        static const size_t MAX_ONE_SHOTS = 32;
+        static const uint32_t MIN_PERIOD_US = 1000;
+        //A standard 8 byte frame is ~125 bits, so at 250kbit/s this is a tenth of the segment.
+        static const uint32_t MAX_FRAMES_PER_SECOND = 200;
+        static const uint32_t BURST_FRAMES = 8;
+        static const int64_t NO_WAKE = INT64_MAX;
+
+        struct SScheduledFrame
+        {
+            bool bus;
+            SCanMessage message;
+            int64_t deadline;
+        };
+
+        struct STimingStats
+        {
+            uint32_t sent;
+            uint32_t throttled; //Sent late because of the rate cap.
+            uint32_t skipped; //Periodic deadlines dropped after falling a whole period behind.
+            uint32_t maxLatenessUs;
+            uint64_t totalLatenessUs;
+        };
+
+    private:
+        static const int64_t FRAME_COST_US = 1000000 / MAX_FRAMES_PER_SECOND;
+
+        struct SPeriodic
+        {
+            bool active;
+            bool bus;
+            SCanMessage message;
+            uint32_t periodUs;
+            int64_t deadline;
+        };
+
+        SPeriodic _periodic[MAX_PERIODIC] = {};
+        size_t _periodicCount = 0;
+        SScheduledFrame _oneShots[MAX_ONE_SHOTS]; //Ring buffer, deadlines never decrease.
+        size_t _oneShotHead = 0;
+        size_t _oneShotCount = 0;
+        int64_t _lastOneShot = 0;
+        int64_t _allowedAt[2] = { INT64_MIN, INT64_MIN }; //Earliest time the next frame on each bus fits under the rate cap.
+        STimingStats _stats = {};
+
+        inline int64_t ReadyAt(bool bus, int64_t deadline) const
+        {
+            return deadline > _allowedAt[bus] ? deadline : _allowedAt[bus];
+        }
+
+        //The periodic slot (or MAX_PERIODIC for the one-shot queue) whose frame can be sent first.
+        size_t FindNext(int64_t* outReadyAt) const
+        {
+            size_t next = MAX_PERIODIC + 1;
+            int64_t earliest = NO_WAKE;
+            for (size_t i = 0; i < MAX_PERIODIC; i++)
+            {
+                if (!_periodic[i].active)
+                    continue;
+                int64_t readyAt = ReadyAt(_periodic[i].bus, _periodic[i].deadline);
+                if (readyAt < earliest)
+                {
+                    earliest = readyAt;
+                    next = i;
+                }
+            }
+            if (_oneShotCount > 0)
+            {
+                const SScheduledFrame& frame = _oneShots[_oneShotHead];
+                int64_t readyAt = ReadyAt(frame.bus, frame.deadline);
+                if (readyAt < earliest)
+                {
+                    earliest = readyAt;
+                    next = MAX_PERIODIC;
+                }
+            }
+            *outReadyAt = earliest;
+            return next;
+        }
+
+    public:
+        //Returns the slot used to remove the frame, or -1 if every slot is in use or the period is below MIN_PERIOD_US. The first frame is sent at now.
+        int AddPeriodic(bool bus, const SCanMessage& message, uint32_t periodUs, int64_t now)
+        {
+            if (periodUs < MIN_PERIOD_US)
+                return -1;
+            for (size_t i = 0; i < MAX_PERIODIC; i++)
+            {
+                if (_periodic[i].active)
+                    continue;
+                _periodic[i] = { true, bus, message, periodUs, now };
+                _periodicCount++;
+                return i;
+            }
+            return -1;
+        }
+
+        bool RemovePeriodic(int slot)
+        {
+            if (slot < 0 || slot >= (int)MAX_PERIODIC || !_periodic[slot].active)
+                return false;
+            _periodic[slot].active = false;
+            _periodicCount--;
+            return true;
+        }
+
+        //Appends a frame to the one-shot sequence, sent delayUs after the previous frame in the sequence (or after now if the sequence is empty). Returns false if the queue is full.
+        bool QueueOneShot(bool bus, const SCanMessage& message, uint32_t delayUs, int64_t now)
+        {
+            if (_oneShotCount >= MAX_ONE_SHOTS)
+                return false;
+            int64_t base = _oneShotCount > 0 && _lastOneShot > now ? _lastOneShot : now;
+            _lastOneShot = base + delayUs;
+            _oneShots[(_oneShotHead + _oneShotCount) % MAX_ONE_SHOTS] = { bus, message, _lastOneShot };
+            _oneShotCount++;
+            return true;
+        }
+
+        void Clear()
+        {
+            for (auto&& periodic : _periodic)
+                periodic.active = false;
+            _periodicCount = 0;
+            _oneShotCount = 0;
+        }
+
+        //The time at which the next frame can be sent, NO_WAKE if nothing is scheduled.
+        int64_t GetNextWake() const
+        {
+            int64_t readyAt;
+            FindNext(&readyAt);
+            return readyAt;
+        }
+
+        //Takes the next frame that is due at now, returns false once there are none.
+        bool PopDue(int64_t now, SScheduledFrame* outFrame)
+        {
+            int64_t readyAt;
+            size_t next = FindNext(&readyAt);
+            if (readyAt > now)
+                return false;
+
+            if (next == MAX_PERIODIC)
+            {
+                *outFrame = _oneShots[_oneShotHead];
+                _oneShotHead = (_oneShotHead + 1) % MAX_ONE_SHOTS;
+                _oneShotCount--;
+            }
+            else
+            {
+                SPeriodic& periodic = _periodic[next];
+                *outFrame = { periodic.bus, periodic.message, periodic.deadline };
+                periodic.deadline += periodic.periodUs;
+                while (periodic.deadline <= now)
+                {
+                    periodic.deadline += periodic.periodUs;
+                    _stats.skipped++;
+                }
+            }
+
+            int64_t& allowedAt = _allowedAt[outFrame->bus];
+            if (allowedAt > outFrame->deadline)
+                _stats.throttled++;
+            //Credit for idle time is capped at the burst so that a quiet period can't be followed by an unbounded burst.
+            int64_t earliest = now - (int64_t)(BURST_FRAMES - 1) * FRAME_COST_US;
+            allowedAt = (allowedAt > earliest ? allowedAt : earliest) + FRAME_COST_US;
+
+            uint32_t lateness = now - outFrame->deadline > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - outFrame->deadline);
+            _stats.sent++;
+            _stats.totalLatenessUs += lateness;
+            if (lateness > _stats.maxLatenessUs)
+                _stats.maxLatenessUs = lateness;
+            return true;
+        }
+
+        size_t GetPeriodicCount() const
+        {
+            return _periodicCount;
+        }
+
+        size_t GetOneShotCount() const
+        {
+            return _oneShotCount;
+        }
+
+        const STimingStats& GetStats() const
+        {
+            return _stats;
+        }
+
+        void ResetStats()
+        {
+            _stats = {};
+        }
+    };
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <Service/AService.hpp>
+#include "BusMaster.hpp"
+#include "TransmitSchedule.h"
+#include "Metrics/Metrics.hpp"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::CAN
+{
+    //Sends injected frames on a schedule (see TransmitSchedule.h): periodic frames, one-shot sequences with relative delays and batches.
+    //The task sleeps until the next deadline on a one-shot esp_timer, so frames go out within the timer's microsecond resolution rather than on the tick.
+    //It runs below the relay tasks and sends without waiting on a full controller queue, so injected traffic never holds up relayed traffic.
+    class TransmitScheduler : public Service::AService
+    {
+    public:
+        struct SInjectedFrame
+        {
+            bool bus;
+            SCanMessage message;
+            uint32_t delayUs; //After the previous frame in the sequence.
+        };
+
+    private:
+        static const TickType_t IDLE_WAIT = pdMS_TO_TICKS(1000);
+        static const size_t MAX_BATCH = 8; //Frames sent per wake before the schedule is checked again.
+
+        BusMaster* _busMaster = nullptr;
+        TransmitSchedule _schedule;
+        SemaphoreHandle_t _mutex = xSemaphoreCreateMutex(); //Guards the schedule, changed over BLE and read by the task.
+        TaskHandle_t _task = NULL;
+        esp_timer_handle_t _timer = nullptr;
+
+        static Metrics::Counter _framesSent;
+        static Metrics::Counter _framesThrottled;
+        static Metrics::Counter _sendFailures;
+        static Metrics::Gauge _maxLateness;
+
+        static void OnTimer(void* arg)
+        {
+            TransmitScheduler* self = static_cast<TransmitScheduler*>(arg);
+            if (self->_task != NULL)
+                xTaskNotifyGive(self->_task);
+        }
+
+        //Wakes the task so that a change to the schedule is picked up straight away.
+        void Wake()
+        {
+            if (_task != NULL)
+                xTaskNotifyGive(_task);
+        }
+
+        //Returns at the given time (esp_timer), or earlier if the schedule changes.
+        void WaitUntil(int64_t wake)
+        {
+            if (wake == TransmitSchedule::NO_WAKE)
+            {
+                ulTaskNotifyTake(pdTRUE, IDLE_WAIT);
+                return;
+            }
+
+            int64_t remaining = wake - esp_timer_get_time();
+            if (remaining <= 0)
+                return;
+
+            esp_timer_stop(_timer); //Fails harmlessly if the timer isn't running.
+            if (esp_timer_start_once(_timer, remaining) != ESP_OK)
+            {
+                vTaskDelay(1);
+                return;
+            }
+            ulTaskNotifyTake(pdTRUE, IDLE_WAIT);
+        }
+
+    protected:
+        void RunServiceImpl() override
+        {
+            _busMaster = GetService<BusMaster>();
+
+            esp_timer_create_args_t timerArgs =
+            {
+                .callback = OnTimer,
+                .arg = this,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "TransmitScheduler",
+                .skip_unhandled_events = true
+            };
+            esp_err_t err = esp_timer_create(&timerArgs, &_timer);
+            if (err != ESP_OK)
+            {
+                LOGE(nameof(CAN::TransmitScheduler), "Failed to create the schedule timer: %s", esp_err_to_name(err));
+                return;
+            }
+            _task = xTaskGetCurrentTaskHandle();
+
+            while (!ServiceCancellationToken.IsCancellationRequested())
+            {
+                TransmitSchedule::SScheduledFrame batch[MAX_BATCH];
+                size_t count = 0;
+
+                xSemaphoreTake(_mutex, portMAX_DELAY);
+                uint32_t throttled = _schedule.GetStats().throttled;
+                int64_t now = esp_timer_get_time();
+                while (count < MAX_BATCH && _schedule.PopDue(now, &batch[count]))
+                    count++;
+                int64_t wake = _schedule.GetNextWake();
+                const TransmitSchedule::STimingStats& stats = _schedule.GetStats();
+                _framesThrottled.Increment(stats.throttled - throttled);
+                _maxLateness.Set((int32_t)stats.maxLatenessUs);
+                xSemaphoreGive(_mutex);
+
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (_busMaster->TransmitMessage(batch[i].bus, batch[i].message) == ESP_OK)
+                        _framesSent.Increment();
+                    else
+                        _sendFailures.Increment();
+                }
+
+                if (count < MAX_BATCH)
+                    WaitUntil(wake);
+            }
+
+            _task = NULL;
+            esp_timer_stop(_timer);
+            esp_timer_delete(_timer);
+            _timer = nullptr;
+            _busMaster = nullptr;
+        }
+
+    public:
+        TransmitScheduler()
+        {
+            ServiceEntrypointStackDepth += 1024;
+            ServiceEntrypointPriority = configMAX_PRIORITIES * 0.5; //Below the relay tasks.
+            AddDependencyType<BusMaster>();
+        }
+
+        //Returns the slot to remove the frame with, or -1 if every slot is in use or the period is too short.
+        int AddPeriodic(bool bus, const SCanMessage& message, uint32_t periodUs)
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            int slot = _schedule.AddPeriodic(bus, message, periodUs, esp_timer_get_time());
+            xSemaphoreGive(_mutex);
+            if (slot >= 0)
+                Wake();
+            return slot;
+        }
+
+        bool RemovePeriodic(int slot)
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            bool removed = _schedule.RemovePeriodic(slot);
+            xSemaphoreGive(_mutex);
+            return removed;
+        }
+
+        //Appends the frames to the one-shot sequence, all of them or none if there isn't room. A batch is a sequence with no delays.
+        bool QueueSequence(const SInjectedFrame* frames, size_t count)
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            bool queued = TransmitSchedule::MAX_ONE_SHOTS - _schedule.GetOneShotCount() >= count;
+            if (queued)
+            {
+                int64_t now = esp_timer_get_time();
+                for (size_t i = 0; i < count; i++)
+                    _schedule.QueueOneShot(frames[i].bus, frames[i].message, frames[i].delayUs, now);
+            }
+            xSemaphoreGive(_mutex);
+            if (queued)
+                Wake();
+            return queued;
+        }
+
+        //Stops every periodic frame and drops the queued one-shots.
+        void Clear()
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            _schedule.Clear();
+            xSemaphoreGive(_mutex);
+        }
+
+        void GetStats(TransmitSchedule::STimingStats* outStats, size_t* outPeriodic, size_t* outOneShots)
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            *outStats = _schedule.GetStats();
+            *outPeriodic = _schedule.GetPeriodicCount();
+            *outOneShots = _schedule.GetOneShotCount();
+            xSemaphoreGive(_mutex);
+        }
+    };
+};
+
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::TransmitScheduler::_framesSent = { "can_frames_scheduled_total", "Injected frames sent by the transmit scheduler." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::TransmitScheduler::_framesThrottled = { "can_frames_throttled_total", "Injected frames held back by the injection rate cap." };
+ReadieFur::OpenTCU::Metrics::Counter ReadieFur::OpenTCU::CAN::TransmitScheduler::_sendFailures = { "can_scheduled_send_failures_total", "Injected frames the controller could not queue." };
+ReadieFur::OpenTCU::Metrics::Gauge ReadieFur::OpenTCU::CAN::TransmitScheduler::_maxLateness = { "can_schedule_max_lateness_us", "Latest an injected frame has been sent after its deadline." };
@@ -3,25 +3,41 @@
 #include <cstdint>
 #include <driver/gpio.h>
 #include <driver/twai.h>
+#include <esp_sleep.h>
 #include <stdexcept>
 #include "SCanMessage.h"
 #include "ACan.h"
+#include "RelayPlacement.h"
 
 #if SOC_TWAI_SUPPORTED == 0
 #error "Chip does not support TWAI."
 #endif
 
+#if defined(CAN_RELAY_IN_IRAM) && !defined(CONFIG_TWAI_ISR_IN_IRAM)
+#error "CAN_RELAY_IN_IRAM requires CONFIG_TWAI_ISR_IN_IRAM, otherwise frames are lost while the flash cache is disabled."
+#endif
+
 namespace ReadieFur::OpenTCU::CAN
 {
     class TwaiCan : public ACan
     {
+        static const uint32_t STATE_ALERTS = TWAI_ALERT_ERR_PASS | TWAI_ALERT_ERR_ACTIVE | TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED;
+        static const uint32_t ERROR_PASSIVE_LIMIT = 128;
+
         twai_general_config_t _generalConfig;
         twai_timing_config_t _timingConfig;
         twai_filter_config_t _filterConfig;
         twai_handle_t _driverHandle;
+        SemaphoreHandle_t _wakeSemaphore = xSemaphoreCreateBinary();
 
         TwaiCan(twai_general_config_t generalConfig, twai_timing_config_t timingConfig, twai_filter_config_t filterConfig) : ACan(),
-            _generalConfig(generalConfig), _timingConfig(timingConfig), _filterConfig(filterConfig) {}
+            _generalConfig(generalConfig), _timingConfig(timingConfig), _filterConfig(filterConfig)
+        {
+            #ifdef CAN_RELAY_IN_IRAM
+            //Keep the ISR serviced, and the RX queue filling, while the flash cache is disabled.
+            _generalConfig.intr_flags |= ESP_INTR_FLAG_IRAM;
+            #endif
+        }
 
         int Install()
         {
@@ -36,7 +52,7 @@ namespace ReadieFur::OpenTCU::CAN
                 LOGE(nameof(CAN::TwaiCan), "Failed to start TWAI driver: %#08x", res);
                 return res;
             }
-            if ((res = twai_reconfigure_alerts_v2(_driverHandle, TWAI_ALERT_RX_DATA, NULL)) != ESP_OK)
+            if ((res = twai_reconfigure_alerts_v2(_driverHandle, TWAI_ALERT_RX_DATA | STATE_ALERTS, NULL)) != ESP_OK)
             {
                 LOGE(nameof(CAN::TwaiCan), "Failed to configure TWAI driver: %#08x", res);
                 return res;
@@ -44,6 +60,66 @@ namespace ReadieFur::OpenTCU::CAN
             return 0;
         }
 
+        //The RX line goes low with the start of frame bit of the first frame on the bus.
+        static void IRAM_ATTR OnWake(void* arg)
+        {
+            TwaiCan* self = static_cast<TwaiCan*>(arg);
+            BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+            //The wake-up is level triggered, it would keep firing for every dominant bit.
+            gpio_intr_disable(self->_generalConfig.rx_io);
+            self->_wokenAt = esp_timer_get_time();
+            xSemaphoreGiveFromISR(self->_wakeSemaphore, &higherPriorityTaskWoken);
+
+            if (higherPriorityTaskWoken == pdTRUE)
+                portYIELD_FROM_ISR();
+        }
+
+        //Restarts the controller after Sleep, a no-op if it is not sleeping.
+        esp_err_t Resume()
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, portMAX_DELAY) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+            #endif
+
+            esp_err_t err = ESP_OK;
+            if (_sleeping)
+            {
+                gpio_wakeup_disable(_generalConfig.rx_io);
+                gpio_isr_handler_remove(_generalConfig.rx_io);
+                //Starting the driver takes the APB frequency lock again, holding the CPU at full speed while the bus is in use.
+                if ((err = twai_start_v2(_driverHandle)) == ESP_OK)
+                {
+                    _sleeping = false;
+                    //Release a Receive that is still waiting for the wake-up if a Send got here first.
+                    xSemaphoreGive(_wakeSemaphore);
+                }
+                else
+                {
+                    LOGE(nameof(CAN::TwaiCan), "Failed to restart TWAI driver: %#08x", err);
+                }
+            }
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+            return err;
+        }
+
+        //The alerts only say which thresholds were crossed since they were last read, so the current state is taken from the controller.
+        void UpdateBusState()
+        {
+            twai_status_info_t status;
+            if (twai_get_status_info_v2(_driverHandle, &status) != ESP_OK)
+                return;
+
+            if (status.state == TWAI_STATE_RUNNING)
+                SetBusState(status.tx_error_counter >= ERROR_PASSIVE_LIMIT || status.rx_error_counter >= ERROR_PASSIVE_LIMIT ? ErrorPassive : ErrorActive);
+            else if (_busState != Recovering)
+                SetBusState(BusOff);
+        }
+
     public:
         static TwaiCan* Initialize(twai_general_config_t generalConfig, twai_timing_config_t timingConfig, twai_filter_config_t filterConfig)
         {
@@ -57,12 +133,66 @@ namespace ReadieFur::OpenTCU::CAN
 
         ~TwaiCan()
         {
-            twai_stop_v2(_driverHandle);
+            if (_sleeping)
+            {
+                gpio_wakeup_disable(_generalConfig.rx_io);
+                gpio_isr_handler_remove(_generalConfig.rx_io);
+            }
+            else
+            {
+                twai_stop_v2(_driverHandle);
+            }
             twai_driver_uninstall_v2(_driverHandle);
+            vSemaphoreDelete(_wakeSemaphore);
+        }
+
+        //Stopping the driver releases its APB frequency lock so that DFS and light sleep can take effect, the RX pin is used as the GPIO wake-up source.
+        esp_err_t Sleep()
+        {
+            #ifdef USE_CAN_DRIVER_LOCK
+            if (xSemaphoreTake(_driverMutex, portMAX_DELAY) != pdTRUE)
+                return ESP_ERR_TIMEOUT;
+            #endif
+
+            esp_err_t err = ESP_OK;
+            if (!_sleeping)
+            {
+                //Fails with ESP_ERR_INVALID_STATE if it is already installed, e.g. by McpCan.
+                gpio_install_isr_service(0);
+                xSemaphoreTake(_wakeSemaphore, 0);
+                if ((err = twai_stop_v2(_driverHandle)) == ESP_OK
+                    && (err = gpio_isr_handler_add(_generalConfig.rx_io, OnWake, this)) == ESP_OK
+                    && (err = gpio_wakeup_enable(_generalConfig.rx_io, GPIO_INTR_LOW_LEVEL)) == ESP_OK
+                    && (err = esp_sleep_enable_gpio_wakeup()) == ESP_OK)
+                {
+                    _sleeping = true;
+                    gpio_intr_enable(_generalConfig.rx_io);
+                }
+                else
+                {
+                    LOGE(nameof(CAN::TwaiCan), "Failed to configure the wake-up: %#08x", err);
+                    gpio_wakeup_disable(_generalConfig.rx_io);
+                    gpio_isr_handler_remove(_generalConfig.rx_io);
+                    twai_start_v2(_driverHandle);
+                }
+            }
+
+            #ifdef USE_CAN_DRIVER_LOCK
+            xSemaphoreGive(_driverMutex);
+            #endif
+            return err;
         }
 
-        esp_err_t Send(SCanMessage message, TickType_t timeout)
+        esp_err_t RELAY_IRAM_ATTR Send(SCanMessage message, TickType_t timeout)
         {
+            //A frame relayed from the other bus means the bike is back on, there is no need to wait for this bus to wake up by itself.
+            if (_sleeping)
+            {
+                esp_err_t err = Resume();
+                if (err != ESP_OK)
+                    return err;
+            }
+
             twai_message_t twaiMessage = {
                 .identifier = message.id,
                 .data_length_code = message.length
@@ -90,14 +220,32 @@ namespace ReadieFur::OpenTCU::CAN
             return res;
         }
 
-        esp_err_t Receive(SCanMessage* message, TickType_t timeout)
+        esp_err_t RELAY_IRAM_ATTR Receive(SCanMessage* message, TickType_t timeout)
         {
+            if (IsBusOff())
+                return ESP_ERR_INVALID_STATE;
+
+            if (_sleeping)
+            {
+                if (xSemaphoreTake(_wakeSemaphore, timeout) != pdTRUE)
+                    return ESP_ERR_TIMEOUT;
+                esp_err_t err = Resume();
+                if (err != ESP_OK)
+                    return err;
+            }
+
             //Use the read alerts function to wait for a message to be received (instead of locking on the twai_receive function).
             uint32_t alerts;
             esp_err_t err;
             if ((err = twai_read_alerts_v2(_driverHandle, &alerts, timeout)) != ESP_OK)
                 return err;
-            //We don't need to check the alert type because we have only subscribed to the RX_DATA alert.
+            if (alerts & STATE_ALERTS)
+            {
+                UpdateBusState();
+                if (IsBusOff())
+                    return ESP_ERR_INVALID_STATE;
+            }
+            //If we were only woken by a state change, twai_receive will wait out the rest of the timeout for a message.
 
             #ifdef USE_CAN_DRIVER_LOCK
             if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
@@ -129,24 +277,70 @@ namespace ReadieFur::OpenTCU::CAN
             return ESP_OK;
         }
         
-        esp_err_t GetStatus(uint32_t* status, TickType_t timeout)
+        esp_err_t Recover(TickType_t timeout)
         {
-            #ifdef USE_CAN_DRIVER_LOCK
-            if (xSemaphoreTake(_driverMutex, timeout) != pdTRUE)
+            TickType_t start = xTaskGetTickCount();
+            while (true)
             {
-                // LOGW(nameof(CAN::TwaiCan), "Timeout.");
-                return ESP_ERR_TIMEOUT;
+                twai_status_info_t status;
+                esp_err_t err;
+                if ((err = twai_get_status_info_v2(_driverHandle, &status)) != ESP_OK)
+                    return err;
+
+                switch (status.state)
+                {
+                case TWAI_STATE_RUNNING:
+                    //The error counters are reset by recovery.
+                    if (IsBusOff())
+                        SetBusState(ErrorActive);
+                    return ESP_OK;
+                case TWAI_STATE_BUS_OFF:
+                    //The controller rejoins after monitoring 128 occurrences of 11 recessive bits, ~5.6ms at 250kbit/s on an idle bus.
+                    SetBusState(BusOff);
+                    if ((err = twai_initiate_recovery_v2(_driverHandle)) != ESP_OK)
+                        return err;
+                    SetBusState(Recovering);
+                    break;
+                case TWAI_STATE_STOPPED:
+                    //Recovery has completed, the driver leaves the controller stopped until it is started again.
+                    if ((err = twai_start_v2(_driverHandle)) != ESP_OK)
+                        return err;
+                    continue;
+                default:
+                    break;
+                }
+
+                TickType_t elapsed = xTaskGetTickCount() - start;
+                if (elapsed >= timeout)
+                    return ESP_ERR_TIMEOUT;
+
+                //Nothing else can be received while the controller is off the bus, so any alert here is the recovery completing (or failing).
+                uint32_t alerts;
+                twai_read_alerts_v2(_driverHandle, &alerts, timeout - elapsed);
             }
-            #endif
-            
-            // esp_err_t res = twai_get_status_info_v2(_driverHandle, (twai_status_info_t*)status);
-            esp_err_t res = twai_read_alerts_v2(_driverHandle, status, timeout);
+        }
 
-            #ifdef USE_CAN_DRIVER_LOCK
-            xSemaphoreGive(_driverMutex);
-            #endif
+        esp_err_t GetHealth(SCanHealth* health, TickType_t timeout)
+        {
+            //The driver keeps its own counters so this does not touch the controller and does not need the driver lock.
+            twai_status_info_t status;
+            esp_err_t res;
+            if ((res = twai_get_status_info_v2(_driverHandle, &status)) != ESP_OK)
+                return res;
 
-            return res;
+            *health = {};
+            health->sampledAt = esp_timer_get_time();
+            health->state = _busState;
+            health->txErrorCounter = (uint16_t)status.tx_error_counter;
+            health->rxErrorCounter = (uint16_t)status.rx_error_counter;
+            health->rxMissed = status.rx_missed_count;
+            health->rxOverrun = status.rx_overrun_count;
+            health->txFailed = status.tx_failed_count;
+            health->arbLost = status.arb_lost_count;
+            health->busErrors = status.bus_error_count;
+            health->txQueued = (uint16_t)status.msgs_to_tx;
+            health->rxQueued = (uint16_t)status.msgs_to_rx;
+            return ESP_OK;
         }
     };
 };
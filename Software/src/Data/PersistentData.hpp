@@ -8,6 +8,7 @@
 #include <ArduinoJson.h>
 #include <esp_mac.h>
 #include "StaticConfig.h"
+#include "Memory/FixedString.hpp"
 
 namespace ReadieFur::OpenTCU::Data
 {
@@ -15,12 +16,15 @@ namespace ReadieFur::OpenTCU::Data
     {
     private:
         constexpr static const char* CONFIG_PATH = "/spiffs/persistent_data.json";
+        static const size_t SAVE_BUFFER_SIZE = 192;
+        static bool _loaded;
 
     public:
         static ReadieFur::Event::Observable<std::string> DeviceName;
-        static std::string BikeSerialNumber; //TODO: Convert this to a service and wait on multiple properties for auto-saving.
+        static Memory::FixedString<20> BikeSerialNumber; //TODO: Convert this to a service and wait on multiple properties for auto-saving.
         static uint16_t BaseWheelCircumference;
         static uint16_t TargetWheelCircumference;
+        static uint16_t SpeedLimit; //km/h * 100, 0 for no limit.
         static uint32_t Pin;
 
         static esp_err_t Init()
@@ -32,17 +36,22 @@ namespace ReadieFur::OpenTCU::Data
             switch (err)
             {
             case ESP_OK:
-                JSON_ASSIGN_TO_SOURCE_IF_TYPE(jsonDocument, BikeSerialNumber, std::string);
+                if (jsonDocument["BikeSerialNumber"].is<const char*>())
+                    BikeSerialNumber = jsonDocument["BikeSerialNumber"].as<const char*>();
                 JSON_ASSIGN_TO_SOURCE_IF_TYPE(jsonDocument, BaseWheelCircumference, uint16_t);
                 JSON_ASSIGN_TO_SOURCE_IF_TYPE(jsonDocument, TargetWheelCircumference, uint16_t);
+                JSON_ASSIGN_TO_SOURCE_IF_TYPE(jsonDocument, SpeedLimit, uint16_t);
                 JSON_ASSIGN_TO_SOURCE_IF_TYPE(jsonDocument, Pin, uint32_t);
-                SetDeviceNameFromBikeSerialNumber(BikeSerialNumber);
+                SetDeviceNameFromBikeSerialNumber(BikeSerialNumber.c_str());
+                _loaded = true;
                 return ESP_OK;
             case ESP_ERR_NOT_FOUND:
                 //Use the default config.
+                _loaded = true;
                 return ESP_OK;
             case ESP_FAIL:
                 LOGE(nameof(PersistentData), "Failed to load persistent data (%s). Using the default config for this session.", esp_err_to_name(err));
+                _loaded = true;
                 return ESP_OK;
             default:
                 LOGE(nameof(PersistentData), "Failed to load persistent data: %s", esp_err_to_name(err));
@@ -50,36 +59,56 @@ namespace ReadieFur::OpenTCU::Data
             }
         }
 
+        //Whether Init has run, until then the values are the defaults and must not be saved.
+        static bool IsLoaded()
+        {
+            return _loaded;
+        }
+
+        //Saves happen at runtime (e.g. when the bike reports its serial number), the document is written by hand into a fixed buffer rather than built as a JsonDocument on the heap.
         static esp_err_t Save()
         {
-            JsonDocument jsonDocument;
-            JSON_SET_PROP(jsonDocument, BikeSerialNumber);
-            JSON_SET_PROP(jsonDocument, BaseWheelCircumference);
-            JSON_SET_PROP(jsonDocument, TargetWheelCircumference);
-            JSON_SET_PROP(jsonDocument, Pin);
-            return Flash::SaveJson(CONFIG_PATH, jsonDocument);
+            Memory::FixedString<SAVE_BUFFER_SIZE> json;
+            json.append("{\"BikeSerialNumber\":\"");
+            for (const char* c = BikeSerialNumber.c_str(); *c != '\0'; c++)
+                if (*c >= ' ' && *c != '"' && *c != '\\') //The serial number comes off the bus, drop anything that would need escaping.
+                    json.push_back(*c);
+            json.append_format("\",\"BaseWheelCircumference\":%u,\"TargetWheelCircumference\":%u,\"SpeedLimit\":%u,\"Pin\":%lu}",
+                BaseWheelCircumference, TargetWheelCircumference, SpeedLimit, (unsigned long)Pin);
+            if (json.truncated())
+                return ESP_ERR_NO_MEM;
+            return Flash::Write(CONFIG_PATH, json.c_str(), json.length());
         }
 
-        static void SetDeviceNameFromBikeSerialNumber(std::string bikeSerialNumber)
+        static void SetDeviceNameFromBikeSerialNumber(const char* bikeSerialNumber)
         {
             //Get the device name based on the TCU ID.
-            while (bikeSerialNumber.length() > 0 && !isdigit(bikeSerialNumber.front()))
-                bikeSerialNumber.erase(0, 1);
-            if (bikeSerialNumber.empty())
+            while (*bikeSerialNumber != '\0' && !isdigit(*bikeSerialNumber))
+                bikeSerialNumber++;
+
+            Memory::FixedString<31> deviceName = "OpenTCU";
+            if (*bikeSerialNumber != '\0')
+            {
+                deviceName.append(bikeSerialNumber);
+            }
+            else
             {
                 //Use the mac address as the device name.
                 uint8_t mac[6];
                 esp_read_mac(mac, ESP_MAC_BASE);
-                bikeSerialNumber = std::to_string(mac[0]) + std::to_string(mac[1]) + std::to_string(mac[2]) + std::to_string(mac[3]) + std::to_string(mac[4]) + std::to_string(mac[5]);
+                for (uint8_t byte : mac)
+                    deviceName.append_format("%u", byte);
             }
-            DeviceName.Set("OpenTCU" + bikeSerialNumber);
+            DeviceName.Set(deviceName.c_str()); //Only set during startup, the observable keeps its own std::string.
             LOGD(nameof(PersistentData), "Device name set to: %s", DeviceName.Get().c_str());
         }
     };
 };
 
 ReadieFur::Event::Observable<std::string> ReadieFur::OpenTCU::Data::PersistentData::DeviceName("OpenTCU");
-std::string ReadieFur::OpenTCU::Data::PersistentData::BikeSerialNumber;
+bool ReadieFur::OpenTCU::Data::PersistentData::_loaded = false;
+ReadieFur::OpenTCU::Memory::FixedString<20> ReadieFur::OpenTCU::Data::PersistentData::BikeSerialNumber;
 uint16_t ReadieFur::OpenTCU::Data::PersistentData::BaseWheelCircumference = 2160;
 uint16_t ReadieFur::OpenTCU::Data::PersistentData::TargetWheelCircumference = 2160;
+uint16_t ReadieFur::OpenTCU::Data::PersistentData::SpeedLimit = 0;
 uint32_t ReadieFur::OpenTCU::Data::PersistentData::Pin = TCU_CODE;
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+namespace ReadieFur::OpenTCU::Memory
+{
+    //A null terminated string of up to N characters stored inline.
+    //Anything that does not fit is cut off and remembered by truncated() so that callers can check once at the end instead of after every append.
+    template <size_t N>
+    class FixedString
+    {
+    private:
+        char _data[N + 1] = {};
+        size_t _length = 0;
+        bool _truncated = false;
+
+    public:
+        FixedString() = default;
+
+        FixedString(const char* value)
+        {
+            assign(value);
+        }
+
+        FixedString& operator=(const char* value)
+        {
+            assign(value);
+            return *this;
+        }
+
+        void assign(const char* value)
+        {
+            clear();
+            append(value);
+        }
+
+        void append(const char* value)
+        {
+            size_t length = strlen(value);
+            if (length > N - _length)
+            {
+                length = N - _length;
+                _truncated = true;
+            }
+            memcpy(_data + _length, value, length);
+            _length += length;
+            _data[_length] = '\0';
+        }
+
+        void push_back(char c)
+        {
+            if (_length >= N)
+            {
+                _truncated = true;
+                return;
+            }
+            _data[_length++] = c;
+            _data[_length] = '\0';
+        }
+
+        void append_format(const char* format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            va_list args;
+            va_start(args, format);
+            int written = vsnprintf(_data + _length, N + 1 - _length, format, args);
+            va_end(args);
+            if (written < 0)
+            {
+                _data[_length] = '\0';
+                _truncated = true;
+                return;
+            }
+            if ((size_t)written > N - _length)
+            {
+                written = N - _length;
+                _truncated = true;
+            }
+            _length += written;
+        }
+
+        void clear()
+        {
+            _length = 0;
+            _data[0] = '\0';
+            _truncated = false;
+        }
+
+        const char* c_str() const { return _data; }
+        size_t length() const { return _length; }
+        static constexpr size_t capacity() { return N; }
+        bool empty() const { return _length == 0; }
+        bool truncated() const { return _truncated; }
+
+        bool operator==(const char* other) const { return strcmp(_data, other) == 0; }
+        bool operator!=(const char* other) const { return strcmp(_data, other) != 0; }
+        template <size_t M>
+        bool operator==(const FixedString<M>& other) const { return strcmp(_data, other.c_str()) == 0; }
+        template <size_t M>
+        bool operator!=(const FixedString<M>& other) const { return strcmp(_data, other.c_str()) != 0; }
+    };
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <sdkconfig.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <esp_attr.h>
+
+namespace ReadieFur::OpenTCU::Memory
+{
+    //Counts heap allocations so that a long running build can show that it stops allocating once it has booted.
+    //This uses the heap hooks (CONFIG_HEAP_USE_HOOKS, enabled in the dev config) and sees every allocation, including the ones made by IDF components.
+    class HeapCounter
+    {
+    private:
+        static std::atomic<uint32_t> _allocations;
+        static std::atomic<uint32_t> _frees;
+        static std::atomic<uint32_t> _steadyStateBaseline;
+        static std::atomic<bool> _steadyState;
+
+    public:
+        static constexpr bool IsSupported()
+        {
+            #ifdef CONFIG_HEAP_USE_HOOKS
+            return true;
+            #else
+            return false;
+            #endif
+        }
+
+        //Called from the allocator, possibly from an ISR.
+        static inline void OnAllocated()
+        {
+            _allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static inline void OnFreed()
+        {
+            _frees.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static uint32_t GetAllocations()
+        {
+            return _allocations.load(std::memory_order_relaxed);
+        }
+
+        static uint32_t GetFrees()
+        {
+            return _frees.load(std::memory_order_relaxed);
+        }
+
+        //Marks the end of startup, allocations from here on are reported by GetSteadyStateAllocations.
+        static void MarkSteadyState()
+        {
+            _steadyStateBaseline.store(GetAllocations(), std::memory_order_relaxed);
+            _steadyState.store(true, std::memory_order_release);
+        }
+
+        static bool IsSteadyState()
+        {
+            return _steadyState.load(std::memory_order_acquire);
+        }
+
+        static uint32_t GetSteadyStateAllocations()
+        {
+            if (!IsSteadyState())
+                return 0;
+            return GetAllocations() - _steadyStateBaseline.load(std::memory_order_relaxed);
+        }
+    };
+};
+
+std::atomic<uint32_t> ReadieFur::OpenTCU::Memory::HeapCounter::_allocations(0);
+std::atomic<uint32_t> ReadieFur::OpenTCU::Memory::HeapCounter::_frees(0);
+std::atomic<uint32_t> ReadieFur::OpenTCU::Memory::HeapCounter::_steadyStateBaseline(0);
+std::atomic<bool> ReadieFur::OpenTCU::Memory::HeapCounter::_steadyState(false);
+
+#if defined(CONFIG_HEAP_USE_HOOKS)
+//Weak in the heap component, called after every successful allocation and before every free.
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    ReadieFur::OpenTCU::Memory::HeapCounter::OnAllocated();
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void* ptr)
+{
+    ReadieFur::OpenTCU::Memory::HeapCounter::OnFreed();
+}
+#endif
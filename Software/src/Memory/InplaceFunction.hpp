@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace ReadieFur::OpenTCU::Memory
+{
+    template <typename Signature, size_t Capacity = 16>
+    class InplaceFunction;
+
+    //A std::function replacement that stores the callable inline, capturing more than Capacity bytes fails to compile instead of allocating.
+    template <typename R, typename... Args, size_t Capacity>
+    class InplaceFunction<R(Args...), Capacity>
+    {
+    private:
+        struct SOperations
+        {
+            R (*invoke)(void* callable, Args&&... args);
+            void (*copy)(void* destination, const void* source);
+            void (*destroy)(void* callable);
+        };
+
+        template <typename F>
+        static const SOperations* OperationsFor()
+        {
+            static const SOperations operations =
+            {
+                [](void* callable, Args&&... args) -> R { return (*static_cast<F*>(callable))(std::forward<Args>(args)...); },
+                [](void* destination, const void* source) { new (destination) F(*static_cast<const F*>(source)); },
+                [](void* callable) { static_cast<F*>(callable)->~F(); },
+            };
+            return &operations;
+        }
+
+        alignas(std::max_align_t) unsigned char _storage[Capacity];
+        const SOperations* _operations = nullptr;
+
+    public:
+        InplaceFunction() = default;
+        InplaceFunction(std::nullptr_t) {}
+
+        template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InplaceFunction>::value>>
+        InplaceFunction(F&& callable)
+        {
+            typedef std::decay_t<F> TCallable;
+            static_assert(sizeof(TCallable) <= Capacity, "The callable does not fit, capture less or increase the capacity.");
+            static_assert(alignof(TCallable) <= alignof(std::max_align_t), "The callable is over aligned.");
+            new (_storage) TCallable(std::forward<F>(callable));
+            _operations = OperationsFor<TCallable>();
+        }
+
+        InplaceFunction(const InplaceFunction& other)
+        {
+            if (other._operations != nullptr)
+                other._operations->copy(_storage, other._storage);
+            _operations = other._operations;
+        }
+
+        InplaceFunction& operator=(const InplaceFunction& other)
+        {
+            if (this != &other)
+            {
+                *this = nullptr;
+                if (other._operations != nullptr)
+                    other._operations->copy(_storage, other._storage);
+                _operations = other._operations;
+            }
+            return *this;
+        }
+
+        InplaceFunction& operator=(std::nullptr_t)
+        {
+            if (_operations != nullptr)
+                _operations->destroy(_storage);
+            _operations = nullptr;
+            return *this;
+        }
+
+        ~InplaceFunction()
+        {
+            *this = nullptr;
+        }
+
+        R operator()(Args... args) const
+        {
+            return _operations->invoke(const_cast<unsigned char*>(_storage), std::forward<Args>(args)...);
+        }
+
+        explicit operator bool() const { return _operations != nullptr; }
+        bool operator==(std::nullptr_t) const { return _operations == nullptr; }
+        bool operator!=(std::nullptr_t) const { return _operations != nullptr; }
+    };
+};
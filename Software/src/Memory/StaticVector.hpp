@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace ReadieFur::OpenTCU::Memory
+{
+    //A vector with its storage inline, it never allocates so it can be kept by long running services without fragmenting the heap.
+    //The members follow std::vector so that it can be used with the standard algorithms, push_back and emplace_back return false instead of growing once full.
+    template <typename T, size_t N>
+    class StaticVector
+    {
+    private:
+        alignas(T) unsigned char _storage[N * sizeof(T)];
+        size_t _size = 0;
+
+    public:
+        typedef T value_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+
+        StaticVector() = default;
+
+        StaticVector(const StaticVector& other)
+        {
+            for (const T& item : other)
+                push_back(item);
+        }
+
+        StaticVector& operator=(const StaticVector& other)
+        {
+            if (this != &other)
+            {
+                clear();
+                for (const T& item : other)
+                    push_back(item);
+            }
+            return *this;
+        }
+
+        ~StaticVector()
+        {
+            clear();
+        }
+
+        bool push_back(const T& value)
+        {
+            return emplace_back(value);
+        }
+
+        template <typename... Args>
+        bool emplace_back(Args&&... args)
+        {
+            if (_size >= N)
+                return false;
+            new (&data()[_size]) T(std::forward<Args>(args)...);
+            _size++;
+            return true;
+        }
+
+        void pop_back()
+        {
+            if (_size == 0)
+                return;
+            _size--;
+            data()[_size].~T();
+        }
+
+        //Removes the item by moving the last one into its place, the order is not kept.
+        iterator erase_unordered(iterator position)
+        {
+            iterator last = end() - 1;
+            if (position != last)
+                *position = std::move(*last);
+            pop_back();
+            return position;
+        }
+
+        void clear()
+        {
+            while (_size > 0)
+                pop_back();
+        }
+
+        T* data() { return reinterpret_cast<T*>(_storage); }
+        const T* data() const { return reinterpret_cast<const T*>(_storage); }
+
+        T& operator[](size_t index) { return data()[index]; }
+        const T& operator[](size_t index) const { return data()[index]; }
+
+        iterator begin() { return data(); }
+        iterator end() { return data() + _size; }
+        const_iterator begin() const { return data(); }
+        const_iterator end() const { return data() + _size; }
+
+        size_t size() const { return _size; }
+        static constexpr size_t capacity() { return N; }
+        bool empty() const { return _size == 0; }
+        bool full() const { return _size >= N; }
+    };
+};
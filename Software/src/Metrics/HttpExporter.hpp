@@ -0,0 +1,129 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+#include "Metrics.hpp"
+#include "Logging.hpp"
+
+namespace ReadieFur::OpenTCU::Metrics
+{
+    //Serves every registered metric at /metrics in the Prometheus text format.
+    class HttpExporter
+    {
+    private:
+        static const size_t LINE_BUFFER_SIZE = 192;
+
+        static httpd_handle_t _server;
+
+        static esp_err_t SendLine(httpd_req_t* req, char* buffer, int length)
+        {
+            if (length < 0)
+                return ESP_FAIL;
+            return httpd_resp_send_chunk(req, buffer, length < (int)LINE_BUFFER_SIZE ? length : LINE_BUFFER_SIZE - 1);
+        }
+
+        static esp_err_t GetMetrics(httpd_req_t* req)
+        {
+            httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+            //Written a line at a time so that the response never has to be held in memory.
+            char buffer[LINE_BUFFER_SIZE];
+            const char* previousName = "";
+            for (AMetric* metric = Registry::First(); metric != nullptr; metric = Registry::Next(metric))
+            {
+                //Metrics that only differ by their labels share the HELP and TYPE lines.
+                if (strcmp(metric->Name, previousName) != 0)
+                {
+                    const char* type = metric->Type == CounterType ? "counter" : metric->Type == GaugeType ? "gauge" : "histogram";
+                    if (SendLine(req, buffer, snprintf(buffer, sizeof(buffer), "# HELP %s %s\n# TYPE %s %s\n", metric->Name, metric->Help, metric->Name, type)) != ESP_OK)
+                        return ESP_FAIL;
+                    previousName = metric->Name;
+                }
+
+                const char* separator = metric->Labels[0] != '\0' ? "," : "";
+                esp_err_t err = ESP_OK;
+                switch (metric->Type)
+                {
+                case CounterType:
+                case GaugeType:
+                {
+                    char value[12];
+                    if (metric->Type == GaugeType)
+                        snprintf(value, sizeof(value), "%ld", (long)(int32_t)metric->GetSeries(0));
+                    else
+                        snprintf(value, sizeof(value), "%lu", (unsigned long)metric->GetSeries(0));
+                    //With no labels the braces are dropped and the empty label string is printed in their place.
+                    err = SendLine(req, buffer, snprintf(buffer, sizeof(buffer), metric->Labels[0] != '\0' ? "%s{%s} %s\n" : "%s%s %s\n", metric->Name, metric->Labels, value));
+                    break;
+                }
+                case HistogramType:
+                {
+                    size_t buckets = metric->GetBucketCount();
+                    for (size_t i = 0; i < buckets && err == ESP_OK; i++)
+                        err = SendLine(req, buffer, snprintf(buffer, sizeof(buffer), "%s_bucket{%s%sle=\"%lu\"} %lu\n", metric->Name, metric->Labels, separator,
+                            (unsigned long)metric->GetBound(i), (unsigned long)metric->GetSeries(i)));
+                    if (err == ESP_OK)
+                        err = SendLine(req, buffer, snprintf(buffer, sizeof(buffer), "%s_bucket{%s%sle=\"+Inf\"} %lu\n", metric->Name, metric->Labels, separator,
+                            (unsigned long)metric->GetSeries(buckets)));
+                    if (err == ESP_OK)
+                        err = SendLine(req, buffer, snprintf(buffer, sizeof(buffer), metric->Labels[0] != '\0' ? "%s_sum{%s} %lu\n%s_count{%s} %lu\n" : "%s_sum%s %lu\n%s_count%s %lu\n",
+                            metric->Name, metric->Labels, (unsigned long)metric->GetSeries(buckets + 1),
+                            metric->Name, metric->Labels, (unsigned long)metric->GetSeries(buckets)));
+                    break;
+                }
+                default:
+                    break;
+                }
+                if (err != ESP_OK)
+                    return ESP_FAIL;
+            }
+
+            return httpd_resp_send_chunk(req, NULL, 0);
+        }
+
+    public:
+        static esp_err_t Init(httpd_config_t* config)
+        {
+            if (_server != NULL)
+                return ESP_OK;
+
+            esp_err_t err;
+            if ((err = httpd_start(&_server, config)) != ESP_OK)
+            {
+                LOGE(nameof(Metrics::HttpExporter), "Failed to start metrics server: %s", esp_err_to_name(err));
+                _server = NULL;
+                return err;
+            }
+
+            httpd_uri_t metricsUri =
+            {
+                .uri = "/metrics",
+                .method = HTTP_GET,
+                .handler = GetMetrics,
+                .user_ctx = NULL
+            };
+            if ((err = httpd_register_uri_handler(_server, &metricsUri)) != ESP_OK)
+            {
+                LOGE(nameof(Metrics::HttpExporter), "Failed to register metrics handler: %s", esp_err_to_name(err));
+                Deinit();
+                return err;
+            }
+
+            return ESP_OK;
+        }
+
+        static esp_err_t Deinit()
+        {
+            if (_server == NULL)
+                return ESP_OK;
+
+            esp_err_t err = httpd_stop(_server);
+            _server = NULL;
+            return err;
+        }
+    };
+};
+
+httpd_handle_t ReadieFur::OpenTCU::Metrics::HttpExporter::_server = NULL;
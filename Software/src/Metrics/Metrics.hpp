@@ -0,0 +1,242 @@
+#pragma once
+
+//Counters, gauges and fixed-bucket histograms that can be updated from the relay tasks without locks.
+//Metrics are expected to be static objects, they register themselves on construction and are never unregistered.
+//Values are 32 bit and wrap, exporters report the raw value so consumers should take deltas between reads.
+
+#include <freertos/FreeRTOS.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "CAN/RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::Metrics
+{
+    enum EMetricType : uint8_t
+    {
+        CounterType = 0,
+        GaugeType = 1,
+        HistogramType = 2,
+    };
+
+    class AMetric
+    {
+        friend class Registry;
+
+    private:
+        AMetric* _next = nullptr;
+
+    protected:
+        AMetric(const char* name, const char* help, const char* labels, EMetricType type);
+
+    public:
+        const char* const Name;
+        const char* const Help;
+        const char* const Labels; //Prometheus style labels without the braces, e.g. bus="1", or an empty string.
+        const EMetricType Type;
+
+        virtual ~AMetric() = default;
+
+        //Each metric exports one or more 32 bit values, see the individual types for the layout.
+        virtual size_t GetSeriesCount() const = 0;
+        virtual uint32_t GetSeries(size_t index) const = 0;
+
+        //Upper bounds of a histogram's buckets, other metrics have none.
+        virtual size_t GetBucketCount() const
+        {
+            return 0;
+        }
+
+        virtual uint32_t GetBound(size_t index) const
+        {
+            return 0;
+        }
+    };
+
+    class Registry
+    {
+    private:
+        static std::atomic<AMetric*> _head;
+
+    public:
+        static void Register(AMetric* metric)
+        {
+            AMetric* head = _head.load(std::memory_order_relaxed);
+            do
+            {
+                metric->_next = head;
+            } while (!_head.compare_exchange_weak(head, metric, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        //Metrics are listed newest first, the order is fixed for a given build.
+        static AMetric* First()
+        {
+            return _head.load(std::memory_order_acquire);
+        }
+
+        static AMetric* Next(const AMetric* metric)
+        {
+            return metric->_next;
+        }
+
+        //Flattens every metric's series into one list so that it can be read out a piece at a time.
+        static bool GetSeries(size_t flatIndex, uint8_t* metricIndex, uint8_t* seriesIndex, uint32_t* value)
+        {
+            size_t index = 0;
+            for (AMetric* metric = First(); metric != nullptr; metric = metric->_next, index++)
+            {
+                size_t count = metric->GetSeriesCount();
+                if (flatIndex < count)
+                {
+                    *metricIndex = (uint8_t)index;
+                    *seriesIndex = (uint8_t)flatIndex;
+                    *value = metric->GetSeries(flatIndex);
+                    return true;
+                }
+                flatIndex -= count;
+            }
+            return false;
+        }
+
+        static size_t GetSeriesCount()
+        {
+            size_t count = 0;
+            for (AMetric* metric = First(); metric != nullptr; metric = metric->_next)
+                count += metric->GetSeriesCount();
+            return count;
+        }
+    };
+
+    inline AMetric::AMetric(const char* name, const char* help, const char* labels, EMetricType type) : Name(name), Help(help), Labels(labels), Type(type)
+    {
+        Registry::Register(this);
+    }
+
+    //Monotonic count, sharded per core so that each core only ever increments its own slot.
+    //Series 0 is the total.
+    class Counter : public AMetric
+    {
+    private:
+        std::atomic<uint32_t> _values[portNUM_PROCESSORS] = {};
+
+    public:
+        Counter(const char* name, const char* help, const char* labels = "") : AMetric(name, help, labels, CounterType) {}
+
+        inline void RELAY_IRAM_ATTR Increment(uint32_t amount = 1)
+        {
+            _values[xPortGetCoreID()].fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        uint32_t Get() const
+        {
+            uint32_t total = 0;
+            for (size_t i = 0; i < portNUM_PROCESSORS; i++)
+                total += _values[i].load(std::memory_order_relaxed);
+            return total;
+        }
+
+        size_t GetSeriesCount() const override
+        {
+            return 1;
+        }
+
+        uint32_t GetSeries(size_t index) const override
+        {
+            return Get();
+        }
+    };
+
+    //Last written value.
+    //Series 0 is the value, signed values are exported as their two's complement.
+    class Gauge : public AMetric
+    {
+    private:
+        std::atomic<int32_t> _value = 0;
+
+    public:
+        Gauge(const char* name, const char* help, const char* labels = "") : AMetric(name, help, labels, GaugeType) {}
+
+        inline void Set(int32_t value)
+        {
+            _value.store(value, std::memory_order_relaxed);
+        }
+
+        int32_t Get() const
+        {
+            return _value.load(std::memory_order_relaxed);
+        }
+
+        size_t GetSeriesCount() const override
+        {
+            return 1;
+        }
+
+        uint32_t GetSeries(size_t index) const override
+        {
+            return (uint32_t)Get();
+        }
+    };
+
+    //Distribution over fixed upper bounds, sharded per core like Counter.
+    //Series 0 to BucketCount are the cumulative bucket counts (the last being +Inf, i.e. the total count), followed by the sum.
+    template <size_t BucketCount>
+    class Histogram : public AMetric
+    {
+    private:
+        uint32_t _bounds[BucketCount];
+        std::atomic<uint32_t> _buckets[portNUM_PROCESSORS][BucketCount + 1] = {};
+        std::atomic<uint32_t> _sums[portNUM_PROCESSORS] = {};
+
+    public:
+        //Bounds must be in ascending order.
+        Histogram(const char* name, const char* help, const uint32_t (&bounds)[BucketCount], const char* labels = "") : AMetric(name, help, labels, HistogramType)
+        {
+            for (size_t i = 0; i < BucketCount; i++)
+                _bounds[i] = bounds[i];
+        }
+
+        inline void RELAY_IRAM_ATTR Observe(uint32_t value)
+        {
+            size_t bucket = 0;
+            while (bucket < BucketCount && value > _bounds[bucket])
+                bucket++;
+
+            BaseType_t core = xPortGetCoreID();
+            _buckets[core][bucket].fetch_add(1, std::memory_order_relaxed);
+            _sums[core].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        size_t GetBucketCount() const override
+        {
+            return BucketCount;
+        }
+
+        uint32_t GetBound(size_t index) const override
+        {
+            return _bounds[index];
+        }
+
+        size_t GetSeriesCount() const override
+        {
+            return BucketCount + 2;
+        }
+
+        uint32_t GetSeries(size_t index) const override
+        {
+            uint32_t total = 0;
+            if (index > BucketCount)
+            {
+                for (size_t core = 0; core < portNUM_PROCESSORS; core++)
+                    total += _sums[core].load(std::memory_order_relaxed);
+                return total;
+            }
+
+            for (size_t core = 0; core < portNUM_PROCESSORS; core++)
+                for (size_t bucket = 0; bucket <= index; bucket++)
+                    total += _buckets[core][bucket].load(std::memory_order_relaxed);
+            return total;
+        }
+    };
+};
+
+std::atomic<ReadieFur::OpenTCU::Metrics::AMetric*> ReadieFur::OpenTCU::Metrics::Registry::_head(nullptr);
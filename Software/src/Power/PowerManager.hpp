@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <Service/AService.hpp>
+#include <Network/WiFi.hpp>
+#include "CAN/BusMaster.hpp"
+#include "Bluetooth/API.hpp"
+#include "Logging.hpp"
+
+#ifndef CONFIG_PM_ENABLE
+#error "The power manager requires CONFIG_PM_ENABLE."
+#endif
+
+namespace ReadieFur::OpenTCU::Power
+{
+    //Runs the chip at full speed while the bike is on and with frequency scaling and automatic light sleep while it is off, following the idle state of BusMaster.
+    //While active the TWAI driver holds the APB frequency lock anyway, the active configuration makes that hold for the rest of the chip too.
+    //While idle the controllers are stopped (releasing that lock) with their RX lines as GPIO wake-up sources, so the first CAN edge wakes the chip and the relay restarts them.
+    //Light sleep also requires CONFIG_FREERTOS_USE_TICKLESS_IDLE and, with BLE running, CONFIG_BT_LE_SLEEP_ENABLE, without them idle only scales the frequency.
+    class PowerManager : public Service::AService
+    {
+    private:
+        static const TickType_t POLL_INTERVAL = pdMS_TO_TICKS(1000); //Transitions are signalled, this only bounds how long cancellation takes.
+        static const int ACTIVE_FREQ_MHZ = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        static const int IDLE_MIN_FREQ_MHZ = CONFIG_XTAL_FREQ;
+
+        static esp_err_t Configure(int minFreqMhz, bool lightSleep)
+        {
+            esp_pm_config_t config =
+            {
+                .max_freq_mhz = ACTIVE_FREQ_MHZ,
+                .min_freq_mhz = minFreqMhz,
+                .light_sleep_enable = lightSleep
+            };
+            return esp_pm_configure(&config);
+        }
+
+        void EnterIdle(bool lightSleep)
+        {
+            //The AP keeps the radio awake, it can be started again over the API when it is needed.
+            if (Network::WiFi::Initalized() && Network::WiFi::GetMode() == WIFI_MODE_AP)
+                Bluetooth::API::StopAP();
+
+            esp_err_t err = Configure(IDLE_MIN_FREQ_MHZ, lightSleep);
+            if (err != ESP_OK)
+                LOGE(nameof(Power::PowerManager), "Failed to configure idle power management: %s", esp_err_to_name(err));
+        }
+
+        void ExitIdle()
+        {
+            esp_err_t err = Configure(ACTIVE_FREQ_MHZ, false);
+            if (err != ESP_OK)
+                LOGE(nameof(Power::PowerManager), "Failed to configure active power management: %s", esp_err_to_name(err));
+        }
+
+    protected:
+        void RunServiceImpl() override
+        {
+            CAN::BusMaster* busMaster = GetService<CAN::BusMaster>();
+
+            esp_err_t err = Configure(ACTIVE_FREQ_MHZ, false);
+            if (err != ESP_OK)
+            {
+                LOGE(nameof(Power::PowerManager), "Failed to configure power management: %s", esp_err_to_name(err));
+                return;
+            }
+
+            //The time spent in each state is logged so that it can be lined up with a current measurement.
+            int64_t since = esp_timer_get_time();
+            while (!ServiceCancellationToken.IsCancellationRequested())
+            {
+                EventBits_t bits = busMaster->WaitForIdle(true, POLL_INTERVAL);
+                if (bits == 0)
+                    continue;
+
+                bool lightSleep = (bits & CAN::BusMaster::SLEEP_EVENT_BIT) != 0;
+                EnterIdle(lightSleep);
+                LOGI(nameof(Power::PowerManager), "Idle at %i-%iMHz%s after %llus active.", IDLE_MIN_FREQ_MHZ, ACTIVE_FREQ_MHZ, lightSleep ? " with light sleep" : "", (esp_timer_get_time() - since) / 1000000);
+                since = esp_timer_get_time();
+
+                while (busMaster->WaitForIdle(false, POLL_INTERVAL) == 0)
+                    if (ServiceCancellationToken.IsCancellationRequested())
+                        return;
+
+                ExitIdle();
+                LOGI(nameof(Power::PowerManager), "Active at %iMHz after %llus idle.", ACTIVE_FREQ_MHZ, (esp_timer_get_time() - since) / 1000000);
+                since = esp_timer_get_time();
+            }
+        }
+
+    public:
+        PowerManager()
+        {
+            AddDependencyType<CAN::BusMaster>();
+        }
+    };
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "CAN/RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::Profiling
+{
+    //Timestamps (esp_timer_get_time, which starts counting during startup before app_main) of each stage from app_main to the first relayed frame.
+    //Stages can be marked from any task, each takes a slot with a single atomic increment and is published once its time has been written.
+    class BootTimeline
+    {
+    public:
+        static const size_t MAX_STAGES = 24;
+
+        struct SStage
+        {
+            const char* name;
+            int64_t at;
+        };
+
+    private:
+        struct SSlot
+        {
+            const char* name;
+            std::atomic<int64_t> at; //0 until the slot has been written.
+        };
+
+        static std::atomic<size_t> _count;
+        static SSlot _slots[MAX_STAGES];
+        static std::atomic<bool> _firstReceived;
+        static std::atomic<bool> _firstRelayed;
+
+    public:
+        //Only the pointer is kept, name must be a string literal.
+        static void Mark(const char* name)
+        {
+            int64_t at = esp_timer_get_time();
+            size_t index = _count.fetch_add(1, std::memory_order_relaxed);
+            if (index >= MAX_STAGES)
+                return;
+            _slots[index].name = name;
+            _slots[index].at.store(at > 0 ? at : 1, std::memory_order_release);
+        }
+
+        //Called for every frame by the relay tasks, after the first one this is a single load.
+        static inline void RELAY_IRAM_ATTR MarkFrameReceived()
+        {
+            if (_firstReceived.load(std::memory_order_relaxed))
+                return;
+            bool expected = false;
+            if (_firstReceived.compare_exchange_strong(expected, true))
+                Mark("First frame received");
+        }
+
+        static inline void RELAY_IRAM_ATTR MarkFrameRelayed()
+        {
+            if (_firstRelayed.load(std::memory_order_relaxed))
+                return;
+            bool expected = false;
+            if (_firstRelayed.compare_exchange_strong(expected, true))
+                Mark("First frame relayed");
+        }
+
+        static bool HasRelayed()
+        {
+            return _firstRelayed.load(std::memory_order_relaxed);
+        }
+
+        //Returns false past the last stage or if the stage is still being written.
+        static bool GetStage(size_t index, SStage* stage)
+        {
+            if (index >= _count.load(std::memory_order_relaxed) || index >= MAX_STAGES)
+                return false;
+            int64_t at = _slots[index].at.load(std::memory_order_acquire);
+            if (at == 0)
+                return false;
+            *stage = { _slots[index].name, at };
+            return true;
+        }
+
+        //Time of the named stage, 0 if it has not been reached.
+        static int64_t GetTime(const char* name)
+        {
+            SStage stage;
+            for (size_t i = 0; GetStage(i, &stage); i++)
+                if (stage.name == name || strcmp(stage.name, name) == 0)
+                    return stage.at;
+            return 0;
+        }
+
+        static void Dump()
+        {
+            printf("Boot timeline:\n");
+            SStage stage;
+            int64_t previous = 0;
+            for (size_t i = 0; GetStage(i, &stage); i++)
+            {
+                printf("  %8lldus (+%7lldus) %s\n", (long long)stage.at, (long long)(stage.at - previous), stage.name);
+                previous = stage.at;
+            }
+        }
+    };
+};
+
+std::atomic<size_t> ReadieFur::OpenTCU::Profiling::BootTimeline::_count(0);
+ReadieFur::OpenTCU::Profiling::BootTimeline::SSlot ReadieFur::OpenTCU::Profiling::BootTimeline::_slots[ReadieFur::OpenTCU::Profiling::BootTimeline::MAX_STAGES] = {};
+std::atomic<bool> ReadieFur::OpenTCU::Profiling::BootTimeline::_firstReceived(false);
+std::atomic<bool> ReadieFur::OpenTCU::Profiling::BootTimeline::_firstRelayed(false);
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gptimer.h>
+#include <esp_attr.h>
+#include <Service/AService.hpp>
+#include <atomic>
+#include <stdio.h>
+#include "Logging.hpp"
+
+#ifndef __riscv
+#error "The profiler reads the interrupted PC from mepc and currently only supports RISC-V targets (C3/C6)."
+#endif
+
+namespace ReadieFur::OpenTCU::Profiling
+{
+    //Statistical profiler, a hardware timer interrupts the CPU at a fixed rate and records the interrupted PC and task.
+    //Samples are buffered in RAM and streamed over the console as lines that Tools/Profiler turns into folded stacks:
+    //  @T <task handle> <task name>    (once per task)
+    //  @P <task handle> <pc> [<pc>...] (consecutive samples from the same task)
+    //  @D <count>                      (samples dropped because the buffer was full)
+    class Profiler : public Service::AService
+    {
+    public:
+        static const uint32_t DEFAULT_SAMPLE_RATE_HZ = 250; //~4KB/s of output, comfortably within a 115200 baud console.
+
+    private:
+        static const size_t BUFFER_LENGTH = 1024; //Must be a power of two.
+        static const size_t MAX_PCS_PER_LINE = 8;
+        static const size_t MAX_KNOWN_TASKS = 32;
+        static const TickType_t DRAIN_INTERVAL = pdMS_TO_TICKS(100);
+
+        struct SSample
+        {
+            uint32_t pc;
+            TaskHandle_t task;
+        };
+
+        SSample _buffer[BUFFER_LENGTH];
+        std::atomic<size_t> _head = 0; //Written by the ISR.
+        std::atomic<size_t> _tail = 0; //Written by the service task.
+        std::atomic<uint32_t> _dropped = 0;
+        TaskHandle_t _knownTasks[MAX_KNOWN_TASKS] = {};
+        size_t _knownTaskCount = 0;
+
+        static bool IRAM_ATTR OnAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t* eventData, void* userContext)
+        {
+            Profiler* self = static_cast<Profiler*>(userContext);
+
+            //mepc still holds the interrupted PC as this runs at the highest C interrupt priority, a nested interrupt would overwrite it.
+            uint32_t pc;
+            asm volatile("csrr %0, mepc" : "=r"(pc));
+
+            size_t head = self->_head.load(std::memory_order_relaxed);
+            if (head - self->_tail.load(std::memory_order_acquire) >= BUFFER_LENGTH)
+            {
+                self->_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            self->_buffer[head & (BUFFER_LENGTH - 1)] = { pc, xTaskGetCurrentTaskHandle() };
+            self->_head.store(head + 1, std::memory_order_release);
+            return false;
+        }
+
+        //Names are printed the first time a task is seen, while it is known to still exist.
+        void DescribeTask(TaskHandle_t task)
+        {
+            for (size_t i = 0; i < _knownTaskCount; i++)
+                if (_knownTasks[i] == task)
+                    return;
+
+            if (_knownTaskCount < MAX_KNOWN_TASKS)
+                _knownTasks[_knownTaskCount++] = task;
+            printf("@T %08lx %s\n", (unsigned long)(uintptr_t)task, task != NULL ? pcTaskGetName(task) : "ISR");
+        }
+
+        void Drain()
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            while (tail != head)
+            {
+                TaskHandle_t task = _buffer[tail & (BUFFER_LENGTH - 1)].task;
+                DescribeTask(task);
+
+                printf("@P %08lx", (unsigned long)(uintptr_t)task);
+                for (size_t i = 0; i < MAX_PCS_PER_LINE && tail != head && _buffer[tail & (BUFFER_LENGTH - 1)].task == task; i++, tail++)
+                    printf(" %08lx", (unsigned long)_buffer[tail & (BUFFER_LENGTH - 1)].pc);
+                printf("\n");
+
+                _tail.store(tail, std::memory_order_release);
+            }
+
+            uint32_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped != 0)
+                printf("@D %lu\n", (unsigned long)dropped);
+        }
+
+    protected:
+        void RunServiceImpl() override
+        {
+            gptimer_handle_t timer = NULL;
+            gptimer_config_t timerConfig =
+            {
+                .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+                .direction = GPTIMER_COUNT_UP,
+                .resolution_hz = 1000000,
+                .intr_priority = 3,
+            };
+            gptimer_alarm_config_t alarmConfig =
+            {
+                .alarm_count = 1000000 / (SampleRateHz != 0 ? SampleRateHz : DEFAULT_SAMPLE_RATE_HZ),
+                .reload_count = 0,
+                .flags = { .auto_reload_on_alarm = true },
+            };
+            gptimer_event_callbacks_t callbacks = { .on_alarm = OnAlarm };
+
+            esp_err_t err;
+            if ((err = gptimer_new_timer(&timerConfig, &timer)) != ESP_OK
+                || (err = gptimer_set_alarm_action(timer, &alarmConfig)) != ESP_OK
+                || (err = gptimer_register_event_callbacks(timer, &callbacks, this)) != ESP_OK
+                || (err = gptimer_enable(timer)) != ESP_OK
+                || (err = gptimer_start(timer)) != ESP_OK)
+            {
+                LOGE(nameof(Profiling::Profiler), "Failed to start sample timer: %s", esp_err_to_name(err));
+                if (timer != NULL)
+                    gptimer_del_timer(timer);
+                return;
+            }
+
+            LOGI(nameof(Profiling::Profiler), "Sampling at %luHz.", (unsigned long)(1000000 / alarmConfig.alarm_count));
+            while (!ServiceCancellationToken.IsCancellationRequested())
+            {
+                vTaskDelay(DRAIN_INTERVAL);
+                Drain();
+            }
+
+            gptimer_stop(timer);
+            gptimer_disable(timer);
+            gptimer_del_timer(timer);
+            Drain();
+        }
+
+    public:
+        uint32_t SampleRateHz = DEFAULT_SAMPLE_RATE_HZ; //Read when the service starts.
+
+        Profiler()
+        {
+            ServiceEntrypointStackDepth += 1024;
+        }
+    };
+};
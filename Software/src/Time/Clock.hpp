@@ -0,0 +1,211 @@
+#pragma once
+
+//Time as seen by the bike logic (live data staleness, the assist controller, CAN dump timestamps, the simulated buses), in microseconds since boot.
+//Reading it through Clock allows a simulation to install a VirtualClock, where time only moves when the simulation advances it, so that a replay runs as fast as the firmware can process it.
+//Measurements of the firmware itself (relay latency, the stall watchdog, controller health) and driver timeouts stay on esp_timer and the tick count as they describe real execution.
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_rom_sys.h>
+#include <stdint.h>
+#include <atomic>
+#include "CAN/RelayPlacement.h"
+
+namespace ReadieFur::OpenTCU::Time
+{
+    class AClock
+    {
+    public:
+        virtual ~AClock() = default;
+
+        //Microseconds since boot.
+        virtual int64_t Now() = 0;
+
+        //Blocks the calling task until Now() has reached the given time.
+        virtual void DelayUntil(int64_t at) = 0;
+
+        //As DelayUntil, for waits shorter than a tick that have to end on time (e.g. the wire time of a simulated frame).
+        virtual void SpinUntil(int64_t at)
+        {
+            DelayUntil(at);
+        }
+    };
+
+    class SystemClock : public AClock
+    {
+    public:
+        int64_t RELAY_IRAM_ATTR Now() override
+        {
+            return esp_timer_get_time();
+        }
+
+        void DelayUntil(int64_t at) override
+        {
+            //Rounded up to whole ticks so that the task is never left spinning, which would also hold off light sleep.
+            const int64_t tickUs = (int64_t)portTICK_PERIOD_MS * 1000;
+            int64_t remaining = at - esp_timer_get_time();
+            if (remaining > 0)
+                vTaskDelay((TickType_t)((remaining + tickUs - 1) / tickUs));
+        }
+
+        void SpinUntil(int64_t at) override
+        {
+            //Whole ticks are slept, the remainder is busy waited.
+            const int64_t tickUs = (int64_t)portTICK_PERIOD_MS * 1000;
+            int64_t remaining = at - esp_timer_get_time();
+            if (remaining >= tickUs)
+            {
+                vTaskDelay((TickType_t)(remaining / tickUs));
+                remaining = at - esp_timer_get_time();
+            }
+            if (remaining > 0)
+                esp_rom_delay_us((uint32_t)remaining);
+        }
+    };
+
+    //Time stands still until AdvanceTo is called, tasks waiting on the clock are woken once it passes their deadline.
+    //Only the task driving the simulation should advance it, typically after handing the firmware the next event so that everything due before that event has run first.
+    class VirtualClock : public AClock
+    {
+    public:
+        static const size_t MAX_WAITERS = 8;
+
+    private:
+        struct SWaiter
+        {
+            int64_t at;
+            SemaphoreHandle_t signal;
+            bool waiting;
+        };
+
+        std::atomic<int64_t> _now;
+        SemaphoreHandle_t _mutex = xSemaphoreCreateMutex();
+        SWaiter _waiters[MAX_WAITERS] = {};
+
+    public:
+        VirtualClock(int64_t start = 0) : _now(start)
+        {
+            for (auto&& waiter : _waiters)
+                waiter.signal = xSemaphoreCreateBinary();
+        }
+
+        ~VirtualClock()
+        {
+            for (auto&& waiter : _waiters)
+                vSemaphoreDelete(waiter.signal);
+            vSemaphoreDelete(_mutex);
+        }
+
+        int64_t Now() override
+        {
+            return _now.load(std::memory_order_acquire);
+        }
+
+        void DelayUntil(int64_t at) override
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            if (Now() >= at)
+            {
+                xSemaphoreGive(_mutex);
+                return;
+            }
+
+            SWaiter* slot = nullptr;
+            for (auto&& waiter : _waiters)
+            {
+                if (!waiter.waiting)
+                {
+                    slot = &waiter;
+                    break;
+                }
+            }
+
+            if (slot == nullptr)
+            {
+                //More tasks are waiting than there are slots, fall back to polling.
+                xSemaphoreGive(_mutex);
+                while (Now() < at)
+                    vTaskDelay(1);
+                return;
+            }
+
+            slot->at = at;
+            slot->waiting = true;
+            xSemaphoreGive(_mutex);
+            xSemaphoreTake(slot->signal, portMAX_DELAY);
+        }
+
+        //Moves the time forward (never back) and wakes the tasks whose deadline has passed.
+        void AdvanceTo(int64_t at)
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            if (at > Now())
+                _now.store(at, std::memory_order_release);
+
+            for (auto&& waiter : _waiters)
+            {
+                if (waiter.waiting && waiter.at <= Now())
+                {
+                    waiter.waiting = false;
+                    xSemaphoreGive(waiter.signal);
+                }
+            }
+            xSemaphoreGive(_mutex);
+        }
+
+        void Advance(int64_t us)
+        {
+            AdvanceTo(Now() + us);
+        }
+    };
+
+    class Clock
+    {
+    private:
+        static SystemClock _system;
+        static AClock* _clock;
+
+    public:
+        //Must be called before any service is started, the clock is read without synchronisation. nullptr restores the system clock.
+        static void Set(AClock* clock)
+        {
+            _clock = clock != nullptr ? clock : &_system;
+        }
+
+        static AClock* Get()
+        {
+            return _clock;
+        }
+
+        static inline int64_t RELAY_IRAM_ATTR Now()
+        {
+            return _clock->Now();
+        }
+
+        //Milliseconds since boot, as esp_log_timestamp.
+        static inline uint32_t RELAY_IRAM_ATTR NowMs()
+        {
+            return (uint32_t)(_clock->Now() / 1000);
+        }
+
+        static void Delay(int64_t us)
+        {
+            _clock->DelayUntil(_clock->Now() + us);
+        }
+
+        static void DelayUntil(int64_t at)
+        {
+            _clock->DelayUntil(at);
+        }
+
+        static void SpinUntil(int64_t at)
+        {
+            _clock->SpinUntil(at);
+        }
+    };
+};
+
+ReadieFur::OpenTCU::Time::SystemClock ReadieFur::OpenTCU::Time::Clock::_system;
+ReadieFur::OpenTCU::Time::AClock* ReadieFur::OpenTCU::Time::Clock::_clock = &ReadieFur::OpenTCU::Time::Clock::_system;
@@ -8,12 +8,34 @@
 #if defined(ENABLE_CAN_DUMP_SERIAL) || defined(ENABLE_CAN_DUMP_UDP)
 #define ENABLE_CAN_DUMP
 #endif
+// #define CAN_STRESS_TEST //Replaces the CAN controllers with in-memory buses driven by synthetic traffic.
+// #define CAN_LOOPBACK //Replaces the CAN controllers with in-process loopback buses (see BusMaster::GetLoopbackPeer).
+// #define VIRTUAL_TIME //Runs CAN_STRESS_TEST on a virtual clock, StressTest replays an hour of traffic at the recorded rate as fast as the relay can process it.
+// #define ENABLE_PROFILER //Streams PC samples over the console for Tools/Profiler.
+// #define FLASH_JITTER_TEST //Reports relay latency while saving and writing an OTA image, compare with and without CAN_RELAY_IN_IRAM.
+#endif
+// #define CAN_RELAY_IN_IRAM //Links the relay path into IRAM (requires CONFIG_TWAI_ISR_IN_IRAM), check the placement with Tools/IramCheck.
+
+#if defined(VIRTUAL_TIME) && !defined(CAN_STRESS_TEST)
+#error "VIRTUAL_TIME requires the simulated controllers, nothing else advances the clock."
 #endif
 
 #include <freertos/FreeRTOS.h> //Has to always be the first included FreeRTOS related header.
 #include "Service/ServiceManager.hpp"
 #include "CAN/BusMaster.hpp"
 #include "CAN/Logger.hpp"
+#ifdef CAN_STRESS_TEST
+#include "CAN/StressTest.hpp"
+#endif
+#ifdef ENABLE_PROFILER
+#include "Profiling/Profiler.hpp"
+#endif
+#ifdef FLASH_JITTER_TEST
+#include "CAN/FlashJitterTest.hpp"
+#endif
+#ifdef DEBUG
+#include "CAN/TransmitScheduler.hpp"
+#endif
 #include <esp_sleep.h>
 #include <freertos/task.h>
 #include "Logging.hpp"
@@ -22,7 +44,7 @@
 #endif
 #include <Network/WiFi.hpp>
 #include <Network/OTA/API.hpp>
-#include <esp_pm.h>
+#include "Power/PowerManager.hpp"
 #include <Network/Bluetooth/BLE.hpp>
 #include "Bluetooth/API.hpp"
 // #include "Bluetooth/TCU.hpp"
@@ -36,6 +58,8 @@
 #endif
 #include "Data/Flash.hpp"
 #include "Data/PersistentData.hpp"
+#include "Time/Clock.hpp"
+#include "Profiling/BootTimeline.hpp"
 #include <Event/Observable.hpp>
 
 #define CHECK_SERVICE_RESULT(func) do {                                                 \
@@ -60,18 +84,6 @@ struct sockaddr_in UdpDestAddr;
 int UdpBroadcastEnable = 1;
 #endif
 
-void SetCPUFrequency()
-{
-    //Set CPU frequency to the highest available as this real-time system needs to be as fast as possible.
-    // esp_pm_config_t cpuConfig = {
-    //     .max_freq_mhz = ESP_PM_CPU_FREQ_MAX,
-    //     .min_freq_mhz = ESP_PM_CPU_FREQ_MAX,
-    //     .light_sleep_enable = false
-    // };
-    // CHECK_ESP_RESULT(esp_pm_configure(&cpuConfig));
-    //Setting the CPU frequency is not strictly required as when TWAI is enabled, the frequency is locked at ESP_PM_APB_FREQ_MAX as per the ESP-IDF documentation.
-}
-
 void SetLogLevel()
 {
     #ifdef DEBUG
@@ -134,6 +146,8 @@ void ConfigureAdditionalLoggers()
 
 extern "C" void app_main()
 {
+    Profiling::BootTimeline::Mark("app_main");
+
     #if defined(DEBUG) && false
     vTaskDelay(pdMS_TO_TICKS(2000)); //Delay to allow the serial port to initialize.
     #endif
@@ -142,9 +156,19 @@ extern "C" void app_main()
     ReadieFur::Logging::OverrideStdout();
     #endif
 
-    // SetCPUFrequency();
     SetLogLevel();
 
+    #ifdef VIRTUAL_TIME
+    static Time::VirtualClock virtualClock;
+    Time::Clock::Set(&virtualClock); //Before any service reads the time.
+    #endif
+
+    //Bridge the bike first, the motor and display can't talk to each other until the relay is running.
+    //The relay starts on the default settings and the persisted ones are applied once storage is up (mounting, or on first boot formatting, SPIFFS can take seconds).
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<CAN::BusMaster>());
+    CAN::BusMaster* busMaster = ReadieFur::Service::ServiceManager::GetService<CAN::BusMaster>();
+    Profiling::BootTimeline::Mark("BusMaster started");
+
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
@@ -152,25 +176,43 @@ extern "C" void app_main()
         err = nvs_flash_init();
     }
     CHECK_ESP_RESULT(err);
+    Profiling::BootTimeline::Mark("NVS initialised");
 
     CHECK_ESP_RESULT(Data::Flash::Init());
+    Profiling::BootTimeline::Mark("Flash mounted");
     CHECK_ESP_RESULT(Data::PersistentData::Init());
+    busMaster->ApplyPersistentData();
+    Profiling::BootTimeline::Mark("Persistent data loaded");
     // ReadieFur::Event::TObservableHandle deviceNameObserverHandle;
     // Data::PersistentData::DeviceName.Register(deviceNameObserverHandle);
 
-    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<CAN::BusMaster>());
-    // CAN::BusMaster* busMaster = ReadieFur::Service::ServiceManager::GetService<CAN::BusMaster>(); //Create a secondary watcher as we want to capture changes now but not wait on them until later.
-
     #ifdef DEBUG
     CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<ReadieFur::Diagnostic::DiagnosticsService>());
     #endif
 
+    #ifdef CAN_STRESS_TEST
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<CAN::StressTest>());
+    #endif
+
+    #ifdef ENABLE_PROFILER
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<Profiling::Profiler>());
+    #endif
+
+    #ifdef FLASH_JITTER_TEST
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<CAN::FlashJitterTest>());
+    #endif
+
+    #ifdef DEBUG
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<CAN::TransmitScheduler>());
+    #endif
+
     //Attempt to fetch the device serial number from the bus with some retries (in my testing it can take a few seconds between device boot and the serial number being automatically requested).
     //If the times out then the default value will be used.
     // Data::PersistentData::DeviceName.WaitOne(deviceNameObserverHandle, pdMS_TO_TICKS(3000));
 
     CHECK_ESP_RESULT(ReadieFur::Network::WiFi::Init());
     ReadieFur::Network::WiFi::ShutdownInterface(WIFI_IF_AP);
+    Profiling::BootTimeline::Mark("WiFi initialised");
 
     #ifdef DEBUG
     ConfigureAdditionalLoggers();
@@ -184,6 +226,10 @@ extern "C" void app_main()
     #endif
 
     CHECK_ESP_RESULT(ReadieFur::Network::Bluetooth::BLE::Init(Data::PersistentData::DeviceName.Get().c_str(), Data::PersistentData::Pin));
+    Profiling::BootTimeline::Mark("BLE initialised");
     CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<Bluetooth::API>());
+    //Full speed while the bike is on, frequency scaling and light sleep while it is off.
+    CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<Power::PowerManager>());
+    Profiling::BootTimeline::Mark("Startup complete");
     // CHECK_SERVICE_RESULT(ReadieFur::Service::ServiceManager::InstallAndStartService<Bluetooth::TCU>());
 }
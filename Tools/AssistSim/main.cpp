@@ -0,0 +1,238 @@
+//Replays walk captures through the assist controller against a simple model of the bike and reports how well the speed limit is held.
+//Build: g++ -std=c++17 -O2 -o assistsim main.cpp
+//Usage: ./assistsim [--target mm] [--tau ms] [--limit km/h*100] <capture.txt>...
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/Signals.h"
+#include "../../Software/src/CAN/FixedRatio.h"
+#include "../../Software/src/CAN/AssistController.h"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::CAN;
+using namespace ReadieFur::OpenTCU::Tools;
+
+static const uint16_t BASE_CIRCUMFERENCE = 2160; //PersistentData default.
+static const uint16_t SETTLE_BAND = 25; //+/- 0.25km/h.
+static const uint32_t STEADY_WINDOW_MS = 2000; //The end of each walk segment that is taken as its steady state.
+static const uint32_t MIN_SEGMENT_MS = 5000;
+
+struct SSimOptions
+{
+    uint16_t targetCircumference = 1440; //A smaller wheel so that the recorded walk speed exceeds the walk limit once corrected.
+    uint32_t tauMs = 800; //Time constant of the bike's response to a change in assist.
+    uint16_t speedLimit = 0;
+};
+
+//The controller being simulated, either the legacy cut-off or AssistController.
+enum EController
+{
+    Legacy,
+    Taper
+};
+
+struct SSample
+{
+    uint32_t timestamp;
+    uint16_t realSpeed;
+    bool walkMode;
+};
+
+struct SSimResult
+{
+    std::vector<SSample> samples;
+    uint32_t toggles = 0; //Times assist was switched fully off or back on.
+    uint32_t shapedFrames = 0;
+    uint32_t reactionMaxUs = 0;
+    uint64_t reactionSumUs = 0;
+};
+
+struct SSegmentReport
+{
+    uint32_t start;
+    uint32_t duration;
+    uint16_t peak;
+    uint16_t steady;
+    int32_t settleMs; //-1 if it never settled.
+};
+
+//Legacy behaviour as previously written in BusMaster: assist is cut while the latest real speed is over 650.
+static uint16_t LegacyShape(uint8_t* data, uint16_t latestRealSpeed, bool wheelScaled)
+{
+    bool walkMode = SignalCodec<Signals::WalkMode>::Extract(data) == AssistController::WALK_MODE_ON;
+    if (walkMode && wheelScaled && latestRealSpeed > 650)
+    {
+        SignalCodec<Signals::MotorMode>::Insert(data, 0);
+        SignalCodec<Signals::EaseSetting>::Insert(data, 0);
+        SignalCodec<Signals::PowerSetting>::Insert(data, 0);
+        return 0;
+    }
+    return AssistController::FULL_SCALE;
+}
+
+//The bike is modelled as a first order lag: with full assist it tends towards the recorded speed, with less assist towards a proportionally lower speed.
+static SSimResult Simulate(const std::vector<SRecordedFrame>& frames, EController controllerType, const SSimOptions& options)
+{
+    SSimResult result;
+    FixedRatio wheel(BASE_CIRCUMFERENCE, options.targetCircumference, Multiply);
+    AssistController controller;
+    controller.SetWalkLimitEnabled(!wheel.IsIdentity());
+    controller.SetSpeedLimit(options.speedLimit);
+
+    double bikeSpeed = 0;
+    uint16_t recordedSpeed = 0;
+    uint16_t scale = AssistController::FULL_SCALE;
+    uint16_t latestRealSpeed = 0;
+    bool walkMode = false;
+    uint32_t lastTime = frames.empty() ? 0 : frames.front().timestamp;
+
+    for (auto&& frame : frames)
+    {
+        uint32_t dt = frame.timestamp - lastTime;
+        lastTime = frame.timestamp;
+        double target = (double)recordedSpeed * scale / AssistController::FULL_SCALE;
+        bikeSpeed += (target - bikeSpeed) * std::min(1.0, (double)dt / options.tauMs);
+
+        uint64_t nowUs = (uint64_t)frame.timestamp * 1000;
+        SCanMessage message = frame.message;
+        if (message.id == Signals::Speed.id)
+        {
+            recordedSpeed = SignalCodec<Signals::Speed>::Extract(message.data);
+            latestRealSpeed = (uint16_t)wheel.Apply((uint16_t)bikeSpeed);
+            controller.UpdateSpeed(latestRealSpeed, nowUs);
+            result.samples.push_back({ frame.timestamp, latestRealSpeed, walkMode });
+        }
+        else if (message.id == Signals::WalkMode.id)
+        {
+            walkMode = SignalCodec<Signals::WalkMode>::Extract(message.data) == AssistController::WALK_MODE_ON;
+            uint16_t next = controllerType == Legacy
+                ? LegacyShape(message.data, latestRealSpeed, !wheel.IsIdentity())
+                : controller.Shape(message.data, nowUs);
+            if ((next == 0) != (scale == 0))
+                result.toggles++;
+            scale = next;
+        }
+    }
+
+    AssistController::SStats stats = controller.GetStats();
+    if (controllerType == Taper)
+    {
+        result.shapedFrames = stats.shaped;
+        result.reactionMaxUs = stats.reactionMaxUs;
+        result.reactionSumUs = stats.reactionSumUs;
+    }
+    return result;
+}
+
+static std::vector<SSegmentReport> AnalyseSegments(const std::vector<SSample>& samples)
+{
+    std::vector<SSegmentReport> reports;
+    size_t i = 0;
+    while (i < samples.size())
+    {
+        if (!samples[i].walkMode)
+        {
+            i++;
+            continue;
+        }
+        size_t first = i;
+        while (i < samples.size() && samples[i].walkMode)
+            i++;
+        size_t last = i - 1;
+
+        SSegmentReport report = {};
+        report.start = samples[first].timestamp;
+        report.duration = samples[last].timestamp - report.start;
+        if (report.duration < MIN_SEGMENT_MS)
+            continue;
+
+        uint64_t steadySum = 0;
+        size_t steadyCount = 0;
+        for (size_t j = first; j <= last; j++)
+        {
+            report.peak = std::max(report.peak, samples[j].realSpeed);
+            if (samples[last].timestamp - samples[j].timestamp <= STEADY_WINDOW_MS)
+            {
+                steadySum += samples[j].realSpeed;
+                steadyCount++;
+            }
+        }
+        report.steady = (uint16_t)(steadySum / steadyCount);
+
+        //Settled once every later sample stays within the band around the steady state.
+        report.settleMs = 0;
+        for (size_t j = last + 1; j-- > first;)
+        {
+            if (std::abs((int)samples[j].realSpeed - (int)report.steady) > SETTLE_BAND)
+            {
+                report.settleMs = j == last ? -1 : (int32_t)(samples[j + 1].timestamp - report.start);
+                break;
+            }
+        }
+        reports.push_back(report);
+    }
+    return reports;
+}
+
+static void Report(const char* name, const SSimResult& result, uint16_t limit)
+{
+    std::vector<SSegmentReport> segments = AnalyseSegments(result.samples);
+    printf("  %-7s toggles %4u", name, result.toggles);
+    if (result.shapedFrames > 0)
+        printf(", reaction avg %5.1fms max %5.1fms", result.reactionSumUs / 1000.0 / result.shapedFrames, result.reactionMaxUs / 1000.0);
+    printf("\n");
+    for (auto&& segment : segments)
+    {
+        int overshoot = std::max(0, (int)segment.peak - (int)limit);
+        printf("    walk @%7.1fs for %5.1fs: peak %5.2fkm/h, overshoot %5.2fkm/h, steady %5.2fkm/h, ",
+            segment.start / 1000.0, segment.duration / 1000.0, segment.peak / 100.0, overshoot / 100.0, segment.steady / 100.0);
+        if (segment.settleMs < 0)
+            printf("never settled\n");
+        else
+            printf("settled after %5.1fs\n", segment.settleMs / 1000.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SSimOptions options;
+    int i = 1;
+    for (; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2)
+    {
+        if (strcmp(argv[i], "--target") == 0)
+            options.targetCircumference = (uint16_t)strtoul(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--tau") == 0)
+            options.tauMs = strtoul(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--limit") == 0)
+            options.speedLimit = (uint16_t)strtoul(argv[i + 1], nullptr, 0);
+        else
+            break;
+    }
+    if (i >= argc || options.tauMs == 0 || options.targetCircumference < 800 || options.targetCircumference > 2400)
+    {
+        std::cerr << "Usage: assistsim [--target mm] [--tau ms] [--limit km/h*100] <capture.txt>..." << std::endl;
+        return 1;
+    }
+
+    printf("Wheel %u -> %umm, bike time constant %ums, walk limit %.2fkm/h\n",
+        BASE_CIRCUMFERENCE, options.targetCircumference, options.tauMs, AssistController::WALK_SPEED_LIMIT / 100.0);
+    for (; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+
+        printf("%s\n", argv[i]);
+        Report("legacy", Simulate(frames, Legacy, options), AssistController::WALK_SPEED_LIMIT);
+        Report("taper", Simulate(frames, Taper, options), AssistController::WALK_SPEED_LIMIT);
+    }
+    return 0;
+}
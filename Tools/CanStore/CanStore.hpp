@@ -0,0 +1,597 @@
+#pragma once
+
+/**
+ * OpenTCU columnar recording store (.otcr).
+ *
+ * Layout:
+ *   Header   "OTCR" + version byte + 3 reserved bytes.
+ *   Block*   A time slice of the capture. Each block starts with a directory of its streams (one stream per bus/ID pair),
+ *            followed by an order column (which stream each frame came from, allowing the original interleaving to be rebuilt)
+ *            and then the stream columns themselves. A stream holds three columns:
+ *              - Timestamps: zigzag varint deltas (the first relative to the block start).
+ *              - Length/flags: run-length encoded (DLC | extended << 4 | remote << 5).
+ *              - Payload: one column per byte index, each value is the byte-wise delta to the previous frame of the stream, zero runs are varint encoded.
+ *   Index    Per block time range, offset, size and frame count, followed by a per-ID summary (count, first/last seen, min/max interval).
+ *   Trailer  Index offset (u32 LE) + index length (u32 LE) + "OTCI".
+ *
+ * Queries only read the trailer, the index and the blocks (and within them only the streams) that overlap the requested range.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include "../Common/Recording.hpp"
+
+namespace ReadieFur::OpenTCU::Tools
+{
+    class CanStore
+    {
+    public:
+        static constexpr const char* FILE_MAGIC = "OTCR";
+        static constexpr const char* INDEX_MAGIC = "OTCI";
+        static constexpr uint8_t VERSION = 1;
+        static constexpr size_t HEADER_SIZE = 8;
+        static constexpr size_t TRAILER_SIZE = 12;
+
+        struct SStreamKey
+        {
+            uint8_t bus;
+            uint32_t id;
+            bool isExtended;
+
+            bool operator<(const SStreamKey& other) const
+            {
+                if (bus != other.bus)
+                    return bus < other.bus;
+                if (isExtended != other.isExtended)
+                    return isExtended < other.isExtended;
+                return id < other.id;
+            }
+        };
+
+        struct SBlockIndex
+        {
+            uint32_t startTime;
+            uint32_t endTime;
+            uint32_t offset;
+            uint32_t size;
+            uint32_t frameCount;
+        };
+
+        struct SIdSummary
+        {
+            SStreamKey key;
+            uint32_t count;
+            uint32_t firstSeen;
+            uint32_t lastSeen;
+            uint32_t minInterval;
+            uint32_t maxInterval;
+        };
+
+    private:
+        #pragma region Encoding helpers
+        static void PutVarint(std::vector<uint8_t>& out, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((uint8_t)value);
+        }
+
+        static void PutU32(std::vector<uint8_t>& out, uint32_t value)
+        {
+            for (size_t i = 0; i < 4; i++)
+                out.push_back((uint8_t)(value >> (i * 8)));
+        }
+
+        static uint32_t ZigZag(int32_t value)
+        {
+            return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        }
+
+        static int32_t UnZigZag(uint32_t value)
+        {
+            return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+
+        //Bounds checked cursor over an in-memory section of the file.
+        struct SReader
+        {
+            const uint8_t* data;
+            size_t length;
+            size_t position = 0;
+            bool failed = false;
+
+            uint8_t Byte()
+            {
+                if (position >= length)
+                {
+                    failed = true;
+                    return 0;
+                }
+                return data[position++];
+            }
+
+            uint32_t Varint()
+            {
+                uint32_t value = 0;
+                for (int shift = 0; shift < 35; shift += 7)
+                {
+                    uint8_t byte = Byte();
+                    value |= (uint32_t)(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                        return value;
+                }
+                failed = true;
+                return 0;
+            }
+
+            uint32_t U32()
+            {
+                uint32_t value = 0;
+                for (size_t i = 0; i < 4; i++)
+                    value |= (uint32_t)Byte() << (i * 8);
+                return value;
+            }
+
+            SReader Sub(size_t subLength)
+            {
+                if (position + subLength > length)
+                {
+                    failed = true;
+                    return SReader { data, 0 };
+                }
+                SReader sub { data + position, subLength };
+                position += subLength;
+                return sub;
+            }
+        };
+
+        //Zero runs are written as a varint count followed by the next non-zero literal.
+        static void PutZeroRunColumn(std::vector<uint8_t>& out, const std::vector<uint8_t>& column)
+        {
+            uint32_t run = 0;
+            for (uint8_t value : column)
+            {
+                if (value == 0)
+                {
+                    run++;
+                    continue;
+                }
+                PutVarint(out, run);
+                out.push_back(value);
+                run = 0;
+            }
+            if (run > 0)
+                PutVarint(out, run);
+        }
+
+        static bool GetZeroRunColumn(SReader& in, size_t count, std::vector<uint8_t>& outColumn)
+        {
+            outColumn.clear();
+            while (outColumn.size() < count && !in.failed)
+            {
+                uint32_t run = in.Varint();
+                if (run > count - outColumn.size())
+                    return false;
+                outColumn.insert(outColumn.end(), run, 0);
+                if (outColumn.size() < count)
+                    outColumn.push_back(in.Byte());
+            }
+            return !in.failed;
+        }
+        #pragma endregion
+
+    public:
+        class Writer
+        {
+        private:
+            FILE* _file = nullptr;
+            size_t _maxBlockFrames;
+            uint32_t _maxBlockSpan;
+            std::vector<SRecordedFrame> _pending;
+            std::vector<SBlockIndex> _blocks;
+            std::map<SStreamKey, SIdSummary> _summaries;
+            uint32_t _offset = 0;
+
+            bool WriteBytes(const std::vector<uint8_t>& bytes)
+            {
+                if (fwrite(bytes.data(), 1, bytes.size(), _file) != bytes.size())
+                    return false;
+                _offset += bytes.size();
+                return true;
+            }
+
+            bool FlushBlock()
+            {
+                if (_pending.empty())
+                    return true;
+
+                uint32_t startTime = UINT32_MAX, endTime = 0;
+                for (auto&& frame : _pending)
+                {
+                    startTime = std::min(startTime, frame.timestamp);
+                    endTime = std::max(endTime, frame.timestamp);
+                }
+
+                //Group the frames by stream, preserving the arrival order within each stream.
+                std::map<SStreamKey, std::vector<const SRecordedFrame*>> streams;
+                for (auto&& frame : _pending)
+                    streams[{ frame.bus, frame.message.id, frame.message.isExtended }].push_back(&frame);
+
+                std::map<SStreamKey, uint32_t> streamIndices;
+                std::vector<std::vector<uint8_t>> encodedStreams;
+                for (auto&& [key, frames] : streams)
+                {
+                    streamIndices[key] = (uint32_t)encodedStreams.size();
+                    std::vector<uint8_t> encoded;
+
+                    //Timestamp column.
+                    uint32_t previous = startTime;
+                    for (auto&& frame : frames)
+                    {
+                        PutVarint(encoded, ZigZag((int32_t)(frame->timestamp - previous)));
+                        previous = frame->timestamp;
+                    }
+
+                    //Length/flags column.
+                    for (size_t i = 0; i < frames.size();)
+                    {
+                        uint8_t flags = frames[i]->message.length | frames[i]->message.isExtended << 4 | frames[i]->message.isRemote << 5;
+                        size_t run = 1;
+                        while (i + run < frames.size()
+                            && (frames[i + run]->message.length | frames[i + run]->message.isExtended << 4 | frames[i + run]->message.isRemote << 5) == flags)
+                            run++;
+                        PutVarint(encoded, run);
+                        encoded.push_back(flags);
+                        i += run;
+                    }
+
+                    //Payload columns, only frames long enough to have the byte contribute to its column.
+                    for (size_t byteIndex = 0; byteIndex < 8; byteIndex++)
+                    {
+                        std::vector<uint8_t> column;
+                        uint8_t last = 0;
+                        for (auto&& frame : frames)
+                        {
+                            if (frame->message.length <= byteIndex)
+                                continue;
+                            column.push_back((uint8_t)(frame->message.data[byteIndex] - last));
+                            last = frame->message.data[byteIndex];
+                        }
+                        PutZeroRunColumn(encoded, column);
+                    }
+
+                    encodedStreams.push_back(std::move(encoded));
+
+                    //Update the file level summary.
+                    auto summary = _summaries.find(key);
+                    if (summary == _summaries.end())
+                        summary = _summaries.insert({ key, { key, 0, frames.front()->timestamp, frames.front()->timestamp, UINT32_MAX, 0 } }).first;
+                    for (auto&& frame : frames)
+                    {
+                        if (summary->second.count > 0 && frame->timestamp >= summary->second.lastSeen)
+                        {
+                            uint32_t interval = frame->timestamp - summary->second.lastSeen;
+                            summary->second.minInterval = std::min(summary->second.minInterval, interval);
+                            summary->second.maxInterval = std::max(summary->second.maxInterval, interval);
+                        }
+                        summary->second.lastSeen = std::max(summary->second.lastSeen, frame->timestamp);
+                        summary->second.count++;
+                    }
+                }
+
+                std::vector<uint8_t> orderColumn;
+                for (auto&& frame : _pending)
+                    PutVarint(orderColumn, streamIndices[{ frame.bus, frame.message.id, frame.message.isExtended }]);
+
+                //Block directory.
+                std::vector<uint8_t> block;
+                PutVarint(block, (uint32_t)streams.size());
+                size_t streamIndex = 0;
+                for (auto&& [key, frames] : streams)
+                {
+                    block.push_back(key.bus | key.isExtended << 1);
+                    PutVarint(block, key.id);
+                    PutVarint(block, (uint32_t)frames.size());
+                    PutVarint(block, (uint32_t)encodedStreams[streamIndex++].size());
+                }
+                PutVarint(block, (uint32_t)_pending.size());
+                PutVarint(block, (uint32_t)orderColumn.size());
+                block.insert(block.end(), orderColumn.begin(), orderColumn.end());
+                for (auto&& encoded : encodedStreams)
+                    block.insert(block.end(), encoded.begin(), encoded.end());
+
+                _blocks.push_back({ startTime, endTime, _offset, (uint32_t)block.size(), (uint32_t)_pending.size() });
+                _pending.clear();
+                return WriteBytes(block);
+            }
+
+        public:
+            Writer(size_t maxBlockFrames = 2048, uint32_t maxBlockSpan = 5000) : _maxBlockFrames(maxBlockFrames), _maxBlockSpan(maxBlockSpan) {}
+
+            ~Writer()
+            {
+                if (_file != nullptr)
+                    Close();
+            }
+
+            bool Open(const std::string& path)
+            {
+                _file = fopen(path.c_str(), "wb");
+                if (_file == nullptr)
+                    return false;
+
+                std::vector<uint8_t> header(FILE_MAGIC, FILE_MAGIC + 4);
+                header.push_back(VERSION);
+                header.insert(header.end(), 3, 0);
+                return WriteBytes(header);
+            }
+
+            bool Append(const SRecordedFrame& frame)
+            {
+                if (!_pending.empty()
+                    && (_pending.size() >= _maxBlockFrames || frame.timestamp - _pending.front().timestamp >= _maxBlockSpan)
+                    && !FlushBlock())
+                    return false;
+                _pending.push_back(frame);
+                return true;
+            }
+
+            bool Close()
+            {
+                bool ok = FlushBlock();
+
+                std::vector<uint8_t> index;
+                PutVarint(index, (uint32_t)_blocks.size());
+                for (auto&& block : _blocks)
+                {
+                    PutVarint(index, block.startTime);
+                    PutVarint(index, block.endTime - block.startTime);
+                    PutVarint(index, block.offset);
+                    PutVarint(index, block.size);
+                    PutVarint(index, block.frameCount);
+                }
+                PutVarint(index, (uint32_t)_summaries.size());
+                for (auto&& [key, summary] : _summaries)
+                {
+                    index.push_back(key.bus | key.isExtended << 1);
+                    PutVarint(index, key.id);
+                    PutVarint(index, summary.count);
+                    PutVarint(index, summary.firstSeen);
+                    PutVarint(index, summary.lastSeen - summary.firstSeen);
+                    PutVarint(index, summary.count > 1 ? summary.minInterval : 0);
+                    PutVarint(index, summary.maxInterval);
+                }
+
+                uint32_t indexOffset = _offset;
+                std::vector<uint8_t> trailer;
+                PutU32(trailer, indexOffset);
+                PutU32(trailer, (uint32_t)index.size());
+                trailer.insert(trailer.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+
+                ok = ok && WriteBytes(index) && WriteBytes(trailer);
+                ok = fclose(_file) == 0 && ok;
+                _file = nullptr;
+                return ok;
+            }
+        };
+
+        class Reader
+        {
+        private:
+            FILE* _file = nullptr;
+
+            bool ReadAt(uint32_t offset, size_t length, std::vector<uint8_t>& outBytes)
+            {
+                outBytes.resize(length);
+                return fseek(_file, offset, SEEK_SET) == 0 && fread(outBytes.data(), 1, length, _file) == length;
+            }
+
+            struct SStreamDirectory
+            {
+                SStreamKey key;
+                uint32_t count;
+                size_t offset;
+                size_t length;
+            };
+
+            static bool DecodeStream(SReader in, const SStreamDirectory& stream, uint32_t blockStart, std::vector<SRecordedFrame>& outFrames)
+            {
+                size_t first = outFrames.size();
+                outFrames.resize(first + stream.count);
+                SRecordedFrame* frames = outFrames.data() + first;
+
+                uint32_t timestamp = blockStart;
+                for (size_t i = 0; i < stream.count; i++)
+                {
+                    timestamp += UnZigZag(in.Varint());
+                    frames[i].timestamp = timestamp;
+                    frames[i].bus = stream.key.bus;
+                    frames[i].message.id = stream.key.id;
+                    memset(frames[i].message.data, 0, sizeof(frames[i].message.data));
+                }
+
+                for (size_t i = 0; i < stream.count && !in.failed;)
+                {
+                    uint32_t run = in.Varint();
+                    uint8_t flags = in.Byte();
+                    if (run == 0 || run > stream.count - i || (flags & 0x0F) > 8)
+                        return false;
+                    for (; run > 0; run--, i++)
+                    {
+                        frames[i].message.length = flags & 0x0F;
+                        frames[i].message.isExtended = flags & 0x10;
+                        frames[i].message.isRemote = flags & 0x20;
+                    }
+                }
+
+                std::vector<uint8_t> column;
+                for (size_t byteIndex = 0; byteIndex < 8; byteIndex++)
+                {
+                    size_t columnLength = 0;
+                    for (size_t i = 0; i < stream.count; i++)
+                        columnLength += frames[i].message.length > byteIndex;
+                    if (!GetZeroRunColumn(in, columnLength, column))
+                        return false;
+
+                    uint8_t last = 0;
+                    size_t columnIndex = 0;
+                    for (size_t i = 0; i < stream.count; i++)
+                    {
+                        if (frames[i].message.length <= byteIndex)
+                            continue;
+                        last += column[columnIndex++];
+                        frames[i].message.data[byteIndex] = last;
+                    }
+                }
+
+                return !in.failed;
+            }
+
+        public:
+            std::vector<SBlockIndex> Blocks;
+            std::vector<SIdSummary> Summaries;
+
+            ~Reader()
+            {
+                if (_file != nullptr)
+                    fclose(_file);
+            }
+
+            bool Open(const std::string& path)
+            {
+                _file = fopen(path.c_str(), "rb");
+                if (_file == nullptr)
+                    return false;
+
+                std::vector<uint8_t> bytes;
+                if (!ReadAt(0, HEADER_SIZE, bytes) || memcmp(bytes.data(), FILE_MAGIC, 4) != 0 || bytes[4] != VERSION)
+                    return false;
+
+                if (fseek(_file, 0, SEEK_END) != 0)
+                    return false;
+                long fileSize = ftell(_file);
+                if (fileSize < (long)(HEADER_SIZE + TRAILER_SIZE)
+                    || !ReadAt(fileSize - TRAILER_SIZE, TRAILER_SIZE, bytes)
+                    || memcmp(bytes.data() + 8, INDEX_MAGIC, 4) != 0)
+                    return false;
+
+                SReader trailer { bytes.data(), bytes.size() };
+                uint32_t indexOffset = trailer.U32();
+                uint32_t indexLength = trailer.U32();
+                if ((long)(indexOffset + indexLength + TRAILER_SIZE) > fileSize || !ReadAt(indexOffset, indexLength, bytes))
+                    return false;
+
+                SReader index { bytes.data(), bytes.size() };
+                Blocks.resize(index.Varint());
+                for (auto&& block : Blocks)
+                {
+                    block.startTime = index.Varint();
+                    block.endTime = block.startTime + index.Varint();
+                    block.offset = index.Varint();
+                    block.size = index.Varint();
+                    block.frameCount = index.Varint();
+                }
+                Summaries.resize(index.Varint());
+                for (auto&& summary : Summaries)
+                {
+                    uint8_t keyFlags = index.Byte();
+                    summary.key = { (uint8_t)(keyFlags & 1), index.Varint(), (keyFlags & 2) != 0 };
+                    summary.count = index.Varint();
+                    summary.firstSeen = index.Varint();
+                    summary.lastSeen = summary.firstSeen + index.Varint();
+                    summary.minInterval = index.Varint();
+                    summary.maxInterval = index.Varint();
+                }
+                return !index.failed;
+            }
+
+            /**
+             * Decodes the frames of a single block.
+             * If a filter is provided only the matching streams are decoded (the others are skipped using the block directory),
+             * otherwise all streams are decoded and returned in their original capture order.
+             */
+            bool ReadBlock(const SBlockIndex& block, std::vector<SRecordedFrame>& outFrames, const std::function<bool(const SStreamKey&)>& filter = nullptr)
+            {
+                std::vector<uint8_t> bytes;
+                if (!ReadAt(block.offset, block.size, bytes))
+                    return false;
+
+                SReader in { bytes.data(), bytes.size() };
+                std::vector<SStreamDirectory> streams(in.Varint());
+                size_t streamOffset = 0;
+                for (auto&& stream : streams)
+                {
+                    uint8_t keyFlags = in.Byte();
+                    stream.key = { (uint8_t)(keyFlags & 1), in.Varint(), (keyFlags & 2) != 0 };
+                    stream.count = in.Varint();
+                    stream.length = in.Varint();
+                    stream.offset = streamOffset;
+                    streamOffset += stream.length;
+                }
+                uint32_t frameCount = in.Varint();
+                SReader order = in.Sub(in.Varint());
+                SReader columns = in.Sub(streamOffset);
+                if (in.failed)
+                    return false;
+
+                std::vector<SRecordedFrame> decoded;
+                std::vector<size_t> firstFrame;
+                for (auto&& stream : streams)
+                {
+                    firstFrame.push_back(decoded.size());
+                    if (filter != nullptr && !filter(stream.key))
+                        continue;
+                    SReader streamReader { columns.data + stream.offset, stream.length };
+                    if (!DecodeStream(streamReader, stream, block.startTime, decoded))
+                        return false;
+                }
+
+                if (filter != nullptr)
+                {
+                    outFrames.insert(outFrames.end(), decoded.begin(), decoded.end());
+                    return true;
+                }
+
+                //Rebuild the original interleaving from the order column.
+                std::vector<size_t> cursors(firstFrame);
+                for (uint32_t i = 0; i < frameCount; i++)
+                {
+                    uint32_t streamIndex = order.Varint();
+                    if (order.failed || streamIndex >= streams.size() || cursors[streamIndex] >= firstFrame[streamIndex] + streams[streamIndex].count)
+                        return false;
+                    outFrames.push_back(decoded[cursors[streamIndex]++]);
+                }
+                return true;
+            }
+
+            //Visits the frames (in time order per stream) of the matching streams within [from, to], only the overlapping blocks are read.
+            bool Query(uint32_t from, uint32_t to, const std::function<bool(const SStreamKey&)>& filter, const std::function<void(const SRecordedFrame&)>& callback)
+            {
+                std::vector<SRecordedFrame> frames;
+                for (auto&& block : Blocks)
+                {
+                    if (block.endTime < from || block.startTime > to)
+                        continue;
+
+                    frames.clear();
+                    if (!ReadBlock(block, frames, filter))
+                        return false;
+                    std::stable_sort(frames.begin(), frames.end(), [](const SRecordedFrame& a, const SRecordedFrame& b) { return a.timestamp < b.timestamp; });
+                    for (auto&& frame : frames)
+                        if (frame.timestamp >= from && frame.timestamp <= to)
+                            callback(frame);
+                }
+                return true;
+            }
+        };
+    };
+};
@@ -0,0 +1,401 @@
+//Converts CAN::Logger captures into the columnar .otcr format and answers queries against it.
+//Build: g++ -std=c++17 -O2 -o canstore main.cpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "CanStore.hpp"
+#include "../../Software/src/CAN/Signals.h"
+
+using namespace ReadieFur::OpenTCU::Tools;
+
+struct SQueryOptions
+{
+    int bus = -1;
+    int64_t id = -1;
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+    int byteOffset = -1;
+    int byteLength = 0;
+    const ReadieFur::OpenTCU::CAN::SSignal* signal = nullptr;
+};
+
+int PrintUsage()
+{
+    std::cerr
+        << "Usage:" << std::endl
+        << "  canstore convert <capture.txt> <out.otcr> [--block-frames N] [--block-ms N]" << std::endl
+        << "  canstore delta <capture.txt>" << std::endl
+        << "      Writes the capture as the logger would in delta capture mode and reports the size reduction." << std::endl
+        << "  canstore compress <capture.txt>..." << std::endl
+        << "      Writes the capture as the logger would in compressed capture mode, checks that it decodes back to the same frames and reports the ratio and encoding time." << std::endl
+        << "      Writes the capture as the logger would in delta capture mode and reports the size reduction." << std::endl
+        << "  canstore info <file.otcr>" << std::endl
+        << "  canstore rates <file.otcr>" << std::endl
+        << "  canstore query <file.otcr> [--id 0x201] [--bus 0|1] [--from ms] [--to ms] [--bytes offset:length | --signal Name]" << std::endl
+        << "  canstore dump <file.otcr>" << std::endl
+        << "  canstore canlog <file.otcr> [interface0 interface1]" << std::endl
+        << "Signals:";
+    for (auto&& signal : ReadieFur::OpenTCU::CAN::Signals::ALL)
+        std::cerr << " " << signal->name;
+    std::cerr << std::endl;
+    return 1;
+}
+
+int Convert(int argc, char** argv)
+{
+    if (argc < 4)
+        return PrintUsage();
+
+    size_t blockFrames = 2048;
+    uint32_t blockSpan = 5000;
+    for (int i = 4; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--block-frames") == 0)
+            blockFrames = strtoul(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--block-ms") == 0)
+            blockSpan = strtoul(argv[i + 1], nullptr, 0);
+        else
+            return PrintUsage();
+    }
+
+    std::vector<SRecordedFrame> frames;
+    if (!Recording::Load(argv[2], frames))
+    {
+        std::cerr << "Failed to open " << argv[2] << std::endl;
+        return 2;
+    }
+
+    CanStore::Writer writer(blockFrames, blockSpan);
+    if (!writer.Open(argv[3]))
+    {
+        std::cerr << "Failed to create " << argv[3] << std::endl;
+        return 2;
+    }
+    for (auto&& frame : frames)
+        if (!writer.Append(frame))
+            return 3;
+    if (!writer.Close())
+    {
+        std::cerr << "Failed to write " << argv[3] << std::endl;
+        return 3;
+    }
+
+    std::cout << "Converted " << frames.size() << " frames into " << argv[3] << std::endl;
+    return 0;
+}
+
+//Runs the capture through the firmware's delta filter, the output expands back into the same frames with Recording::Load.
+int Delta(const char* path)
+{
+    std::vector<SRecordedFrame> frames;
+    if (!Recording::Load(path, frames))
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 2;
+    }
+
+    ReadieFur::OpenTCU::CAN::DeltaFilter filter;
+    ReadieFur::OpenTCU::CAN::DeltaFilter::SRepeat repeats[16];
+    size_t fullBytes = 0, deltaBytes = 0, lines = 0;
+    auto write = [&](const std::string& line)
+    {
+        std::cout << line << std::endl;
+        deltaBytes += line.size() + 1;
+        lines++;
+    };
+    auto flush = [&](uint32_t now, bool all)
+    {
+        size_t count;
+        do
+        {
+            count = filter.Flush(now, repeats, 16, all);
+            for (size_t i = 0; i < count; i++)
+                write(Recording::FormatRepeatLine(repeats[i]));
+        }
+        while (count == 16);
+    };
+
+    //The logger flushes quiet IDs every LOG_INTERVAL.
+    static const uint32_t FLUSH_INTERVAL = 500;
+    uint32_t lastFlush = frames.empty() ? 0 : frames.front().timestamp;
+    for (auto&& frame : frames)
+    {
+        if (frame.timestamp - lastFlush >= FLUSH_INTERVAL)
+        {
+            flush(frame.timestamp, false);
+            lastFlush = frame.timestamp;
+        }
+
+        std::string line = Recording::FormatLine(frame);
+        fullBytes += line.size() + 1;
+        ReadieFur::OpenTCU::CAN::DeltaFilter::SRepeat repeat;
+        bool hasRepeat;
+        if (!filter.Filter(frame.bus, frame.message, frame.timestamp, &repeat, &hasRepeat))
+            continue;
+        if (hasRepeat)
+            write(Recording::FormatRepeatLine(repeat));
+        write(line);
+    }
+    flush(0, true);
+
+    fprintf(stderr, "%zu frames, %zu bytes -> %zu lines, %zu bytes (%.1fx smaller)\n",
+        frames.size(), fullBytes, lines, deltaBytes, deltaBytes > 0 ? (double)fullBytes / deltaBytes : 0);
+    return 0;
+}
+
+//Runs the captures through the firmware's capture encoder, blocks are sealed every LOG_INTERVAL of capture time like the logger does.
+//The compressed capture of the last file is written to stdout, the summary of each file to stderr.
+int Compress(int argc, char** argv)
+{
+    static const uint32_t FLUSH_INTERVAL = 500;
+    static const size_t ITERATIONS = 20;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+
+        size_t textBytes = 0, blockBytes = 0, lineBytes = 0;
+        std::vector<std::string> lines;
+        auto seal = [&](ReadieFur::OpenTCU::CAN::CaptureEncoder& encoder)
+        {
+            size_t length = encoder.Seal();
+            if (length == 0)
+                return;
+            blockBytes += length;
+            lines.push_back(Recording::FormatBlockLine(encoder.GetBlock(), length));
+            lineBytes += lines.back().size() + 1;
+        };
+
+        //Time the encoder on its own, then encode again to collect the output.
+        auto start = std::chrono::steady_clock::now();
+        for (size_t iteration = 0; iteration < ITERATIONS; iteration++)
+        {
+            ReadieFur::OpenTCU::CAN::CaptureEncoder encoder;
+            for (auto&& frame : frames)
+                if (!encoder.Append(frame.bus, frame.message, frame.timestamp))
+                {
+                    encoder.Seal();
+                    encoder.Append(frame.bus, frame.message, frame.timestamp);
+                }
+        }
+        double nsPerFrame = frames.empty() ? 0 : std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS / frames.size();
+
+        ReadieFur::OpenTCU::CAN::CaptureEncoder encoder;
+        uint32_t lastFlush = frames.empty() ? 0 : frames.front().timestamp;
+        for (auto&& frame : frames)
+        {
+            textBytes += Recording::FormatLine(frame).size() + 1;
+            if (frame.timestamp - lastFlush >= FLUSH_INTERVAL)
+            {
+                seal(encoder);
+                lastFlush = frame.timestamp;
+            }
+            if (!encoder.Append(frame.bus, frame.message, frame.timestamp))
+            {
+                seal(encoder);
+                encoder.Append(frame.bus, frame.message, frame.timestamp);
+            }
+        }
+        seal(encoder);
+
+        //Decode what was written and compare it with the original.
+        ReadieFur::OpenTCU::CAN::CaptureDecoder decoder;
+        std::vector<SRecordedFrame> decoded;
+        uint8_t block[ReadieFur::OpenTCU::CAN::CaptureCodec::BLOCK_SIZE];
+        for (auto&& line : lines)
+            decoder.Decode(block, Recording::ParseBlockLine(line, block), [&decoded](uint8_t bus, const ReadieFur::OpenTCU::CAN::SCanMessage& message, uint32_t timestamp)
+            {
+                decoded.push_back({ timestamp, bus, message });
+            });
+        bool matches = decoded.size() == frames.size();
+        for (size_t j = 0; matches && j < frames.size(); j++)
+            matches = Recording::FormatLine(decoded[j]) == Recording::FormatLine(frames[j]);
+
+        fprintf(stderr, "%s: %zu frames, %zu text bytes -> %zu block bytes (%.2f bytes/frame, %.1fx), %zu base64 line bytes (%.1fx), %.0f ns/frame, %s\n",
+            argv[i], frames.size(), textBytes, blockBytes, frames.empty() ? 0 : (double)blockBytes / frames.size(),
+            blockBytes > 0 ? (double)textBytes / blockBytes : 0, lineBytes, lineBytes > 0 ? (double)textBytes / lineBytes : 0,
+            nsPerFrame, matches ? "round trip OK" : "ROUND TRIP MISMATCH");
+        if (!matches)
+            return 3;
+
+        if (i == argc - 1)
+            for (auto&& line : lines)
+                std::cout << line << std::endl;
+    }
+    return 0;
+}
+
+int Info(CanStore::Reader& reader)
+{
+    printf("Blocks: %zu\n", reader.Blocks.size());
+    for (auto&& block : reader.Blocks)
+        printf("  %10u - %10u ms  %5u frames  %6u bytes @ %u\n", block.startTime, block.endTime, block.frameCount, block.size, block.offset);
+    printf("Streams: %zu\n", reader.Summaries.size());
+    return 0;
+}
+
+int Rates(CanStore::Reader& reader)
+{
+    //Answered entirely from the index, no blocks are read.
+    printf("bus  id   count   first(ms)   last(ms)  rate(Hz)  period(ms)  min(ms)  max(ms)\n");
+    for (auto&& summary : reader.Summaries)
+    {
+        uint32_t span = summary.lastSeen - summary.firstSeen;
+        double rate = span > 0 ? (summary.count - 1) * 1000.0 / span : 0;
+        double period = summary.count > 1 ? (double)span / (summary.count - 1) : 0;
+        printf("%3u  %03x %6u  %10u %10u  %8.2f  %10.2f  %7u  %7u\n",
+            summary.key.bus, summary.key.id, summary.count, summary.firstSeen, summary.lastSeen, rate, period, summary.minInterval, summary.maxInterval);
+    }
+    return 0;
+}
+
+int Query(CanStore::Reader& reader, int argc, char** argv)
+{
+    SQueryOptions options;
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--id") == 0)
+            options.id = strtol(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--bus") == 0)
+            options.bus = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--from") == 0)
+            options.from = strtoul(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--to") == 0)
+            options.to = strtoul(argv[i + 1], nullptr, 0);
+        else if (strcmp(argv[i], "--bytes") == 0)
+        {
+            if (sscanf(argv[i + 1], "%d:%d", &options.byteOffset, &options.byteLength) != 2
+                || options.byteOffset < 0 || options.byteLength < 1 || options.byteOffset + options.byteLength > 8)
+                return PrintUsage();
+        }
+        else if (strcmp(argv[i], "--signal") == 0)
+        {
+            if ((options.signal = ReadieFur::OpenTCU::CAN::SignalDecoder::Find(argv[i + 1])) == nullptr)
+                return PrintUsage();
+            if (options.id < 0)
+                options.id = options.signal->id;
+        }
+        else
+            return PrintUsage();
+    }
+
+    bool ok = reader.Query(options.from, options.to,
+        [&options](const CanStore::SStreamKey& key)
+        {
+            return (options.id < 0 || key.id == options.id) && (options.bus < 0 || key.bus == options.bus);
+        },
+        [&options](const SRecordedFrame& frame)
+        {
+            if (options.signal != nullptr)
+            {
+                //Physical value from the signal table, e.g. --signal Speed gives km/h.
+                int64_t raw = ReadieFur::OpenTCU::CAN::SignalDecoder::Extract(*options.signal, frame.message.data);
+                printf("%u,%u,%x,%s,%lld,%.3f%s\n", frame.timestamp, frame.bus, frame.message.id, options.signal->name, (long long)raw,
+                    (double)raw * options.signal->scaleNumerator / options.signal->scaleDenominator, options.signal->unit);
+                return;
+            }
+
+            if (options.byteOffset < 0)
+            {
+                std::cout << Recording::FormatLine(frame) << std::endl;
+                return;
+            }
+
+            //Little-endian unsigned field, e.g. --bytes 0:2 on 0x201 gives the speed in km/h * 100.
+            uint32_t value = 0;
+            for (int i = options.byteLength - 1; i >= 0; i--)
+                value = value << 8 | frame.message.data[options.byteOffset + i];
+            printf("%u,%u,%x,%u\n", frame.timestamp, frame.bus, frame.message.id, value);
+        });
+
+    if (!ok)
+    {
+        std::cerr << "File is corrupt." << std::endl;
+        return 3;
+    }
+    return 0;
+}
+
+//Writes the capture as a candump log so that it can be replayed onto real or virtual buses with canplayer.
+int CanLog(CanStore::Reader& reader, int argc, char** argv)
+{
+    const char* interfaces[2] = { "vcan0", "vcan1" };
+    if (argc >= 5)
+    {
+        interfaces[0] = argv[3];
+        interfaces[1] = argv[4];
+    }
+
+    std::vector<SRecordedFrame> frames;
+    for (auto&& block : reader.Blocks)
+    {
+        frames.clear();
+        if (!reader.ReadBlock(block, frames))
+        {
+            std::cerr << "File is corrupt." << std::endl;
+            return 3;
+        }
+        for (auto&& frame : frames)
+            std::cout << Recording::FormatCanLogLine(frame, interfaces, (uint64_t)frame.timestamp * 1000) << std::endl;
+    }
+    return 0;
+}
+
+int Dump(CanStore::Reader& reader)
+{
+    std::vector<SRecordedFrame> frames;
+    for (auto&& block : reader.Blocks)
+    {
+        frames.clear();
+        if (!reader.ReadBlock(block, frames))
+        {
+            std::cerr << "File is corrupt." << std::endl;
+            return 3;
+        }
+        for (auto&& frame : frames)
+            std::cout << Recording::FormatLine(frame) << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return PrintUsage();
+
+    std::string command = argv[1];
+    if (command == "convert")
+        return Convert(argc, argv);
+    else if (command == "delta")
+        return Delta(argv[2]);
+    else if (command == "compress")
+        return Compress(argc, argv);
+
+    CanStore::Reader reader;
+    if (!reader.Open(argv[2]))
+    {
+        std::cerr << "Failed to open " << argv[2] << " (missing or not an .otcr file)." << std::endl;
+        return 2;
+    }
+
+    if (command == "info")
+        return Info(reader);
+    else if (command == "rates")
+        return Rates(reader);
+    else if (command == "query")
+        return Query(reader, argc, argv);
+    else if (command == "dump")
+        return Dump(reader);
+    else if (command == "canlog")
+        return CanLog(reader, argc, argv);
+    return PrintUsage();
+}
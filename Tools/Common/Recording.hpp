@@ -0,0 +1,258 @@
+#pragma once
+
+//Shared parsing of the serial captures produced by CAN::Logger (see the .txt files in /Recordings).
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include "../../Software/src/CAN/SCanMessage.h"
+#include "../../Software/src/CAN/DeltaFilter.h"
+#include "../../Software/src/CAN/CaptureCodec.h"
+
+namespace ReadieFur::OpenTCU::Tools
+{
+    //Mirrors BusMaster::SCanDump, the bus is normalised to 0 (CAN1) or 1 (CAN2).
+    struct SRecordedFrame
+    {
+        uint32_t timestamp;
+        uint8_t bus;
+        CAN::SCanMessage message;
+    };
+
+    class Recording
+    {
+    private:
+        static std::vector<std::string> Split(const std::string& line, size_t start)
+        {
+            std::vector<std::string> tokens;
+            size_t pos;
+            while ((pos = line.find(',', start)) != std::string::npos)
+            {
+                tokens.push_back(line.substr(start, pos - start));
+                start = pos + 1;
+            }
+            tokens.push_back(line.substr(start));
+            return tokens;
+        }
+
+        static bool ParseUnsigned(const std::string& token, int base, uint32_t* outValue)
+        {
+            if (token.empty())
+                return false;
+            char* end = nullptr;
+            unsigned long value = strtoul(token.c_str(), &end, base);
+            if (end == token.c_str())
+                return false;
+            *outValue = (uint32_t)value;
+            return true;
+        }
+
+    public:
+        /**
+         * Parses a single capture line, returns false if the line is not a CAN::Logger frame.
+         * Two formats exist in the recordings:
+         * - Legacy: "93565,49,768,0,0,8,3,90,..." where the bus is the ASCII character ('1'/'2') and the ID and data are decimal.
+         * - Current: "10598,0,301,0,0,3,B5,0C,00" where the bus is 0/1 and the ID and data are hexadecimal.
+         */
+        static bool ParseLine(const std::string& line, SRecordedFrame* outFrame)
+        {
+            static const char* MARKER = "CAN::Logger:";
+            size_t start = line.find(MARKER);
+            if (start == std::string::npos)
+                return false;
+            start += strlen(MARKER);
+
+            std::vector<std::string> tokens = Split(line, start);
+
+            //Timestamp, bus, id, extended, remote and length are always present.
+            if (tokens.size() < 6)
+                return false;
+
+            uint32_t timestamp, bus, id, isExtended, isRemote, length;
+            if (!ParseUnsigned(tokens[0], 10, &timestamp)
+                || !ParseUnsigned(tokens[1], 10, &bus))
+                return false;
+
+            bool legacy = bus == '1' || bus == '2';
+            int base = legacy ? 10 : 16;
+            if (!ParseUnsigned(tokens[2], base, &id)
+                || !ParseUnsigned(tokens[3], 10, &isExtended)
+                || !ParseUnsigned(tokens[4], 10, &isRemote)
+                || !ParseUnsigned(tokens[5], 10, &length)
+                || length > 8
+                || tokens.size() < 6 + length)
+                return false;
+
+            outFrame->timestamp = timestamp;
+            outFrame->bus = legacy ? (uint8_t)(bus - '1') : (uint8_t)(bus != 0);
+            outFrame->message.id = id;
+            outFrame->message.isExtended = isExtended != 0;
+            outFrame->message.isRemote = isRemote != 0;
+            outFrame->message.length = (uint8_t)length;
+            for (size_t i = 0; i < 8; i++)
+            {
+                uint32_t value = 0;
+                if (i < length && !ParseUnsigned(tokens[6 + i], base, &value))
+                    return false;
+                outFrame->message.data[i] = (uint8_t)value;
+            }
+            return true;
+        }
+
+        //Parses a "CAN::Repeat:bus,id,count,first,last" line written by the logger in delta capture mode (see CAN/DeltaFilter.h).
+        static bool ParseRepeatLine(const std::string& line, CAN::DeltaFilter::SRepeat* outRepeat)
+        {
+            static const char* MARKER = "CAN::Repeat:";
+            size_t start = line.find(MARKER);
+            if (start == std::string::npos)
+                return false;
+
+            std::vector<std::string> tokens = Split(line, start + strlen(MARKER));
+            uint32_t bus;
+            if (tokens.size() != 5
+                || !ParseUnsigned(tokens[0], 10, &bus)
+                || !ParseUnsigned(tokens[1], 16, &outRepeat->id)
+                || !ParseUnsigned(tokens[2], 10, &outRepeat->count)
+                || !ParseUnsigned(tokens[3], 10, &outRepeat->firstTimestamp)
+                || !ParseUnsigned(tokens[4], 10, &outRepeat->lastTimestamp)
+                || outRepeat->id >= CAN::DeltaFilter::ID_COUNT)
+                return false;
+            outRepeat->bus = (uint8_t)(bus != 0);
+            return true;
+        }
+
+        //Returns the block of a "CAN::Block:<base64>" line written by the logger in compressed capture mode (see CAN/CaptureCodec.h), or 0 if the line isn't one.
+        static size_t ParseBlockLine(const std::string& line, uint8_t* outBlock)
+        {
+            static const char* MARKER = "CAN::Block:";
+            size_t start = line.find(MARKER);
+            if (start == std::string::npos)
+                return 0;
+            start += strlen(MARKER);
+
+            size_t end = line.find_last_not_of("\r\n ");
+            if (end == std::string::npos || end < start)
+                return 0;
+            return CAN::CaptureCodec::Base64Decode(line.c_str() + start, end + 1 - start, outBlock, CAN::CaptureCodec::BLOCK_SIZE);
+        }
+
+        /**
+         * Loads every frame in a capture, delta captures are expanded back into the full stream and compressed blocks are decoded.
+         * A repeat stands for copies of the last frame logged with its ID, their timestamps are spread evenly over the span of the repeat.
+         * Repeats are written when they end so the expanded frames are sorted back into time order.
+         */
+        static bool Load(const std::string& path, std::vector<SRecordedFrame>& outFrames)
+        {
+            std::ifstream file(path);
+            if (!file.is_open())
+                return false;
+
+            std::string line;
+            SRecordedFrame frame;
+            CAN::DeltaFilter::SRepeat repeat;
+            std::vector<SRecordedFrame> lastLogged(CAN::DeltaFilter::ID_COUNT);
+            std::vector<bool> logged(CAN::DeltaFilter::ID_COUNT, false);
+            bool expanded = false;
+            size_t first = outFrames.size();
+            CAN::CaptureDecoder decoder;
+            uint8_t block[CAN::CaptureCodec::BLOCK_SIZE];
+            size_t blockLength;
+            while (std::getline(file, line))
+            {
+                if ((blockLength = ParseBlockLine(line, block)) > 0)
+                {
+                    //Lost or corrupt blocks drop the frames up to the next dictionary reset.
+                    decoder.Decode(block, blockLength, [&outFrames](uint8_t bus, const CAN::SCanMessage& message, uint32_t timestamp)
+                    {
+                        outFrames.push_back({ timestamp, bus, message });
+                    });
+                }
+                else if (ParseLine(line, &frame))
+                {
+                    outFrames.push_back(frame);
+                    if (!frame.message.isExtended && frame.message.id < CAN::DeltaFilter::ID_COUNT)
+                    {
+                        lastLogged[frame.message.id] = frame;
+                        logged[frame.message.id] = true;
+                    }
+                }
+                //Skipped if the capture started after the frame it repeats was logged.
+                else if (ParseRepeatLine(line, &repeat) && logged[repeat.id])
+                {
+                    frame = lastLogged[repeat.id];
+                    frame.bus = repeat.bus;
+                    uint32_t span = repeat.lastTimestamp - repeat.firstTimestamp;
+                    for (uint32_t i = 0; i < repeat.count; i++)
+                    {
+                        frame.timestamp = repeat.firstTimestamp + (repeat.count > 1 ? (uint32_t)((uint64_t)span * i / (repeat.count - 1)) : 0);
+                        outFrames.push_back(frame);
+                    }
+                    expanded = true;
+                }
+            }
+
+            if (expanded)
+                std::stable_sort(outFrames.begin() + first, outFrames.end(), [](const SRecordedFrame& a, const SRecordedFrame& b) { return a.timestamp < b.timestamp; });
+            return true;
+        }
+
+        //Formats a block in the CAN::Logger compressed capture format.
+        static std::string FormatBlockLine(const uint8_t* block, size_t length)
+        {
+            char text[CAN::CaptureCodec::BASE64_BLOCK_SIZE];
+            return "CAN::Block:" + std::string(text, CAN::CaptureCodec::Base64Encode(block, length, text));
+        }
+
+        //Formats a repeat in the CAN::Logger delta capture format.
+        static std::string FormatRepeatLine(const CAN::DeltaFilter::SRepeat& repeat)
+        {
+            char buffer[96];
+            int length = snprintf(buffer, sizeof(buffer), "CAN::Repeat:%u,%x,%u,%u,%u",
+                repeat.bus,
+                repeat.id,
+                repeat.count,
+                repeat.firstTimestamp,
+                repeat.lastTimestamp);
+            return std::string(buffer, length);
+        }
+
+        //Formats a frame in the current CAN::Logger output format.
+        static std::string FormatLine(const SRecordedFrame& frame)
+        {
+            char buffer[96];
+            int length = snprintf(buffer, sizeof(buffer), "CAN::Logger:%u,%u,%x,%u,%u,%u",
+                frame.timestamp,
+                frame.bus,
+                frame.message.id,
+                frame.message.isExtended,
+                frame.message.isRemote,
+                frame.message.length);
+            for (size_t i = 0; i < frame.message.length && i < 8; i++)
+                length += snprintf(buffer + length, sizeof(buffer) - length, ",%02X", frame.message.data[i]);
+            return std::string(buffer, length);
+        }
+
+        //Formats a frame as a candump log line (as read by canplayer), e.g. "(0.100000) vcan0 201#E803000000".
+        //Bus 0 is written to interfaces[0] and bus 1 to interfaces[1].
+        static std::string FormatCanLogLine(const SRecordedFrame& frame, const char* const interfaces[2], uint64_t timeUs)
+        {
+            char buffer[96];
+            int length = snprintf(buffer, sizeof(buffer), frame.message.isExtended ? "(%llu.%06llu) %s %08X#" : "(%llu.%06llu) %s %03X#",
+                (unsigned long long)(timeUs / 1000000),
+                (unsigned long long)(timeUs % 1000000),
+                interfaces[frame.bus & 1],
+                frame.message.id);
+            if (frame.message.isRemote)
+                length += snprintf(buffer + length, sizeof(buffer) - length, "R");
+            else
+                for (size_t i = 0; i < frame.message.length && i < 8; i++)
+                    length += snprintf(buffer + length, sizeof(buffer) - length, "%02X", frame.message.data[i]);
+            return std::string(buffer, length);
+        }
+    };
+};
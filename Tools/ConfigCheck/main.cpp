@@ -0,0 +1,443 @@
+//Replays the configuration requests and responses on 0x100/0x101 from captures through the transaction engine and the round trip tracker, and drives them through retries, timeouts, the cache lifetime and expiry.
+//Build: g++ -std=c++17 -O2 -o configcheck main.cpp
+//Usage: ./configcheck <capture.txt>...
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdio>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/ConfigTransactions.h"
+#include "../../Software/src/CAN/RoundTripTracker.h"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::CAN;
+using namespace ReadieFur::OpenTCU::Tools;
+
+static size_t _failures = 0;
+
+static void Check(bool condition, const char* section, const char* what)
+{
+    if (condition)
+        return;
+    _failures++;
+    printf("  FAILED %s: %s\n", section, what);
+}
+
+static SCanMessage Frame(uint32_t id, std::initializer_list<uint8_t> data)
+{
+    SCanMessage message = { id, {}, (uint8_t)data.size(), false, false };
+    std::copy(data.begin(), data.end(), message.data);
+    return message;
+}
+
+static bool SameFrame(const SCanMessage& a, const SCanMessage& b)
+{
+    return a.id == b.id && a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+}
+
+//A recorded exchange: the display's request and the motor's response frames, flow control included.
+struct SExchange
+{
+    uint32_t timestamp;
+    SCanMessage request;
+    std::vector<SCanMessage> response;
+};
+
+//Groups the 0x100/0x101 frames of a capture by the single frame request that started them.
+static std::vector<SExchange> FindExchanges(const std::vector<SRecordedFrame>& frames)
+{
+    std::vector<SExchange> exchanges;
+    for (auto&& frame : frames)
+    {
+        const SCanMessage& message = frame.message;
+        if (message.id == ConfigTransactions::REQUEST_ID && (message.data[0] >> 4) == 0x0)
+            exchanges.push_back({ frame.timestamp, message, {} });
+        else if ((message.id == ConfigTransactions::REQUEST_ID || message.id == ConfigTransactions::RESPONSE_ID) && !exchanges.empty())
+            exchanges.back().response.push_back(message);
+    }
+    return exchanges;
+}
+
+//The value a positive response carries, reassembled independently of the engine. Returns false for a negative or incomplete response.
+static bool ExpectedValue(const SExchange& exchange, uint16_t* outDid, std::vector<uint8_t>* outData)
+{
+    std::vector<uint8_t> payload;
+    size_t expected = 0;
+    for (auto&& message : exchange.response)
+    {
+        if (message.id != ConfigTransactions::RESPONSE_ID)
+            continue;
+        switch (message.data[0] >> 4)
+        {
+        case 0x0:
+            expected = message.data[0] & 0x0F;
+            payload.assign(message.data + 1, message.data + 1 + expected);
+            break;
+        case 0x1:
+            expected = (message.data[0] & 0x0F) << 8 | message.data[1];
+            payload.assign(message.data + 2, message.data + 8);
+            break;
+        case 0x2:
+            payload.insert(payload.end(), message.data + 1, message.data + message.length);
+            break;
+        }
+    }
+    if (expected < 3 || payload.size() < expected || payload[0] < 0x40 || payload[0] == 0x7F)
+        return false;
+    *outDid = payload[1] << 8 | payload[2];
+    outData->assign(payload.begin() + 3, payload.begin() + expected);
+    return true;
+}
+
+//Feeds the capture to the engine as the relay does, every response belongs to the display so it should be observed and cached.
+static void CheckObserved(const std::vector<SRecordedFrame>& frames, const std::vector<SExchange>& exchanges)
+{
+    const char* section = "observed";
+    ConfigTransactions transactions;
+    size_t responses = 0;
+    for (auto&& exchange : exchanges)
+    {
+        uint16_t did;
+        std::vector<uint8_t> data;
+        if (ExpectedValue(exchange, &did, &data))
+            responses++;
+    }
+
+    std::map<uint16_t, std::vector<uint8_t>> lastRead;
+    uint32_t last = 0;
+    for (auto&& exchange : exchanges)
+    {
+        transactions.Receive(exchange.request, exchange.timestamp);
+        uint8_t cached[ConfigTransactions::MAX_DATA];
+        uint8_t length;
+        uint16_t did = exchange.request.data[2] << 8 | exchange.request.data[3];
+        if (exchange.request.data[1] == ConfigTransactions::SERVICE_WRITE)
+            Check(transactions.GetCached(did, exchange.timestamp, cached, &length) == ConfigTransactions::CacheMissing, section, "a write from the display invalidates the cached value");
+
+        for (auto&& message : exchange.response)
+            transactions.Receive(message, exchange.timestamp);
+        last = exchange.timestamp;
+
+        SCanMessage frame;
+        Check(!transactions.Poll(exchange.timestamp, &frame), section, "nothing is sent for the display's requests, not even flow control");
+
+        std::vector<uint8_t> data;
+        if (!ExpectedValue(exchange, &did, &data))
+            continue;
+
+        ConfigTransactions::SResult result;
+        Check(transactions.TakeCompleted(&result), section, "every response gives a result");
+        Check(result.handle == 0 && result.result == ConfigTransactions::Observed, section, "the result is observed, not ours");
+        Check(result.did == did && result.length == data.size() && memcmp(result.data, data.data(), data.size()) == 0, section, "the result carries the response's DID and value");
+
+        if (exchange.request.data[1] == ConfigTransactions::SERVICE_READ)
+        {
+            lastRead[did] = data;
+            ConfigTransactions::ECacheState state = transactions.GetCached(did, exchange.timestamp, cached, &length);
+            Check(state == ConfigTransactions::CacheFresh && length == data.size() && memcmp(cached, data.data(), data.size()) == 0, section, "a read is cached");
+        }
+    }
+
+    //Everything that was read stays readable, stale once the TTL has passed.
+    for (auto&& entry : lastRead)
+    {
+        uint8_t cached[ConfigTransactions::MAX_DATA];
+        uint8_t length;
+        ConfigTransactions::ECacheState state = transactions.GetCached(entry.first, last + ConfigTransactions::CACHE_TTL_MS, cached, &length);
+        Check(state == ConfigTransactions::CacheStale && length == entry.second.size() && memcmp(cached, entry.second.data(), length) == 0, section, "a value past its TTL is stale but still copied");
+    }
+
+    const ConfigTransactions::SStats& stats = transactions.GetStats();
+    Check(stats.observed == responses && stats.requests == 0 && stats.rejected == 0, section, "observed count matches the responses");
+    printf("Observed:       %zu exchanges, %u responses, %zu values cached (%zu frames)\n", exchanges.size(), stats.observed, lastRead.size(), frames.size());
+}
+
+//Makes the display's reads ourselves, answered with the motor's recorded frames. The requests and flow control have to match the display's byte for byte.
+static void CheckOwnReads(const std::vector<SExchange>& exchanges)
+{
+    const char* section = "own reads";
+    ConfigTransactions transactions;
+    size_t completed = 0;
+    uint32_t now = 1000;
+    for (auto&& exchange : exchanges)
+    {
+        uint16_t did;
+        std::vector<uint8_t> data;
+        if (exchange.request.data[1] != ConfigTransactions::SERVICE_READ || !ExpectedValue(exchange, &did, &data))
+            continue;
+
+        uint32_t handle = transactions.Queue(ConfigTransactions::SERVICE_READ, did, nullptr, 0);
+        Check(handle != 0 && transactions.IsQueued(ConfigTransactions::SERVICE_READ, did), section, "the read is queued");
+
+        SCanMessage frame;
+        Check(transactions.Poll(now, &frame) && SameFrame(frame, exchange.request), section, "the request matches the display's");
+        for (auto&& message : exchange.response)
+        {
+            if (message.id == ConfigTransactions::REQUEST_ID)
+                Check(transactions.Poll(now, &frame) && SameFrame(frame, message), section, "flow control matches the display's");
+            else
+                transactions.Receive(message, now);
+        }
+        Check(!transactions.Poll(now, &frame), section, "nothing else is sent");
+
+        ConfigTransactions::SResult result;
+        Check(transactions.TakeCompleted(&result), section, "the read completes");
+        Check(result.handle == handle && result.result == ConfigTransactions::Completed, section, "the result is ours");
+        Check(result.did == did && result.length == data.size() && memcmp(result.data, data.data(), data.size()) == 0, section, "the result carries the recorded value");
+        Check(!transactions.IsQueued(ConfigTransactions::SERVICE_READ, did), section, "the read is no longer queued");
+        completed++;
+        now += 10;
+    }
+    printf("Own reads:      %zu completed\n", completed);
+}
+
+//A request that is never answered is sent MAX_ATTEMPTS times RESPONSE_TIMEOUT_MS apart and then fails, the next one goes straight out.
+static void CheckRetries()
+{
+    const char* section = "retries";
+    ConfigTransactions transactions;
+    SCanMessage frame;
+    SCanMessage request = Frame(ConfigTransactions::REQUEST_ID, { 0x03, 0x22, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00 });
+    uint32_t first = transactions.Queue(ConfigTransactions::SERVICE_READ, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, nullptr, 0);
+    uint8_t payload[2] = { 0x60, 0x09 };
+    uint32_t second = transactions.Queue(ConfigTransactions::SERVICE_WRITE, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, payload, sizeof(payload));
+
+    uint32_t now = 5000;
+    Check(transactions.Poll(now, &frame) && SameFrame(frame, request), section, "the first attempt is sent");
+    Check(!transactions.Poll(now + ConfigTransactions::RESPONSE_TIMEOUT_MS - 1, &frame), section, "nothing is sent before the timeout");
+    for (uint32_t attempt = 1; attempt < ConfigTransactions::MAX_ATTEMPTS; attempt++)
+    {
+        now += ConfigTransactions::RESPONSE_TIMEOUT_MS;
+        Check(transactions.Poll(now, &frame) && SameFrame(frame, request), section, "the request is sent again after the timeout");
+        Check(!transactions.Poll(now, &frame), section, "only once per timeout");
+    }
+
+    now += ConfigTransactions::RESPONSE_TIMEOUT_MS;
+    Check(transactions.Poll(now, &frame) && SameFrame(frame, Frame(ConfigTransactions::REQUEST_ID, { 0x05, 0x2E, 0x02, 0x06, 0x60, 0x09, 0x00, 0x00 })), section, "the next request goes out once the first fails");
+
+    ConfigTransactions::SResult result;
+    Check(transactions.TakeCompleted(&result) && result.handle == first && result.result == ConfigTransactions::TimedOut, section, "the first request times out");
+
+    //Response pending pushes the deadline back, a refusal fails the request without retrying.
+    now += ConfigTransactions::RESPONSE_TIMEOUT_MS - 10;
+    transactions.Receive(Frame(ConfigTransactions::RESPONSE_ID, { 0x03, 0x7F, 0x2E, 0x78, 0x00, 0x00, 0x00, 0x00 }), now);
+    Check(!transactions.Poll(now + 10, &frame), section, "response pending extends the timeout");
+    transactions.Receive(Frame(ConfigTransactions::RESPONSE_ID, { 0x03, 0x7F, 0x2E, 0x31, 0x00, 0x00, 0x00, 0x00 }), now + 20);
+    Check(transactions.TakeCompleted(&result) && result.handle == second && result.result == ConfigTransactions::Rejected && result.length == 1 && result.data[0] == 0x31, section, "a negative response rejects the request with its reason");
+    Check(!transactions.Poll(now + 1000, &frame) && transactions.GetQueuedCount() == 0, section, "a rejected request isn't retried");
+
+    const ConfigTransactions::SStats& stats = transactions.GetStats();
+    Check(stats.requests == 2 && stats.retries == ConfigTransactions::MAX_ATTEMPTS - 1 && stats.timeouts == 1 && stats.rejected == 1, section, "the stats count each attempt and failure");
+    printf("Retries:        %u requests, %u retries, %u timed out, %u rejected\n", stats.requests, stats.retries, stats.timeouts, stats.rejected);
+}
+
+//Our own writes are cached with the written value, the queue and the cache hold what they say and no more.
+static void CheckCache()
+{
+    const char* section = "cache";
+    ConfigTransactions transactions;
+    SCanMessage frame;
+    uint8_t data[ConfigTransactions::MAX_DATA];
+    uint8_t length;
+
+    Check(transactions.GetCached(ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, 0, data, &length) == ConfigTransactions::CacheMissing && length == 0, section, "an unknown value is missing");
+
+    uint8_t payload[2] = { 0x70, 0x08 };
+    transactions.Queue(ConfigTransactions::SERVICE_WRITE, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, payload, sizeof(payload));
+    transactions.Poll(100, &frame);
+    transactions.Receive(Frame(ConfigTransactions::RESPONSE_ID, { 0x03, 0x6E, 0x02, 0x06, 0xE0, 0xB3, 0xF8, 0x02 }), 110);
+    Check(transactions.GetCached(ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, 110, data, &length) == ConfigTransactions::CacheFresh && length == 2 && data[0] == 0x70 && data[1] == 0x08, section, "a confirmed write caches the written value");
+    Check(transactions.GetCached(ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, 110 + ConfigTransactions::CACHE_TTL_MS - 1, data, &length) == ConfigTransactions::CacheFresh, section, "fresh until the TTL");
+    Check(transactions.GetCached(ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, 110 + ConfigTransactions::CACHE_TTL_MS, data, &length) == ConfigTransactions::CacheStale, section, "stale from the TTL");
+
+    //A response to a request that was cancelled on the bus is only observed.
+    uint32_t handle = transactions.Queue(ConfigTransactions::SERVICE_READ, 0x0207, nullptr, 0);
+    transactions.Poll(200, &frame);
+    Check(transactions.Cancel(handle) && !transactions.Cancel(handle), section, "a request can only be cancelled once");
+    transactions.Receive(Frame(ConfigTransactions::RESPONSE_ID, { 0x05, 0x62, 0x02, 0x07, 0x78, 0x1E, 0xE0, 0xAA }), 210);
+    ConfigTransactions::SResult result;
+    bool taken;
+    while ((taken = transactions.TakeCompleted(&result)) && result.did != 0x0207) {}
+    Check(taken && result.handle == 0 && result.result == ConfigTransactions::Observed, section, "a cancelled request's response is observed");
+
+    for (size_t i = 0; i < ConfigTransactions::MAX_QUEUED; i++)
+        Check(transactions.Queue(ConfigTransactions::SERVICE_READ, 0x0200 + i, nullptr, 0) != 0, section, "the queue holds MAX_QUEUED requests");
+    Check(transactions.Queue(ConfigTransactions::SERVICE_READ, 0x0210, nullptr, 0) == 0, section, "a full queue refuses more");
+    Check(transactions.Queue(ConfigTransactions::SERVICE_READ, 0x0210, payload, ConfigTransactions::MAX_PAYLOAD + 1) == 0, section, "a payload that doesn't fit a single frame is refused");
+    printf("Cache:          checked\n");
+}
+
+//Replays each of the display's exchanges with one of our reads waiting, ours must not go out until the display has its answer or DISPLAY_TIMEOUT_MS has passed.
+static void CheckDisplayRequests(const std::vector<SExchange>& exchanges)
+{
+    const char* section = "display requests";
+    size_t answered = 0, unanswered = 0;
+    for (auto&& exchange : exchanges)
+    {
+        ConfigTransactions transactions;
+        SCanMessage frame;
+        uint32_t handle = transactions.Queue(ConfigTransactions::SERVICE_READ, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, nullptr, 0);
+        uint32_t now = 1000;
+        transactions.Receive(exchange.request, now);
+        bool final = false;
+        for (auto&& message : exchange.response)
+        {
+            Check(!transactions.Poll(now, &frame), section, "ours is held while the display's exchange is open, flow control included");
+            transactions.Receive(message, ++now);
+            if (message.id == ConfigTransactions::RESPONSE_ID && message.data[1] == 0x7F && message.length >= 4)
+                final = message.data[3] != 0x78;
+        }
+
+        uint16_t did;
+        std::vector<uint8_t> data;
+        if (final || ExpectedValue(exchange, &did, &data))
+        {
+            Check(transactions.Poll(now, &frame) && frame.data[1] == ConfigTransactions::SERVICE_READ, section, "ours goes out as soon as the display has its answer");
+            answered++;
+        }
+        else
+        {
+            Check(!transactions.Poll(now + ConfigTransactions::DISPLAY_TIMEOUT_MS - 1, &frame), section, "ours is held while the display waits for an answer");
+            Check(transactions.Poll(now + ConfigTransactions::DISPLAY_TIMEOUT_MS, &frame), section, "ours goes out once the display has given up");
+            unanswered++;
+        }
+        transactions.Cancel(handle);
+    }
+
+    //A request from the display while ours is on the bus holds our retry, not our response.
+    ConfigTransactions transactions;
+    SCanMessage frame;
+    SCanMessage request = Frame(ConfigTransactions::REQUEST_ID, { 0x03, 0x22, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00 });
+    transactions.Queue(ConfigTransactions::SERVICE_READ, ConfigTransactions::DID_WHEEL_CIRCUMFERENCE, nullptr, 0);
+    transactions.Poll(0, &frame);
+    transactions.Receive(Frame(ConfigTransactions::REQUEST_ID, { 0x03, 0x22, 0x02, 0x07, 0x00, 0x00, 0x00, 0x00 }), 100);
+    Check(!transactions.Poll(ConfigTransactions::RESPONSE_TIMEOUT_MS, &frame), section, "our retry waits for the display's answer");
+    transactions.Receive(Frame(ConfigTransactions::RESPONSE_ID, { 0x05, 0x62, 0x02, 0x07, 0x78, 0x1E, 0xE0, 0xAA }), 110 + ConfigTransactions::RESPONSE_TIMEOUT_MS);
+    Check(transactions.Poll(110 + ConfigTransactions::RESPONSE_TIMEOUT_MS, &frame) && SameFrame(frame, request), section, "and is sent once it has been answered");
+    Check(transactions.GetStats().retries == 1, section, "the held retry is only counted once it is sent");
+    printf("Display:        %zu answered, %zu unanswered exchanges held ours\n", answered, unanswered);
+}
+
+//Relays the capture through the tracker, every answered request should be matched with its legs split as the relay timed them.
+static void CheckRoundTrips(const std::vector<SExchange>& exchanges)
+{
+    const char* section = "round trips";
+    static const int64_t RELAY_US = 150; //Time each frame spends in the relay.
+    static const int64_t FRAME_US = 500; //The captures have millisecond timestamps, frames logged together are spread this far apart.
+    RoundTripTracker tracker;
+    size_t answered = 0;
+    int64_t last = 0;
+    for (auto&& exchange : exchanges)
+    {
+        int64_t requestAt = (int64_t)exchange.timestamp * 1000;
+        tracker.OnRequest(exchange.request, requestAt, requestAt + RELAY_US);
+        last = requestAt + RELAY_US;
+
+        bool matched = false;
+        for (size_t i = 0; i < exchange.response.size(); i++)
+        {
+            const SCanMessage& message = exchange.response[i];
+            int64_t receivedAt = requestAt + (int64_t)(i + 1) * FRAME_US;
+            last = receivedAt + RELAY_US;
+            if (message.id == RoundTripTracker::REQUEST_ID)
+            {
+                //Flow control from the display, not a request of its own.
+                tracker.OnRequest(message, receivedAt, receivedAt + RELAY_US);
+                continue;
+            }
+
+            //Only the single or first frame of a response is matched, consecutive frames are not looked at.
+            RoundTripTracker::SRoundTrip roundTrip;
+            bool timed = tracker.OnResponse(message, receivedAt, receivedAt + RELAY_US, &roundTrip);
+            Check(timed == (!matched && (message.data[0] >> 4) <= 0x1), section, "the first frame of a response, and only that, is matched");
+            if (!timed)
+                continue;
+            matched = true;
+
+            uint16_t did = exchange.request.data[2] << 8 | exchange.request.data[3];
+            Check(roundTrip.service == exchange.request.data[1] && (roundTrip.did == did || roundTrip.did == 0), section, "the response is matched to its request");
+            Check(roundTrip.requestRelayUs == RELAY_US && roundTrip.responseRelayUs == RELAY_US, section, "the relay legs are the time spent in the relay");
+            Check(roundTrip.deviceUs == (uint32_t)(receivedAt - requestAt - RELAY_US), section, "the device leg is from the request being relayed to the response arriving");
+            Check(roundTrip.totalUs == roundTrip.requestRelayUs + roundTrip.deviceUs + roundTrip.responseRelayUs, section, "the legs add up to the total");
+            answered++;
+        }
+    }
+
+    //A request that is never answered is forgotten once the next frame comes after its timeout.
+    const RoundTripTracker::SStats& stats = tracker.GetStats();
+    uint32_t pending = exchanges.size() - answered;
+    if (!exchanges.empty())
+        tracker.OnRequest(Frame(RoundTripTracker::REQUEST_ID, { 0x03, 0x22, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00 }), last + RoundTripTracker::RESPONSE_TIMEOUT_US, last + RoundTripTracker::RESPONSE_TIMEOUT_US);
+    Check(stats.matched == answered && stats.unmatched == 0, section, "every response is matched");
+    Check(stats.expired == pending, section, "the unanswered requests expire");
+    printf("Round trips:    %u matched, %u unmatched, %u expired\n", stats.matched, stats.unmatched, stats.expired);
+}
+
+//The tracker holds MAX_PENDING requests, the oldest is given up on when another arrives and anything past the timeout is dropped.
+static void CheckPendingSlots()
+{
+    const char* section = "pending slots";
+    RoundTripTracker tracker;
+    RoundTripTracker::SRoundTrip roundTrip;
+    auto request = [](uint16_t did) { return Frame(RoundTripTracker::REQUEST_ID, { 0x03, 0x22, (uint8_t)(did >> 8), (uint8_t)did, 0x00, 0x00, 0x00, 0x00 }); };
+    auto response = [](uint16_t did) { return Frame(RoundTripTracker::RESPONSE_ID, { 0x05, 0x62, (uint8_t)(did >> 8), (uint8_t)did, 0x60, 0x09, 0xE0, 0xAA }); };
+
+    for (uint16_t i = 0; i <= RoundTripTracker::MAX_PENDING; i++)
+        tracker.OnRequest(request(0x0200 + i), i * 1000, i * 1000 + 100);
+    Check(tracker.GetStats().expired == 1, section, "a request past MAX_PENDING replaces the oldest");
+    Check(!tracker.OnResponse(response(0x0200), 10000, 10100, &roundTrip), section, "the replaced request is no longer matched");
+    Check(tracker.OnResponse(response(0x0200 + RoundTripTracker::MAX_PENDING), 10000, 10100, &roundTrip) && roundTrip.deviceUs == 10000 - (RoundTripTracker::MAX_PENDING * 1000 + 100), section, "the newest request is matched");
+    Check(tracker.OnResponse(response(0x0201), 20000, 20100, &roundTrip) && roundTrip.did == 0x0201, section, "the others are still matched out of order");
+
+    //The remaining two time out.
+    int64_t late = 3 * 1000 + 100 + RoundTripTracker::RESPONSE_TIMEOUT_US;
+    Check(!tracker.OnResponse(response(0x0202), late, late + 100, &roundTrip), section, "a response after the timeout isn't matched");
+    Check(tracker.GetStats().expired == 3, section, "the requests past the timeout expire");
+
+    //Negative responses don't repeat the DID and are matched on the service alone, a response to a request that wasn't relayed (ours) isn't matched.
+    tracker.OnRequest(Frame(RoundTripTracker::REQUEST_ID, { 0x05, 0x2E, 0x02, 0x06, 0x60, 0x09, 0x00, 0x00 }), late + 1000, late + 1100);
+    Check(tracker.OnResponse(Frame(RoundTripTracker::RESPONSE_ID, { 0x03, 0x7F, 0x2E, 0x31, 0x00, 0x00, 0x00, 0x00 }), late + 2000, late + 2100, &roundTrip) && roundTrip.service == 0x2E && roundTrip.did == 0, section, "a negative response is matched on its service");
+    Check(!tracker.OnResponse(response(0x0206), late + 3000, late + 3100, &roundTrip), section, "a response to a request that wasn't seen isn't matched");
+
+    const RoundTripTracker::SStats& stats = tracker.GetStats();
+    Check(stats.matched == 3 && stats.unmatched == 3 && stats.expired == 3, section, "the stats count each outcome");
+    printf("Pending slots:  %u matched, %u unmatched, %u expired\n", stats.matched, stats.unmatched, stats.expired);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: configcheck <capture.txt>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<SRecordedFrame> frames;
+    std::vector<SExchange> exchanges;
+    for (int i = 1; i < argc; i++)
+    {
+        //Each capture starts from a clean engine state, the timestamps restart with each one.
+        std::vector<SRecordedFrame> captureFrames;
+        if (!Recording::Load(argv[i], captureFrames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+        std::vector<SExchange> captureExchanges = FindExchanges(captureFrames);
+        CheckObserved(captureFrames, captureExchanges);
+        CheckDisplayRequests(captureExchanges);
+        CheckRoundTrips(captureExchanges);
+        frames.insert(frames.end(), captureFrames.begin(), captureFrames.end());
+        exchanges.insert(exchanges.end(), captureExchanges.begin(), captureExchanges.end());
+    }
+
+    CheckOwnReads(exchanges);
+    CheckRetries();
+    CheckCache();
+    CheckPendingSlots();
+
+    printf("Failures:       %zu\n", _failures);
+    return _failures == 0 ? 0 : 3;
+}
@@ -0,0 +1,208 @@
+//Checks the GattSchema decoder against malformed and older writes and that the runtime stats schema packs the same bytes as the memcpys it replaced, then compares their cost.
+//Build: g++ -std=c++17 -O2 -I../../Software/src -o gattbench main.cpp
+//Usage: ./gattbench
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "../../Software/src/Bluetooth/GattSchema.h"
+#include "../../Software/src/Data/RuntimeStats.hpp"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::Bluetooth;
+
+static const size_t ITERATIONS = 20000000;
+
+//As Bluetooth::API::RuntimeStatsSchema.
+typedef GattSchema<
+    GattField<&Data::RuntimeStats::BikeSpeed>,
+    GattField<&Data::RuntimeStats::RealSpeed>,
+    GattField<&Data::RuntimeStats::Cadence>,
+    GattField<&Data::RuntimeStats::RiderPower>,
+    GattField<&Data::RuntimeStats::MotorPower>,
+    GattField<&Data::RuntimeStats::BatteryVoltage>,
+    GattField<&Data::RuntimeStats::BatteryCurrent>,
+    GattField<&Data::RuntimeStats::EaseSetting>,
+    GattField<&Data::RuntimeStats::PowerSetting>,
+    GattField<&Data::RuntimeStats::WalkMode>
+> RuntimeStatsSchema;
+static_assert(RuntimeStatsSchema::MAX_SIZE == 20, "The runtime stats layout has changed.");
+
+//Stands in for the persistent data, with a string and a field added in a second version.
+namespace Settings
+{
+    uint16_t Wheel = 2160;
+    Memory::FixedString<20> Name = "OpenTCU";
+    uint16_t Limits[2] = { 2500, 4500 };
+    uint16_t Newer = 42;
+};
+
+typedef GattSchema<
+    GattField<&Settings::Wheel>,
+    GattField<&Settings::Name>,
+    GattField<&Settings::Limits>,
+    GattField<&Settings::Newer, 2>
+> SettingsSchema;
+static_assert(SettingsSchema::VERSION == 2, "The version should follow the newest field.");
+static_assert(SettingsSchema::MAX_SIZE == 1 + 2 + 21 + 4 + 2, "The size should be the version and every field at its largest.");
+
+#pragma region Reference implementation (as previously written in Bluetooth::API)
+__attribute__((noinline)) static void HandEncode(uint8_t* outValue, uint16_t* outLength)
+{
+    *outLength = 0;
+    memcpy(outValue + *outLength, &Data::RuntimeStats::BikeSpeed, sizeof(Data::RuntimeStats::BikeSpeed));
+    *outLength += sizeof(Data::RuntimeStats::BikeSpeed);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::RealSpeed, sizeof(Data::RuntimeStats::RealSpeed));
+    *outLength += sizeof(Data::RuntimeStats::RealSpeed);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::Cadence, sizeof(Data::RuntimeStats::Cadence));
+    *outLength += sizeof(Data::RuntimeStats::Cadence);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::RiderPower, sizeof(Data::RuntimeStats::RiderPower));
+    *outLength += sizeof(Data::RuntimeStats::RiderPower);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::MotorPower, sizeof(Data::RuntimeStats::MotorPower));
+    *outLength += sizeof(Data::RuntimeStats::MotorPower);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::BatteryVoltage, sizeof(Data::RuntimeStats::BatteryVoltage));
+    *outLength += sizeof(Data::RuntimeStats::BatteryVoltage);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::BatteryCurrent, sizeof(Data::RuntimeStats::BatteryCurrent));
+    *outLength += sizeof(Data::RuntimeStats::BatteryCurrent);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::EaseSetting, sizeof(Data::RuntimeStats::EaseSetting));
+    *outLength += sizeof(Data::RuntimeStats::EaseSetting);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::PowerSetting, sizeof(Data::RuntimeStats::PowerSetting));
+    *outLength += sizeof(Data::RuntimeStats::PowerSetting);
+    memcpy(outValue + *outLength, &Data::RuntimeStats::WalkMode, sizeof(Data::RuntimeStats::WalkMode));
+    *outLength += sizeof(Data::RuntimeStats::WalkMode);
+}
+#pragma endregion
+
+__attribute__((noinline)) static void SchemaEncode(uint8_t* outValue, uint16_t* outLength)
+{
+    RuntimeStatsSchema::Encode(outValue, outLength);
+}
+
+template <typename TEncode>
+static double Measure(TEncode encode, uint32_t* outChecksum)
+{
+    uint8_t buffer[RuntimeStatsSchema::MAX_SIZE];
+    uint16_t length;
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        Data::RuntimeStats::BikeSpeed = (uint16_t)i;
+        encode(buffer, &length);
+        checksum += buffer[length - 1] + buffer[length - 19];
+    }
+    auto end = std::chrono::steady_clock::now();
+    *outChecksum = checksum;
+    return std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+}
+
+//The schema must pack the same bytes as the hand-written code, after its version byte.
+static bool VerifyEncode()
+{
+    bool ok = true;
+    for (uint32_t seed = 0; seed < 100000; seed++)
+    {
+        uint32_t value = seed * 2654435761u;
+        Data::RuntimeStats::BikeSpeed = (uint16_t)value;
+        Data::RuntimeStats::RealSpeed = (uint16_t)(value >> 3);
+        Data::RuntimeStats::Cadence = (uint16_t)(value >> 5);
+        Data::RuntimeStats::RiderPower = (uint16_t)(value >> 7);
+        Data::RuntimeStats::MotorPower = (uint16_t)(value >> 9);
+        Data::RuntimeStats::BatteryVoltage = (uint16_t)(value >> 11);
+        Data::RuntimeStats::BatteryCurrent = value ^ 0xA5A5A5A5;
+        Data::RuntimeStats::EaseSetting = (uint8_t)(value >> 13);
+        Data::RuntimeStats::PowerSetting = (uint8_t)(value >> 17);
+        Data::RuntimeStats::WalkMode = value & 1;
+
+        uint8_t hand[RuntimeStatsSchema::MAX_SIZE], schema[RuntimeStatsSchema::MAX_SIZE];
+        uint16_t handLength, schemaLength;
+        HandEncode(hand, &handLength);
+        SchemaEncode(schema, &schemaLength);
+        ok &= schemaLength == handLength + 1 && schema[0] == RuntimeStatsSchema::VERSION && memcmp(schema + 1, hand, handLength) == 0;
+    }
+    return ok;
+}
+
+struct SDecodeCase
+{
+    const char* name;
+    std::vector<uint8_t> input;
+    bool accepted;
+    uint16_t newer; //The value of the version 2 field after decoding, when accepted.
+};
+
+static bool VerifyDecode()
+{
+    std::vector<SDecodeCase> cases =
+    {
+        { "version 1 write", { 1, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11 }, true, 42 },
+        { "version 2 write", { 2, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11, 0x07, 0x00 }, true, 7 },
+        { "empty", {}, false, 0 },
+        { "short", { 2, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11, 0x07 }, false, 0 },
+        { "trailing bytes", { 1, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11, 0x07, 0x00 }, false, 0 },
+        { "version 0", { 0, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11 }, false, 0 },
+        { "unknown version", { 3, 0x70, 0x08, 2, 'H', 'i', 0xC4, 0x09, 0x94, 0x11, 0x07, 0x00 }, false, 0 },
+        { "embedded NUL", { 1, 0x70, 0x08, 2, 'H', 0, 0xC4, 0x09, 0x94, 0x11 }, false, 0 },
+        { "string too long", { 1, 0x70, 0x08, 21, 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 0xC4, 0x09, 0x94, 0x11 }, false, 0 },
+        { "string past the end", { 1, 0x70, 0x08, 9, 'H', 'i' }, false, 0 },
+    };
+
+    bool ok = true;
+    for (auto&& test : cases)
+    {
+        SettingsSchema::TValues values = SettingsSchema::Get();
+        bool accepted = SettingsSchema::Decode(test.input.data(), test.input.size(), &values);
+        bool passed = accepted == test.accepted;
+        if (passed && accepted)
+        {
+            passed = SettingsSchema::Get<&Settings::Wheel>(values) == 2160
+                && strcmp(SettingsSchema::Get<&Settings::Name>(values).c_str(), "Hi") == 0
+                && SettingsSchema::Get<&Settings::Limits>(values)[0] == 2500
+                && SettingsSchema::Get<&Settings::Limits>(values)[1] == 4500
+                && SettingsSchema::Get<&Settings::Newer>(values) == test.newer;
+
+            //Applying and encoding again gives the latest version of the same write.
+            SettingsSchema::Apply(values);
+            uint8_t encoded[SettingsSchema::MAX_SIZE];
+            uint16_t length;
+            SettingsSchema::Encode(encoded, &length);
+            passed &= length == 12 && encoded[0] == SettingsSchema::VERSION && memcmp(encoded + 1, test.input.data() + 1, 9) == 0;
+            Settings::Name = "OpenTCU";
+            Settings::Newer = 42;
+        }
+        printf("  %-20s %-8s %s\n", test.name, accepted ? "accepted" : "rejected", passed ? "ok" : "FAILED");
+        ok &= passed;
+    }
+    return ok;
+}
+
+int main(int argc, char**)
+{
+    if (argc > 1)
+    {
+        std::cerr << "Usage: gattbench" << std::endl;
+        return 1;
+    }
+
+    printf("Decode:\n");
+    bool decode = VerifyDecode();
+    bool encode = VerifyEncode();
+
+    //Interleave the runs and keep the best of each so neither side benefits from warm caches or frequency scaling.
+    uint32_t handChecksum, schemaChecksum;
+    double hand = 1e9, schema = 1e9;
+    for (size_t run = 0; run < 5; run++)
+    {
+        hand = std::min(hand, Measure(HandEncode, &handChecksum));
+        schema = std::min(schema, Measure(SchemaEncode, &schemaChecksum));
+    }
+
+    printf("Encode:         %s\n", encode ? "ok" : "FAILED");
+    printf("Hand-written:   %.2f ns/read (checksum %08x)\n", hand, handChecksum);
+    printf("Schema:         %.2f ns/read (checksum %08x)\n", schema, schemaChecksum);
+
+    return decode && encode && handChecksum == schemaChecksum ? 0 : 3;
+}
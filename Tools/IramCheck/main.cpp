@@ -0,0 +1,246 @@
+//Checks a firmware linker map built with CAN_RELAY_IN_IRAM and fails if any relay path function was linked into flash.
+//Build: g++ -std=c++17 -O2 -o iramcheck main.cpp
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <cxxabi.h>
+
+//Functions that every relayed frame passes through, matched against the demangled name up to the parameter list.
+static const char* DEFAULT_HOT_FUNCTIONS[] =
+{
+    "ReadieFur::OpenTCU::CAN::BusMaster::RelayTask",
+    "ReadieFur::OpenTCU::CAN::BusMaster::InterceptMessage",
+    "ReadieFur::OpenTCU::CAN::BusMaster::LogMessage",
+    "ReadieFur::OpenTCU::CAN::TwaiCan::Send",
+    "ReadieFur::OpenTCU::CAN::TwaiCan::Receive",
+    "ReadieFur::OpenTCU::CAN::McpCan::Send",
+    "ReadieFur::OpenTCU::CAN::McpCan::Receive",
+    "ReadieFur::OpenTCU::CAN::McpCan::OnInterrupt",
+    "ReadieFur::OpenTCU::CAN::AssistController::UpdateSpeed",
+    "ReadieFur::OpenTCU::CAN::AssistController::Shape",
+    "ReadieFur::OpenTCU::CAN::FixedRatio::Apply",
+    "ReadieFur::OpenTCU::CAN::FixedRatio::Undershoots",
+    "ReadieFur::OpenTCU::CAN::Samples<", //AddSample, matched by HOT_MEMBER_SUFFIXES.
+    "ReadieFur::OpenTCU::CAN::RelayWatchdog::OnReceived",
+    "ReadieFur::OpenTCU::CAN::RelayWatchdog::OnRelayed",
+    "ReadieFur::OpenTCU::CAN::PeriodMonitor::OnFrame",
+    "ReadieFur::OpenTCU::Metrics::Counter::Increment",
+    "ReadieFur::OpenTCU::Time::SystemClock::Now", //Called through Time::Clock by the assist controller and the CAN dump.
+    "ReadieFur::OpenTCU::Metrics::Histogram<", //Observe, matched by HOT_MEMBER_SUFFIXES.
+};
+
+//Templates are matched on their class name, these restrict them to the members on the relay path.
+static const char* HOT_MEMBER_SUFFIXES[] = { "::AddSample", "::Observe" };
+
+enum EPlacement
+{
+    Ignored,
+    Ram,
+    Flash,
+};
+
+struct SPlacement
+{
+    std::string symbol;
+    std::string outputSection;
+    EPlacement placement;
+};
+
+int PrintUsage()
+{
+    std::cerr
+        << "Usage:" << std::endl
+        << "  iramcheck <firmware.map> [functions.txt]" << std::endl
+        << "      Exits with 1 if a relay path function is placed in flash, or if none were found in IRAM." << std::endl
+        << "      functions.txt replaces the built-in list, one demangled name (or prefix ending in '<') per line." << std::endl;
+    return 2;
+}
+
+std::string Demangle(const std::string& name)
+{
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || demangled == nullptr)
+        return name;
+    std::string result(demangled);
+    free(demangled);
+    return result;
+}
+
+//The output sections of the ESP-IDF linker scripts, anything else (debug info, RTC memory) is not reported.
+EPlacement Classify(const std::string& outputSection)
+{
+    if (outputSection.find("iram") != std::string::npos || outputSection.find("dram") != std::string::npos)
+        return Ram;
+    if (outputSection.find("flash") != std::string::npos)
+        return Flash;
+    return Ignored;
+}
+
+//Input sections of functions in flash are named after the function (-ffunction-sections), e.g. .text._ZN...; IRAM sections are numbered and are identified by the symbol lines below them.
+std::string SymbolFromSection(const std::string& section)
+{
+    for (const char* prefix : { ".text.", ".literal." })
+    {
+        std::string p(prefix);
+        if (section.compare(0, p.size(), p) == 0 && section.size() > p.size() + 2 && section.compare(p.size(), 2, "_Z") == 0)
+            return section.substr(p.size());
+    }
+    return "";
+}
+
+bool ReadMap(const char* path, std::vector<SPlacement>& outPlacements)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    bool inMemoryMap = false;
+    std::string outputSection;
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (!inMemoryMap)
+        {
+            inMemoryMap = line.rfind("Linker script and memory map", 0) == 0;
+            continue;
+        }
+        if (line.empty())
+            continue;
+
+        std::istringstream stream(line);
+        std::vector<std::string> tokens;
+        for (std::string token; stream >> token;)
+            tokens.push_back(token);
+
+        if (line[0] == '.')
+        {
+            outputSection = tokens[0];
+            continue;
+        }
+
+        //Input section, " .text._ZN... 0x42000000 0x40 lib.a(obj.o)" or the name alone with the rest wrapped onto the next line.
+        if (line[0] == ' ' && line.size() > 1 && line[1] == '.')
+        {
+            std::string symbol = SymbolFromSection(tokens[0]);
+            if (!symbol.empty())
+                outPlacements.push_back({ symbol, outputSection, Classify(outputSection) });
+            continue;
+        }
+
+        //Symbol, "                0x40380100                _ZN...", assignments such as "_iram_text_start = ABSOLUTE (.)" have more tokens.
+        if (tokens.size() == 2 && tokens[0].rfind("0x", 0) == 0 && tokens[1].rfind("_Z", 0) == 0)
+            outPlacements.push_back({ tokens[1], outputSection, Classify(outputSection) });
+    }
+
+    if (!inMemoryMap)
+    {
+        std::cerr << path << " is not a GNU ld map file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Matches(const std::string& demangled, const std::string& function)
+{
+    if (demangled.compare(0, function.size(), function) != 0)
+        return false;
+
+    if (function.back() == '<')
+    {
+        for (const char* suffix : HOT_MEMBER_SUFFIXES)
+            if (demangled.find(std::string(suffix) + "(") != std::string::npos)
+                return true;
+        return false;
+    }
+
+    //Don't match functions that only share a prefix, e.g. Send and SendRemote.
+    return demangled.size() == function.size() || demangled[function.size()] == '(';
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+        return PrintUsage();
+
+    std::vector<std::string> functions;
+    if (argc == 3)
+    {
+        std::ifstream file(argv[2]);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << argv[2] << std::endl;
+            return 2;
+        }
+        for (std::string line; std::getline(file, line);)
+            if (!line.empty() && line[0] != '#')
+                functions.push_back(line);
+    }
+    else
+    {
+        functions.assign(std::begin(DEFAULT_HOT_FUNCTIONS), std::end(DEFAULT_HOT_FUNCTIONS));
+    }
+
+    std::vector<SPlacement> placements;
+    if (!ReadMap(argv[1], placements))
+        return 2;
+
+    size_t inRam = 0, inFlash = 0;
+    std::map<std::string, size_t> found;
+    std::set<std::pair<std::string, std::string>> seen; //A function in flash is listed both by its section name and its symbol.
+    for (auto&& placement : placements)
+    {
+        if (placement.placement == Ignored || !seen.insert({ placement.symbol, placement.outputSection }).second)
+            continue;
+
+        std::string demangled = Demangle(placement.symbol);
+        for (auto&& function : functions)
+        {
+            if (!Matches(demangled, function))
+                continue;
+
+            found[function]++;
+            if (placement.placement == Flash)
+            {
+                std::cout << "FLASH " << placement.outputSection << "\t" << demangled << std::endl;
+                inFlash++;
+            }
+            else
+            {
+                std::cout << "ok    " << placement.outputSection << "\t" << demangled << std::endl;
+                inRam++;
+            }
+            break;
+        }
+    }
+
+    //Small functions are usually inlined into their callers and have no symbol of their own.
+    for (auto&& function : functions)
+        if (found.find(function) == found.end())
+            std::cout << "note  " << function << " has no out of line copy (inlined or not used by this target)." << std::endl;
+
+    if (inFlash != 0)
+    {
+        std::cerr << inFlash << " relay path function(s) placed in flash." << std::endl;
+        return 1;
+    }
+    if (inRam == 0)
+    {
+        std::cerr << "No relay path functions found in IRAM, was the firmware built with CAN_RELAY_IN_IRAM?" << std::endl;
+        return 1;
+    }
+    std::cout << inRam << " relay path function(s) in IRAM, none in flash." << std::endl;
+    return 0;
+}
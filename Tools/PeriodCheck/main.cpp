@@ -0,0 +1,225 @@
+//Replays captures through the PeriodMonitor as the relay and watchdog tasks drive it, and checks learning, overdue reporting, drift and Reset against synthetic frames.
+//Build: g++ -std=c++17 -O2 -o periodcheck main.cpp
+//Usage: ./periodcheck [capture.txt]...
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/PeriodMonitor.h"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::CAN;
+using namespace ReadieFur::OpenTCU::Tools;
+
+//As CAN::BusMaster::PERIODIC_IDS.
+static const uint16_t PERIODIC_IDS[] = { 0x200, 0x201, 0x202, 0x203, 0x204, 0x205, 0x206, 0x300, 0x301, 0x400, 0x401, 0x402, 0x403, 0x665, 0x666 };
+static const size_t PERIODIC_ID_COUNT = sizeof(PERIODIC_IDS) / sizeof(PERIODIC_IDS[0]);
+static const uint32_t CHECK_INTERVAL_US = 10000; //As the watchdog task.
+static const uint32_t IDLE_TIMEOUT_US = 30000000; //As CAN::BusMaster::IDLE_TIMEOUT_MS, applied to the whole bus here.
+
+static size_t _failures = 0;
+
+static void Check(bool condition, const char* section, const char* what)
+{
+    if (condition)
+        return;
+    _failures++;
+    printf("  FAILED %s: %s\n", section, what);
+}
+
+//Whether a check between the frame at lastSeen and until ran past the ID's allowed gap.
+static bool Overdue(const PeriodMonitor& monitor, size_t index, uint32_t lastSeen, uint32_t until)
+{
+    PeriodMonitor::SPeriodStats stats = {};
+    monitor.GetStats(index, &stats);
+    uint32_t deadline = lastSeen + stats.nominalPeriodUs * PeriodMonitor::OVERDUE_PERIODS;
+    return stats.nominalPeriodUs != 0 && (deadline / CHECK_INTERVAL_US + 1) * CHECK_INTERVAL_US <= until;
+}
+
+//Runs the monitor over a capture, each gap of more than OVERDUE_PERIODS after an ID has learned its period should be reported as overdue exactly once.
+//The serial captures drop frames when the logger falls behind, which gives plenty of real gaps.
+static void CheckCapture(const char* path, const std::vector<SRecordedFrame>& frames)
+{
+    const char* section = "capture";
+    PeriodMonitor monitor(PERIODIC_IDS, PERIODIC_ID_COUNT);
+    std::vector<std::vector<uint32_t>> intervals(PERIODIC_ID_COUNT);
+    std::vector<uint32_t> lastSeen(PERIODIC_ID_COUNT, 0);
+    std::vector<uint32_t> gaps(PERIODIC_ID_COUNT, 0);
+    uint32_t overdue = 0, drifted = 0, resets = 0;
+    uint32_t nextCheck = 0, lastFrame = 0;
+    for (auto&& frame : frames)
+    {
+        uint32_t now = frame.timestamp * 1000;
+        for (; !frames.empty() && (int32_t)(now - nextCheck) >= 0; nextCheck += CHECK_INTERVAL_US)
+        {
+            if (nextCheck - lastFrame >= IDLE_TIMEOUT_US)
+                continue;
+            PeriodMonitor::SChanges changes = monitor.Check(nextCheck);
+            overdue += __builtin_popcount(changes.overdue);
+            drifted += __builtin_popcount(changes.drifted);
+        }
+        if (now - lastFrame >= IDLE_TIMEOUT_US && lastFrame != 0)
+        {
+            monitor.Reset();
+            resets++;
+        }
+        lastFrame = now;
+
+        if (frame.message.isExtended)
+            continue;
+        for (size_t i = 0; i < PERIODIC_ID_COUNT; i++)
+        {
+            if (PERIODIC_IDS[i] != frame.message.id)
+                continue;
+
+            if (Overdue(monitor, i, lastSeen[i], now))
+                gaps[i]++;
+            if (lastSeen[i] != 0)
+                intervals[i].push_back(now - lastSeen[i]);
+            lastSeen[i] = now;
+        }
+        monitor.OnFrame(frame.message.id, now);
+    }
+
+    //Including the IDs that stopped before the end of the capture.
+    for (size_t i = 0; i < PERIODIC_ID_COUNT; i++)
+        if (Overdue(monitor, i, lastSeen[i], nextCheck - CHECK_INTERVAL_US))
+            gaps[i]++;
+
+    printf("%s: %zu frames, %u overdue, %u drifted, %u resets\n", path, frames.size(), overdue, drifted, resets);
+    for (size_t i = 0; i < monitor.GetCount(); i++)
+    {
+        PeriodMonitor::SPeriodStats stats;
+        monitor.GetStats(i, &stats);
+        if (intervals[i].size() < PeriodMonitor::LEARNING_FRAMES + 1)
+            continue;
+
+        std::vector<uint32_t> sorted = intervals[i];
+        std::sort(sorted.begin(), sorted.end());
+        uint32_t median = sorted[sorted.size() / 2];
+        printf("  %03x: median %7uus, nominal %7uus, period %7uus, jitter %6uus, %u overdue (%u gaps)\n", stats.id, median, stats.nominalPeriodUs, stats.periodUs, stats.jitterUs, stats.overdueCount, gaps[i]);
+        Check(stats.nominalPeriodUs != 0, section, "every ID seen often enough learns its period");
+        Check(stats.overdueCount == gaps[i], section, "every gap is reported as overdue once");
+    }
+}
+
+static uint32_t Learn(PeriodMonitor& monitor, uint32_t id, uint32_t start, uint32_t period)
+{
+    for (uint32_t i = 0; i <= PeriodMonitor::LEARNING_FRAMES; i++)
+        monitor.OnFrame(id, start + i * period);
+    return start + PeriodMonitor::LEARNING_FRAMES * period;
+}
+
+static void CheckLearning()
+{
+    const char* section = "learning";
+    const uint16_t ids[] = { 0x201, 0x300, 0x201 };
+    PeriodMonitor monitor(ids, 3);
+    Check(monitor.GetCount() == 2, section, "duplicate IDs are ignored");
+
+    for (uint32_t i = 0; i < PeriodMonitor::LEARNING_FRAMES; i++)
+        monitor.OnFrame(0x201, i * 100000);
+    Check(monitor.GetLearnedBitmap() == 0, section, "nothing is learned before LEARNING_FRAMES intervals");
+    monitor.OnFrame(0x201, PeriodMonitor::LEARNING_FRAMES * 100000);
+    monitor.OnFrame(0x202, 0);
+    monitor.OnFrame(0x7FF, 0);
+
+    PeriodMonitor::SPeriodStats stats;
+    monitor.GetStats(0, &stats);
+    Check(monitor.GetLearnedBitmap() == 0x1 && stats.nominalPeriodUs == 100000, section, "the nominal period is the mean of the learning intervals");
+    PeriodMonitor::SChanges changes = monitor.Check(PeriodMonitor::LEARNING_FRAMES * 100000);
+    Check(changes.learned == 0x1 && monitor.GetHealthBitmap() == 0x1, section, "learning is reported once and the ID is healthy");
+    Check(monitor.Check(PeriodMonitor::LEARNING_FRAMES * 100000).learned == 0, section, "learning isn't reported again");
+}
+
+static void CheckOverdue()
+{
+    const char* section = "overdue";
+    const uint16_t ids[] = { 0x201 };
+    PeriodMonitor monitor(ids, 1);
+    uint32_t last = Learn(monitor, 0x201, 0, 100000);
+    monitor.Check(last);
+
+    Check(monitor.Check(last + 100000 * PeriodMonitor::OVERDUE_PERIODS).overdue == 0, section, "not overdue at OVERDUE_PERIODS");
+    Check(monitor.Check(last + 100000 * PeriodMonitor::OVERDUE_PERIODS + 1).overdue == 0x1, section, "overdue just past OVERDUE_PERIODS");
+    Check(monitor.Check(last + 1000000).overdue == 0 && monitor.GetOverdueBitmap() == 0x1 && monitor.GetHealthBitmap() == 0, section, "reported once and unhealthy until the next frame");
+
+    monitor.OnFrame(0x201, last + 2000000);
+    PeriodMonitor::SChanges changes = monitor.Check(last + 2000000);
+    PeriodMonitor::SPeriodStats stats;
+    monitor.GetStats(0, &stats);
+    Check(changes.resumed == 0x1 && monitor.GetOverdueBitmap() == 0 && monitor.GetHealthBitmap() == 0x1, section, "the next frame resumes it");
+    Check(stats.periodUs == 100000 && stats.overdueCount == 1, section, "the gap isn't averaged into the period");
+}
+
+static void CheckDrift()
+{
+    const char* section = "drift";
+    const uint16_t ids[] = { 0x201 };
+    PeriodMonitor monitor(ids, 1);
+    uint32_t now = Learn(monitor, 0x201, 0, 100000);
+    monitor.Check(now);
+
+    uint32_t frames = 0;
+    while (!(monitor.GetDriftingBitmap() & 0x1) && frames++ < 100)
+        monitor.OnFrame(0x201, now += 130000);
+    Check(frames < 100 && monitor.Check(now).drifted == 0x1, section, "a slower rate drifts");
+
+    monitor.OnFrame(0x201, now += 110000);
+    Check(monitor.GetDriftingBitmap() == 0x1, section, "drift needs to fall below DRIFT_PERCENT / 2 to recover");
+    frames = 0;
+    while ((monitor.GetDriftingBitmap() & 0x1) && frames++ < 100)
+        monitor.OnFrame(0x201, now += 100000);
+    Check(frames < 100 && monitor.Check(now).recovered == 0x1, section, "the nominal rate recovers");
+}
+
+static void CheckReset()
+{
+    const char* section = "reset";
+    const uint16_t ids[] = { 0x201, 0x300 };
+    PeriodMonitor monitor(ids, 2);
+    uint32_t now = Learn(monitor, 0x201, 0, 100000);
+    Learn(monitor, 0x300, 0, 50000);
+    monitor.Check(now + 1000000);
+    Check(monitor.GetOverdueBitmap() == 0x3, section, "both overdue while the bike is off");
+
+    monitor.Reset();
+    Check(monitor.GetLearnedBitmap() == 0 && monitor.GetOverdueBitmap() == 0 && monitor.GetDriftingBitmap() == 0, section, "the bitmaps are cleared");
+    PeriodMonitor::SChanges changes = monitor.Check(now + 60000000);
+    Check((changes.learned | changes.overdue | changes.resumed | changes.drifted | changes.recovered) == 0, section, "nothing is reported for the reset or the IDs that haven't come back");
+
+    //Back at a different rate, the gap over the reset isn't an interval.
+    now += 60000000;
+    monitor.OnFrame(0x201, now);
+    PeriodMonitor::SPeriodStats stats;
+    monitor.GetStats(0, &stats);
+    Check(stats.nominalPeriodUs == 0 && stats.frames == 1, section, "learning restarts from the first frame");
+    for (uint32_t i = 1; i <= PeriodMonitor::LEARNING_FRAMES; i++)
+        monitor.OnFrame(0x201, now + i * 200000);
+    monitor.GetStats(0, &stats);
+    Check(monitor.GetLearnedBitmap() == 0x1 && stats.nominalPeriodUs == 200000 && stats.overdueCount == 1, section, "the new period is learned, the overdue count is kept");
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+        CheckCapture(argv[i], frames);
+    }
+
+    CheckLearning();
+    CheckOverdue();
+    CheckDrift();
+    CheckReset();
+
+    printf("Failures: %zu\n", _failures);
+    return _failures == 0 ? 0 : 3;
+}
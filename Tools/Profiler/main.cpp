@@ -0,0 +1,234 @@
+//Symbolises the PC samples streamed by Profiling::Profiler against the firmware ELF and writes folded stacks for flamegraphs.
+//Build: g++ -std=c++17 -O2 -o profiler main.cpp
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+static const char* DEFAULT_ADDR2LINE = "riscv32-esp-elf-addr2line";
+static const size_t ADDRESSES_PER_CALL = 256;
+
+struct SCapture
+{
+    std::map<std::string, std::string> taskNames; //Task handle to name.
+    std::map<std::pair<std::string, uint32_t>, uint64_t> samples; //(task handle, pc) to count.
+    uint64_t total = 0;
+    uint64_t dropped = 0;
+};
+
+int PrintUsage()
+{
+    std::cerr
+        << "Usage:" << std::endl
+        << "  profiler fold <firmware.elf> <capture.log> [addr2line]" << std::endl
+        << "      Writes folded stacks (task;caller;...;function count) to stdout, e.g. for flamegraph.pl." << std::endl
+        << "  profiler top <firmware.elf> <capture.log> [addr2line]" << std::endl
+        << "      Prints the share of samples per task and per function." << std::endl
+        << "The capture is the console output of a build with ENABLE_PROFILER, other lines are ignored." << std::endl
+        << "addr2line defaults to " << DEFAULT_ADDR2LINE << " (use the Xtensa or host addr2line to match the ELF)." << std::endl;
+    return 1;
+}
+
+bool ReadCapture(const char* path, SCapture& capture)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        //Samples can share a line with a log prefix or a partially written log line.
+        size_t marker = line.find('@');
+        while (marker != std::string::npos && (marker + 2 >= line.size() || line[marker + 2] != ' ' || std::string("TPD").find(line[marker + 1]) == std::string::npos))
+            marker = line.find('@', marker + 1);
+        if (marker == std::string::npos)
+            continue;
+
+        std::istringstream stream(line.substr(marker + 3));
+        std::string task;
+        switch (line[marker + 1])
+        {
+        case 'T':
+        {
+            std::string name;
+            stream >> task;
+            std::getline(stream >> std::ws, name);
+            if (!name.empty() && name.back() == '\r')
+                name.pop_back();
+            capture.taskNames[task] = name;
+            break;
+        }
+        case 'P':
+        {
+            std::string pc;
+            stream >> task;
+            while (stream >> pc)
+            {
+                capture.samples[{ task, (uint32_t)strtoul(pc.c_str(), nullptr, 16) }]++;
+                capture.total++;
+            }
+            break;
+        }
+        case 'D':
+        {
+            uint64_t dropped = 0;
+            stream >> dropped;
+            capture.dropped += dropped;
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+//Resolves each PC to its inline chain, outermost function first.
+bool Symbolise(const char* elf, const char* addr2line, const std::vector<uint32_t>& pcs, std::map<uint32_t, std::vector<std::string>>& outFrames)
+{
+    for (size_t first = 0; first < pcs.size(); first += ADDRESSES_PER_CALL)
+    {
+        std::ostringstream command;
+        command << addr2line << " -a -f -i -C -e '" << elf << "'";
+        for (size_t i = first; i < pcs.size() && i < first + ADDRESSES_PER_CALL; i++)
+            command << " 0x" << std::hex << pcs[i];
+
+        FILE* pipe = popen(command.str().c_str(), "r");
+        if (pipe == nullptr)
+        {
+            std::cerr << "Failed to run " << addr2line << std::endl;
+            return false;
+        }
+
+        //-a prints each address before its frames, -i then prints the function it was inlined into and so on up to the real function.
+        char buffer[4096];
+        std::vector<std::string>* frames = nullptr;
+        bool expectFunction = true;
+        while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+        {
+            std::string line(buffer);
+            while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+                line.pop_back();
+
+            if (line.rfind("0x", 0) == 0 && line.find(':') == std::string::npos)
+            {
+                frames = &outFrames[(uint32_t)strtoul(line.c_str(), nullptr, 16)];
+                expectFunction = true;
+                continue;
+            }
+            if (frames == nullptr)
+                continue;
+            if (expectFunction)
+                frames->insert(frames->begin(), line == "??" ? "[unknown]" : line);
+            expectFunction = !expectFunction;
+        }
+
+        if (pclose(pipe) != 0)
+        {
+            std::cerr << addr2line << " failed, check that it is installed and matches the ELF." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string TaskName(const SCapture& capture, const std::string& task)
+{
+    auto it = capture.taskNames.find(task);
+    return it != capture.taskNames.end() ? it->second : task;
+}
+
+int Fold(const SCapture& capture, const std::map<uint32_t, std::vector<std::string>>& frames)
+{
+    std::map<std::string, uint64_t> stacks;
+    for (auto&& [key, count] : capture.samples)
+    {
+        std::string stack = TaskName(capture, key.first);
+        auto it = frames.find(key.second);
+        if (it == frames.end() || it->second.empty())
+            stack += ";[unknown]";
+        else
+            for (auto&& frame : it->second)
+                stack += ";" + frame;
+        //Folded stacks are separated by semicolons and the count by the last space, neither can appear in a frame.
+        std::replace(stack.begin(), stack.end(), ' ', '_');
+        stacks[stack] += count;
+    }
+
+    for (auto&& [stack, count] : stacks)
+        std::cout << stack << " " << count << std::endl;
+    return 0;
+}
+
+void PrintTop(const char* title, const std::map<std::string, uint64_t>& counts, uint64_t total)
+{
+    std::vector<std::pair<std::string, uint64_t>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+    std::cout << title << std::endl;
+    for (auto&& [name, count] : sorted)
+    {
+        char percent[16];
+        snprintf(percent, sizeof(percent), "%6.2f%%", total != 0 ? 100.0 * count / total : 0.0);
+        std::cout << "  " << percent << "  " << count << "\t" << name << std::endl;
+    }
+}
+
+int Top(const SCapture& capture, const std::map<uint32_t, std::vector<std::string>>& frames)
+{
+    std::map<std::string, uint64_t> tasks, functions;
+    for (auto&& [key, count] : capture.samples)
+    {
+        tasks[TaskName(capture, key.first)] += count;
+        auto it = frames.find(key.second);
+        functions[it == frames.end() || it->second.empty() ? "[unknown]" : it->second.back()] += count;
+    }
+
+    std::cout << capture.total << " samples";
+    if (capture.dropped != 0)
+        std::cout << ", " << capture.dropped << " dropped on the device";
+    std::cout << std::endl;
+    PrintTop("Tasks:", tasks, capture.total);
+    PrintTop("Functions:", functions, capture.total);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+        return PrintUsage();
+
+    std::string command = argv[1];
+    if (command != "fold" && command != "top")
+        return PrintUsage();
+
+    SCapture capture;
+    if (!ReadCapture(argv[3], capture))
+        return 2;
+    if (capture.total == 0)
+    {
+        std::cerr << "No samples found in " << argv[3] << std::endl;
+        return 2;
+    }
+
+    std::vector<uint32_t> pcs;
+    for (auto&& [key, count] : capture.samples)
+        pcs.push_back(key.second);
+    std::sort(pcs.begin(), pcs.end());
+    pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+
+    std::map<uint32_t, std::vector<std::string>> frames;
+    if (!Symbolise(argv[2], argc >= 5 ? argv[4] : DEFAULT_ADDR2LINE, pcs, frames))
+        return 2;
+
+    return command == "fold" ? Fold(capture, frames) : Top(capture, frames);
+}
@@ -0,0 +1,154 @@
+//Checks that FixedRatio gives the same results as the double precision wheel scaling it replaced, bit for bit, and compares their cost per frame.
+//Build: g++ -std=c++17 -O2 -o scalebench main.cpp
+//Usage: ./scalebench <capture.txt>...
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <set>
+#include <numeric>
+#include <algorithm>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/Signals.h"
+#include "../../Software/src/CAN/FixedRatio.h"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::CAN;
+using namespace ReadieFur::OpenTCU::Tools;
+
+//Valid wheel circumferences as accepted by BusMaster::SetTargetWheelCircumference and the API.
+static const uint32_t MIN_CIRCUMFERENCE = 800;
+static const uint32_t MAX_CIRCUMFERENCE = 2400;
+static const size_t ITERATIONS = 2000;
+
+#pragma region Reference implementations (as previously written in BusMaster)
+__attribute__((noinline)) static uint32_t DoubleMultiply(uint16_t value, double multiplier)
+{
+    return (uint16_t)(value * multiplier);
+}
+
+__attribute__((noinline)) static uint32_t DoubleDivide(uint32_t value, double multiplier)
+{
+    return (uint32_t)(value / multiplier);
+}
+#pragma endregion
+
+__attribute__((noinline)) static uint32_t FixedMultiply(uint16_t value, const FixedRatio& ratio)
+{
+    return (uint16_t)ratio.Apply(value);
+}
+
+struct SCheckResult
+{
+    uint64_t checked = 0;
+    uint64_t mismatches = 0;
+};
+
+static void Check(uint32_t base, uint32_t target, uint16_t value, SCheckResult* result)
+{
+    double multiplier = (double)base / target;
+    FixedRatio multiply(base, target, Multiply);
+    FixedRatio divide(base, target, Divide);
+    result->checked += 2;
+    if (DoubleMultiply(value, multiplier) != FixedMultiply(value, multiply))
+        result->mismatches++;
+    if (DoubleDivide(value, multiplier) != divide.Apply(value))
+        result->mismatches++;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: scalebench <capture.txt>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<uint16_t> speeds;
+    std::set<uint16_t> uniqueSpeeds;
+    for (int i = 1; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+        for (auto&& frame : frames)
+        {
+            if (frame.message.id != Signals::Speed.id)
+                continue;
+            uint16_t speed = SignalCodec<Signals::Speed>::Extract(frame.message.data);
+            speeds.push_back(speed);
+            uniqueSpeeds.insert(speed);
+        }
+    }
+    if (speeds.empty())
+    {
+        std::cerr << "No speed frames found." << std::endl;
+        return 2;
+    }
+
+    //Every recorded speed against every valid wheel combination.
+    SCheckResult recorded;
+    for (uint32_t base = MIN_CIRCUMFERENCE; base <= MAX_CIRCUMFERENCE; base++)
+        for (uint32_t target = MIN_CIRCUMFERENCE; target <= MAX_CIRCUMFERENCE; target++)
+            for (uint16_t speed : uniqueSpeeds)
+                Check(base, target, speed, &recorded);
+
+    //Results can only differ where the exact result is a whole number, so check every such input for every combination.
+    SCheckResult exact;
+    for (uint32_t base = MIN_CIRCUMFERENCE; base <= MAX_CIRCUMFERENCE; base++)
+    {
+        for (uint32_t target = MIN_CIRCUMFERENCE; target <= MAX_CIRCUMFERENCE; target++)
+        {
+            uint32_t divisor = std::gcd(base, target);
+            for (uint32_t value = 0; value <= 0xFFFF; value += target / divisor)
+                Check(base, target, value, &exact);
+            for (uint32_t value = 0; value <= 0xFFFF; value += base / divisor)
+                Check(base, target, value, &exact);
+        }
+    }
+
+    //And every input for a spread of combinations.
+    SCheckResult full;
+    for (uint32_t base = MIN_CIRCUMFERENCE; base <= MAX_CIRCUMFERENCE; base += 97)
+        for (uint32_t target = MIN_CIRCUMFERENCE; target <= MAX_CIRCUMFERENCE; target += 89)
+            for (uint32_t value = 0; value <= 0xFFFF; value++)
+                Check(base, target, value, &full);
+
+    //Timing with the default base circumference and a smaller target wheel.
+    double multiplier = 2160.0 / 2000;
+    FixedRatio ratio(2160, 2000);
+    uint32_t doubleChecksum = 0, fixedChecksum = 0;
+    double doubleTime = 1e9, fixedTime = 1e9;
+    for (size_t run = 0; run < 5; run++)
+    {
+        uint32_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ITERATIONS; i++)
+            for (uint16_t speed : speeds)
+                checksum += DoubleMultiply(speed, multiplier);
+        auto end = std::chrono::steady_clock::now();
+        doubleTime = std::min(doubleTime, std::chrono::duration<double, std::nano>(end - start).count() / (ITERATIONS * speeds.size()));
+        doubleChecksum = checksum;
+
+        checksum = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ITERATIONS; i++)
+            for (uint16_t speed : speeds)
+                checksum += FixedMultiply(speed, ratio);
+        end = std::chrono::steady_clock::now();
+        fixedTime = std::min(fixedTime, std::chrono::duration<double, std::nano>(end - start).count() / (ITERATIONS * speeds.size()));
+        fixedChecksum = checksum;
+    }
+
+    printf("Speed frames:       %zu (%zu unique)\n", speeds.size(), uniqueSpeeds.size());
+    printf("Recorded speeds:    %llu checked, %llu mismatches\n", (unsigned long long)recorded.checked, (unsigned long long)recorded.mismatches);
+    printf("Whole results:      %llu checked, %llu mismatches\n", (unsigned long long)exact.checked, (unsigned long long)exact.mismatches);
+    printf("Full range sample:  %llu checked, %llu mismatches\n", (unsigned long long)full.checked, (unsigned long long)full.mismatches);
+    printf("Double:             %.2f ns/frame (checksum %08x)\n", doubleTime, doubleChecksum);
+    printf("Fixed point:        %.2f ns/frame (checksum %08x)\n", fixedTime, fixedChecksum);
+
+    return recorded.mismatches == 0 && exact.mismatches == 0 && full.mismatches == 0 && doubleChecksum == fixedChecksum ? 0 : 3;
+}
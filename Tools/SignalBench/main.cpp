@@ -0,0 +1,184 @@
+//Checks that the SignalCodec generated accessors match the hand-written shifts they replaced, bit for bit and in speed, and that the logged physical values are scaled correctly.
+//Build: g++ -std=c++17 -O2 -o signalbench main.cpp
+//Usage: ./signalbench <capture.txt>...
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/Signals.h"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::CAN;
+using namespace ReadieFur::OpenTCU::Tools;
+
+static const size_t ITERATIONS = 2000;
+
+#pragma region Reference implementations (as previously written in BusMaster::InterceptMessage)
+__attribute__((noinline)) static uint32_t HandDecode(SCanMessage& message)
+{
+    switch (message.id)
+    {
+    case 0x201:
+    {
+        uint16_t speed = message.data[0] | message.data[1] << 8;
+        message.data[0] = speed & 0xFF;
+        message.data[1] = speed >> 8;
+        return speed;
+    }
+    case 0x300:
+        return (message.data[1] == 0xA5) + message.data[4] + message.data[6];
+    case 0x401:
+        return (uint16_t)(message.data[0] | message.data[1] << 8)
+            + (int32_t)(message.data[4] | message.data[5] << 8 | message.data[6] << 16 | (uint32_t)message.data[7] << 24);
+    default:
+        return 0;
+    }
+}
+#pragma endregion
+
+__attribute__((noinline)) static uint32_t GeneratedDecode(SCanMessage& message)
+{
+    switch (message.id)
+    {
+    case Signals::Speed.id:
+    {
+        uint16_t speed = SignalCodec<Signals::Speed>::Extract(message.data);
+        SignalCodec<Signals::Speed>::Insert(message.data, speed);
+        return speed;
+    }
+    case Signals::WalkMode.id:
+        return (SignalCodec<Signals::WalkMode>::Extract(message.data) == 0xA5)
+            + SignalCodec<Signals::EaseSetting>::Extract(message.data)
+            + SignalCodec<Signals::PowerSetting>::Extract(message.data);
+    case Signals::BatteryVoltage.id:
+        return SignalCodec<Signals::BatteryVoltage>::Extract(message.data)
+            + SignalCodec<Signals::BatteryCurrent>::Extract(message.data);
+    default:
+        return 0;
+    }
+}
+
+template <typename TDecode>
+static double Measure(std::vector<SCanMessage>& messages, TDecode decode, uint32_t* outChecksum)
+{
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+        for (auto&& message : messages)
+            checksum += decode(message);
+    auto end = std::chrono::steady_clock::now();
+    *outChecksum = checksum;
+    return std::chrono::duration<double, std::nano>(end - start).count() / (ITERATIONS * messages.size());
+}
+
+//Exhaustive-ish round trip check of the generated accessors against the table driven decoder.
+static bool VerifyRoundTrips()
+{
+    bool ok = true;
+    uint8_t data[8];
+    for (uint32_t seed = 0; seed < 100000; seed++)
+    {
+        for (size_t i = 0; i < 8; i++)
+            data[i] = (uint8_t)((seed * 2654435761u) >> (i * 3));
+
+        ok &= SignalCodec<Signals::Speed>::Extract(data) == SignalDecoder::Extract(Signals::Speed, data);
+        ok &= SignalCodec<Signals::EaseSetting>::Extract(data) == SignalDecoder::Extract(Signals::EaseSetting, data);
+        ok &= SignalCodec<Signals::BatteryCurrent>::Extract(data) == SignalDecoder::Extract(Signals::BatteryCurrent, data);
+
+        uint8_t copy[8];
+        memcpy(copy, data, sizeof(copy));
+        SignalCodec<Signals::BatteryCurrent>::Insert(copy, SignalCodec<Signals::BatteryCurrent>::Extract(data));
+        SignalCodec<Signals::PowerSetting>::Insert(copy, SignalCodec<Signals::PowerSetting>::Extract(data));
+        ok &= memcmp(copy, data, sizeof(copy)) == 0;
+    }
+    return ok;
+}
+
+//The logged physical values against the examples in Signals.h and the double precision expression for every frame.
+static bool VerifyPhysical(const std::vector<SCanMessage>& messages)
+{
+    auto formatted = [](const SSignal& signal, std::initializer_list<uint8_t> bytes)
+    {
+        uint8_t data[8] = {};
+        std::copy(bytes.begin(), bytes.end(), data);
+        char value[SignalDecoder::MAX_FORMATTED];
+        SignalDecoder::Format(signal, data, value, sizeof(value));
+        return std::string(value);
+    };
+    bool ok = formatted(Signals::Speed, { 0xEA, 0x01 }) == "4.90"
+        && formatted(Signals::BatteryVoltage, { 0x35, 0x9F }) == "40.757"
+        && formatted(Signals::BatteryCurrent, { 0, 0, 0, 0, 0x5B, 0xF0, 0xFF, 0xFF }) == "-4.005"
+        && formatted(Signals::BatteryCurrent, { 0, 0, 0, 0, 0x0C, 0xFE, 0xFF, 0xFF }) == "-0.500"
+        && formatted(Signals::EaseSetting, { 0, 0, 0, 0, 0x64 }) == "100";
+
+    for (auto&& message : messages)
+    {
+        for (const SSignal* signal : Signals::ALL)
+        {
+            if (signal->id != message.id)
+                continue;
+            char value[SignalDecoder::MAX_FORMATTED];
+            SignalDecoder::Format(*signal, message.data, value, sizeof(value));
+            double expected = (double)SignalDecoder::Extract(*signal, message.data) * signal->scaleNumerator / signal->scaleDenominator;
+            ok &= std::abs(strtod(value, nullptr) - expected) < 1e-9;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: signalbench <capture.txt>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<SCanMessage> messages;
+    for (int i = 1; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 2;
+        }
+        for (auto&& frame : frames)
+            messages.push_back(frame.message);
+    }
+
+    //Per frame equality.
+    size_t mismatches = 0;
+    for (auto&& message : messages)
+    {
+        SCanMessage a = message, b = message;
+        if (HandDecode(a) != GeneratedDecode(b) || memcmp(a.data, b.data, sizeof(a.data)) != 0)
+            mismatches++;
+    }
+
+    bool roundTrips = VerifyRoundTrips();
+    bool physical = VerifyPhysical(messages);
+
+    //Interleave the runs and keep the best of each so neither side benefits from warm caches or frequency scaling.
+    uint32_t handChecksum, generatedChecksum;
+    double hand = 1e9, generated = 1e9;
+    for (size_t run = 0; run < 5; run++)
+    {
+        hand = std::min(hand, Measure(messages, HandDecode, &handChecksum));
+        generated = std::min(generated, Measure(messages, GeneratedDecode, &generatedChecksum));
+    }
+
+    printf("Frames:         %zu\n", messages.size());
+    printf("Mismatches:     %zu\n", mismatches);
+    printf("Round trips:    %s\n", roundTrips ? "ok" : "FAILED");
+    printf("Physical:       %s\n", physical ? "ok" : "FAILED");
+    printf("Hand-written:   %.2f ns/frame (checksum %08x)\n", hand, handChecksum);
+    printf("Generated:      %.2f ns/frame (checksum %08x)\n", generated, generatedChecksum);
+
+    return mismatches == 0 && roundTrips && physical && handChecksum == generatedChecksum ? 0 : 3;
+}
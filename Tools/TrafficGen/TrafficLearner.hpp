@@ -0,0 +1,122 @@
+#pragma once
+
+//Learns per-ID period, jitter and payload change models (see Software/src/CAN/TrafficModel.h) from CAN::Logger captures.
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "../Common/Recording.hpp"
+#include "../../Software/src/CAN/TrafficModel.h"
+
+namespace ReadieFur::OpenTCU::Tools
+{
+    class TrafficLearner
+    {
+    private:
+        struct SStreamObservations
+        {
+            uint32_t firstSeen = UINT32_MAX;
+            uint8_t length = 0;
+            std::vector<uint32_t> intervals;
+            std::vector<std::vector<uint8_t>> payloads;
+        };
+
+        std::map<std::pair<uint8_t, uint32_t>, SStreamObservations> _observations;
+
+    public:
+        //Each capture is processed on its own so that intervals are never measured across file boundaries.
+        void AddCapture(const std::vector<SRecordedFrame>& frames)
+        {
+            std::map<std::pair<uint8_t, uint32_t>, uint32_t> lastSeen;
+            uint32_t captureStart = frames.empty() ? 0 : frames.front().timestamp;
+            for (auto&& frame : frames)
+            {
+                if (frame.message.isExtended || frame.message.isRemote)
+                    continue;
+
+                auto key = std::make_pair(frame.bus, frame.message.id);
+                SStreamObservations& stream = _observations[key];
+                auto last = lastSeen.find(key);
+                if (last != lastSeen.end() && frame.timestamp >= last->second)
+                    stream.intervals.push_back(frame.timestamp - last->second);
+                else
+                    stream.firstSeen = std::min(stream.firstSeen, frame.timestamp - captureStart);
+                lastSeen[key] = frame.timestamp;
+
+                stream.length = std::max(stream.length, frame.message.length);
+                stream.payloads.emplace_back(frame.message.data, frame.message.data + frame.message.length);
+            }
+        }
+
+        //Streams seen fewer than minFrames times (one-off configuration traffic) are not periodic and are left out of the model.
+        std::vector<CAN::STrafficStreamModel> Build(size_t minFrames = 3) const
+        {
+            std::vector<CAN::STrafficStreamModel> models;
+            for (auto&& [key, stream] : _observations)
+            {
+                if (stream.payloads.size() < minFrames || stream.intervals.empty())
+                    continue;
+
+                CAN::STrafficStreamModel model = {};
+                model.id = key.second;
+                model.bus = key.first;
+                model.length = stream.length;
+
+                //The mean is used for the period so that bursty request/response IDs (e.g. 0x404/0x405) contribute their average load.
+                uint64_t total = 0;
+                for (uint32_t interval : stream.intervals)
+                    total += interval;
+                uint64_t periodUs = std::max<uint64_t>(total * 1000 / stream.intervals.size(), 1000);
+                uint64_t deviation = 0;
+                for (uint32_t interval : stream.intervals)
+                    deviation += (uint64_t)std::abs((int64_t)interval * 1000 - (int64_t)periodUs);
+                model.periodUs = (uint32_t)periodUs;
+                model.jitterUs = (uint32_t)std::min<uint64_t>(deviation / stream.intervals.size(), periodUs - 1);
+                model.phaseUs = (uint32_t)((uint64_t)stream.firstSeen * 1000 % periodUs);
+
+                for (size_t b = 0; b < model.length; b++)
+                {
+                    CAN::STrafficByteModel& byte = model.bytes[b];
+                    const std::vector<uint8_t>* previous = nullptr;
+                    size_t comparisons = 0, changes = 0;
+                    bool constantStep = true;
+                    int stepValue = 0;
+                    byte.minimum = 0xFF;
+                    byte.maximum = 0x00;
+                    byte.initial = b < stream.payloads.front().size() ? stream.payloads.front()[b] : 0;
+                    for (auto&& payload : stream.payloads)
+                    {
+                        if (b >= payload.size())
+                            continue;
+                        byte.minimum = std::min(byte.minimum, payload[b]);
+                        byte.maximum = std::max(byte.maximum, payload[b]);
+                        if (previous != nullptr && b < previous->size())
+                        {
+                            comparisons++;
+                            int8_t delta = (int8_t)(uint8_t)(payload[b] - (*previous)[b]);
+                            if (delta != 0)
+                            {
+                                if (changes == 0)
+                                    stepValue = delta;
+                                else if (delta != stepValue)
+                                    constantStep = false;
+                                changes++;
+                            }
+                        }
+                        previous = &payload;
+                    }
+                    if (byte.minimum > byte.maximum)
+                        byte.minimum = byte.maximum = byte.initial;
+                    byte.changeProbability = comparisons > 0 ? (uint16_t)(changes * 65535 / comparisons) : 0;
+                    byte.step = changes > 1 && constantStep ? (int8_t)stepValue : 0;
+                }
+
+                models.push_back(model);
+            }
+            return models;
+        }
+    };
+};
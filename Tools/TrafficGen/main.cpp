@@ -0,0 +1,145 @@
+//Learns the bike bus traffic model from the recordings and synthesizes traffic from it.
+//Build: g++ -std=c++17 -O2 -o trafficgen main.cpp
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "TrafficLearner.hpp"
+
+using namespace ReadieFur::OpenTCU;
+using namespace ReadieFur::OpenTCU::Tools;
+
+int PrintUsage()
+{
+    std::cerr
+        << "Usage:" << std::endl
+        << "  trafficgen model <capture.txt>..." << std::endl
+        << "      Prints the learned model, bus load and the rate at which the bus saturates." << std::endl
+        << "  trafficgen header <out.h> <capture.txt>..." << std::endl
+        << "      Writes the learned model as a firmware header (Software/src/CAN/TrafficModelData.h)." << std::endl
+        << "  trafficgen synth <rate %> <duration ms> <capture.txt>..." << std::endl
+        << "      Writes synthetic traffic in the CAN::Logger capture format to stdout (100% = 1x)." << std::endl
+        << "  trafficgen canlog <rate %> <duration ms> <interface0> <interface1> <capture.txt>..." << std::endl
+        << "      As synth but written as a candump log for canplayer, e.g. to replay into vcan0/vcan1." << std::endl;
+    return 1;
+}
+
+bool Learn(int first, int argc, char** argv, std::vector<CAN::STrafficStreamModel>& outModels)
+{
+    TrafficLearner learner;
+    for (int i = first; i < argc; i++)
+    {
+        std::vector<SRecordedFrame> frames;
+        if (!Recording::Load(argv[i], frames))
+        {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return false;
+        }
+        learner.AddCapture(frames);
+    }
+    outModels = learner.Build();
+    if (outModels.empty())
+    {
+        std::cerr << "No periodic traffic found." << std::endl;
+        return false;
+    }
+    if (outModels.size() > CAN::TrafficSynthesizer::MAX_STREAMS)
+    {
+        std::cerr << "Too many streams (" << outModels.size() << "), the synthesizer supports " << CAN::TrafficSynthesizer::MAX_STREAMS << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int Model(const std::vector<CAN::STrafficStreamModel>& models)
+{
+    printf("bus  id   dlc  period(ms)  jitter(ms)  changing bytes (probability/step)\n");
+    for (auto&& model : models)
+    {
+        printf("%3u  %03x  %3u  %10.1f  %10.2f ", model.bus, model.id, model.length, model.periodUs / 1000.0, model.jitterUs / 1000.0);
+        for (size_t b = 0; b < model.length; b++)
+            if (model.bytes[b].changeProbability > 0)
+                printf(" D%zu:%.2f%s", b + 1, model.bytes[b].changeProbability / 65535.0, model.bytes[b].step != 0 ? "/counter" : "");
+        printf("\n");
+    }
+
+    uint32_t load = CAN::TrafficSynthesizer::BusLoad(models.data(), models.size());
+    printf("Bus load at 1x: %.2f%% of %u bit/s (worst case stuffing)\n", load / 100.0, CAN::TrafficSynthesizer::BUS_BITRATE);
+    printf("Saturation at:  %.1fx (rate %u%%)\n", 10000.0 / load, 1000000 / load);
+    return 0;
+}
+
+int Header(const std::vector<CAN::STrafficStreamModel>& models, const char* path, int first, int argc, char** argv)
+{
+    std::ofstream out(path);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to create " << path << std::endl;
+        return 2;
+    }
+
+    out << "#pragma once" << std::endl << std::endl;
+    out << "//Generated by Tools/TrafficGen from:" << std::endl;
+    for (int i = first; i < argc; i++)
+    {
+        std::string source = argv[i];
+        size_t recordings = source.find("Recordings/");
+        out << "//  " << (recordings != std::string::npos ? source.substr(recordings) : source) << std::endl;
+    }
+    out << "//Do not edit by hand, regenerate with: trafficgen header <this file> <captures>..." << std::endl << std::endl;
+    out << "#include \"TrafficModel.h\"" << std::endl << std::endl;
+    out << "namespace ReadieFur::OpenTCU::CAN::TrafficModelData" << std::endl << "{" << std::endl;
+    out << "    inline constexpr STrafficStreamModel STREAMS[] =" << std::endl << "    {" << std::endl;
+    char line[256];
+    for (auto&& model : models)
+    {
+        snprintf(line, sizeof(line), "        { 0x%03X, %u, %u, %u, %u, %u, {", model.id, model.bus, model.length, model.periodUs, model.jitterUs, model.phaseUs);
+        out << line;
+        for (size_t b = 0; b < 8; b++)
+        {
+            const CAN::STrafficByteModel& byte = model.bytes[b];
+            snprintf(line, sizeof(line), "%s { 0x%02X, 0x%02X, 0x%02X, %u, %d }", b > 0 ? "," : "", byte.initial, byte.minimum, byte.maximum, byte.changeProbability, byte.step);
+            out << line;
+        }
+        out << " } }," << std::endl;
+    }
+    out << "    };" << std::endl;
+    out << "    inline constexpr size_t STREAM_COUNT = sizeof(STREAMS) / sizeof(STREAMS[0]);" << std::endl;
+    out << "};" << std::endl;
+    return out.good() ? 0 : 3;
+}
+
+//If interfaces is set the output is a candump log, otherwise it is in the CAN::Logger format.
+int Synth(const std::vector<CAN::STrafficStreamModel>& models, uint32_t rateScale, uint64_t durationMs, const char* const* interfaces = nullptr)
+{
+    CAN::TrafficSynthesizer synthesizer(models.data(), models.size(), rateScale);
+    SRecordedFrame frame;
+    uint64_t timeUs;
+    while (synthesizer.Next(&frame.message, &frame.bus, &timeUs) && timeUs < durationMs * 1000)
+    {
+        frame.timestamp = (uint32_t)(timeUs / 1000);
+        std::cout << (interfaces != nullptr ? Recording::FormatCanLogLine(frame, interfaces, timeUs) : Recording::FormatLine(frame)) << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return PrintUsage();
+
+    std::string command = argv[1];
+    std::vector<CAN::STrafficStreamModel> models;
+    if (command == "model")
+        return Learn(2, argc, argv, models) ? Model(models) : 2;
+    else if (command == "header" && argc >= 4)
+        return Learn(3, argc, argv, models) ? Header(models, argv[2], 3, argc, argv) : 2;
+    else if (command == "synth" && argc >= 5)
+        return Learn(4, argc, argv, models) ? Synth(models, strtoul(argv[2], nullptr, 0), strtoull(argv[3], nullptr, 0)) : 2;
+    else if (command == "canlog" && argc >= 7)
+        return Learn(6, argc, argv, models) ? Synth(models, strtoul(argv[2], nullptr, 0), strtoull(argv[3], nullptr, 0), argv + 4) : 2;
+    return PrintUsage();
+}
@@ -0,0 +1,130 @@
+//Drives the transmit schedule with a real clock the way the TransmitScheduler task does on the target and measures how closely frames meet their deadlines.
+//Build: g++ -std=c++17 -O2 -o txbench main.cpp
+//Usage: ./txbench [duration ms per scenario]
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "../../Software/src/CAN/TransmitSchedule.h"
+
+using namespace ReadieFur::OpenTCU::CAN;
+
+struct SPeriodicSpec
+{
+    bool bus;
+    uint32_t id;
+    uint32_t periodUs;
+};
+
+struct SScenario
+{
+    const char* name;
+    std::vector<SPeriodicSpec> periodic;
+    uint32_t sequenceDelayUs; //0 for no one-shot sequence, otherwise the sequence is refilled whenever it runs dry.
+};
+
+struct SResult
+{
+    std::vector<uint32_t> latenessUs;
+    std::vector<int64_t> wakeErrorUs;
+    uint32_t frames[2] = { 0, 0 };
+};
+
+static int64_t NowUs(std::chrono::steady_clock::time_point origin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+template <typename T>
+static T Percentile(std::vector<T> values, double percentile)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(percentile / 100 * values.size()))];
+}
+
+static void Run(const SScenario& scenario, uint32_t durationMs)
+{
+    TransmitSchedule schedule;
+    SResult result;
+    auto origin = std::chrono::steady_clock::now();
+    int64_t end = (int64_t)durationMs * 1000;
+
+    for (auto&& spec : scenario.periodic)
+    {
+        SCanMessage message = { spec.id, {}, 8, false, false };
+        schedule.AddPeriodic(spec.bus, message, spec.periodUs, NowUs(origin));
+    }
+
+    int64_t now;
+    while ((now = NowUs(origin)) < end)
+    {
+        TransmitSchedule::SScheduledFrame frame;
+        while (schedule.PopDue(now, &frame))
+        {
+            result.latenessUs.push_back((uint32_t)(now - frame.deadline));
+            result.frames[frame.bus]++;
+        }
+
+        if (scenario.sequenceDelayUs != 0 && schedule.GetOneShotCount() == 0)
+        {
+            SCanMessage message = { 0x7F0, {}, 8, false, false };
+            for (size_t i = 0; i < TransmitSchedule::MAX_ONE_SHOTS; i++)
+                schedule.QueueOneShot(i & 1, message, scenario.sequenceDelayUs, now);
+        }
+
+        //Stands in for the one-shot esp_timer the task waits on.
+        int64_t wake = std::min(schedule.GetNextWake(), end);
+        std::this_thread::sleep_until(origin + std::chrono::microseconds(wake));
+        result.wakeErrorUs.push_back(NowUs(origin) - wake);
+    }
+
+    const TransmitSchedule::STimingStats& stats = schedule.GetStats();
+    double seconds = durationMs / 1000.0;
+    printf("%-10s %7u %8.1f %8.1f %7u %7u %7u %7lld %7lld %6u %6u\n",
+        scenario.name,
+        stats.sent,
+        result.frames[0] / seconds,
+        result.frames[1] / seconds,
+        Percentile(result.latenessUs, 50),
+        Percentile(result.latenessUs, 99),
+        stats.maxLatenessUs,
+        (long long)Percentile(result.wakeErrorUs, 50),
+        (long long)Percentile(result.wakeErrorUs, 99),
+        stats.throttled,
+        stats.skipped);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t durationMs = argc > 1 ? strtoul(argv[1], nullptr, 0) : 5000;
+    if (durationMs == 0)
+    {
+        std::cerr << "Usage: txbench [duration ms per scenario]" << std::endl;
+        return 1;
+    }
+
+    std::vector<SScenario> scenarios =
+    {
+        //The bike's own periodic IDs replayed at their nominal rates, within the cap on both buses.
+        { "bike", { { false, 0x200, 20000 }, { false, 0x201, 100000 }, { false, 0x300, 50000 }, { false, 0x301, 50000 }, { true, 0x400, 10000 }, { true, 0x401, 100000 } }, 0 },
+        //Periods that don't line up with each other or with the tick.
+        { "odd", { { false, 0x600, 13000 }, { false, 0x601, 11111 }, { true, 0x602, 33333 } }, 0 },
+        { "sequence", {}, 2500 },
+        //Asks for 1000 frames/s on one bus, the cap should hold it to MAX_FRAMES_PER_SECOND.
+        { "overload", { { false, 0x7FF, 1000 } }, 0 },
+    };
+
+    printf("Rate cap: %u frames/s per bus, burst %u. Lateness is from each frame's deadline, wake error is the sleep overshoot.\n",
+        TransmitSchedule::MAX_FRAMES_PER_SECOND, TransmitSchedule::BURST_FRAMES);
+    printf("%-10s %7s %8s %8s %7s %7s %7s %7s %7s %6s %6s\n",
+        "scenario", "frames", "bus0/s", "bus1/s", "p50 us", "p99 us", "max us", "wake50", "wake99", "thrtl", "skip");
+    for (auto&& scenario : scenarios)
+        Run(scenario, durationMs);
+    return 0;
+}